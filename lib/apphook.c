@@ -40,6 +40,8 @@
 #include "crypto.h"
 #include "value-pairs/value-pairs.h"
 #include "scratch-buffers.h"
+#include "slab-allocator.h"
+#include "filter/filter-re-prefilter.h"
 #include "mainloop.h"
 #include "secret-storage/nondumpable-allocator.h"
 #include "secret-storage/secret-storage.h"
@@ -162,6 +164,7 @@ app_finish_app_startup_after_cfg_init(void)
   log_tags_reinit_stats();
   log_msg_stats_global_init();
   scratch_buffers_global_init();
+  slab_allocator_global_init();
 }
 
 void
@@ -195,6 +198,9 @@ app_shutdown(void)
   log_template_global_deinit();
   log_tags_global_deinit();
   log_msg_global_deinit();
+  filter_re_prefilter_thread_deinit();
+  slab_allocator_thread_deinit();
+  slab_allocator_global_deinit();
 
   afinter_global_deinit();
   stats_destroy();
@@ -241,4 +247,6 @@ app_thread_stop(void)
   main_loop_call_thread_deinit();
   dns_caching_thread_deinit();
   scratch_buffers_allocator_deinit();
+  filter_re_prefilter_thread_deinit();
+  slab_allocator_thread_deinit();
 }
@@ -335,6 +335,11 @@ extern struct _StatsOptions *last_stats_options;
 %token KW_ON_ERROR                    10510
 
 %token KW_RETRIES                     10511
+%token KW_WORKERS                     10512
+%token KW_PARTITION_KEY               10513
+%token KW_BATCH_LINES                 10514
+%token KW_BATCH_BYTES                 10515
+%token KW_BATCH_TIMEOUT               10516
 
 /* END_DECLS */
 
@@ -1186,6 +1191,28 @@ threaded_dest_driver_option
         {
           log_threaded_dest_driver_set_max_retries(last_driver, $3);
         }
+        | KW_WORKERS '(' positive_integer ')'
+        {
+          log_threaded_dest_driver_set_num_workers(last_driver, $3);
+        }
+        | KW_PARTITION_KEY '(' template_content ')'
+        {
+          log_threaded_dest_driver_set_partition_key(last_driver, $3);
+          log_template_unref($3);
+        }
+        | KW_BATCH_LINES '(' nonnegative_integer ')'
+        {
+          log_threaded_dest_driver_set_batch_lines(last_driver, $3);
+        }
+        | KW_BATCH_BYTES '(' nonnegative_integer ')'
+        {
+          log_threaded_dest_driver_set_batch_bytes(last_driver, $3);
+        }
+        | KW_BATCH_TIMEOUT '(' nonnegative_integer ')'
+        {
+          log_threaded_dest_driver_set_batch_timeout(last_driver, $3);
+        }
+        ;
 
 dest_driver_option
         /* NOTE: plugins need to set "last_driver" in order to incorporate this rule in their grammar */
@@ -158,6 +158,11 @@ static CfgLexerKeyword main_keywords[] =
   { "persist_name",            KW_PERSIST_NAME, VERSION_VALUE_3_8 },
 
   { "retries",            KW_RETRIES },
+  { "workers",            KW_WORKERS },
+  { "partition_key",      KW_PARTITION_KEY },
+  { "batch_lines",        KW_BATCH_LINES },
+  { "batch_bytes",        KW_BATCH_BYTES },
+  { "batch_timeout",      KW_BATCH_TIMEOUT },
 
   { "read_old_records",   KW_READ_OLD_RECORDS},
   /* filter items */
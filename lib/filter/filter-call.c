@@ -80,6 +80,7 @@ filter_call_init(FilterExprNode *s, GlobalConfig *cfg)
       self->filter_expr = filter_expr_ref(filter_pipe->expr);
       filter_expr_init(self->filter_expr, cfg);
       self->super.modify = self->filter_expr->modify;
+      self->super.cost = self->filter_expr->cost;
 
       stats_lock();
       StatsClusterKey sc_key;
@@ -39,27 +39,23 @@ typedef struct _FilterCmp
   FilterExprNode super;
   LogTemplate *left, *right;
   gint cmp_op;
+  /* both sides are literal strings, the result is computed in init() */
+  gboolean constant;
+  gboolean constant_result;
 } FilterCmp;
 
-gboolean
-fop_cmp_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
+static gboolean
+fop_cmp_compare(FilterCmp *self, const gchar *left, const gchar *right)
 {
-  FilterCmp *self = (FilterCmp *) s;
-  ScratchBuffersMarker marker;
-  GString *left_buf = scratch_buffers_alloc_and_mark(&marker);
-  GString *right_buf = scratch_buffers_alloc();
   gboolean result = FALSE;
   gint cmp;
 
-  log_template_format_with_context(self->left, msgs, num_msg, NULL, LTZ_LOCAL, 0, NULL, left_buf);
-  log_template_format_with_context(self->right, msgs, num_msg, NULL, LTZ_LOCAL, 0, NULL, right_buf);
-
   if (self->cmp_op & FCMP_NUM)
     {
       gint l, r;
 
-      l = atoi(left_buf->str);
-      r = atoi(right_buf->str);
+      l = atoi(left);
+      r = atoi(right);
       if (l == r)
         cmp = 0;
       else if (l < r)
@@ -69,7 +65,7 @@ fop_cmp_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
     }
   else
     {
-      cmp = strcmp(left_buf->str, right_buf->str);
+      cmp = strcmp(left, right);
     }
 
   if (cmp == 0)
@@ -84,6 +80,35 @@ fop_cmp_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
     {
       result = self->cmp_op & FCMP_GT || self->cmp_op == 0;
     }
+  return result;
+}
+
+gboolean
+fop_cmp_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
+{
+  FilterCmp *self = (FilterCmp *) s;
+  ScratchBuffersMarker marker;
+  GString *left_buf, *right_buf;
+  gboolean result;
+
+  if (self->constant)
+    {
+      msg_debug("  cmp() evaluation result, constant expression",
+                filter_result_tag(self->constant_result),
+                evt_tag_str("left", log_template_get_literal_value(self->left, NULL)),
+                evt_tag_str("operator", self->super.type),
+                evt_tag_str("right", log_template_get_literal_value(self->right, NULL)),
+                evt_tag_printf("msg", "%p", msgs[num_msg - 1]));
+      return self->constant_result ^ s->comp;
+    }
+
+  left_buf = scratch_buffers_alloc_and_mark(&marker);
+  right_buf = scratch_buffers_alloc();
+
+  log_template_format_with_context(self->left, msgs, num_msg, NULL, LTZ_LOCAL, 0, NULL, left_buf);
+  log_template_format_with_context(self->right, msgs, num_msg, NULL, LTZ_LOCAL, 0, NULL, right_buf);
+
+  result = fop_cmp_compare(self, left_buf->str, right_buf->str);
 
   msg_debug("  cmp() evaluation result",
             filter_result_tag(result),
@@ -96,6 +121,25 @@ fop_cmp_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
   return result ^ s->comp;
 }
 
+static void
+fop_cmp_init(FilterExprNode *s, GlobalConfig *cfg)
+{
+  FilterCmp *self = (FilterCmp *) s;
+
+  self->constant = log_template_is_literal_string(self->left) && log_template_is_literal_string(self->right);
+  if (self->constant)
+    {
+      self->constant_result = fop_cmp_compare(self,
+                                              log_template_get_literal_value(self->left, NULL),
+                                              log_template_get_literal_value(self->right, NULL));
+      self->super.cost = FILTER_COST_CHEAP;
+    }
+  else
+    {
+      self->super.cost = FILTER_COST_EXPENSIVE;
+    }
+}
+
 void
 fop_cmp_free(FilterExprNode *s)
 {
@@ -111,6 +155,7 @@ fop_cmp_new(LogTemplate *left, LogTemplate *right, gint op)
   FilterCmp *self = g_new0(FilterCmp, 1);
 
   filter_expr_node_init_instance(&self->super);
+  self->super.init = fop_cmp_init;
   self->super.eval = fop_cmp_eval;
   self->super.free_fn = fop_cmp_free;
   self->left = left;
@@ -33,6 +33,7 @@ void
 filter_expr_node_init_instance(FilterExprNode *self)
 {
   self->ref_cnt = 1;
+  self->cost = FILTER_COST_DEFAULT;
 }
 
 /*
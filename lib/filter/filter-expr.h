@@ -33,11 +33,21 @@
 struct _GlobalConfig;
 typedef struct _FilterExprNode FilterExprNode;
 
+/* relative cost of evaluating a filter expression, AND/OR operands without
+ * side effects are evaluated in increasing cost order */
+enum
+{
+  FILTER_COST_CHEAP,      /* bit tests on already parsed fields, constants */
+  FILTER_COST_DEFAULT,
+  FILTER_COST_EXPENSIVE,  /* template formatting, pattern matching */
+};
+
 struct _FilterExprNode
 {
   guint32 ref_cnt;
   guint32 comp:1,   /* this not is negated */
-          modify:1; /* this filter changes the log message */
+          modify:1, /* this filter changes the log message */
+          cost:2;   /* FILTER_COST_* */
   const gchar *type;
   void (*init)(FilterExprNode *self, GlobalConfig *cfg);
   gboolean (*eval)(FilterExprNode *self, LogMessage **msg, gint num_msg);
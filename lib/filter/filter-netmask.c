@@ -106,5 +106,6 @@ filter_netmask_new(gchar *cidr)
     }
   self->address.s_addr &= self->netmask.s_addr;
   self->super.eval = filter_netmask_eval;
+  self->super.cost = FILTER_COST_CHEAP;
   return &self->super;
 }
@@ -163,6 +163,7 @@ filter_netmask6_new(gchar *cidr)
     self->address = in6addr_loopback;
 
   self->super.eval = _eval;
+  self->super.cost = FILTER_COST_CHEAP;
   return &self->super;
 }
 #endif
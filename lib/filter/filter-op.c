@@ -23,12 +23,196 @@
  */
 #include "filter-op.h"
 
+/* targets of the last instruction of a filter program */
+#define FOP_PROGRAM_ACCEPT -1
+#define FOP_PROGRAM_REJECT -2
+
+/*
+ * AND/OR trees are compiled into a flat array of leaf expressions at init
+ * time.  Each instruction evaluates one leaf and jumps forward to either
+ * of its targets, which yields the same short-circuit evaluation as the
+ * recursive version, without descending into the tree for every message.
+ * Jumps always go forward, so evaluation ends in at most program_len
+ * steps.
+ */
+typedef struct _FilterInstruction
+{
+  FilterExprNode *expr;
+  gint on_match;
+  gint on_mismatch;
+} FilterInstruction;
+
 typedef struct _FilterOp
 {
   FilterExprNode super;
   FilterExprNode *left, *right;
+  FilterInstruction *program;
+  gint program_len;
 } FilterOp;
 
+static gboolean fop_or_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg);
+static gboolean fop_and_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg);
+
+static gboolean
+fop_is_op(FilterExprNode *s)
+{
+  return s->eval == fop_and_eval || s->eval == fop_or_eval;
+}
+
+static gint
+fop_count_leaves(FilterExprNode *s)
+{
+  FilterOp *self = (FilterOp *) s;
+
+  if (!fop_is_op(s))
+    return 1;
+  return fop_count_leaves(self->left) + fop_count_leaves(self->right);
+}
+
+/* collects the operands of a chain of the same, non-negated operator, so
+ * that a AND (b AND c) is handled as a single AND with three operands */
+static void
+fop_collect_operands(FilterOp *self, FilterExprNode *s, GPtrArray *operands)
+{
+  if (s != &self->super && (s->eval != self->super.eval || s->comp))
+    {
+      g_ptr_array_add(operands, s);
+      return;
+    }
+
+  fop_collect_operands(self, ((FilterOp *) s)->left, operands);
+  fop_collect_operands(self, ((FilterOp *) s)->right, operands);
+}
+
+/* Operands without side effects are moved ahead in increasing cost order,
+ * so that bit tests on the priority field or tags may decide the result
+ * before a regexp has to run.  If any of the operands changes the message
+ * (e.g. stores regexp matches), the order the user wrote is kept. */
+static void
+fop_sort_operands_by_cost(GPtrArray *operands)
+{
+  gint i, j;
+
+  for (i = 0; i < operands->len; i++)
+    {
+      if (((FilterExprNode *) g_ptr_array_index(operands, i))->modify)
+        return;
+    }
+
+  /* insertion sort, as it is stable and the number of operands is small */
+  for (i = 1; i < operands->len; i++)
+    {
+      FilterExprNode *operand = g_ptr_array_index(operands, i);
+
+      for (j = i; j > 0 && ((FilterExprNode *) g_ptr_array_index(operands, j - 1))->cost > operand->cost; j--)
+        operands->pdata[j] = operands->pdata[j - 1];
+      operands->pdata[j] = operand;
+    }
+}
+
+/*
+ * Emits the program of @s starting at @pos, jumping to @on_match or
+ * @on_mismatch once the result of @s is known.  Every leaf takes exactly one
+ * instruction, which is what makes the position of the next operand known
+ * in advance.
+ */
+static void
+fop_compile_node(FilterOp *self, FilterExprNode *s, gint pos, gint on_match, gint on_mismatch)
+{
+  GPtrArray *operands;
+  gboolean is_and;
+  gint i;
+
+  if (!fop_is_op(s))
+    {
+      self->program[pos].expr = s;
+      self->program[pos].on_match = on_match;
+      self->program[pos].on_mismatch = on_mismatch;
+      return;
+    }
+
+  /* the root is negated at evaluation time, as comp may change after init */
+  if (s->comp && s != &self->super)
+    {
+      gint tmp = on_match;
+
+      on_match = on_mismatch;
+      on_mismatch = tmp;
+    }
+
+  is_and = (s->eval == fop_and_eval);
+  operands = g_ptr_array_new();
+  fop_collect_operands((FilterOp *) s, s, operands);
+  fop_sort_operands_by_cost(operands);
+
+  for (i = 0; i < operands->len; i++)
+    {
+      FilterExprNode *operand = g_ptr_array_index(operands, i);
+      gboolean last = (i == operands->len - 1);
+      gint next = pos + fop_count_leaves(operand);
+
+      if (is_and)
+        fop_compile_node(self, operand, pos, last ? on_match : next, on_mismatch);
+      else
+        fop_compile_node(self, operand, pos, on_match, last ? on_mismatch : next);
+      pos = next;
+    }
+  g_ptr_array_free(operands, TRUE);
+}
+
+static void
+fop_free_program(FilterOp *self)
+{
+  g_free(self->program);
+  self->program = NULL;
+  self->program_len = 0;
+}
+
+/* the programs of nested operators are not needed once they are inlined
+ * into ours, they are never evaluated on their own */
+static void
+fop_free_nested_programs(FilterExprNode *s)
+{
+  FilterOp *self = (FilterOp *) s;
+
+  if (!fop_is_op(s))
+    return;
+
+  fop_free_program(self);
+  fop_free_nested_programs(self->left);
+  fop_free_nested_programs(self->right);
+}
+
+static void
+fop_compile(FilterOp *self)
+{
+  fop_free_program(self);
+
+  self->program_len = fop_count_leaves(&self->super);
+  self->program = g_new0(FilterInstruction, self->program_len);
+  fop_compile_node(self, &self->super, 0, FOP_PROGRAM_ACCEPT, FOP_PROGRAM_REJECT);
+
+  fop_free_nested_programs(self->left);
+  fop_free_nested_programs(self->right);
+}
+
+static gboolean
+fop_program_eval(FilterOp *self, LogMessage **msgs, gint num_msg)
+{
+  gint pc = 0;
+
+  while (pc >= 0)
+    {
+      FilterInstruction *insn = &self->program[pc];
+
+      if (filter_expr_eval_with_context(insn->expr, msgs, num_msg))
+        pc = insn->on_match;
+      else
+        pc = insn->on_mismatch;
+    }
+  return pc == FOP_PROGRAM_ACCEPT;
+}
+
 static void
 fop_init(FilterExprNode *s, GlobalConfig *cfg)
 {
@@ -41,6 +225,8 @@ fop_init(FilterExprNode *s, GlobalConfig *cfg)
   filter_expr_init(self->right, cfg);
 
   self->super.modify = self->left->modify || self->right->modify;
+  self->super.cost = MAX(self->left->cost, self->right->cost);
+  fop_compile(self);
 }
 
 static void
@@ -48,6 +234,7 @@ fop_free(FilterExprNode *s)
 {
   FilterOp *self = (FilterOp *) s;
 
+  fop_free_program(self);
   filter_expr_unref(self->left);
   filter_expr_unref(self->right);
 }
@@ -60,11 +247,15 @@ fop_init_instance(FilterOp *self)
   self->super.free_fn = fop_free;
 }
 
+/* expressions that were never initialized are evaluated recursively */
 static gboolean
 fop_or_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
 {
   FilterOp *self = (FilterOp *) s;
 
+  if (self->program)
+    return fop_program_eval(self, msgs, num_msg) ^ s->comp;
+
   return (filter_expr_eval_with_context(self->left, msgs, num_msg)
           || filter_expr_eval_with_context(self->right, msgs, num_msg)) ^ s->comp;
 }
@@ -87,6 +278,9 @@ fop_and_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
 {
   FilterOp *self = (FilterOp *) s;
 
+  if (self->program)
+    return fop_program_eval(self, msgs, num_msg) ^ s->comp;
+
   return (filter_expr_eval_with_context(self->left, msgs, num_msg)
           && filter_expr_eval_with_context(self->right, msgs, num_msg)) ^ s->comp;
 }
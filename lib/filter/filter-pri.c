@@ -67,6 +67,7 @@ filter_facility_new(guint32 facilities)
   self->super.eval = filter_facility_eval;
   self->valid = facilities;
   self->super.type = "facility";
+  self->super.cost = FILTER_COST_CHEAP;
   return &self->super;
 }
 
@@ -98,5 +99,6 @@ filter_level_new(guint32 levels)
   self->super.eval = filter_level_eval;
   self->valid = levels;
   self->super.type = "level";
+  self->super.cost = FILTER_COST_CHEAP;
   return &self->super;
 }
@@ -0,0 +1,471 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "filter/filter-re-prefilter.h"
+#include "module-config.h"
+#include "tls-support.h"
+#include "cfg.h"
+#include "messages.h"
+
+#include <string.h>
+
+/*
+ * Shared prefilter for regexp/string/glob filters
+ *
+ * Configurations often contain hundreds of filters matching the same value
+ * (typically $MESSAGE) against different patterns, each of them running
+ * its own matcher for every message.  Most of these patterns contain a
+ * literal string that has to occur in every value they match (see
+ * log_matcher_get_required_literal()).
+ *
+ * The required literals of all filters matching the same value in a
+ * configuration are collected into a single Aho-Corasick automaton, which
+ * finds all of them in one pass over the value.  A filter whose literal is
+ * not present can't match, so it returns without running its matcher; if
+ * it is present, the matcher runs to confirm.
+ *
+ * The result of the last scan is cached per thread, as a message visits
+ * the filters of all log paths in the same thread, one after the other.
+ * The cache is keyed by the contents of the value, so a value that has
+ * been rewritten in between is scanned again.
+ *
+ * The automaton is built when the first message is evaluated, once all
+ * filters of the configuration have registered their patterns.
+ */
+
+#define FILTER_RE_PREFILTER_CACHE_SLOTS 8
+#define FILTER_RE_PREFILTER_MODULE_CONFIG_KEY "filter-re-prefilter"
+
+/* a DFA with ASCII case folding and a compressed alphabet: bytes that
+ * don't occur in any of the literals share a single character class */
+typedef struct _PrefilterAutomaton
+{
+  guint8 char_class[256];
+  gint num_classes;
+  gint num_states;
+  gint32 *transitions;
+  /* first pattern ending in a state, -1 if none */
+  gint32 *output;
+  /* the next state on the failure chain that has an output, -1 if none */
+  gint32 *output_link;
+  /* the next pattern with the same literal, -1 if none */
+  gint32 *next_pattern;
+} PrefilterAutomaton;
+
+struct _FilterREPrefilter
+{
+  gint ref_cnt;
+  guint32 id;
+  NVHandle value_handle;
+  GStaticMutex lock;
+  GPtrArray *literals;
+  gint built;
+  gint num_built_patterns;
+  PrefilterAutomaton *automaton;
+};
+
+typedef struct _FilterREPrefilterCacheSlot
+{
+  guint32 prefilter_id;
+  GString *value;
+  guint8 *matches;
+  gsize matches_size;
+} FilterREPrefilterCacheSlot;
+
+TLS_BLOCK_START
+{
+  FilterREPrefilterCacheSlot *prefilter_cache;
+}
+TLS_BLOCK_END;
+
+#define prefilter_cache  __tls_deref(prefilter_cache)
+
+static guint32 prefilter_next_id = 1;
+
+/* automaton */
+
+static gint32
+_automaton_add_state(PrefilterAutomaton *self)
+{
+  gint32 state = self->num_states++;
+
+  self->transitions = g_renew(gint32, self->transitions, self->num_states * self->num_classes);
+  self->output = g_renew(gint32, self->output, self->num_states);
+  self->output_link = g_renew(gint32, self->output_link, self->num_states);
+
+  memset(&self->transitions[state * self->num_classes], 0xFF, self->num_classes * sizeof(gint32));
+  self->output[state] = -1;
+  self->output_link[state] = -1;
+  return state;
+}
+
+static void
+_automaton_assign_char_classes(PrefilterAutomaton *self, GPtrArray *literals)
+{
+  gint i;
+  const guchar *p;
+
+  self->num_classes = 1;
+  for (i = 0; i < literals->len; i++)
+    {
+      for (p = g_ptr_array_index(literals, i); *p; p++)
+        {
+          guchar c = g_ascii_tolower(*p);
+
+          if (self->char_class[c])
+            continue;
+          self->char_class[c] = self->num_classes;
+          self->char_class[g_ascii_toupper(c)] = self->num_classes;
+          self->num_classes++;
+        }
+    }
+}
+
+static void
+_automaton_add_literal(PrefilterAutomaton *self, gint pattern, const guchar *literal)
+{
+  gint32 state = 0;
+  const guchar *p;
+
+  for (p = literal; *p; p++)
+    {
+      gint32 *next = &self->transitions[state * self->num_classes + self->char_class[*p]];
+
+      if (*next < 0)
+        {
+          gint32 new_state = _automaton_add_state(self);
+
+          /* transitions may have been reallocated */
+          next = &self->transitions[state * self->num_classes + self->char_class[*p]];
+          *next = new_state;
+        }
+      state = *next;
+    }
+  self->next_pattern[pattern] = self->output[state];
+  self->output[state] = pattern;
+}
+
+/* computes the failure function breadth first and turns the trie into a DFA */
+static void
+_automaton_resolve_failures(PrefilterAutomaton *self)
+{
+  gint32 *failure = g_new0(gint32, self->num_states);
+  gint32 *queue = g_new(gint32, self->num_states);
+  gint head = 0, tail = 0;
+  gint c;
+
+  for (c = 0; c < self->num_classes; c++)
+    {
+      gint32 child = self->transitions[c];
+
+      if (child < 0)
+        {
+          self->transitions[c] = 0;
+          continue;
+        }
+      failure[child] = 0;
+      queue[tail++] = child;
+    }
+
+  while (head < tail)
+    {
+      gint32 state = queue[head++];
+
+      for (c = 0; c < self->num_classes; c++)
+        {
+          gint32 child = self->transitions[state * self->num_classes + c];
+          gint32 fallback = self->transitions[failure[state] * self->num_classes + c];
+
+          if (child < 0)
+            {
+              self->transitions[state * self->num_classes + c] = fallback;
+              continue;
+            }
+
+          failure[child] = fallback;
+          self->output_link[child] = self->output[fallback] >= 0 ? fallback : self->output_link[fallback];
+          queue[tail++] = child;
+        }
+    }
+
+  g_free(queue);
+  g_free(failure);
+}
+
+static PrefilterAutomaton *
+_automaton_new(GPtrArray *literals)
+{
+  PrefilterAutomaton *self = g_new0(PrefilterAutomaton, 1);
+  gint i;
+
+  _automaton_assign_char_classes(self, literals);
+  _automaton_add_state(self);
+
+  self->next_pattern = g_new(gint32, literals->len);
+  for (i = 0; i < literals->len; i++)
+    _automaton_add_literal(self, i, g_ptr_array_index(literals, i));
+
+  _automaton_resolve_failures(self);
+  return self;
+}
+
+static void
+_automaton_free(PrefilterAutomaton *self)
+{
+  if (!self)
+    return;
+
+  g_free(self->transitions);
+  g_free(self->output);
+  g_free(self->output_link);
+  g_free(self->next_pattern);
+  g_free(self);
+}
+
+static void
+_automaton_scan(PrefilterAutomaton *self, const gchar *value, gsize value_len, guint8 *matches)
+{
+  gint32 state = 0;
+  gsize i;
+
+  for (i = 0; i < value_len; i++)
+    {
+      gint32 found;
+
+      state = self->transitions[state * self->num_classes + self->char_class[(guchar) value[i]]];
+
+      found = self->output[state] >= 0 ? state : self->output_link[state];
+      for (; found > 0; found = self->output_link[found])
+        {
+          gint32 pattern;
+
+          for (pattern = self->output[found]; pattern >= 0; pattern = self->next_pattern[pattern])
+            matches[pattern / 8] |= 1 << (pattern % 8);
+        }
+    }
+}
+
+/* per-thread cache of scan results */
+
+static FilterREPrefilterCacheSlot *
+_cache_lookup(FilterREPrefilter *self, const gchar *value, gsize value_len)
+{
+  FilterREPrefilterCacheSlot *slot;
+  gsize matches_size = (self->num_built_patterns + 7) / 8;
+
+  if (!prefilter_cache)
+    prefilter_cache = g_new0(FilterREPrefilterCacheSlot, FILTER_RE_PREFILTER_CACHE_SLOTS);
+
+  slot = &prefilter_cache[self->id % FILTER_RE_PREFILTER_CACHE_SLOTS];
+  if (slot->prefilter_id == self->id &&
+      slot->value->len == value_len &&
+      memcmp(slot->value->str, value, value_len) == 0)
+    return slot;
+
+  if (!slot->value)
+    slot->value = g_string_sized_new(value_len);
+  g_string_truncate(slot->value, 0);
+  g_string_append_len(slot->value, value, value_len);
+
+  if (slot->matches_size < matches_size)
+    {
+      slot->matches = g_renew(guint8, slot->matches, matches_size);
+      slot->matches_size = matches_size;
+    }
+  memset(slot->matches, 0, matches_size);
+  _automaton_scan(self->automaton, value, value_len, slot->matches);
+  slot->prefilter_id = self->id;
+  return slot;
+}
+
+void
+filter_re_prefilter_thread_deinit(void)
+{
+  gint i;
+
+  if (!prefilter_cache)
+    return;
+
+  for (i = 0; i < FILTER_RE_PREFILTER_CACHE_SLOTS; i++)
+    {
+      if (prefilter_cache[i].value)
+        g_string_free(prefilter_cache[i].value, TRUE);
+      g_free(prefilter_cache[i].matches);
+    }
+  g_free(prefilter_cache);
+  prefilter_cache = NULL;
+}
+
+/* FilterREPrefilter */
+
+static void
+_build_automaton(FilterREPrefilter *self)
+{
+  g_static_mutex_lock(&self->lock);
+  if (!self->built)
+    {
+      if (self->literals->len >= FILTER_RE_PREFILTER_MIN_PATTERNS)
+        {
+          self->automaton = _automaton_new(self->literals);
+          self->num_built_patterns = self->literals->len;
+
+          msg_debug("Shared prefilter for regexp filters built",
+                    evt_tag_str("value", log_msg_get_value_name(self->value_handle, NULL)),
+                    evt_tag_int("patterns", self->num_built_patterns),
+                    evt_tag_int("states", self->automaton->num_states));
+        }
+      g_atomic_int_set(&self->built, TRUE);
+    }
+  g_static_mutex_unlock(&self->lock);
+}
+
+/* returns the index of the pattern, or -1 if it takes no part in prefiltering */
+gint
+filter_re_prefilter_add_pattern(FilterREPrefilter *self, const gchar *literal)
+{
+  gint pattern = -1;
+
+  if (strlen(literal) < FILTER_RE_PREFILTER_MIN_LITERAL_LEN)
+    return -1;
+
+  g_static_mutex_lock(&self->lock);
+  /* patterns registered after the first message are not prefiltered */
+  if (!self->built)
+    {
+      pattern = self->literals->len;
+      g_ptr_array_add(self->literals, g_strdup(literal));
+    }
+  g_static_mutex_unlock(&self->lock);
+  return pattern;
+}
+
+/* FALSE if the required literal of @pattern does not occur in @value */
+gboolean
+filter_re_prefilter_may_match(FilterREPrefilter *self, gint pattern, const gchar *value, gssize value_len)
+{
+  FilterREPrefilterCacheSlot *slot;
+
+  if (pattern < 0)
+    return TRUE;
+
+  if (!g_atomic_int_get(&self->built))
+    _build_automaton(self);
+
+  if (!self->automaton)
+    return TRUE;
+
+  if (value_len < 0)
+    value_len = strlen(value);
+
+  slot = _cache_lookup(self, value, value_len);
+  return !!(slot->matches[pattern / 8] & (1 << (pattern % 8)));
+}
+
+static FilterREPrefilter *
+filter_re_prefilter_new(NVHandle value_handle)
+{
+  FilterREPrefilter *self = g_new0(FilterREPrefilter, 1);
+
+  self->ref_cnt = 1;
+  /* configurations are initialized in the main thread */
+  self->id = prefilter_next_id++;
+  self->value_handle = value_handle;
+  g_static_mutex_init(&self->lock);
+  self->literals = g_ptr_array_new_with_free_func(g_free);
+  return self;
+}
+
+FilterREPrefilter *
+filter_re_prefilter_ref(FilterREPrefilter *self)
+{
+  g_assert(!self || self->ref_cnt > 0);
+
+  if (self)
+    self->ref_cnt++;
+  return self;
+}
+
+void
+filter_re_prefilter_unref(FilterREPrefilter *self)
+{
+  g_assert(!self || self->ref_cnt > 0);
+
+  if (self && --self->ref_cnt == 0)
+    {
+      _automaton_free(self->automaton);
+      g_ptr_array_free(self->literals, TRUE);
+      g_static_mutex_free(&self->lock);
+      g_free(self);
+    }
+}
+
+/* per-configuration registry of prefilters, one for each value */
+
+typedef struct _FilterREPrefilterRegistry
+{
+  ModuleConfig super;
+  GHashTable *prefilters;
+} FilterREPrefilterRegistry;
+
+static void
+filter_re_prefilter_registry_free(ModuleConfig *s)
+{
+  FilterREPrefilterRegistry *self = (FilterREPrefilterRegistry *) s;
+
+  g_hash_table_destroy(self->prefilters);
+  module_config_free_method(s);
+}
+
+static FilterREPrefilterRegistry *
+filter_re_prefilter_registry_new(void)
+{
+  FilterREPrefilterRegistry *self = g_new0(FilterREPrefilterRegistry, 1);
+
+  self->super.free_fn = filter_re_prefilter_registry_free;
+  self->prefilters = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                           (GDestroyNotify) filter_re_prefilter_unref);
+  return self;
+}
+
+/* returns a new reference to the prefilter of @value_handle in @cfg */
+FilterREPrefilter *
+filter_re_prefilter_lookup(GlobalConfig *cfg, NVHandle value_handle)
+{
+  FilterREPrefilterRegistry *registry;
+  FilterREPrefilter *prefilter;
+
+  registry = g_hash_table_lookup(cfg->module_config, FILTER_RE_PREFILTER_MODULE_CONFIG_KEY);
+  if (!registry)
+    {
+      registry = filter_re_prefilter_registry_new();
+      g_hash_table_insert(cfg->module_config, g_strdup(FILTER_RE_PREFILTER_MODULE_CONFIG_KEY), registry);
+    }
+
+  prefilter = g_hash_table_lookup(registry->prefilters, GUINT_TO_POINTER(value_handle));
+  if (!prefilter)
+    {
+      prefilter = filter_re_prefilter_new(value_handle);
+      g_hash_table_insert(registry->prefilters, GUINT_TO_POINTER(value_handle), prefilter);
+    }
+  return filter_re_prefilter_ref(prefilter);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#ifndef FILTER_RE_PREFILTER_H_INCLUDED
+#define FILTER_RE_PREFILTER_H_INCLUDED
+
+#include "syslog-ng.h"
+#include "logmsg/nvtable.h"
+
+/* literals shorter than this would match almost every message */
+#define FILTER_RE_PREFILTER_MIN_LITERAL_LEN 3
+/* below this many patterns a shared scan is not worth it */
+#define FILTER_RE_PREFILTER_MIN_PATTERNS 4
+
+typedef struct _FilterREPrefilter FilterREPrefilter;
+
+FilterREPrefilter *filter_re_prefilter_lookup(GlobalConfig *cfg, NVHandle value_handle);
+gint filter_re_prefilter_add_pattern(FilterREPrefilter *self, const gchar *literal);
+gboolean filter_re_prefilter_may_match(FilterREPrefilter *self, gint pattern, const gchar *value, gssize value_len);
+
+FilterREPrefilter *filter_re_prefilter_ref(FilterREPrefilter *self);
+void filter_re_prefilter_unref(FilterREPrefilter *self);
+
+void filter_re_prefilter_thread_deinit(void);
+
+#endif
@@ -56,6 +56,16 @@ filter_re_eval(FilterExprNode *s, LogMessage **msgs, gint num_msg)
 
   value = log_msg_get_value(msg, self->value_handle, &len);
 
+  if (self->prefilter && !filter_re_prefilter_may_match(self->prefilter, self->prefilter_pattern, value, len))
+    {
+      msg_debug("  match() evaluation result, required literal not found by prefilter",
+                filter_result_tag(FALSE),
+                evt_tag_str("pattern", self->matcher->pattern),
+                evt_tag_str("value", log_msg_get_value_name(self->value_handle, NULL)),
+                evt_tag_printf("msg", "%p", msg));
+      return FALSE ^ s->comp;
+    }
+
   APPEND_ZERO(value, value, len);
   return filter_re_eval_string(s, msg, self->value_handle, value, len);
 }
@@ -65,10 +75,30 @@ filter_re_free(FilterExprNode *s)
 {
   FilterRE *self = (FilterRE *) s;
 
+  filter_re_prefilter_unref(self->prefilter);
   log_matcher_unref(self->matcher);
   log_matcher_options_destroy(&self->matcher_options);
 }
 
+/* filters matching the same value share a prefilter that looks for the
+ * required literals of all of them in a single pass */
+static void
+filter_re_register_prefilter(FilterRE *self, GlobalConfig *cfg)
+{
+  gchar *literal;
+
+  if (self->prefilter || !self->value_handle || !self->matcher)
+    return;
+
+  literal = log_matcher_get_required_literal(self->matcher);
+  if (!literal)
+    return;
+
+  self->prefilter = filter_re_prefilter_lookup(cfg, self->value_handle);
+  self->prefilter_pattern = filter_re_prefilter_add_pattern(self->prefilter, literal);
+  g_free(literal);
+}
+
 static void
 filter_re_init(FilterExprNode *s, GlobalConfig *cfg)
 {
@@ -76,6 +106,8 @@ filter_re_init(FilterExprNode *s, GlobalConfig *cfg)
 
   if (self->matcher_options.flags & LMF_STORE_MATCHES)
     self->super.modify = TRUE;
+
+  filter_re_register_prefilter(self, cfg);
 }
 
 gboolean
@@ -95,6 +127,7 @@ filter_re_init_instance(FilterRE *self, NVHandle value_handle)
   self->super.eval = filter_re_eval;
   self->super.free_fn = filter_re_free;
   self->super.type = "regexp";
+  self->super.cost = FILTER_COST_EXPENSIVE;
   log_matcher_options_defaults(&self->matcher_options);
   self->matcher_options.flags |= LMF_MATCH_ONLY;
 }
@@ -26,6 +26,7 @@
 #define FILTER_RE_H_INCLUDED
 
 #include "filter-expr.h"
+#include "filter-re-prefilter.h"
 #include "logmatcher.h"
 
 typedef struct _FilterRE
@@ -34,6 +35,8 @@ typedef struct _FilterRE
   NVHandle value_handle;
   LogMatcherOptions matcher_options;
   LogMatcher *matcher;
+  FilterREPrefilter *prefilter;
+  gint prefilter_pattern;
 } FilterRE;
 
 typedef struct _FilterMatch FilterMatch;
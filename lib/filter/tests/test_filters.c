@@ -100,6 +100,13 @@ create_pcre_regexp_match(gchar *regexp, gint flags)
   return compile_pattern(filter_match_new(), regexp, "pcre", flags);
 }
 
+FilterExprNode *
+negate(FilterExprNode *f)
+{
+  f->comp = !f->comp;
+  return f;
+}
+
 LogTemplate *
 create_template(const gchar *template)
 {
@@ -396,6 +403,36 @@ main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
   testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
            fop_and_new(create_pcre_regexp_match(" PAD ", 0), create_pcre_regexp_match("^PTHREAD$", 0)), 0);
 
+  /* nested and negated operators, the cheap operands are reordered ahead of the regexps */
+  testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
+           fop_and_new(create_pcre_regexp_match(" PTHREAD ", 0),
+                       fop_and_new(filter_level_new(level_bits("err")), filter_facility_new(facility_bits("user")))), 0);
+  testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
+           fop_and_new(create_pcre_regexp_match(" PTHREAD ", 0),
+                       fop_and_new(filter_level_new(level_bits("debug")), filter_facility_new(facility_bits("user")))), 1);
+  testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
+           fop_or_new(create_pcre_regexp_match("^PAD$", 0),
+                      negate(fop_and_new(filter_level_new(level_bits("debug")), filter_facility_new(facility_bits("daemon"))))), 1);
+  testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
+           fop_and_new(filter_facility_new(facility_bits("user")),
+                       negate(fop_or_new(filter_level_new(level_bits("err")), create_pcre_regexp_match("PTHREAD", 0)))), 0);
+  testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
+           fop_or_new(fop_and_new(create_pcre_regexp_match(" PAD ", 0), filter_level_new(level_bits("debug"))),
+                      fop_and_new(filter_facility_new(facility_bits("user")),
+                                  fop_or_new(filter_level_new(level_bits("err")),
+                                             fop_cmp_new(create_template("alma"), create_template("alma"), KW_EQ)))), 1);
+  testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
+           fop_or_new(fop_and_new(create_pcre_regexp_match(" PAD ", 0), filter_level_new(level_bits("debug"))),
+                      fop_and_new(filter_facility_new(facility_bits("user")),
+                                  fop_or_new(filter_level_new(level_bits("err")),
+                                             fop_cmp_new(create_template("alma"), create_template("korte"), KW_EQ)))), 0);
+
+  /* the regexp stores its matches, the order of the operands is kept */
+  testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
+           fop_and_new(create_pcre_regexp_match("(PTHREAD)", LMF_STORE_MATCHES),
+                       fop_and_new(fop_cmp_new(create_template("$1"), create_template("PTHREAD"), KW_EQ),
+                                   filter_level_new(level_bits("debug")))), 1);
+
   /* LEVEL_NUM is 7 */
   testcase("<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized",
            fop_cmp_new(create_template("$LEVEL_NUM"), create_template("7"), KW_NUM_EQ), 1);
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include <criterion/criterion.h>
+#include "filter/filter-re.h"
+#include "filter/filter-re-prefilter.h"
+#include "logmatcher.h"
+#include "cfg.h"
+#include "apphook.h"
+#include "plugin.h"
+
+#include <string.h>
+
+MsgFormatOptions parse_options;
+
+static gchar *
+_get_required_literal(const gchar *type, gint flags, const gchar *pattern)
+{
+  LogMatcherOptions options;
+  LogMatcher *matcher;
+  gchar *literal;
+
+  log_matcher_options_defaults(&options);
+  log_matcher_options_set_type(&options, type);
+  options.flags = flags;
+  log_matcher_options_init(&options, configuration);
+
+  matcher = log_matcher_new(configuration, &options);
+  cr_assert(log_matcher_compile(matcher, pattern, NULL), "error compiling pattern: %s", pattern);
+  literal = log_matcher_get_required_literal(matcher);
+
+  log_matcher_unref(matcher);
+  log_matcher_options_destroy(&options);
+  return literal;
+}
+
+static void
+assert_required_literal(const gchar *type, gint flags, const gchar *pattern, const gchar *expected)
+{
+  gchar *literal = _get_required_literal(type, flags, pattern);
+
+  if (expected)
+    cr_assert_str_eq(literal, expected, "bad required literal for %s pattern %s", type, pattern);
+  else
+    cr_assert_null(literal, "no required literal was expected for %s pattern %s, got: %s", type, pattern, literal);
+  g_free(literal);
+}
+
+static FilterExprNode *
+_create_message_filter(const gchar *type, gint flags, const gchar *pattern)
+{
+  FilterRE *filter = filter_re_new(LM_V_MESSAGE);
+
+  log_matcher_options_set_type(&filter->matcher_options, type);
+  filter->matcher_options.flags |= flags;
+  cr_assert(filter_re_compile_pattern(filter, configuration, (gchar *) pattern, NULL));
+  filter_expr_init(&filter->super, configuration);
+  return &filter->super;
+}
+
+static LogMessage *
+_create_message(const gchar *message)
+{
+  LogMessage *msg = log_msg_new_empty();
+
+  log_msg_set_value(msg, LM_V_MESSAGE, message, -1);
+  return msg;
+}
+
+static void
+setup(void)
+{
+  app_startup();
+  configuration = cfg_new_snippet();
+  msg_format_options_defaults(&parse_options);
+  msg_format_options_init(&parse_options, configuration);
+}
+
+static void
+teardown(void)
+{
+  cfg_free(configuration);
+  app_shutdown();
+}
+
+TestSuite(filter_re_prefilter, .init = setup, .fini = teardown);
+
+Test(filter_re_prefilter, pcre_required_literals)
+{
+  assert_required_literal("pcre", 0, "PTHREAD support", "PTHREAD support");
+  assert_required_literal("pcre", 0, "^kernel: .*usb [0-9]+ disconnected$", " disconnected");
+  assert_required_literal("pcre", 0, "foo(bar|baz)quux", "quux");
+  assert_required_literal("pcre", 0, "foobars?", "fooba");
+  assert_required_literal("pcre", 0, "abcdef{0,2}g", "abcde");
+  assert_required_literal("pcre", 0, "abc\\.def\\d+", "abc.def");
+  assert_required_literal("pcre", 0, "\\x41BCDE", NULL);
+  assert_required_literal("pcre", 0, "[a-z]+ failed password", " failed password");
+
+  assert_required_literal("pcre", 0, "foo|bar", NULL);
+  assert_required_literal("pcre", 0, "(?x) foo bar", NULL);
+  assert_required_literal("pcre", 0, "\\Qa.b\\E", NULL);
+  assert_required_literal("pcre", LMF_ICASE, "error: \xc3\xa9t\xc3\xa9", "error: ");
+}
+
+Test(filter_re_prefilter, string_and_glob_required_literals)
+{
+  assert_required_literal("string", LMF_SUBSTRING, "session opened", "session opened");
+  assert_required_literal("string", LMF_PREFIX | LMF_ICASE, "\xc3\xa9t\xc3\xa9", NULL);
+  assert_required_literal("glob", 0, "*session ?pened for user*", "pened for user");
+}
+
+Test(filter_re_prefilter, filters_give_the_same_results_with_a_shared_prefilter)
+{
+  const gchar *patterns[] =
+  {
+    "session opened for user \\w+",
+    "Failed password for",
+    "usb \\d+-\\d+: new",
+    "Out of memory: Kill process",
+    "(?i)segfault at",
+  };
+  FilterExprNode *filters[G_N_ELEMENTS(patterns) + 1];
+  struct
+  {
+    const gchar *message;
+    /* bitmask of the matching filters */
+    guint32 expected;
+  } messages[] =
+  {
+    { "pam_unix(sshd:session): session opened for user root by (uid=0)", 1 << 0 },
+    { "Failed password for invalid user admin from 10.0.0.1", 1 << 1 },
+    { "kernel: usb 1-1: new high-speed USB device", 1 << 2 | 1 << 5 },
+    { "kernel: Out of memory: Kill process 1234 (java)", 1 << 3 },
+    { "app[123]: SEGFAULT AT 0000 ip 0000", 1 << 4 },
+    { "nothing interesting here", 0 },
+  };
+  gint i, j;
+
+  for (i = 0; i < G_N_ELEMENTS(patterns); i++)
+    filters[i] = _create_message_filter("pcre", 0, patterns[i]);
+  filters[i] = _create_message_filter("string", LMF_SUBSTRING, "USB device");
+
+  for (i = 0; i < G_N_ELEMENTS(messages); i++)
+    {
+      LogMessage *msg = _create_message(messages[i].message);
+
+      for (j = 0; j < G_N_ELEMENTS(filters); j++)
+        {
+          gboolean expected = !!(messages[i].expected & (1 << j));
+
+          cr_assert_eq(filter_expr_eval(filters[j], msg), expected,
+                       "unexpected result for filter %d on message: %s", j, messages[i].message);
+        }
+
+      /* the value changes, the cached scan must not be reused */
+      log_msg_set_value(msg, LM_V_MESSAGE, "Failed password for root", -1);
+      cr_assert(filter_expr_eval(filters[1], msg));
+      cr_assert_not(filter_expr_eval(filters[0], msg));
+      log_msg_unref(msg);
+    }
+
+  for (i = 0; i < G_N_ELEMENTS(filters); i++)
+    filter_expr_unref(filters[i]);
+}
+
+Test(filter_re_prefilter, filters_registered_after_the_first_message_are_not_prefiltered)
+{
+  FilterExprNode *filters[5];
+  LogMessage *msg = _create_message("late filter matches");
+  FilterExprNode *late;
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS(filters); i++)
+    {
+      gchar *pattern = g_strdup_printf("pattern number %d", i);
+
+      filters[i] = _create_message_filter("pcre", 0, pattern);
+      g_free(pattern);
+    }
+  cr_assert_not(filter_expr_eval(filters[0], msg));
+
+  late = _create_message_filter("pcre", 0, "late filter");
+  cr_assert_eq(((FilterRE *) late)->prefilter_pattern, -1);
+  cr_assert(filter_expr_eval(late, msg));
+
+  filter_expr_unref(late);
+  for (i = 0; i < G_N_ELEMENTS(filters); i++)
+    filter_expr_unref(filters[i]);
+  log_msg_unref(msg);
+}
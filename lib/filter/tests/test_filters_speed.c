@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "filter/filter-expr.h"
+#include "filter/filter-expr-parser.h"
+#include "cfg.h"
+#include "cfg-lexer.h"
+#include "logmsg/logmsg.h"
+#include "apphook.h"
+#include "plugin.h"
+#include "testutils.h"
+#include "stopwatch.h"
+
+#include <string.h>
+
+#define ITERATIONS 1000000
+
+MsgFormatOptions parse_options;
+
+typedef struct _FilterBenchmark
+{
+  const gchar *name;
+  const gchar *expr;
+  gboolean expected_result;
+} FilterBenchmark;
+
+static const gchar *test_message =
+  "<15>Oct 15 16:17:01 host openvpn[2499]: PTHREAD support initialized";
+
+static const FilterBenchmark benchmarks[] =
+{
+  {
+    "regexp before a mismatching level",
+    "message('PTHREAD.*initialized') and level(err) and facility(user)",
+    FALSE
+  },
+  {
+    "long chain of facilities",
+    "facility(kern) or facility(mail) or facility(daemon) or facility(auth) or "
+    "facility(syslog) or facility(lpr) or facility(news) or facility(uucp) or "
+    "facility(cron) or facility(authpriv) or facility(ftp) or facility(local0) or "
+    "facility(local1) or facility(local2) or facility(local3) or facility(user)",
+    TRUE
+  },
+  {
+    "negated nested expressions",
+    "not (program('sshd') or host('^db')) and not (level(err..emerg) and facility(auth))",
+    TRUE
+  },
+  {
+    /* as produced by substituting a `backtick` value into the config */
+    "constant comparison",
+    "program('openvpn') and ('no' == 'yes' or level(debug))",
+    TRUE
+  },
+  {
+    "template comparison",
+    "\"$LEVEL_NUM\" == \"3\" or \"${PROGRAM}\" ne \"openvpn\" or level(debug)",
+    TRUE
+  },
+};
+
+static FilterExprNode *
+_parse_filter(const gchar *expr)
+{
+  FilterExprNode *filter = NULL;
+  CfgLexer *lexer;
+
+  lexer = cfg_lexer_new_buffer(configuration, expr, strlen(expr));
+  assert_true(cfg_run_parser(configuration, lexer, &filter_expr_parser, (gpointer *) &filter, NULL),
+              "Error parsing filter expression: %s", expr);
+  return filter;
+}
+
+static void
+_perftest_filter(const FilterBenchmark *benchmark, LogMessage *msg, gboolean compile)
+{
+  FilterExprNode *filter = _parse_filter(benchmark->expr);
+  gint i;
+
+  /* filters are compiled into a flat program by init(), without it the
+   * expression tree is walked recursively */
+  if (compile)
+    filter_expr_init(filter, configuration);
+
+  assert_gboolean(filter_expr_eval(filter, msg), benchmark->expected_result,
+                  "Unexpected filter result: %s", benchmark->expr);
+
+  start_stopwatch();
+  for (i = 0; i < ITERATIONS; i++)
+    filter_expr_eval(filter, msg);
+  stop_stopwatch_and_display_result(ITERATIONS, "%-40s %s", benchmark->name, compile ? "compiled" : "tree walk");
+
+  filter_expr_unref(filter);
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  LogMessage *msg;
+  gint i;
+
+  app_startup();
+
+  configuration = cfg_new_snippet();
+  cfg_load_module(configuration, "syslogformat");
+  msg_format_options_defaults(&parse_options);
+  msg_format_options_init(&parse_options, configuration);
+
+  msg = log_msg_new(test_message, strlen(test_message), NULL, &parse_options);
+  for (i = 0; i < G_N_ELEMENTS(benchmarks); i++)
+    {
+      _perftest_filter(&benchmarks[i], msg, FALSE);
+      _perftest_filter(&benchmarks[i], msg, TRUE);
+    }
+  log_msg_unref(msg);
+
+  cfg_free(configuration);
+  app_shutdown();
+  return 0;
+}
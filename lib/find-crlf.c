@@ -24,15 +24,22 @@
 #include "find-crlf.h"
 
 #include <string.h>
-/**
- * This is an optimized version of finding either a CR or LF or NUL
- * character in a buffer.  It is used to find these line terminators in
- * syslog traffic.
- *
- * It uses an algorithm very similar to what there's in libc memchr/strchr.
- **/
-gchar *
-find_cr_or_lf(gchar *s, gsize n)
+
+#if defined(__x86_64__) && defined(__SSE2__) && defined(__GNUC__)
+#define FIND_CRLF_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+ * The scalar implementations below use an algorithm very similar to what
+ * there's in libc memchr/strchr, looking at a long word at a time.  On
+ * x86_64 they are only used for the tail of the buffer that is shorter
+ * than a vector, the rest is scanned by the SSE2/AVX2 variants, selected
+ * at runtime based on the capabilities of the CPU.
+ */
+
+static gchar *
+_find_cr_or_lf_scalar(gchar *s, gsize n)
 {
   gchar *char_ptr;
   gulong *longword_ptr;
@@ -97,3 +104,246 @@ find_cr_or_lf(gchar *s, gsize n)
 
   return NULL;
 }
+
+static const guchar *
+_find_lf_or_nul_scalar(const guchar *s, gsize n)
+{
+  const guchar *char_ptr;
+  const gulong *longword_ptr;
+  gulong longword, magic_bits, charmask;
+  gchar c;
+
+  c = '\n';
+
+  /* align input to long boundary */
+  for (char_ptr = s; n > 0 && ((gulong) char_ptr & (sizeof(longword) - 1)) != 0; ++char_ptr, n--)
+    {
+      if (*char_ptr == c || *char_ptr == '\0')
+        return char_ptr;
+    }
+
+  longword_ptr = (gulong *) char_ptr;
+
+#if GLIB_SIZEOF_LONG == 8
+  magic_bits = 0x7efefefefefefeffL;
+#elif GLIB_SIZEOF_LONG == 4
+  magic_bits = 0x7efefeffL;
+#else
+#error "unknown architecture"
+#endif
+  memset(&charmask, c, sizeof(charmask));
+
+  while (n > sizeof(longword))
+    {
+      longword = *longword_ptr++;
+      if ((((longword + magic_bits) ^ ~longword) & ~magic_bits) != 0 ||
+          ((((longword ^ charmask) + magic_bits) ^ ~(longword ^ charmask)) & ~magic_bits) != 0)
+        {
+          gint i;
+
+          char_ptr = (const guchar *) (longword_ptr - 1);
+
+          for (i = 0; i < sizeof(longword); i++)
+            {
+              if (*char_ptr == c || *char_ptr == '\0')
+                return char_ptr;
+              char_ptr++;
+            }
+        }
+      n -= sizeof(longword);
+    }
+
+  char_ptr = (const guchar *) longword_ptr;
+
+  while (n-- > 0)
+    {
+      if (*char_ptr == c || *char_ptr == '\0')
+        return char_ptr;
+      ++char_ptr;
+    }
+
+  return NULL;
+}
+
+#if FIND_CRLF_X86
+
+/*
+ * The vectorized variants only use unaligned loads that are fully within
+ * the buffer, the remaining bytes are handed over to the narrower
+ * implementation, so we never read past the end of the input.
+ */
+
+static inline gchar *
+_cr_or_lf_match(gchar *p)
+{
+  /* a NUL character terminates the search without a match */
+  return *p ? p : NULL;
+}
+
+static gchar *
+_find_cr_or_lf_sse2(gchar *s, gsize n)
+{
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i nul = _mm_setzero_si128();
+  gsize i;
+
+  for (i = 0; i + sizeof(__m128i) <= n; i += sizeof(__m128i))
+    {
+      __m128i chunk = _mm_loadu_si128((const __m128i *) (s + i));
+      __m128i eq = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, cr),
+                                             _mm_cmpeq_epi8(chunk, lf)),
+                                _mm_cmpeq_epi8(chunk, nul));
+      guint mask = _mm_movemask_epi8(eq);
+
+      if (mask)
+        return _cr_or_lf_match(s + i + __builtin_ctz(mask));
+    }
+  return _find_cr_or_lf_scalar(s + i, n - i);
+}
+
+static const guchar *
+_find_lf_or_nul_sse2(const guchar *s, gsize n)
+{
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i nul = _mm_setzero_si128();
+  gsize i;
+
+  for (i = 0; i + sizeof(__m128i) <= n; i += sizeof(__m128i))
+    {
+      __m128i chunk = _mm_loadu_si128((const __m128i *) (s + i));
+      __m128i eq = _mm_or_si128(_mm_cmpeq_epi8(chunk, lf),
+                                _mm_cmpeq_epi8(chunk, nul));
+      guint mask = _mm_movemask_epi8(eq);
+
+      if (mask)
+        return s + i + __builtin_ctz(mask);
+    }
+  return _find_lf_or_nul_scalar(s + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static gchar *
+_find_cr_or_lf_avx2(gchar *s, gsize n)
+{
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  const __m256i nul = _mm256_setzero_si256();
+  gsize i;
+
+  for (i = 0; i + sizeof(__m256i) <= n; i += sizeof(__m256i))
+    {
+      __m256i chunk = _mm256_loadu_si256((const __m256i *) (s + i));
+      __m256i eq = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, cr),
+                                                   _mm256_cmpeq_epi8(chunk, lf)),
+                                   _mm256_cmpeq_epi8(chunk, nul));
+      guint mask = _mm256_movemask_epi8(eq);
+
+      if (mask)
+        return _cr_or_lf_match(s + i + __builtin_ctz(mask));
+    }
+  return _find_cr_or_lf_sse2(s + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static const guchar *
+_find_lf_or_nul_avx2(const guchar *s, gsize n)
+{
+  const __m256i lf = _mm256_set1_epi8('\n');
+  const __m256i nul = _mm256_setzero_si256();
+  gsize i;
+
+  for (i = 0; i + sizeof(__m256i) <= n; i += sizeof(__m256i))
+    {
+      __m256i chunk = _mm256_loadu_si256((const __m256i *) (s + i));
+      __m256i eq = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, lf),
+                                   _mm256_cmpeq_epi8(chunk, nul));
+      guint mask = _mm256_movemask_epi8(eq);
+
+      if (mask)
+        return s + i + __builtin_ctz(mask);
+    }
+  return _find_lf_or_nul_sse2(s + i, n - i);
+}
+
+#endif
+
+typedef gchar *(*FindCrOrLfFunc)(gchar *s, gsize n);
+typedef const guchar *(*FindLfOrNulFunc)(const guchar *s, gsize n);
+
+static gchar *_find_cr_or_lf_select(gchar *s, gsize n);
+static const guchar *_find_lf_or_nul_select(const guchar *s, gsize n);
+
+/* start out with the selector functions, which replace themselves upon the first call */
+static FindCrOrLfFunc find_cr_or_lf_impl = _find_cr_or_lf_select;
+static FindLfOrNulFunc find_lf_or_nul_impl = _find_lf_or_nul_select;
+
+static void
+_select_implementation(void)
+{
+  FindCrOrLfFunc cr_or_lf = _find_cr_or_lf_scalar;
+  FindLfOrNulFunc lf_or_nul = _find_lf_or_nul_scalar;
+
+#if FIND_CRLF_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    {
+      cr_or_lf = _find_cr_or_lf_avx2;
+      lf_or_nul = _find_lf_or_nul_avx2;
+    }
+  else
+    {
+      cr_or_lf = _find_cr_or_lf_sse2;
+      lf_or_nul = _find_lf_or_nul_sse2;
+    }
+#endif
+
+  /* the selection is idempotent, so racing threads store the same values */
+  g_atomic_pointer_set(&find_cr_or_lf_impl, cr_or_lf);
+  g_atomic_pointer_set(&find_lf_or_nul_impl, lf_or_nul);
+}
+
+static gchar *
+_find_cr_or_lf_select(gchar *s, gsize n)
+{
+  _select_implementation();
+  return find_cr_or_lf(s, n);
+}
+
+static const guchar *
+_find_lf_or_nul_select(const guchar *s, gsize n)
+{
+  _select_implementation();
+  return find_lf_or_nul(s, n);
+}
+
+/**
+ * This is an optimized version of finding either a CR or LF or NUL
+ * character in a buffer.  It is used to find these line terminators in
+ * syslog traffic.
+ *
+ * Returns a pointer to the first CR or LF character, or NULL if a NUL
+ * character comes first or neither is found within @n bytes.
+ **/
+gchar *
+find_cr_or_lf(gchar *s, gsize n)
+{
+  FindCrOrLfFunc func = (FindCrOrLfFunc) g_atomic_pointer_get(&find_cr_or_lf_impl);
+
+  return func(s, n);
+}
+
+/**
+ * Find the first LF or NUL character in a buffer, this is what terminates
+ * a message in newline separated protocols.
+ *
+ * Returns a pointer to the terminating character or NULL if none was
+ * found within @n bytes.
+ **/
+const guchar *
+find_lf_or_nul(const guchar *s, gsize n)
+{
+  FindLfOrNulFunc func = (FindLfOrNulFunc) g_atomic_pointer_get(&find_lf_or_nul_impl);
+
+  return func(s, n);
+}
@@ -27,5 +27,6 @@
 #include "syslog-ng.h"
 
 gchar *find_cr_or_lf(gchar *s, gsize n);
+const guchar *find_lf_or_nul(const guchar *s, gsize n);
 
 #endif
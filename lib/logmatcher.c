@@ -44,6 +44,36 @@ log_matcher_store_pattern(LogMatcher *self, const gchar *pattern)
   self->pattern = g_strdup(pattern);
 }
 
+/* Case insensitive matchers may match non-ASCII characters in a different
+ * case, which the ASCII-only folding of the required literal would miss.
+ * Such literals are cut at the first non-ASCII character. */
+static gboolean
+_is_usable_literal_char(guchar c, gboolean caseless)
+{
+  return !caseless || c < 0x80;
+}
+
+static void
+_literal_run_finish(GString *run, GString *best)
+{
+  if (run->len > best->len)
+    g_string_assign(best, run->str);
+  g_string_truncate(run, 0);
+}
+
+static gchar *
+_literal_best_result(GString *run, GString *best)
+{
+  _literal_run_finish(run, best);
+  g_string_free(run, TRUE);
+  if (best->len == 0)
+    {
+      g_string_free(best, TRUE);
+      return NULL;
+    }
+  return g_string_free(best, FALSE);
+}
+
 static void
 log_matcher_free_method(LogMatcher *self)
 {
@@ -76,6 +106,21 @@ log_matcher_string_compile(LogMatcher *s, const gchar *pattern, GError **error)
   return TRUE;
 }
 
+/* exact, prefix and substring matches all contain the whole pattern */
+static gchar *
+log_matcher_string_get_required_literal(LogMatcher *s)
+{
+  gboolean caseless = !!(s->flags & LMF_ICASE);
+  const guchar *p;
+
+  for (p = (const guchar *) s->pattern; *p; p++)
+    {
+      if (!_is_usable_literal_char(*p, caseless))
+        return NULL;
+    }
+  return g_strdup(s->pattern);
+}
+
 static const gchar *
 log_matcher_string_match_string(LogMatcherString *self, const gchar *value, gsize value_len)
 {
@@ -209,6 +254,7 @@ log_matcher_string_new(GlobalConfig *cfg, const LogMatcherOptions *options)
   self->super.compile = log_matcher_string_compile;
   self->super.match = log_matcher_string_match;
   self->super.replace = log_matcher_string_replace;
+  self->super.get_required_literal = log_matcher_string_get_required_literal;
 
   return &self->super;
 }
@@ -231,6 +277,24 @@ log_matcher_glob_compile(LogMatcher *s, const gchar *pattern, GError **error)
   return TRUE;
 }
 
+/* the longest run of characters between '*' and '?' wildcards */
+static gchar *
+log_matcher_glob_get_required_literal(LogMatcher *s)
+{
+  GString *run = g_string_sized_new(32);
+  GString *best = g_string_sized_new(32);
+  const gchar *p;
+
+  for (p = s->pattern; *p; p++)
+    {
+      if (*p == '*' || *p == '?')
+        _literal_run_finish(run, best);
+      else
+        g_string_append_c(run, *p);
+    }
+  return _literal_best_result(run, best);
+}
+
 /* GPattern only works with utf8 strings, if the input is not utf8, we risk
  * a crash
  */
@@ -278,6 +342,7 @@ log_matcher_glob_new(GlobalConfig *cfg, const LogMatcherOptions *options)
   self->super.compile = log_matcher_glob_compile;
   self->super.match = log_matcher_glob_match;
   self->super.replace = NULL;
+  self->super.get_required_literal = log_matcher_glob_get_required_literal;
   self->super.free_fn = log_matcher_glob_free;
 
   return &self->super;
@@ -603,6 +668,193 @@ log_matcher_pcre_re_replace(LogMatcher *s, LogMessage *msg, gint value_handle, c
   return NULL;
 }
 
+/* drops the last character of the run, including all bytes of a multibyte
+ * UTF-8 character, as a quantifier made it optional */
+static void
+_literal_run_drop_last_char(GString *run)
+{
+  gsize len = run->len;
+
+  while (len > 0 && (guchar) run->str[len - 1] >= 0x80)
+    len--;
+  if (len == run->len && len > 0)
+    len--;
+  g_string_truncate(run, len);
+}
+
+/* skips a character class starting at @p, returns NULL if it is unterminated */
+static const gchar *
+_skip_pcre_char_class(const gchar *p)
+{
+  p++;
+  if (*p == '^')
+    p++;
+  if (*p == ']')
+    p++;
+
+  while (*p && *p != ']')
+    {
+      if (*p == '\\' && *(p + 1))
+        p += 2;
+      else if (*p == '[' && *(p + 1) == ':' && strstr(p + 2, ":]"))
+        p = strstr(p + 2, ":]") + 2;
+      else
+        p++;
+    }
+  return *p ? p : NULL;
+}
+
+/* {n}, {n,} or {n,m}, anything else is a literal brace in PCRE */
+static const gchar *
+_skip_pcre_counted_quantifier(const gchar *p)
+{
+  const gchar *q = p + 1;
+
+  if (!g_ascii_isdigit(*q))
+    return NULL;
+  while (g_ascii_isdigit(*q))
+    q++;
+  if (*q == ',')
+    q++;
+  while (g_ascii_isdigit(*q))
+    q++;
+  return *q == '}' ? q : NULL;
+}
+
+/*
+ * A conservative scan of the regexp for a literal string that must occur
+ * in every match.  Only characters outside of groups are considered, a
+ * top-level alternation or any construct that changes how the pattern is
+ * parsed ((?x), \Q...\E) gives up and returns NULL.
+ */
+static gchar *
+log_matcher_pcre_re_get_required_literal(LogMatcher *s)
+{
+  gboolean caseless = (s->flags & LMF_ICASE) || strstr(s->pattern, "(?") != NULL;
+  GString *run = g_string_sized_new(32);
+  GString *best = g_string_sized_new(32);
+  const gchar *p = s->pattern;
+  gint depth = 0;
+
+  while (*p)
+    {
+      switch (*p)
+        {
+        case '\\':
+          if (!*(p + 1))
+            goto give_up;
+          if (*(p + 1) == 'Q')
+            goto give_up;
+          if (g_ascii_isalnum(*(p + 1)))
+            {
+              /* \d, \x41, \p{Lu}, \k<name>: none of them is literal */
+              _literal_run_finish(run, best);
+              p += 2;
+              while (g_ascii_isalnum(*p))
+                p++;
+              if (*p == '{' || *p == '<')
+                {
+                  p = strchr(p, *p == '{' ? '}' : '>');
+                  if (!p)
+                    goto give_up;
+                  p++;
+                }
+              continue;
+            }
+          p++;
+          if (depth == 0 && _is_usable_literal_char(*p, caseless))
+            g_string_append_c(run, *p);
+          else
+            _literal_run_finish(run, best);
+          break;
+
+        case '(':
+          _literal_run_finish(run, best);
+          if (*(p + 1) == '?' && *(p + 2) == '#')
+            {
+              p = strchr(p, ')');
+              if (!p)
+                goto give_up;
+              break;
+            }
+          if (*(p + 1) == '?')
+            {
+              const gchar *opt;
+
+              for (opt = p + 2; g_ascii_isalpha(*opt) || *opt == '-'; opt++)
+                {
+                  if (*opt == 'x')
+                    goto give_up;
+                }
+            }
+          depth++;
+          break;
+
+        case ')':
+          _literal_run_finish(run, best);
+          if (--depth < 0)
+            goto give_up;
+          break;
+
+        case '|':
+          if (depth == 0)
+            goto give_up;
+          break;
+
+        case '[':
+          _literal_run_finish(run, best);
+          p = _skip_pcre_char_class(p);
+          if (!p)
+            goto give_up;
+          break;
+
+        case '*':
+        case '?':
+          _literal_run_drop_last_char(run);
+          _literal_run_finish(run, best);
+          break;
+
+        case '{':
+        {
+          const gchar *end = _skip_pcre_counted_quantifier(p);
+
+          if (end && *(p + 1) == '0')
+            _literal_run_drop_last_char(run);
+          _literal_run_finish(run, best);
+          if (end)
+            p = end;
+          break;
+        }
+
+        case '+':
+          /* the character is there at least once, but its repetitions
+           * are not part of the literal */
+          _literal_run_finish(run, best);
+          break;
+
+        case '.':
+        case '^':
+        case '$':
+          _literal_run_finish(run, best);
+          break;
+
+        default:
+          if (depth == 0 && _is_usable_literal_char(*p, caseless))
+            g_string_append_c(run, *p);
+          else
+            _literal_run_finish(run, best);
+          break;
+        }
+      p++;
+    }
+  return _literal_best_result(run, best);
+
+give_up:
+  g_string_free(run, TRUE);
+  g_string_free(best, TRUE);
+  return NULL;
+}
+
 static void
 log_matcher_pcre_re_free(LogMatcher *s)
 {
@@ -621,6 +873,7 @@ log_matcher_pcre_re_new(GlobalConfig *cfg, const LogMatcherOptions *options)
   self->super.compile = log_matcher_pcre_re_compile;
   self->super.match = log_matcher_pcre_re_match;
   self->super.replace = log_matcher_pcre_re_replace;
+  self->super.get_required_literal = log_matcher_pcre_re_get_required_literal;
   self->super.free_fn = log_matcher_pcre_re_free;
 
   return &self->super;
@@ -56,7 +56,16 @@ _serialize_message(LogMessageSerializationState *state)
   serialize_write_uint8(sa, msg->num_sdata);
   serialize_write_uint8(sa, msg->alloc_sdata);
   serialize_write_uint32_array(sa, (guint32 *) msg->sdata, msg->num_sdata);
-  nv_table_serialize(state, msg->payload);
+  if (msg->payload_base)
+    {
+      /* the payload is a delta, serialize it along with its base */
+      NVTable *payload = nv_table_merge(msg->payload, msg->payload_base);
+
+      nv_table_serialize(state, payload);
+      nv_table_unref(payload);
+    }
+  else
+    nv_table_serialize(state, msg->payload);
   return TRUE;
 }
 
@@ -160,6 +169,7 @@ _deserialize_message_version_2x(LogMessageSerializationState *state)
     return FALSE;
 
   nv_table_unref(msg->payload);
+  msg->payload_base = NULL;
   msg->payload = _nv_table_deserialize_selector(state);
   if (!msg->payload)
     return FALSE;
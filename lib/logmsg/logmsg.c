@@ -33,6 +33,7 @@
 #include "stats/stats-cluster-single.h"
 #include "template/templates.h"
 #include "tls-support.h"
+#include "slab-allocator.h"
 #include "compat/string.h"
 #include "rcptid.h"
 #include "template/macros.h"
@@ -477,7 +478,7 @@ log_msg_alloc_queue_node(LogMessage *msg, const LogPathOptions *path_options)
        */
       if (nodes < 32 && nodes <= msg->num_nodes)
         logmsg_queue_node_max = msg->num_nodes + 1;
-      node = g_slice_new(LogMessageQueueNode);
+      node = slab_alloc(sizeof(LogMessageQueueNode));
       node->embedded = FALSE;
     }
   log_msg_init_queue_node(msg, node, path_options);
@@ -488,7 +489,7 @@ LogMessageQueueNode *
 log_msg_alloc_dynamic_queue_node(LogMessage *msg, const LogPathOptions *path_options)
 {
   LogMessageQueueNode *node;
-  node = g_slice_new(LogMessageQueueNode);
+  node = slab_alloc(sizeof(LogMessageQueueNode));
   node->embedded = FALSE;
   log_msg_init_queue_node(msg, node, path_options);
   return node;
@@ -498,7 +499,7 @@ void
 log_msg_free_queue_node(LogMessageQueueNode *node)
 {
   if (!node->embedded)
-    g_slice_free(LogMessageQueueNode, node);
+    slab_free(node);
 }
 
 static gboolean
@@ -512,6 +513,72 @@ _log_name_value_updates(LogMessage *self)
   return (!self->initial_parse && (self->flags & LF_INTERNAL) == 0);
 }
 
+/*
+ * Payload deltas
+ *
+ * A cloned message shares the payload of the message it was cloned from,
+ * until it is changed.  If the shared payload is large, it is not copied
+ * on the first write: the changes go to a small delta NVTable on top of
+ * it (payload_base), which is merged into a copy of the base once it
+ * grows comparable to the base.  The base is kept alive by the reference
+ * to the original message.
+ */
+#define LOGMSG_PAYLOAD_DELTA_MIN_BASE_SIZE 1024
+
+static inline gboolean
+_is_value_set_in_payload(const LogMessage *self, NVHandle handle)
+{
+  if (nv_table_is_value_set(self->payload, handle))
+    return TRUE;
+  return self->payload_base && nv_table_is_value_set(self->payload_base, handle);
+}
+
+static void
+_make_payload_writable(LogMessage *self, gsize additional_space)
+{
+  if (log_msg_chk_flag(self, LF_STATE_OWN_PAYLOAD))
+    return;
+
+  if (self->payload_base)
+    {
+      /* cloned from a message with a delta, only the delta is copied */
+      self->payload = nv_table_clone(self->payload, additional_space);
+    }
+  else if (self->payload->used >= LOGMSG_PAYLOAD_DELTA_MIN_BASE_SIZE)
+    {
+      self->payload_base = self->payload;
+      self->payload = nv_table_new(LM_V_MAX, 16, MAX(additional_space, 256));
+    }
+  else
+    {
+      self->payload = nv_table_clone(self->payload, additional_space);
+    }
+  log_msg_set_flag(self, LF_STATE_OWN_PAYLOAD);
+  self->allocated_bytes += self->payload->size;
+  stats_counter_add(count_allocated_bytes, self->payload->size);
+}
+
+static void
+_merge_payload_delta(LogMessage *self)
+{
+  NVTable *merged = nv_table_merge(self->payload, self->payload_base);
+
+  self->allocated_bytes += merged->size;
+  self->allocated_bytes -= self->payload->size;
+  stats_counter_add(count_allocated_bytes, (gssize) merged->size - (gssize) self->payload->size);
+
+  nv_table_unref(self->payload);
+  self->payload = merged;
+  self->payload_base = NULL;
+}
+
+static inline void
+_merge_payload_delta_if_too_large(LogMessage *self)
+{
+  if (self->payload_base && self->payload->used * 2 > self->payload_base->used)
+    _merge_payload_delta(self);
+}
+
 void
 log_msg_set_value(LogMessage *self, NVHandle handle, const gchar *value, gssize value_len)
 {
@@ -538,13 +605,7 @@ log_msg_set_value(LogMessage *self, NVHandle handle, const gchar *value, gssize
   if (value_len < 0)
     value_len = strlen(value);
 
-  if (!log_msg_chk_flag(self, LF_STATE_OWN_PAYLOAD))
-    {
-      self->payload = nv_table_clone(self->payload, name_len + value_len + 2);
-      log_msg_set_flag(self, LF_STATE_OWN_PAYLOAD);
-      self->allocated_bytes += self->payload->size;
-      stats_counter_add(count_allocated_bytes, self->payload->size);
-    }
+  _make_payload_writable(self, name_len + value_len + 2);
 
   /* we need a loop here as a single realloc may not be enough. Might help
    * if we pass how much bytes we need though. */
@@ -567,15 +628,27 @@ log_msg_set_value(LogMessage *self, NVHandle handle, const gchar *value, gssize
       stats_counter_inc(count_payload_reallocs);
     }
 
+  if (new_entry && self->payload_base && nv_table_is_value_set(self->payload_base, handle))
+    new_entry = FALSE;
   if (new_entry)
     log_msg_update_sdata(self, handle, name, name_len);
   if (handle == LM_V_PROGRAM || handle == LM_V_PID)
     log_msg_unset_value(self, LM_V_LEGACY_MSGHDR);
+  _merge_payload_delta_if_too_large(self);
 }
 
 void
 log_msg_unset_value(LogMessage *self, NVHandle handle)
 {
+  if (!_is_value_set_in_payload(self, handle))
+    return;
+
+  _make_payload_writable(self, 0);
+  if (self->payload_base && !nv_table_is_value_set(self->payload, handle))
+    {
+      /* hide the value in the base with an unset entry in the delta */
+      log_msg_set_value(self, handle, "", 0);
+    }
   nv_table_unset_value(self->payload, handle);
 }
 
@@ -613,10 +686,21 @@ log_msg_set_value_indirect(LogMessage *self, NVHandle handle, NVHandle ref_handl
                 evt_tag_int("len", len));
     }
 
-  if (!log_msg_chk_flag(self, LF_STATE_OWN_PAYLOAD))
+  _make_payload_writable(self, name_len + 1);
+
+  if (self->payload_base && !nv_table_is_value_set(self->payload, ref_handle))
     {
-      self->payload = nv_table_clone(self->payload, name_len + 1);
-      log_msg_set_flag(self, LF_STATE_OWN_PAYLOAD);
+      /* indirect values are resolved within the same NVTable, the
+       * referenced value is in the base which never changes, so copy it */
+      const gchar *ref_value;
+      gssize ref_len;
+
+      ref_value = nv_table_get_value(self->payload_base, ref_handle, &ref_len);
+      if (ofs > ref_len)
+        log_msg_set_value(self, handle, "", 0);
+      else
+        log_msg_set_value(self, handle, ref_value + ofs, MIN(ofs + len, ref_len) - ofs);
+      return;
     }
 
   NVReferencedSlice referenced_slice =
@@ -641,13 +725,18 @@ log_msg_set_value_indirect(LogMessage *self, NVHandle handle, NVHandle ref_handl
       stats_counter_inc(count_payload_reallocs);
     }
 
+  if (new_entry && self->payload_base && nv_table_is_value_set(self->payload_base, handle))
+    new_entry = FALSE;
   if (new_entry)
     log_msg_update_sdata(self, handle, name, name_len);
+  _merge_payload_delta_if_too_large(self);
 }
 
 gboolean
 log_msg_values_foreach(const LogMessage *self, NVTableForeachFunc func, gpointer user_data)
 {
+  if (self->payload_base)
+    return nv_table_foreach_layered(self->payload, self->payload_base, logmsg_registry, func, user_data);
   return nv_table_foreach(self->payload, logmsg_registry, func, user_data);
 }
 
@@ -1107,6 +1196,7 @@ log_msg_clear(LogMessage *self)
     nv_table_clear(self->payload);
   else
     self->payload = nv_table_new(LM_V_MAX, 16, 256);
+  self->payload_base = NULL;
 
   if (log_msg_chk_flag(self, LF_STATE_OWN_TAGS) && self->tags)
     {
@@ -1155,7 +1245,7 @@ log_msg_alloc(gsize payload_size)
       payload_ofs = alloc_size;
       alloc_size += payload_space;
     }
-  msg = g_malloc(alloc_size);
+  msg = slab_alloc(alloc_size);
 
   memset(msg, 0, sizeof(LogMessage));
 
@@ -1173,7 +1263,7 @@ _merge_value(NVHandle handle, const gchar *name, const gchar *value, gssize valu
 {
   LogMessage *msg = (LogMessage *) user_data;
 
-  if (!nv_table_is_value_set(msg->payload, handle))
+  if (!_is_value_set_in_payload(msg, handle))
     log_msg_set_value(msg, handle, value, value_len);
   return FALSE;
 }
@@ -1376,7 +1466,7 @@ log_msg_free(LogMessage *self)
 
   stats_counter_sub(count_allocated_bytes, self->allocated_bytes);
 
-  g_free(self);
+  slab_free(self);
 }
 
 /**
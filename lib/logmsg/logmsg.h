@@ -189,6 +189,9 @@ struct _LogMessage
 
   GSockAddr *saddr;
   NVTable *payload;
+  /* if set, payload is a delta on top of this NVTable, which is owned by
+   * the message we were cloned from (kept alive via self->original) */
+  NVTable *payload_base;
 
   guint32 flags;
   guint16 pri;
@@ -243,14 +246,26 @@ log_msg_is_handle_settable_with_an_indirect_value(NVHandle handle)
 
 const gchar *log_msg_get_macro_value(const LogMessage *self, gint id, gssize *value_len);
 
+static inline const gchar *
+log_msg_get_payload_value_if_set(const LogMessage *self, NVHandle handle, gssize *value_len)
+{
+  if (G_UNLIKELY(self->payload_base) && !nv_table_is_value_set(self->payload, handle))
+    return nv_table_get_value_if_set(self->payload_base, handle, value_len);
+  return nv_table_get_value_if_set(self->payload, handle, value_len);
+}
+
 static inline const gchar *
 log_msg_get_value(const LogMessage *self, NVHandle handle, gssize *value_len)
 {
   guint16 flags;
+  const gchar *value;
 
   flags = nv_registry_get_handle_flags(logmsg_registry, handle);
   if ((flags & LM_VF_MACRO) == 0)
-    return nv_table_get_value(self->payload, handle, value_len);
+    {
+      value = log_msg_get_payload_value_if_set(self, handle, value_len);
+      return value ? value : null_string;
+    }
   else
     return log_msg_get_macro_value(self, flags >> 8, value_len);
 }
@@ -262,7 +277,7 @@ log_msg_get_value_if_set(const LogMessage *self, NVHandle handle, gssize *value_
 
   flags = nv_registry_get_handle_flags(logmsg_registry, handle);
   if ((flags & LM_VF_MACRO) == 0)
-    return nv_table_get_value_if_set(self->payload, handle, value_len);
+    return log_msg_get_payload_value_if_set(self, handle, value_len);
   else
     return log_msg_get_macro_value(self, flags >> 8, value_len);
 }
@@ -318,6 +318,7 @@ nv_table_deserialize_22(SerializeArchive *sa)
 
   res->ref_cnt = 1;
   res->borrowed = FALSE;
+  res->indexed = FALSE;
 
   if (!_deserialize_struct_22(sa, res))
     {
@@ -454,6 +455,7 @@ nv_table_deserialize_legacy(SerializeArchive *sa)
 
   res->borrowed = FALSE;
   res->ref_cnt = 1;
+  res->indexed = FALSE;
 
   if (!_deserialize_blob_v22(sa, res, nv_table_get_top(res), swap_bytes))
     {
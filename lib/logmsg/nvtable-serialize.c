@@ -127,6 +127,7 @@ _read_header(SerializeArchive *sa, NVTable **nvtable)
 
   res = (NVTable *) g_malloc(size);
   res->size = size;
+  res->indexed = FALSE;
 
   if (!serialize_read_uint32(sa, &res->used))
     goto error;
@@ -148,6 +148,19 @@ nv_registry_free(NVRegistry *self)
 }
 
 
+/* the hash index is only a cache, it gives up its space before an
+ * allocation would fail */
+static inline gboolean
+nv_table_make_room(NVTable *self, gsize alloc_size)
+{
+  if (nv_table_alloc_check(self, alloc_size))
+    return TRUE;
+  if (!self->indexed)
+    return FALSE;
+  self->indexed = FALSE;
+  return nv_table_alloc_check(self, alloc_size);
+}
+
 /* return the offset to a newly allocated payload string */
 static inline NVEntry *
 nv_table_alloc_value(NVTable *self, gsize alloc_size)
@@ -156,7 +169,7 @@ nv_table_alloc_value(NVTable *self, gsize alloc_size)
 
   alloc_size = NV_TABLE_BOUND(alloc_size);
   /* alloc error, NVTable should be realloced */
-  if (!nv_table_alloc_check(self, alloc_size))
+  if (!nv_table_make_room(self, alloc_size))
     return NULL;
   self->used += alloc_size;
   entry = (NVEntry *) (nv_table_get_top(self) - (self->used));
@@ -215,6 +228,93 @@ nv_table_resolve_entry(NVTable *self, NVEntry *entry, gssize *length)
     return nv_table_resolve_indirect(self, entry, length);
 }
 
+static inline guint16 *
+nv_table_get_hash_index(NVTable *self)
+{
+  return (guint16 *) &nv_table_get_index(self)[self->index_size];
+}
+
+static inline gsize
+nv_table_hash_handle(NVHandle handle, gsize mask)
+{
+  return (handle * 2654435761U) & mask;
+}
+
+/* returns the position of @handle in the index or -1 if it is not there */
+static gint
+nv_table_hash_index_lookup(NVTable *self, NVHandle handle)
+{
+  NVIndexEntry *index_table = nv_table_get_index(self);
+  guint16 *slots = nv_table_get_hash_index(self);
+  gsize mask = nv_table_get_hash_index_slots(self) - 1;
+  gsize i;
+
+  for (i = nv_table_hash_handle(handle, mask); slots[i]; i = (i + 1) & mask)
+    {
+      if (index_table[slots[i] - 1].handle == handle)
+        return slots[i] - 1;
+    }
+  return -1;
+}
+
+static void
+nv_table_hash_index_insert(NVTable *self, NVHandle handle, gint position)
+{
+  guint16 *slots = nv_table_get_hash_index(self);
+  gsize mask = nv_table_get_hash_index_slots(self) - 1;
+  gsize i;
+
+  for (i = nv_table_hash_handle(handle, mask); slots[i]; i = (i + 1) & mask)
+    ;
+  slots[i] = position + 1;
+}
+
+static void
+nv_table_build_hash_index(NVTable *self)
+{
+  NVIndexEntry *index_table = nv_table_get_index(self);
+  gsize size;
+  gint i;
+
+  self->indexed = FALSE;
+  if (self->index_size < NV_TABLE_HASH_INDEX_THRESHOLD)
+    return;
+
+  size = nv_table_get_hash_index_slots(self) * sizeof(guint16);
+  if (!nv_table_alloc_check(self, size))
+    return;
+
+  memset(nv_table_get_hash_index(self), 0, size);
+  self->indexed = TRUE;
+  for (i = 0; i < self->index_size; i++)
+    nv_table_hash_index_insert(self, index_table[i].handle, i);
+}
+
+/* a new entry was inserted into the index at @position, and the hash
+ * index was moved along with the index entries following it */
+static void
+nv_table_update_hash_index(NVTable *self, gint position, gsize prev_slots)
+{
+  NVIndexEntry *index_table = nv_table_get_index(self);
+  guint16 *slots;
+  gsize i, num_slots;
+
+  if (!self->indexed || nv_table_get_hash_index_slots(self) != prev_slots)
+    {
+      nv_table_build_hash_index(self);
+      return;
+    }
+
+  slots = nv_table_get_hash_index(self);
+  num_slots = nv_table_get_hash_index_slots(self);
+  for (i = 0; i < num_slots; i++)
+    {
+      if (slots[i] > position)
+        slots[i]++;
+    }
+  nv_table_hash_index_insert(self, index_table[position].handle, position);
+}
+
 NVEntry *
 nv_table_get_entry_slow(NVTable *self, NVHandle handle, NVIndexEntry **index_entry)
 {
@@ -229,6 +329,18 @@ nv_table_get_entry_slow(NVTable *self, NVHandle handle, NVIndexEntry **index_ent
       return NULL;
     }
 
+  if (self->indexed)
+    {
+      m = nv_table_hash_index_lookup(self, handle);
+      if (m < 0)
+        {
+          *index_entry = NULL;
+          return NULL;
+        }
+      *index_entry = &index_table[m];
+      return nv_table_get_entry_at_ofs(self, index_table[m].ofs);
+    }
+
   /* open-coded binary search */
   *index_entry = NULL;
   l = 0;
@@ -268,7 +380,7 @@ nv_table_reserve_table_entry(NVTable *self, NVHandle handle, NVIndexEntry **inde
       gint l, h, m, ndx;
       gboolean found = FALSE;
 
-      if (!nv_table_alloc_check(self, sizeof(index_table[0])))
+      if (!nv_table_make_room(self, sizeof(index_table[0])))
         return FALSE;
 
       l = 0;
@@ -301,9 +413,19 @@ nv_table_reserve_table_entry(NVTable *self, NVHandle handle, NVIndexEntry **inde
         ndx = l;
 
       g_assert(ndx >= 0 && ndx <= self->index_size);
-      if (ndx < self->index_size)
+      if (found)
         {
-          memmove(&index_table[ndx + 1], &index_table[ndx], (self->index_size - ndx) * sizeof(index_table[0]));
+          *index_entry = &index_table[ndx];
+          (**index_entry).ofs = 0;
+          return TRUE;
+        }
+
+      /* the hash index follows the index entries, move it along with them */
+      gsize prev_slots = nv_table_get_hash_index_slots(self);
+      gsize move_size = (self->index_size - ndx) * sizeof(index_table[0]) + nv_table_get_hash_index_size(self);
+      if (move_size)
+        {
+          memmove(&index_table[ndx + 1], &index_table[ndx], move_size);
         }
 
       *index_entry = &index_table[ndx];
@@ -312,8 +434,8 @@ nv_table_reserve_table_entry(NVTable *self, NVHandle handle, NVIndexEntry **inde
          be found even if the slot is present in index */
       (**index_entry).handle = handle;
       (**index_entry).ofs    = 0;
-      if (!found)
-        self->index_size++;
+      self->index_size++;
+      nv_table_update_hash_index(self, ndx, prev_slots);
     }
   return TRUE;
 }
@@ -635,12 +757,109 @@ nv_table_foreach_entry(NVTable *self, NVTableForeachEntryFunc func, gpointer use
   return FALSE;
 }
 
+/*
+ * Layered NVTables
+ *
+ * An NVTable may be used as a delta on top of another (base) NVTable,
+ * which is shared with other users and is not modified.  An entry in the
+ * delta hides the entry of the base with the same handle, including unset
+ * entries.  The delta must not contain indirect values that refer to
+ * values in the base table, as those are resolved within the same table.
+ */
+gboolean
+nv_table_foreach_layered(NVTable *self, NVTable *base, NVRegistry *registry, NVTableForeachFunc func,
+                         gpointer user_data)
+{
+  gpointer data[4] = { NULL, registry, func, user_data };
+  NVIndexEntry *index_table = nv_table_get_index(self);
+  NVIndexEntry *base_index_table = nv_table_get_index(base);
+  NVEntry *entry;
+  NVHandle handle;
+  gint i, j;
+
+  for (i = 0; i < MAX(self->num_static_entries, base->num_static_entries); i++)
+    {
+      if (i < self->num_static_entries && self->static_entries[i])
+        {
+          data[0] = self;
+          entry = nv_table_get_entry_at_ofs(self, self->static_entries[i]);
+        }
+      else if (i < base->num_static_entries)
+        {
+          data[0] = base;
+          entry = nv_table_get_entry_at_ofs(base, base->static_entries[i]);
+        }
+      else
+        continue;
+
+      if (entry && nv_table_call_foreach(i + 1, entry, NULL, data))
+        return TRUE;
+    }
+
+  /* both indexes are sorted by handle, merge them */
+  i = j = 0;
+  while (i < self->index_size || j < base->index_size)
+    {
+      if (j >= base->index_size || (i < self->index_size && index_table[i].handle <= base_index_table[j].handle))
+        {
+          if (j < base->index_size && index_table[i].handle == base_index_table[j].handle)
+            j++;
+          data[0] = self;
+          handle = index_table[i].handle;
+          entry = nv_table_get_entry_at_ofs(self, index_table[i].ofs);
+          i++;
+        }
+      else
+        {
+          data[0] = base;
+          handle = base_index_table[j].handle;
+          entry = nv_table_get_entry_at_ofs(base, base_index_table[j].ofs);
+          j++;
+        }
+
+      if (entry && nv_table_call_foreach(handle, entry, NULL, data))
+        return TRUE;
+    }
+  return FALSE;
+}
+
+static gboolean
+nv_table_merge_entry(NVHandle handle, NVEntry *entry, NVIndexEntry *index_entry, gpointer user_data)
+{
+  NVTable *self = (NVTable *) ((gpointer *) user_data)[0];
+  NVTable **merged = (NVTable **) ((gpointer *) user_data)[1];
+  const gchar *value;
+  gssize value_len;
+
+  value = nv_table_resolve_entry(self, entry, &value_len);
+  while (!nv_table_add_value(*merged, handle, nv_entry_get_name(entry), entry->name_len, value, value_len, NULL))
+    {
+      if (!nv_table_realloc(*merged, merged))
+        return FALSE;
+    }
+  if (entry->unset)
+    nv_table_unset_value(*merged, handle);
+  return FALSE;
+}
+
+/* creates a self-contained copy of @self layered on top of @base */
+NVTable *
+nv_table_merge(NVTable *self, NVTable *base)
+{
+  NVTable *merged = nv_table_clone(base, self->used + self->index_size * sizeof(NVIndexEntry));
+  gpointer data[2] = { self, &merged };
+
+  nv_table_foreach_entry(self, nv_table_merge_entry, data);
+  return merged;
+}
+
 void
 nv_table_clear(NVTable *self)
 {
   g_assert(self->ref_cnt == 1);
   self->used = 0;
   self->index_size = 0;
+  self->indexed = FALSE;
   memset(&self->static_entries[0], 0, self->num_static_entries * sizeof(self->static_entries[0]));
 }
 
@@ -654,6 +873,7 @@ nv_table_init(NVTable *self, gsize alloc_length, gint num_static_entries)
   self->num_static_entries = num_static_entries;
   self->ref_cnt = 1;
   self->borrowed = FALSE;
+  self->indexed = FALSE;
   memset(&self->static_entries[0], 0, self->num_static_entries * sizeof(self->static_entries[0]));
 }
 
@@ -710,9 +930,8 @@ nv_table_realloc(NVTable *self, NVTable **new)
     {
       *new = g_malloc(new_size);
 
-      /* we only copy the header first */
-      memcpy(*new, self, sizeof(NVTable) + self->num_static_entries * sizeof(self->static_entries[0]) + self->index_size *
-             sizeof(NVIndexEntry));
+      /* we only copy the header first, along with the hash index */
+      memcpy(*new, self, nv_table_get_ofs_table_top(self) - (gchar *) self);
       (*new)->ref_cnt = 1;
       (*new)->borrowed = FALSE;
       (*new)->size = new_size;
@@ -764,8 +983,7 @@ nv_table_clone(NVTable *self, gint additional_space)
     new_size = NV_TABLE_MAX_BYTES;
 
   new = g_malloc(new_size);
-  memcpy(new, self, sizeof(NVTable) + self->num_static_entries * sizeof(self->static_entries[0]) + self->index_size *
-         sizeof(NVIndexEntry));
+  memcpy(new, self, nv_table_get_ofs_table_top(self) - (gchar *) self);
   new->size = new_size;
   new->ref_cnt = 1;
   new->borrowed = FALSE;
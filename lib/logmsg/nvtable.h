@@ -174,7 +174,7 @@ nv_entry_get_name(NVEntry *self)
  * Memory layout:
  * =============
  *
- *  || struct || static value offsets || dynamic value (id, offset) pairs || <free space> || stored (name, value)  ||
+ *  || struct || static value offsets || dynamic value (id, offset) pairs || <hash index> || <free space> || stored (name, value)  ||
  *
  * Name value area:
  *   - the name-value area grows down (e.g. lower addresses) from the end of the struct
@@ -190,6 +190,16 @@ nv_entry_get_name(NVEntry *self)
  *   - a dynamically sized NVIndexEntry array (contains ID + offset)
  *   - dynamic values are sorted by the global ID to make handle->entry lookups fast
  *
+ * Hash index:
+ *   - once the number of dynamic values reaches NV_TABLE_HASH_INDEX_THRESHOLD,
+ *     an open-addressing hash table of guint16 slots is built right after the
+ *     dynamic value array, each slot contains an index position + 1 (or
+ *     zero if the slot is empty)
+ *   - it is only a cache of the dynamic value array, it is not serialized,
+ *     and it is dropped whenever it would not fit into the free space
+ *   - it is only built and maintained when adding values, lookups never
+ *     modify the NVTable, so that they remain safe to be done in parallel
+ *
  * Memory allocation
  * =================
  *   - the memory used by NVTable is managed by the caller, sometimes it is
@@ -231,8 +241,9 @@ struct _NVTable
    * versions, but index_size is a more descriptive name */
   guint16 index_size;
   guint8 num_static_entries;
-  guint8 ref_cnt:7,
-         borrowed:1; /* specifies if the memory used by NVTable was borrowed from the container struct */
+  guint8 ref_cnt:6,
+         borrowed:1, /* specifies if the memory used by NVTable was borrowed from the container struct */
+         indexed:1;  /* the hash index follows the dynamic value array */
 
   /* variable data, see memory layout in the comment above */
   union
@@ -254,6 +265,9 @@ struct _NVTable
  * static values */
 #define NV_TABLE_MIN_BYTES  128
 
+/* dynamic values are looked up using the hash index above this many entries */
+#define NV_TABLE_HASH_INDEX_THRESHOLD  32
+
 gboolean nv_table_add_value(NVTable *self, NVHandle handle, const gchar *name, gsize name_len, const gchar *value,
                             gsize value_len, gboolean *new_entry);
 void nv_table_unset_value(NVTable *self, NVHandle handle);
@@ -262,6 +276,9 @@ gboolean nv_table_add_value_indirect(NVTable *self, NVHandle handle, const gchar
 
 gboolean nv_table_foreach(NVTable *self, NVRegistry *registry, NVTableForeachFunc func, gpointer user_data);
 gboolean nv_table_foreach_entry(NVTable *self, NVTableForeachEntryFunc func, gpointer user_data);
+gboolean nv_table_foreach_layered(NVTable *self, NVTable *base, NVRegistry *registry, NVTableForeachFunc func,
+                                  gpointer user_data);
+NVTable *nv_table_merge(NVTable *self, NVTable *base);
 
 void nv_table_clear(NVTable *self);
 NVTable *nv_table_new(gint num_static_values, gint index_size_hint, gint init_length);
@@ -298,11 +315,27 @@ nv_table_get_bottom(NVTable *self)
   return nv_table_get_top(self) - self->used;
 }
 
+/* the number of slots is kept at least twice the number of dynamic values */
+static inline gsize
+nv_table_get_hash_index_slots(NVTable *self)
+{
+  return MAX(2 * NV_TABLE_HASH_INDEX_THRESHOLD, 1 << (g_bit_storage(self->index_size) + 1));
+}
+
+static inline gsize
+nv_table_get_hash_index_size(NVTable *self)
+{
+  if (!self->indexed)
+    return 0;
+  return nv_table_get_hash_index_slots(self) * sizeof(guint16);
+}
+
 static inline gchar *
 nv_table_get_ofs_table_top(NVTable *self)
 {
   return (gchar *) &self->data[self->num_static_entries * sizeof(self->static_entries[0]) +
-                               self->index_size * sizeof(NVIndexEntry)];
+                               self->index_size * sizeof(NVIndexEntry) +
+                               nv_table_get_hash_index_size(self)];
 }
 
 static inline gboolean
@@ -526,3 +526,111 @@ Test(log_message, when_get_indirect_value_with_null_value_len_abort_instead_of_s
 
   log_message_test_params_free(params);
 }
+
+static LogMessage *
+_construct_message_with_large_payload(void)
+{
+  LogMessage *msg = log_msg_new_empty();
+  gchar name[32], value[32];
+
+  for (gint i = 0; i < 64; i++)
+    {
+      g_snprintf(name, sizeof(name), "key%d", i);
+      g_snprintf(value, sizeof(value), "value%d", i);
+      log_msg_set_value_by_name(msg, name, value, -1);
+    }
+  return msg;
+}
+
+static gboolean
+_count_value(NVHandle handle, const gchar *name, const gchar *value, gssize value_len, gpointer user_data)
+{
+  gint *count = (gint *) user_data;
+
+  if (strncmp(name, "key", 3) == 0)
+    (*count)++;
+  return FALSE;
+}
+
+static gint
+_count_key_values(LogMessage *msg)
+{
+  gint count = 0;
+
+  log_msg_values_foreach(msg, _count_value, &count);
+  return count;
+}
+
+Test(log_message, test_clone_of_a_large_payload_stores_changes_in_a_delta)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg = _construct_message_with_large_payload();
+  LogMessage *clone = log_msg_clone_cow(msg, &path_options);
+
+  log_msg_set_value_by_name(clone, "key1", "changed", -1);
+  log_msg_set_value_by_name(clone, "newkey", "newvalue", -1);
+  log_msg_unset_value_by_name(clone, "key2");
+  log_msg_set_value_indirect(clone, log_msg_get_value_handle("key3ref"), log_msg_get_value_handle("key3"), 0, 1, 3);
+
+  cr_assert(clone->payload_base == msg->payload);
+  cr_assert_str_eq(log_msg_get_value_by_name(clone, "key0", NULL), "value0");
+  cr_assert_str_eq(log_msg_get_value_by_name(clone, "key1", NULL), "changed");
+  cr_assert_str_eq(log_msg_get_value_by_name(clone, "newkey", NULL), "newvalue");
+  cr_assert_str_empty(log_msg_get_value_by_name(clone, "key2", NULL));
+  cr_assert_str_eq(log_msg_get_value_by_name(clone, "key3ref", NULL), "alu");
+  cr_assert_eq(_count_key_values(clone), 64);
+
+  cr_assert_str_eq(log_msg_get_value_by_name(msg, "key1", NULL), "value1");
+  cr_assert_str_eq(log_msg_get_value_by_name(msg, "key2", NULL), "value2");
+  cr_assert_str_empty(log_msg_get_value_by_name(msg, "newkey", NULL));
+  cr_assert_eq(_count_key_values(msg), 64);
+
+  log_msg_unref(clone);
+  log_msg_unref(msg);
+}
+
+Test(log_message, test_clone_of_a_clone_with_delta_shares_the_same_base)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg = _construct_message_with_large_payload();
+  LogMessage *clone = log_msg_clone_cow(msg, &path_options);
+  LogMessage *clone_of_clone;
+
+  log_msg_set_value_by_name(clone, "key1", "changed", -1);
+  clone_of_clone = log_msg_clone_cow(clone, &path_options);
+  log_msg_set_value_by_name(clone_of_clone, "key1", "changed again", -1);
+
+  cr_assert(clone_of_clone->payload_base == msg->payload);
+  cr_assert_str_eq(log_msg_get_value_by_name(clone_of_clone, "key1", NULL), "changed again");
+  cr_assert_str_eq(log_msg_get_value_by_name(clone, "key1", NULL), "changed");
+  cr_assert_str_eq(log_msg_get_value_by_name(clone_of_clone, "key63", NULL), "value63");
+
+  log_msg_unref(clone_of_clone);
+  log_msg_unref(clone);
+  log_msg_unref(msg);
+}
+
+Test(log_message, test_delta_is_merged_into_a_copy_of_the_base_when_it_grows_large)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg = _construct_message_with_large_payload();
+  LogMessage *clone = log_msg_clone_cow(msg, &path_options);
+  gchar name[32];
+
+  log_msg_unset_value_by_name(clone, "key0");
+  for (gint i = 1; i < 64; i++)
+    {
+      g_snprintf(name, sizeof(name), "key%d", i);
+      log_msg_set_value_by_name(clone, name, "a considerably longer value than the original", -1);
+    }
+
+  cr_assert_null(clone->payload_base);
+  cr_assert_str_empty(log_msg_get_value_by_name(clone, "key0", NULL));
+  cr_assert_str_eq(log_msg_get_value_by_name(clone, "key63", NULL), "a considerably longer value than the original");
+  cr_assert_eq(_count_key_values(clone), 63);
+  cr_assert_str_eq(log_msg_get_value_by_name(msg, "key0", NULL), "value0");
+  cr_assert_str_eq(log_msg_get_value_by_name(msg, "key63", NULL), "value63");
+
+  log_msg_unref(clone);
+  log_msg_unref(msg);
+}
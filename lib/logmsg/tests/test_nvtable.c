@@ -867,6 +867,80 @@ Test(nvtable, test_nvtable_lookup)
     }
 }
 
+static void
+_assert_dynamic_values(NVTable *tab, gint first, gint last)
+{
+  gchar name[16];
+  NVHandle handle;
+
+  for (handle = first; handle <= last; handle++)
+    {
+      g_snprintf(name, sizeof(name), "VAL%d", handle);
+      assert_nvtable(tab, handle, name, strlen(name));
+    }
+  cr_assert_not(nv_table_is_value_set(tab, first - 1));
+  cr_assert_not(nv_table_is_value_set(tab, last + 1));
+}
+
+Test(nvtable, test_nvtable_hash_index)
+{
+  NVTable *tab, *tab_clone;
+  NVHandle handle;
+  gchar name[16];
+  gboolean success;
+
+  tab = nv_table_new(STATIC_VALUES, STATIC_VALUES, 65536);
+
+  /* insert in descending order, so that every new entry goes to the front */
+  for (handle = 2 * STATIC_VALUES + 300; handle > 2 * STATIC_VALUES; handle--)
+    {
+      g_snprintf(name, sizeof(name), "VAL%d", handle);
+      success = nv_table_add_value(tab, handle, name, strlen(name), name, strlen(name), NULL);
+      cr_assert(success);
+      cr_assert_eq(tab->indexed, tab->index_size >= NV_TABLE_HASH_INDEX_THRESHOLD);
+    }
+  _assert_dynamic_values(tab, 2 * STATIC_VALUES + 1, 2 * STATIC_VALUES + 300);
+
+  /* the hash index is carried over to clones */
+  tab_clone = nv_table_clone(tab, 64);
+  cr_assert(tab_clone->indexed);
+  _assert_dynamic_values(tab_clone, 2 * STATIC_VALUES + 1, 2 * STATIC_VALUES + 300);
+  nv_table_unref(tab_clone);
+
+  nv_table_clear(tab);
+  cr_assert_not(tab->indexed);
+  cr_assert_not(nv_table_is_value_set(tab, 2 * STATIC_VALUES + 1));
+  nv_table_unref(tab);
+}
+
+Test(nvtable, test_nvtable_hash_index_gives_up_its_space_when_the_table_is_full)
+{
+  NVTable *tab;
+  NVHandle handle;
+  gchar name[16];
+
+  tab = nv_table_new(STATIC_VALUES, STATIC_VALUES, 4096);
+  for (handle = STATIC_VALUES + 1; ; handle++)
+    {
+      g_snprintf(name, sizeof(name), "VAL%d", handle);
+      if (!nv_table_add_value(tab, handle, name, strlen(name), name, strlen(name), NULL))
+        break;
+    }
+  cr_assert_not(tab->indexed);
+  cr_assert_gt(handle - STATIC_VALUES, NV_TABLE_HASH_INDEX_THRESHOLD);
+
+  /* the index is rebuilt by the next insertion */
+  cr_assert(nv_table_realloc(tab, &tab));
+  for (; handle < STATIC_VALUES + 150; handle++)
+    {
+      g_snprintf(name, sizeof(name), "VAL%d", handle);
+      cr_assert(nv_table_add_value(tab, handle, name, strlen(name), name, strlen(name), NULL));
+    }
+  cr_assert(tab->indexed);
+  _assert_dynamic_values(tab, STATIC_VALUES + 1, handle - 1);
+  nv_table_unref(tab);
+}
+
 Test(nvtable, test_nvtable_clone_grows_the_cloned_structure)
 {
   NVTable *tab, *tab_clone;
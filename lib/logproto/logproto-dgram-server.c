@@ -24,12 +24,24 @@
 #include "logproto-dgram-server.h"
 #include "logproto-buffered-server.h"
 
+#include <string.h>
+
+/* number of datagrams received by a single read_batch() call */
+#define LOG_PROTO_DGRAM_SERVER_BATCH_SIZE 16
+
 /* proto that reads the input in datagrams (e.g. the underlying transport
  * determines record sizes, such as UDP) */
 typedef struct _LogProtoDGramServer LogProtoDGramServer;
 struct _LogProtoDGramServer
 {
   LogProtoBufferedServer super;
+
+  /* datagrams received by the last read_batch() of the transport, handed
+   * out one by one by read_data() */
+  LogTransportDatagram *batch;
+  guchar *batch_buffer;
+  gint batch_len;
+  gint batch_pos;
 };
 
 static gboolean
@@ -48,13 +60,111 @@ log_proto_dgram_server_fetch_from_buffer(LogProtoBufferedServer *s, const guchar
   return TRUE;
 }
 
+static void
+log_proto_dgram_server_allocate_batch(LogProtoDGramServer *self)
+{
+  gsize datagram_size = self->super.super.options->init_buffer_size;
+  gint i;
+
+  self->batch = g_new0(LogTransportDatagram, LOG_PROTO_DGRAM_SERVER_BATCH_SIZE);
+  self->batch_buffer = g_malloc(LOG_PROTO_DGRAM_SERVER_BATCH_SIZE * datagram_size);
+  for (i = 0; i < LOG_PROTO_DGRAM_SERVER_BATCH_SIZE; i++)
+    {
+      self->batch[i].buf = self->batch_buffer + i * datagram_size;
+      self->batch[i].buflen = datagram_size;
+      log_transport_aux_data_init(&self->batch[i].aux);
+    }
+}
+
+static gint
+log_proto_dgram_server_fill_batch(LogProtoDGramServer *self)
+{
+  gint rc, i;
+
+  if (G_UNLIKELY(!self->batch))
+    log_proto_dgram_server_allocate_batch(self);
+
+  for (i = 0; i < self->batch_len; i++)
+    log_transport_aux_data_reinit(&self->batch[i].aux);
+
+  rc = log_transport_read_batch(self->super.super.transport, self->batch, LOG_PROTO_DGRAM_SERVER_BATCH_SIZE);
+  self->batch_pos = 0;
+  self->batch_len = MAX(rc, 0);
+  return rc;
+}
+
+/* serves the datagrams of a batch without further syscalls, the
+ * LogReader fetch loop keeps calling us until it reaches fetch_limit() */
+static gint
+log_proto_dgram_server_read_data(LogProtoBufferedServer *s, guchar *buf, gsize len, LogTransportAuxData *aux)
+{
+  LogProtoDGramServer *self = (LogProtoDGramServer *) s;
+
+  if (!log_transport_can_read_batch(s->super.transport))
+    return log_transport_read(s->super.transport, buf, len, aux);
+
+  while (1)
+    {
+      LogTransportDatagram *datagram;
+      gsize datagram_len;
+
+      if (self->batch_pos >= self->batch_len)
+        {
+          gint rc = log_proto_dgram_server_fill_batch(self);
+
+          if (rc <= 0)
+            return rc;
+        }
+
+      datagram = &self->batch[self->batch_pos++];
+
+      /* empty datagrams are skipped, just like the single read path does */
+      if (datagram->len == 0)
+        continue;
+
+      datagram_len = MIN(datagram->len, len);
+      memcpy(buf, datagram->buf, datagram_len);
+      if (aux)
+        log_transport_aux_data_copy(aux, &datagram->aux);
+      return datagram_len;
+    }
+}
+
+static gboolean
+log_proto_dgram_server_prepare(LogProtoServer *s, GIOCondition *cond)
+{
+  LogProtoDGramServer *self = (LogProtoDGramServer *) s;
+
+  log_proto_buffered_server_prepare(s, cond);
+  return self->batch_pos < self->batch_len;
+}
+
+static void
+log_proto_dgram_server_free(LogProtoServer *s)
+{
+  LogProtoDGramServer *self = (LogProtoDGramServer *) s;
+  gint i;
+
+  if (self->batch)
+    {
+      for (i = 0; i < LOG_PROTO_DGRAM_SERVER_BATCH_SIZE; i++)
+        log_transport_aux_data_destroy(&self->batch[i].aux);
+      g_free(self->batch);
+      g_free(self->batch_buffer);
+    }
+  log_proto_buffered_server_free_method(s);
+}
+
 LogProtoServer *
 log_proto_dgram_server_new(LogTransport *transport, const LogProtoServerOptions *options)
 {
   LogProtoDGramServer *self = g_new0(LogProtoDGramServer, 1);
 
   log_proto_buffered_server_init(&self->super, transport, options);
+  self->super.super.prepare = log_proto_dgram_server_prepare;
+  self->super.super.free_fn = log_proto_dgram_server_free;
   self->super.fetch_from_buffer = log_proto_dgram_server_fetch_from_buffer;
+  self->super.read_data = log_proto_dgram_server_read_data;
   self->super.stream_based = FALSE;
   return &self->super.super;
 }
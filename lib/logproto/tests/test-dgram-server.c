@@ -163,6 +163,35 @@ test_log_proto_dgram_server_eof_handling(void)
   log_proto_server_free(proto);
 }
 
+static void
+test_log_proto_dgram_server_read_batch(void)
+{
+  LogProtoServer *proto;
+  LogTransport *transport;
+  gchar expected[16];
+  gint i;
+
+  proto_server_options.max_msg_size = 32;
+  transport = log_transport_mock_endless_records_new(
+                "msg00", -1, "msg01", -1, "msg02", -1, "msg03", -1, "msg04", -1,
+                "msg05", -1, "msg06", -1, "msg07", -1, "msg08", -1, "msg09", -1,
+                "msg10", -1, "msg11", -1, "msg12", -1, "msg13", -1, "msg14", -1,
+                "msg15", -1, "msg16", -1, "msg17", -1, "msg18", -1, "msg19", -1,
+                LTM_EOF);
+  log_transport_mock_enable_read_batch(transport);
+  proto = log_proto_dgram_server_new(transport, get_inited_proto_server_options());
+
+  /* more records than fit into a single batch, each of them is returned
+   * by a single fetch as the mock injects no EAGAIN within a batch */
+  for (i = 0; i < 20; i++)
+    {
+      g_snprintf(expected, sizeof(expected), "msg%02d", i);
+      assert_proto_server_fetch_single_read(proto, expected, -1);
+    }
+  assert_proto_server_fetch_single_read(proto, NULL, -1);
+  log_proto_server_free(proto);
+}
+
 void
 test_log_proto_dgram_server(void)
 {
@@ -171,4 +200,5 @@ test_log_proto_dgram_server(void)
   PROTO_TESTCASE(test_log_proto_dgram_server_invalid_ucs4);
   PROTO_TESTCASE(test_log_proto_dgram_server_iso_8859_2);
   PROTO_TESTCASE(test_log_proto_dgram_server_eof_handling);
+  PROTO_TESTCASE(test_log_proto_dgram_server_read_batch);
 }
@@ -24,6 +24,7 @@
 #include "logproto/logproto-server.h"
 #include "logmsg/logmsg.h"
 #include <stdlib.h>
+#include <string.h>
 
 static void
 testcase(const gchar *msg_, gsize msg_len, gint eom_ofs)
@@ -48,6 +49,25 @@ testcase(const gchar *msg_, gsize msg_len, gint eom_ofs)
     }
 }
 
+/* cover terminators at every offset of the vectorized code paths */
+static void
+test_long_buffers(void)
+{
+  gchar msg[160];
+  gint eom_ofs;
+
+  for (eom_ofs = 0; eom_ofs < sizeof(msg); eom_ofs++)
+    {
+      memset(msg, 'a', sizeof(msg));
+      msg[eom_ofs] = '\n';
+      testcase(msg, sizeof(msg), eom_ofs);
+      testcase(msg, eom_ofs, -1);
+
+      msg[eom_ofs] = '\0';
+      testcase(msg, sizeof(msg), eom_ofs);
+    }
+}
+
 int
 main(void)
 {
@@ -104,5 +124,7 @@ main(void)
   testcase("abcdefghijklmnopqrstuvwx", 24, -1);
   testcase("abcdefghijklmnopqrstuvwxy", 25, -1);
   testcase("abcdefghijklmnopqrstuvwxyz", 26, -1);
+
+  test_long_buffers();
   return 0;
 }
@@ -43,27 +43,37 @@ const QueueType log_queue_fifo_type = "FIFO";
  *
  *   - has a per-thread, unlocked input queue where threads can put their items
  *
- *   - has a locked wait-queue where items go once the per-thread input
- *     would be overflown or if the input thread goes to sleep (e.g.  one
- *     lock acquisition per a longer period)
+ *   - has a lock-free, multi-producer/single-consumer wait-queue where
+ *     the contents of the per-thread input queue go as a single batch once
+ *     the input thread goes to sleep
  *
  *   - has an unlocked output queue where items from the wait queue go, once
  *     it becomes depleted.
  *
  * This means that items flow in this sequence from one list to the next:
  *
- *    input queue (per-thread) -> wait queue (locked) -> output queue (single-threaded)
+ *    input queue (per-thread) -> wait queue (lock-free) -> output queue (single-threaded)
  *
  * Fastpath is:
  *   - input threads putting elements on their per-thread queue (lockless)
  *   - output threads removing elements from the output queue (lockless)
  *
  * Slowpath:
- *   - input queue is overflown (or the input thread goes to sleep), wait
- *     queue mutex is grabbed, all elements are put to the wait queue.
+ *   - the input thread goes to sleep, its input queue is wrapped into a
+ *     batch, which is pushed to the wait queue with a compare-and-swap.
  *
- *   - output queue is depleted, wait queue mutex is grabbed, all elements
- *     on the wait queue is put to the output queue
+ *   - output queue is depleted, the output thread takes all batches from
+ *     the wait queue with a single compare-and-swap and splices them to
+ *     the output queue in the order they were pushed.
+ *
+ * The wait queue is a stack of batches, since batches are pushed to its
+ * top, the output thread reverses the stack after taking it.  As each
+ * input thread pushes its batches in order, this keeps the per-thread
+ * ordering of messages.
+ *
+ * LogQueue->lock is only taken to synchronize with the output thread
+ * registering its parallel_push_notify callback, and only if such a
+ * callback is registered.
  *
  * Threading assumptions:
  *   - the head of the queue is only manipulated from the output thread
@@ -71,6 +81,14 @@ const QueueType log_queue_fifo_type = "FIFO";
  *
  */
 
+typedef struct _LogQueueFifoBatch LogQueueFifoBatch;
+struct _LogQueueFifoBatch
+{
+  LogQueueFifoBatch *next;
+  struct iv_list_head items;
+  gint len;
+};
+
 
 typedef struct _LogQueueFifo
 {
@@ -78,7 +96,7 @@ typedef struct _LogQueueFifo
 
   /* scalable qoverflow implementation */
   struct iv_list_head qoverflow_output;
-  struct iv_list_head qoverflow_wait;
+  LogQueueFifoBatch *qoverflow_wait;
   gint qoverflow_wait_len;
   gint qoverflow_output_len;
   gint qoverflow_size; /* in number of elements */
@@ -95,14 +113,6 @@ typedef struct _LogQueueFifo
   } qoverflow_input[0];
 } LogQueueFifo;
 
-/* NOTE: this is inherently racy. If the LogQueue->lock is taken, then the
- * race is limited to the changes in qoverflow_output queue changes.
- *
- * In the output thread, this means that this can get race-free. In the
- * input thread, the qoverflow_output can change because of a
- * log_queue_fifo_push_head() or log_queue_fifo_rewind_backlog().
- *
- */
 
 static void
 iv_list_update_msg_size(LogQueueFifo *self, struct iv_list_head *head)
@@ -116,12 +126,24 @@ iv_list_update_msg_size(LogQueueFifo *self, struct iv_list_head *head)
   }
 }
 
+/* NOTE: this is inherently racy. The race is limited to the changes in
+ * qoverflow_output queue changes, as qoverflow_wait_len is updated
+ * atomically.
+ *
+ * In the output thread, this means that this can get race-free. In the
+ * input thread, the qoverflow_output can change because of a
+ * log_queue_fifo_push_head() or log_queue_fifo_rewind_backlog().
+ *
+ * qoverflow_wait_len is increased before a batch is pushed to the wait
+ * queue and decreased after the batch was taken by the output thread, so
+ * it never underestimates the number of items there.
+ */
 static gint64
 log_queue_fifo_get_length(LogQueue *s)
 {
   LogQueueFifo *self = (LogQueueFifo *) s;
 
-  return self->qoverflow_wait_len + self->qoverflow_output_len;
+  return g_atomic_int_get(&self->qoverflow_wait_len) + self->qoverflow_output_len;
 }
 
 gboolean
@@ -129,7 +151,7 @@ log_queue_fifo_is_empty_racy(LogQueue *s)
 {
   LogQueueFifo *self = (LogQueueFifo *) s;
   gboolean has_message_in_queue = FALSE;
-  g_static_mutex_lock(&self->super.lock);
+
   if (log_queue_fifo_get_length(s) > 0)
     {
       has_message_in_queue = TRUE;
@@ -142,7 +164,6 @@ log_queue_fifo_is_empty_racy(LogQueue *s)
           has_message_in_queue |= self->qoverflow_input[i].finish_cb_registered;
         }
     }
-  g_static_mutex_unlock(&self->super.lock);
   return !has_message_in_queue;
 }
 
@@ -154,10 +175,78 @@ log_queue_fifo_keep_on_reload(LogQueue *s)
   return log_queue_fifo_get_length(s) > 0 || self->qbacklog_len > 0;
 }
 
-/* move items from the per-thread input queue to the lock-protected "wait" queue */
+/* push a batch of items to the wait queue, can be called from any thread */
+static void
+log_queue_fifo_push_wait_batch(LogQueueFifo *self, LogQueueFifoBatch *batch)
+{
+  LogQueueFifoBatch *top;
+
+  g_atomic_int_add(&self->qoverflow_wait_len, batch->len);
+  do
+    {
+      top = g_atomic_pointer_get(&self->qoverflow_wait);
+      batch->next = top;
+    }
+  while (!g_atomic_pointer_compare_and_exchange(&self->qoverflow_wait, top, batch));
+}
+
+/* move all items from the wait queue to the output queue, can only run
+ * from the output thread */
+static void
+log_queue_fifo_move_wait_to_output(LogQueueFifo *self)
+{
+  LogQueueFifoBatch *batches, *reversed = NULL;
+  gint len = 0;
+
+  do
+    {
+      batches = g_atomic_pointer_get(&self->qoverflow_wait);
+      if (!batches)
+        return;
+    }
+  while (!g_atomic_pointer_compare_and_exchange(&self->qoverflow_wait, batches, NULL));
+
+  /* batches were pushed to the top of the stack, restore the order they came in */
+  while (batches)
+    {
+      LogQueueFifoBatch *next = batches->next;
+
+      batches->next = reversed;
+      reversed = batches;
+      batches = next;
+    }
+
+  while (reversed)
+    {
+      LogQueueFifoBatch *next = reversed->next;
+
+      iv_list_splice_tail_init(&reversed->items, &self->qoverflow_output);
+      len += reversed->len;
+      g_free(reversed);
+      reversed = next;
+    }
+  self->qoverflow_output_len += len;
+  g_atomic_int_add(&self->qoverflow_wait_len, -len);
+}
+
+/* wake up the output thread if it is waiting for items, the lock is only
+ * needed to synchronize with log_queue_check_items() */
+static void
+log_queue_fifo_push_notify(LogQueueFifo *self)
+{
+  if (!g_atomic_pointer_get(&self->super.parallel_push_notify))
+    return;
+
+  g_static_mutex_lock(&self->super.lock);
+  log_queue_push_notify(&self->super);
+  g_static_mutex_unlock(&self->super.lock);
+}
+
+/* move items from the per-thread input queue to the lock-free "wait" queue */
 static void
 log_queue_fifo_move_input_unlocked(LogQueueFifo *self, gint thread_id)
 {
+  LogQueueFifoBatch *batch;
   gint queue_len;
 
   /* since we're in the input thread, queue_len will be racy. It can
@@ -208,18 +297,24 @@ log_queue_fifo_move_input_unlocked(LogQueueFifo *self, gint thread_id)
                 evt_tag_int("count", n),
                 evt_tag_str("persist_name", self->super.persist_name));
     }
+  if (self->qoverflow_input[thread_id].len == 0)
+    return;
+
   stats_counter_add(self->super.queued_messages, self->qoverflow_input[thread_id].len);
   iv_list_update_msg_size(self, &self->qoverflow_input[thread_id].items);
 
-  iv_list_splice_tail_init(&self->qoverflow_input[thread_id].items, &self->qoverflow_wait);
-  self->qoverflow_wait_len += self->qoverflow_input[thread_id].len;
+  batch = g_new(LogQueueFifoBatch, 1);
+  INIT_IV_LIST_HEAD(&batch->items);
+  iv_list_splice_tail_init(&self->qoverflow_input[thread_id].items, &batch->items);
+  batch->len = self->qoverflow_input[thread_id].len;
   self->qoverflow_input[thread_id].len = 0;
+
+  log_queue_fifo_push_wait_batch(self, batch);
 }
 
-/* move items from the per-thread input queue to the lock-protected
- * "wait" queue, but grabbing locks first. This is registered as a
- * callback to be called when the input worker thread finishes its
- * job.
+/* move items from the per-thread input queue to the "wait" queue and
+ * notify the output thread. This is registered as a callback to be called
+ * when the input worker thread finishes its job.
  */
 static gpointer
 log_queue_fifo_move_input(gpointer user_data)
@@ -231,10 +326,8 @@ log_queue_fifo_move_input(gpointer user_data)
 
   g_assert(thread_id >= 0);
 
-  g_static_mutex_lock(&self->super.lock);
   log_queue_fifo_move_input_unlocked(self, thread_id);
-  log_queue_push_notify(&self->super);
-  g_static_mutex_unlock(&self->super.lock);
+  log_queue_fifo_push_notify(self);
   self->qoverflow_input[thread_id].finish_cb_registered = FALSE;
   log_queue_unref(&self->super);
   return NULL;
@@ -297,30 +390,28 @@ log_queue_fifo_push_tail(LogQueue *s, LogMessage *msg, const LogPathOptions *pat
       return;
     }
 
-  /* slow path, put the pending item and the whole input queue to the wait_queue */
-
-  g_static_mutex_lock(&self->super.lock);
-
-  if (thread_id >= 0)
-    log_queue_fifo_move_input_unlocked(self, thread_id);
+  /* slow path, put the pending item to the wait_queue as a batch on its
+   * own. The length check is racy, just like in the fast path. */
 
   if (log_queue_fifo_get_length(s) < self->qoverflow_size)
     {
+      LogQueueFifoBatch *batch = g_new(LogQueueFifoBatch, 1);
+
       node = log_msg_alloc_queue_node(msg, path_options);
+      INIT_IV_LIST_HEAD(&batch->items);
+      iv_list_add_tail(&node->list, &batch->items);
+      batch->len = 1;
 
-      iv_list_add_tail(&node->list, &self->qoverflow_wait);
-      self->qoverflow_wait_len++;
-      log_queue_push_notify(&self->super);
       stats_counter_inc(self->super.queued_messages);
       stats_counter_add(self->super.memory_usage, log_msg_get_size(msg));
-      g_static_mutex_unlock(&self->super.lock);
+      log_queue_fifo_push_wait_batch(self, batch);
+      log_queue_fifo_push_notify(self);
 
       log_msg_unref(msg);
     }
   else
     {
       stats_counter_inc(self->super.dropped_messages);
-      g_static_mutex_unlock(&self->super.lock);
 
       if (path_options->flow_control_requested)
         log_msg_drop(msg, path_options, AT_SUSPENDED);
@@ -376,11 +467,7 @@ log_queue_fifo_pop_head(LogQueue *s, LogPathOptions *path_options)
   if (self->qoverflow_output_len == 0)
     {
       /* slow path, output queue is empty, get some elements from the wait queue */
-      g_static_mutex_lock(&self->super.lock);
-      iv_list_splice_tail_init(&self->qoverflow_wait, &self->qoverflow_output);
-      self->qoverflow_output_len = self->qoverflow_wait_len;
-      self->qoverflow_wait_len = 0;
-      g_static_mutex_unlock(&self->super.lock);
+      log_queue_fifo_move_wait_to_output(self);
     }
 
   if (self->qoverflow_output_len > 0)
@@ -534,7 +621,7 @@ log_queue_fifo_free(LogQueue *s)
       log_queue_fifo_free_queue(&self->qoverflow_input[i].items);
     }
 
-  log_queue_fifo_free_queue(&self->qoverflow_wait);
+  log_queue_fifo_move_wait_to_output(self);
   log_queue_fifo_free_queue(&self->qoverflow_output);
   log_queue_fifo_free_queue(&self->qbacklog);
   log_queue_free_method(s);
@@ -570,7 +657,6 @@ log_queue_fifo_new(gint qoverflow_size, const gchar *persist_name)
       self->qoverflow_input[i].cb.func = log_queue_fifo_move_input;
       self->qoverflow_input[i].cb.user_data = self;
     }
-  INIT_IV_LIST_HEAD(&self->qoverflow_wait);
   INIT_IV_LIST_HEAD(&self->qoverflow_output);
   INIT_IV_LIST_HEAD(&self->qbacklog);
 
@@ -104,11 +104,20 @@ log_queue_check_items(LogQueue *self, gint *timeout, LogQueuePushNotifyFunc para
   num_elements = log_queue_get_length(self);
   if (num_elements == 0)
     {
-      self->parallel_push_notify = parallel_push_notify;
       self->parallel_push_data = user_data;
       self->parallel_push_data_destroy = user_data_destroy;
-      g_static_mutex_unlock(&self->lock);
-      return FALSE;
+      g_atomic_pointer_set(&self->parallel_push_notify, parallel_push_notify);
+
+      /* producers may push items without taking the lock (see
+       * LogQueueFifo), and only look for the callback after the items
+       * are counted, so either they notice the callback or we notice
+       * the items here */
+      num_elements = log_queue_get_length(self);
+      if (num_elements == 0)
+        {
+          g_static_mutex_unlock(&self->lock);
+          return FALSE;
+        }
     }
 
   /* consume the user_data reference as we won't use the callback */
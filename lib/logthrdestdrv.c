@@ -25,6 +25,7 @@
 #include "stats/stats-cluster-logpipe.h"
 #include "logthrdestdrv.h"
 #include "seqnum.h"
+#include "scratch-buffers.h"
 
 #define MAX_RETRIES_OF_FAILED_INSERT_DEFAULT 3
 
@@ -39,27 +40,53 @@ log_threaded_dest_driver_format_seqnum_for_persist(LogThrDestDriver *self)
   return persist_name;
 }
 
+/* the first worker uses the persist name of the driver, so that queues
+ * persisted by earlier versions (or with workers(1)) are picked up */
+static const gchar *
+log_threaded_dest_driver_format_queue_persist_name(LogThrDestDriver *self, gint worker_index)
+{
+  static gchar persist_name[1024];
+  const gchar *driver_persist_name = self->super.super.super.generate_persist_name((const LogPipe *)self);
+
+  if (worker_index == 0)
+    return driver_persist_name;
+
+  g_snprintf(persist_name, sizeof(persist_name), "%s.%d", driver_persist_name, worker_index);
+  return persist_name;
+}
+
+static gchar *
+log_threaded_dest_driver_format_workers_for_persist(LogThrDestDriver *self)
+{
+  static gchar persist_name[256];
+
+  g_snprintf(persist_name, sizeof(persist_name), "%s.workers",
+             self->super.super.super.generate_persist_name((const LogPipe *)self));
+
+  return persist_name;
+}
+
 static void
-log_threaded_dest_driver_suspend(LogThrDestDriver *self)
+log_threaded_dest_worker_suspend(LogThrDestWorker *self)
 {
   iv_validate_now();
   self->timer_reopen.expires  = iv_now;
-  self->timer_reopen.expires.tv_sec += self->time_reopen;
+  self->timer_reopen.expires.tv_sec += self->owner->time_reopen;
   iv_timer_register(&self->timer_reopen);
 }
 
 static void
-log_threaded_dest_driver_message_became_available_in_the_queue(gpointer user_data)
+log_threaded_dest_worker_message_became_available_in_the_queue(gpointer user_data)
 {
-  LogThrDestDriver *self = (LogThrDestDriver *) user_data;
-  if (!self->under_termination)
+  LogThrDestWorker *self = (LogThrDestWorker *) user_data;
+  if (!self->owner->under_termination)
     iv_event_post(&self->wake_up_event);
 }
 
 static void
-log_threaded_dest_driver_wake_up(gpointer data)
+log_threaded_dest_worker_wake_up(gpointer data)
 {
-  LogThrDestDriver *self = (LogThrDestDriver *)data;
+  LogThrDestWorker *self = (LogThrDestWorker *)data;
 
   if (!iv_task_registered(&self->do_work))
     {
@@ -68,13 +95,13 @@ log_threaded_dest_driver_wake_up(gpointer data)
 }
 
 static void
-log_threaded_dest_driver_start_watches(LogThrDestDriver *self)
+log_threaded_dest_worker_start_watches(LogThrDestWorker *self)
 {
   iv_task_register(&self->do_work);
 }
 
 static void
-log_threaded_dest_driver_stop_watches(LogThrDestDriver *self)
+log_threaded_dest_worker_stop_watches(LogThrDestWorker *self)
 {
   if (iv_task_registered(&self->do_work))
     {
@@ -91,154 +118,373 @@ log_threaded_dest_driver_stop_watches(LogThrDestDriver *self)
 }
 
 static void
-log_threaded_dest_driver_shutdown(gpointer data)
+log_threaded_dest_worker_shutdown(gpointer data)
 {
-  LogThrDestDriver *self = (LogThrDestDriver *)data;
-  log_threaded_dest_driver_stop_watches(self);
+  LogThrDestWorker *self = (LogThrDestWorker *)data;
+  log_threaded_dest_worker_stop_watches(self);
+  if (iv_timer_registered(&self->timer_flush))
+    {
+      iv_timer_unregister(&self->timer_flush);
+    }
   iv_quit();
 }
 
 
 static void
-__connect(LogThrDestDriver *self)
+__connect(LogThrDestWorker *self)
 {
-  self->worker.connected = TRUE;
-  if (self->worker.connect)
+  self->connected = TRUE;
+  if (self->connect)
     {
-      self->worker.connected = self->worker.connect(self);
+      self->connected = self->connect(self);
     }
 
-  if (!self->worker.connected)
+  if (!self->connected)
     {
       log_queue_reset_parallel_push(self->queue);
-      log_threaded_dest_driver_suspend(self);
+      log_threaded_dest_worker_suspend(self);
     }
   else
     {
-      log_threaded_dest_driver_start_watches(self);
+      log_threaded_dest_worker_start_watches(self);
     }
 }
 
+static void _rewind_batch(LogThrDestWorker *self);
+
 static void
-__disconnect(LogThrDestDriver *self)
+__disconnect(LogThrDestWorker *self)
 {
-  if (self->worker.disconnect)
+  if (self->disconnect)
     {
-      self->worker.disconnect(self);
+      self->disconnect(self);
     }
-  self->worker.connected = FALSE;
+  self->connected = FALSE;
+
+  /* requests that were in flight are abandoned by disconnect() */
+  if (self->pending_batches > 0)
+    _rewind_batch(self);
 }
 
 
 
 static void
-_disconnect_and_suspend(LogThrDestDriver *self)
+_disconnect_and_suspend(LogThrDestWorker *self)
 {
   self->suspended = TRUE;
   __disconnect(self);
   log_queue_reset_parallel_push(self->queue);
-  log_threaded_dest_driver_suspend(self);
+  log_threaded_dest_worker_suspend(self);
+}
+
+static void
+_step_sequence_number(LogThrDestWorker *self, gint count)
+{
+  gint i;
+
+  for (i = 0; i < count; i++)
+    {
+      if (self->owner->num_workers > 1)
+        step_sequence_number_atomic(&self->owner->seq_num);
+      else
+        step_sequence_number(&self->owner->seq_num);
+    }
+}
+
+static void
+_reset_batch(LogThrDestWorker *self)
+{
+  self->batch.lines = 0;
+  self->batch.bytes = 0;
+  if (iv_timer_registered(&self->timer_flush))
+    iv_timer_unregister(&self->timer_flush);
+}
+
+static gboolean
+_is_pipeline_full(LogThrDestWorker *self)
+{
+  return self->pending_batches >= self->max_pending_batches;
+}
+
+static void
+_ack_lines(LogThrDestWorker *self, gint lines)
+{
+  self->retries_counter = 0;
+  _step_sequence_number(self, lines);
+  log_queue_ack_backlog(self->queue, lines);
+}
+
+static void
+_accept_batch(LogThrDestWorker *self)
+{
+  _ack_lines(self, self->batch.lines);
+  _reset_batch(self);
+}
+
+static void
+_drop_batch(LogThrDestWorker *self)
+{
+  stats_counter_add(self->owner->dropped_messages, self->batch.lines);
+  _accept_batch(self);
+}
+
+/* outstanding batches precede the current one on the backlog, they are
+ * rewound together so that the original order is kept */
+static void
+_rewind_batch(LogThrDestWorker *self)
+{
+  log_queue_rewind_backlog(self->queue, self->pending_lines + self->batch.lines);
+  self->pending_batches = 0;
+  self->pending_lines = 0;
+  _reset_batch(self);
+}
+
+static void
+_pend_batch(LogThrDestWorker *self)
+{
+  self->pending_batches++;
+  self->pending_lines += self->batch.lines;
+  _reset_batch(self);
+}
+
+/* @msg is the message whose insert() produced @result, or NULL if the
+ * result comes from flush(); the result covers the whole batch */
+static void
+_process_result(LogThrDestWorker *self, worker_insert_result_t result, LogMessage *msg)
+{
+  LogThrDestDriver *owner = self->owner;
+
+  /* the current batch can't be acked ahead of the outstanding ones */
+  if (self->pending_batches > 0 && result != WORKER_INSERT_RESULT_PENDING)
+    result = WORKER_INSERT_RESULT_NOT_CONNECTED;
+
+  switch (result)
+    {
+    case WORKER_INSERT_RESULT_DROP:
+      msg_error("Message dropped while sending message to destination",
+                evt_tag_str("driver", owner->super.super.id),
+                evt_tag_int("worker_index", self->worker_index),
+                evt_tag_int("batch_size", self->batch.lines));
+
+      _drop_batch(self);
+      _disconnect_and_suspend(self);
+      break;
+
+    case WORKER_INSERT_RESULT_ERROR:
+    case WORKER_INSERT_RESULT_RETRY:
+      self->retries_counter++;
+
+      if (self->retries_counter >= owner->retries.max)
+        {
+          if (owner->messages.retry_over && msg)
+            owner->messages.retry_over(owner, msg);
+
+          msg_error("Multiple failures while sending message to destination, message dropped",
+                    evt_tag_str("driver", owner->super.super.id),
+                    evt_tag_int("worker_index", self->worker_index),
+                    evt_tag_int("batch_size", self->batch.lines),
+                    evt_tag_int("number_of_retries", owner->retries.max));
+
+          _drop_batch(self);
+        }
+      else
+        {
+          _rewind_batch(self);
+          if (result == WORKER_INSERT_RESULT_ERROR)
+            _disconnect_and_suspend(self);
+        }
+      break;
+
+    case WORKER_INSERT_RESULT_NOT_CONNECTED:
+      _rewind_batch(self);
+      _disconnect_and_suspend(self);
+      break;
+
+    case WORKER_INSERT_RESULT_REWIND:
+      _rewind_batch(self);
+      break;
+
+    case WORKER_INSERT_RESULT_SUCCESS:
+      stats_counter_add(owner->written_messages, self->batch.lines);
+      _accept_batch(self);
+      break;
+
+    case WORKER_INSERT_RESULT_PENDING:
+      _pend_batch(self);
+      break;
+
+    default:
+      break;
+    }
+}
+
+static void
+_flush_batch(LogThrDestWorker *self)
+{
+  worker_insert_result_t result = WORKER_INSERT_RESULT_SUCCESS;
+
+  if (self->batch.lines == 0)
+    return;
+
+  if (self->flush)
+    result = self->flush(self);
+
+  _process_result(self, result, NULL);
+}
+
+static gboolean
+_should_flush_batch(LogThrDestWorker *self)
+{
+  LogThrDestDriver *owner = self->owner;
+
+  if (owner->batch_lines <= 0 && owner->batch_bytes <= 0)
+    return TRUE;
+
+  if (owner->batch_lines > 0 && self->batch.lines >= owner->batch_lines)
+    return TRUE;
+
+  if (owner->batch_bytes > 0 && self->batch.bytes >= owner->batch_bytes)
+    return TRUE;
+
+  return FALSE;
 }
 
 static void
-log_threaded_dest_driver_do_insert(LogThrDestDriver *self)
+_start_flush_timer(LogThrDestWorker *self)
 {
+  iv_validate_now();
+  self->timer_flush.expires = iv_now;
+  timespec_add_msec(&self->timer_flush.expires, self->owner->batch_timeout);
+  iv_timer_register(&self->timer_flush);
+}
+
+static void
+log_threaded_dest_worker_do_insert(LogThrDestWorker *self)
+{
+  LogThrDestDriver *owner = self->owner;
   LogMessage *msg;
   worker_insert_result_t result;
   LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  gsize batch_bytes;
 
-  while (G_LIKELY(!self->under_termination) &&
+  while (G_LIKELY(!owner->under_termination) &&
          !self->suspended &&
+         !_is_pipeline_full(self) &&
          (msg = log_queue_pop_head(self->queue, &path_options)) != NULL)
     {
       msg_set_context(msg);
       log_msg_refcache_start_consumer(msg, &path_options);
 
-      result = self->worker.insert(self, msg);
+      batch_bytes = self->batch.bytes;
+      result = self->insert(self, msg);
+      self->batch.lines++;
+
+      /* drivers that don't track the size of their payload are accounted
+       * with the size of the messages, so batch-bytes() works for them too */
+      if (self->batch.bytes == batch_bytes)
+        self->batch.bytes += log_msg_get_size(msg);
 
-      switch (result)
+      if (result == WORKER_INSERT_RESULT_QUEUED)
+        {
+          if (_should_flush_batch(self))
+            _flush_batch(self);
+          else if (self->batch.lines == 1 && owner->batch_timeout > 0)
+            _start_flush_timer(self);
+        }
+      else
         {
-        case WORKER_INSERT_RESULT_DROP:
-          msg_error("Message dropped while sending message to destination",
-                    evt_tag_str("driver", self->super.super.id));
+          _process_result(self, result, msg);
+        }
 
-          log_threaded_dest_driver_message_drop(self, msg);
-          _disconnect_and_suspend(self);
-          break;
+      log_msg_unref(msg);
+      msg_set_context(NULL);
+      log_msg_refcache_stop();
+    }
+  if (!self->suspended && !_is_pipeline_full(self))
+    {
+      if (owner->batch_timeout <= 0)
+        _flush_batch(self);
+    }
+  if (!self->suspended && !_is_pipeline_full(self))
+    {
+      if (self->worker_message_queue_empty)
+        {
+          self->worker_message_queue_empty(self);
+        }
+    }
+}
 
-        case WORKER_INSERT_RESULT_ERROR:
-          self->retries.counter++;
-
-          if (self->retries.counter >= self->retries.max)
-            {
-              if (self->messages.retry_over)
-                self->messages.retry_over(self, msg);
-
-              msg_error("Multiple failures while sending message to destination, message dropped",
-                        evt_tag_str("driver", self->super.super.id),
-                        evt_tag_int("number_of_retries", self->retries.max));
-
-              log_threaded_dest_driver_message_drop(self, msg);
-            }
-          else
-            {
-              log_threaded_dest_driver_message_rewind(self, msg);
-              _disconnect_and_suspend(self);
-            }
-          break;
+static void
+log_threaded_dest_worker_flush_timer_expired(gpointer data)
+{
+  LogThrDestWorker *self = (LogThrDestWorker *)data;
 
-        case WORKER_INSERT_RESULT_NOT_CONNECTED:
-          log_threaded_dest_driver_message_rewind(self, msg);
-          _disconnect_and_suspend(self);
-          break;
+  if (!self->connected || self->suspended)
+    return;
 
-        case WORKER_INSERT_RESULT_REWIND:
-          log_threaded_dest_driver_message_rewind(self, msg);
-          break;
+  if (_is_pipeline_full(self))
+    {
+      _start_flush_timer(self);
+      return;
+    }
 
-        case WORKER_INSERT_RESULT_SUCCESS:
-          stats_counter_inc(self->written_messages);
-          log_threaded_dest_driver_message_accept(self, msg);
-          break;
+  _flush_batch(self);
+}
 
-        default:
-          break;
-        }
+/* called after the ivykis loop of the worker has finished, the batch is
+ * either delivered or given back to the queue */
+static void
+_flush_batch_on_exit(LogThrDestWorker *self)
+{
+  worker_insert_result_t result = WORKER_INSERT_RESULT_SUCCESS;
 
-      msg_set_context(NULL);
-      log_msg_refcache_stop();
+  if (self->pending_batches > 0)
+    {
+      _rewind_batch(self);
+      return;
+    }
+
+  if (self->batch.lines == 0)
+    return;
+
+  if (self->connected && self->flush)
+    result = self->flush(self);
+
+  if (self->connected && result == WORKER_INSERT_RESULT_SUCCESS)
+    {
+      stats_counter_add(self->owner->written_messages, self->batch.lines);
+      _accept_batch(self);
     }
-  if (!self->suspended)
+  else
     {
-      if (self->worker.worker_message_queue_empty)
-        {
-          self->worker.worker_message_queue_empty(self);
-        }
+      _rewind_batch(self);
     }
 }
 
 static void
-log_threaded_dest_driver_do_work(gpointer data)
+log_threaded_dest_worker_do_work(gpointer data)
 {
-  LogThrDestDriver *self = (LogThrDestDriver *)data;
+  LogThrDestWorker *self = (LogThrDestWorker *)data;
   gint timeout_msec = 0;
 
   self->suspended = FALSE;
   main_loop_worker_run_gc();
-  log_threaded_dest_driver_stop_watches(self);
+  log_threaded_dest_worker_stop_watches(self);
 
-  if (!self->worker.connected)
+  if (!self->connected)
     {
       __connect(self);
     }
 
   else if (log_queue_check_items(self->queue, &timeout_msec,
-                                 log_threaded_dest_driver_message_became_available_in_the_queue,
+                                 log_threaded_dest_worker_message_became_available_in_the_queue,
                                  self, NULL))
     {
-      log_threaded_dest_driver_do_insert(self);
-      if (!self->suspended)
-        log_threaded_dest_driver_start_watches(self);
+      log_threaded_dest_worker_do_insert(self);
+      /* with a full pipeline, log_threaded_dest_worker_complete_batch()
+       * resumes processing */
+      if (!self->suspended && !_is_pipeline_full(self))
+        log_threaded_dest_worker_start_watches(self);
     }
   else if (timeout_msec != 0)
     {
@@ -251,103 +497,354 @@ log_threaded_dest_driver_do_work(gpointer data)
 }
 
 static void
-log_threaded_dest_driver_init_watches(LogThrDestDriver *self)
+log_threaded_dest_worker_init_watches(LogThrDestWorker *self)
 {
   IV_EVENT_INIT(&self->wake_up_event);
   self->wake_up_event.cookie = self;
-  self->wake_up_event.handler = log_threaded_dest_driver_wake_up;
+  self->wake_up_event.handler = log_threaded_dest_worker_wake_up;
   iv_event_register(&self->wake_up_event);
 
   IV_EVENT_INIT(&self->shutdown_event);
   self->shutdown_event.cookie = self;
-  self->shutdown_event.handler = log_threaded_dest_driver_shutdown;
+  self->shutdown_event.handler = log_threaded_dest_worker_shutdown;
   iv_event_register(&self->shutdown_event);
 
   IV_TIMER_INIT(&self->timer_reopen);
   self->timer_reopen.cookie = self;
-  self->timer_reopen.handler = log_threaded_dest_driver_do_work;
+  self->timer_reopen.handler = log_threaded_dest_worker_do_work;
 
   IV_TIMER_INIT(&self->timer_throttle);
   self->timer_throttle.cookie = self;
-  self->timer_throttle.handler = log_threaded_dest_driver_do_work;
+  self->timer_throttle.handler = log_threaded_dest_worker_do_work;
+
+  IV_TIMER_INIT(&self->timer_flush);
+  self->timer_flush.cookie = self;
+  self->timer_flush.handler = log_threaded_dest_worker_flush_timer_expired;
 
   IV_TASK_INIT(&self->do_work);
   self->do_work.cookie = self;
-  self->do_work.handler = log_threaded_dest_driver_do_work;
+  self->do_work.handler = log_threaded_dest_worker_do_work;
 }
 
 static void
-log_threaded_dest_driver_worker_thread_main(gpointer arg)
+log_threaded_dest_worker_thread_main(gpointer arg)
 {
-  LogThrDestDriver *self = (LogThrDestDriver *)arg;
+  LogThrDestWorker *self = (LogThrDestWorker *)arg;
 
   iv_init();
 
   msg_debug("Worker thread started",
-            evt_tag_str("driver", self->super.super.id));
+            evt_tag_str("driver", self->owner->super.super.id),
+            evt_tag_int("worker_index", self->worker_index));
 
   log_queue_set_use_backlog(self->queue, TRUE);
 
-  log_threaded_dest_driver_init_watches(self);
+  log_threaded_dest_worker_init_watches(self);
 
-  log_threaded_dest_driver_start_watches(self);
+  log_threaded_dest_worker_start_watches(self);
 
-  if (self->worker.thread_init)
-    self->worker.thread_init(self);
+  if (self->thread_init)
+    self->thread_init(self);
 
   iv_main();
 
+  _flush_batch_on_exit(self);
   __disconnect(self);
-  if (self->worker.thread_deinit)
-    self->worker.thread_deinit(self);
+  if (self->thread_deinit)
+    self->thread_deinit(self);
 
   msg_debug("Worker thread finished",
-            evt_tag_str("driver", self->super.super.id));
+            evt_tag_str("driver", self->owner->super.super.id),
+            evt_tag_int("worker_index", self->worker_index));
   iv_deinit();
 }
 
 static void
-log_threaded_dest_driver_stop_thread(gpointer s)
+log_threaded_dest_worker_stop_thread(gpointer s)
 {
-  LogThrDestDriver *self = (LogThrDestDriver *) s;
-  self->under_termination = TRUE;
+  LogThrDestWorker *self = (LogThrDestWorker *) s;
+  self->owner->under_termination = TRUE;
   iv_event_post(&self->shutdown_event);
 }
 
 static void
-log_threaded_dest_driver_start_thread(LogThrDestDriver *self)
+log_threaded_dest_worker_start_thread(LogThrDestWorker *self)
 {
-  main_loop_create_worker_thread(log_threaded_dest_driver_worker_thread_main,
-                                 log_threaded_dest_driver_stop_thread,
-                                 self, &self->worker_options);
+  main_loop_create_worker_thread(log_threaded_dest_worker_thread_main,
+                                 log_threaded_dest_worker_stop_thread,
+                                 self, &self->owner->worker_options);
+}
+
+/* the default worker, used by drivers that implement the worker.*
+ * callbacks on the driver level and don't support workers(N) */
+
+static void
+_compat_thread_init(LogThrDestWorker *self)
+{
+  if (self->owner->worker.thread_init)
+    self->owner->worker.thread_init(self->owner);
+}
+
+static void
+_compat_thread_deinit(LogThrDestWorker *self)
+{
+  if (self->owner->worker.thread_deinit)
+    self->owner->worker.thread_deinit(self->owner);
+}
+
+static gboolean
+_compat_connect(LogThrDestWorker *self)
+{
+  if (self->owner->worker.connect)
+    return self->owner->worker.connect(self->owner);
+  return TRUE;
+}
+
+static void
+_compat_disconnect(LogThrDestWorker *self)
+{
+  if (self->owner->worker.disconnect)
+    self->owner->worker.disconnect(self->owner);
+}
+
+static worker_insert_result_t
+_compat_insert(LogThrDestWorker *self, LogMessage *msg)
+{
+  return self->owner->worker.insert(self->owner, msg);
+}
+
+static worker_insert_result_t
+_compat_flush(LogThrDestWorker *self)
+{
+  if (self->owner->worker.flush)
+    return self->owner->worker.flush(self->owner);
+  return WORKER_INSERT_RESULT_SUCCESS;
+}
+
+static void
+_compat_worker_message_queue_empty(LogThrDestWorker *self)
+{
+  if (self->owner->worker.worker_message_queue_empty)
+    self->owner->worker.worker_message_queue_empty(self->owner);
+}
+
+static LogThrDestWorker *
+_construct_compat_worker(LogThrDestDriver *owner, gint worker_index)
+{
+  LogThrDestWorker *self = g_new0(LogThrDestWorker, 1);
+
+  log_threaded_dest_worker_init_instance(self, owner, worker_index);
+  self->thread_init = _compat_thread_init;
+  self->thread_deinit = _compat_thread_deinit;
+  self->connect = _compat_connect;
+  self->disconnect = _compat_disconnect;
+  self->insert = _compat_insert;
+  self->flush = _compat_flush;
+  self->worker_message_queue_empty = _compat_worker_message_queue_empty;
+  return self;
+}
+
+void
+log_threaded_dest_worker_init_instance(LogThrDestWorker *self, LogThrDestDriver *owner, gint worker_index)
+{
+  self->owner = owner;
+  self->worker_index = worker_index;
+  self->max_pending_batches = 1;
+}
+
+static void
+_complete_pending_batch(LogThrDestWorker *self, gint lines)
+{
+  self->pending_batches--;
+  self->pending_lines -= lines;
+}
+
+/* reports the outcome of the oldest batch flushed with
+ * WORKER_INSERT_RESULT_PENDING, must be called from the worker thread */
+void
+log_threaded_dest_worker_complete_batch(LogThrDestWorker *self, gint lines, worker_insert_result_t result)
+{
+  LogThrDestDriver *owner = self->owner;
+
+  g_assert(self->pending_batches > 0);
+
+  switch (result)
+    {
+    case WORKER_INSERT_RESULT_SUCCESS:
+      _complete_pending_batch(self, lines);
+      stats_counter_add(owner->written_messages, lines);
+      _ack_lines(self, lines);
+      break;
+
+    case WORKER_INSERT_RESULT_DROP:
+      msg_error("Message dropped while sending message to destination",
+                evt_tag_str("driver", owner->super.super.id),
+                evt_tag_int("worker_index", self->worker_index),
+                evt_tag_int("batch_size", lines));
+
+      _complete_pending_batch(self, lines);
+      stats_counter_add(owner->dropped_messages, lines);
+      _ack_lines(self, lines);
+      _disconnect_and_suspend(self);
+      break;
+
+    case WORKER_INSERT_RESULT_ERROR:
+    case WORKER_INSERT_RESULT_RETRY:
+      self->retries_counter++;
+
+      if (self->retries_counter >= owner->retries.max)
+        {
+          msg_error("Multiple failures while sending message to destination, message dropped",
+                    evt_tag_str("driver", owner->super.super.id),
+                    evt_tag_int("worker_index", self->worker_index),
+                    evt_tag_int("batch_size", lines),
+                    evt_tag_int("number_of_retries", owner->retries.max));
+
+          _complete_pending_batch(self, lines);
+          stats_counter_add(owner->dropped_messages, lines);
+          _ack_lines(self, lines);
+          break;
+        }
+    /* fallthrough */
+
+    default:
+      _rewind_batch(self);
+      _disconnect_and_suspend(self);
+      break;
+    }
+
+  if (!self->connected || self->suspended || owner->under_termination)
+    return;
+
+  if (self->batch.lines > 0 && owner->batch_timeout <= 0 && log_queue_get_length(self->queue) == 0)
+    _flush_batch(self);
+
+  log_threaded_dest_worker_wake_up(self);
+}
+
+void
+log_threaded_dest_worker_free(LogThrDestWorker *self)
+{
+  if (self->free_fn)
+    self->free_fn(self);
+  g_free(self);
 }
 
 static void
 _update_memory_usage_counter_when_fifo_is_used(LogThrDestDriver *self)
 {
-  if (!g_strcmp0(self->queue->type, "FIFO") && self->memory_usage)
+  if (!g_strcmp0(self->workers[0]->queue->type, "FIFO") && self->memory_usage)
     {
       LogPipe *_pipe = &self->super.super.super;
       load_counter_from_persistent_storage(log_pipe_get_config(_pipe), self->memory_usage);
     }
 }
 
+static void
+_free_workers(LogThrDestDriver *self)
+{
+  gint i;
+
+  if (!self->workers)
+    return;
+
+  for (i = 0; i < self->num_workers; i++)
+    log_threaded_dest_worker_free(self->workers[i]);
+  g_free(self->workers);
+  self->workers = NULL;
+}
+
+static gboolean
+_construct_workers(LogThrDestDriver *self)
+{
+  gint i;
+
+  if (self->num_workers > 1 && !self->construct_worker)
+    {
+      msg_warning("WARNING: this destination does not support multiple workers, using a single worker thread",
+                  evt_tag_str("driver", self->super.super.id),
+                  evt_tag_int("workers", self->num_workers),
+                  log_pipe_location_tag(&self->super.super.super));
+      self->num_workers = 1;
+    }
+
+  self->workers = g_new0(LogThrDestWorker *, self->num_workers);
+  for (i = 0; i < self->num_workers; i++)
+    {
+      LogThrDestWorker *worker = self->construct_worker
+                                 ? self->construct_worker(self, i)
+                                 : _construct_compat_worker(self, i);
+
+      self->workers[i] = worker;
+      worker->queue = log_dest_driver_acquire_queue(&self->super,
+                                                    log_threaded_dest_driver_format_queue_persist_name(self, i));
+      if (!worker->queue)
+        return FALSE;
+    }
+  return TRUE;
+}
+
+static void
+_move_queue_contents(LogQueue *from, LogQueue *to)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg;
+
+  log_queue_rewind_backlog_all(from);
+  log_queue_set_use_backlog(from, FALSE);
+  while ((msg = log_queue_pop_head_ignore_throttle(from, &path_options)) != NULL)
+    log_queue_push_tail(to, msg, &path_options);
+}
+
+/* If workers() was lowered since the last configuration, the queues of the
+ * workers that no longer exist are persisted under names nobody acquires.
+ * Their messages are moved to the queues of the remaining workers. */
+static void
+_merge_orphaned_worker_queues(LogThrDestDriver *self)
+{
+  GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
+  gint old_num_workers;
+  gint i;
+
+  old_num_workers = GPOINTER_TO_INT(cfg_persist_config_fetch(cfg,
+                                                             log_threaded_dest_driver_format_workers_for_persist(self)));
+
+  for (i = self->num_workers; i < old_num_workers; i++)
+    {
+      LogQueue *orphan = cfg_persist_config_fetch(cfg, log_threaded_dest_driver_format_queue_persist_name(self, i));
+      LogQueue *target = self->workers[i % self->num_workers]->queue;
+
+      if (!orphan)
+        continue;
+
+      msg_warning("The number of workers decreased, moving the queued messages of a removed worker",
+                  evt_tag_str("driver", self->super.super.id),
+                  evt_tag_int("worker_index", i),
+                  evt_tag_int("target_worker_index", i % self->num_workers),
+                  evt_tag_long("queued_messages", log_queue_get_length(orphan)));
+
+      _move_queue_contents(orphan, target);
+      log_queue_unref(orphan);
+    }
+}
+
 gboolean
 log_threaded_dest_driver_start(LogPipe *s)
 {
   LogThrDestDriver *self = (LogThrDestDriver *)s;
   GlobalConfig *cfg = log_pipe_get_config(s);
+  gint i;
 
   if (cfg && self->time_reopen == -1)
     self->time_reopen = cfg->time_reopen;
 
-  self->queue = log_dest_driver_acquire_queue(
-                  &self->super, self->super.super.super.generate_persist_name((const LogPipe *)self));
-
-  if (self->queue == NULL)
+  self->under_termination = FALSE;
+  if (!_construct_workers(self))
     {
+      _free_workers(self);
       return FALSE;
     }
+  _merge_orphaned_worker_queues(self);
 
   stats_lock();
   StatsClusterKey sc_key;
@@ -361,16 +858,20 @@ log_threaded_dest_driver_start(LogPipe *s)
   stats_register_counter(1, &sc_key, SC_TYPE_WRITTEN, &self->written_messages);
   stats_unlock();
 
-  log_queue_set_counters(self->queue, self->queued_messages,
-                         self->dropped_messages, self->memory_usage);
+  for (i = 0; i < self->num_workers; i++)
+    log_queue_set_counters(self->workers[i]->queue, self->queued_messages,
+                           self->dropped_messages, self->memory_usage);
   _update_memory_usage_counter_when_fifo_is_used(self);
 
   self->seq_num = GPOINTER_TO_INT(cfg_persist_config_fetch(cfg,
                                                            log_threaded_dest_driver_format_seqnum_for_persist(self)));
+  if (!self->seq_num && self->format.legacy_seqnum_persist_name)
+    self->seq_num = GPOINTER_TO_INT(cfg_persist_config_fetch(cfg, self->format.legacy_seqnum_persist_name(self)));
   if (!self->seq_num)
     init_sequence_number(&self->seq_num);
 
-  log_threaded_dest_driver_start_thread(self);
+  for (i = 0; i < self->num_workers; i++)
+    log_threaded_dest_worker_start_thread(self->workers[i]);
 
   return TRUE;
 }
@@ -379,14 +880,20 @@ gboolean
 log_threaded_dest_driver_deinit_method(LogPipe *s)
 {
   LogThrDestDriver *self = (LogThrDestDriver *)s;
+  gint i;
 
-  log_queue_reset_parallel_push(self->queue);
-
-  log_queue_set_counters(self->queue, NULL, NULL, NULL);
+  for (i = 0; i < self->num_workers; i++)
+    {
+      log_queue_reset_parallel_push(self->workers[i]->queue);
+      log_queue_set_counters(self->workers[i]->queue, NULL, NULL, NULL);
+    }
 
   cfg_persist_config_add(log_pipe_get_config(s),
                          log_threaded_dest_driver_format_seqnum_for_persist(self),
                          GINT_TO_POINTER(self->seq_num), NULL, FALSE);
+  cfg_persist_config_add(log_pipe_get_config(s),
+                         log_threaded_dest_driver_format_workers_for_persist(self),
+                         GINT_TO_POINTER(self->num_workers), NULL, FALSE);
 
   save_counter_to_persistent_storage(log_pipe_get_config(s), self->memory_usage);
 
@@ -402,6 +909,10 @@ log_threaded_dest_driver_deinit_method(LogPipe *s)
   stats_unregister_counter(&sc_key, SC_TYPE_MEMORY_USAGE, &self->memory_usage);
   stats_unlock();
 
+  /* the worker threads have exited by now, the queues themselves are
+   * released (or persisted) by log_dest_driver_deinit_method() */
+  _free_workers(self);
+
   if (!log_dest_driver_deinit_method(s))
     return FALSE;
 
@@ -413,15 +924,45 @@ log_threaded_dest_driver_free(LogPipe *s)
 {
   LogThrDestDriver *self = (LogThrDestDriver *)s;
 
+  _free_workers(self);
+  log_template_unref(self->partition_key);
   log_dest_driver_free((LogPipe *)self);
 }
 
+static LogThrDestWorker *
+log_threaded_dest_driver_lookup_worker(LogThrDestDriver *self, LogMessage *msg)
+{
+  gint worker_index;
+
+  if (self->num_workers == 1)
+    return self->workers[0];
+
+  if (self->partition_key)
+    {
+      ScratchBuffersMarker marker;
+      GString *key = scratch_buffers_alloc_and_mark(&marker);
+
+      log_template_format(self->partition_key, msg, &log_pipe_get_config(&self->super.super.super)->template_options,
+                          LTZ_SEND, 0, NULL, key);
+      worker_index = g_str_hash(key->str) % self->num_workers;
+      scratch_buffers_reclaim_marked(marker);
+    }
+  else
+    {
+      guint counter = (guint) g_atomic_counter_exchange_and_add(&self->last_worker, 1);
+      worker_index = counter % self->num_workers;
+    }
+
+  return self->workers[worker_index];
+}
+
 static void
 log_threaded_dest_driver_queue(LogPipe *s, LogMessage *msg,
                                const LogPathOptions *path_options,
                                gpointer user_data)
 {
   LogThrDestDriver *self = (LogThrDestDriver *)s;
+  LogThrDestWorker *worker;
   LogPathOptions local_options;
 
   if (!path_options->flow_control_requested)
@@ -430,8 +971,10 @@ log_threaded_dest_driver_queue(LogPipe *s, LogMessage *msg,
   if (self->queue_method)
     self->queue_method(self);
 
+  worker = log_threaded_dest_driver_lookup_worker(self, msg);
+
   log_msg_add_ack(msg, path_options);
-  log_queue_push_tail(self->queue, log_msg_ref(msg), path_options);
+  log_queue_push_tail(worker->queue, log_msg_ref(msg), path_options);
 
   stats_counter_inc(self->processed_messages);
 
@@ -450,40 +993,56 @@ log_threaded_dest_driver_init_instance(LogThrDestDriver *self, GlobalConfig *cfg
   self->super.super.super.queue = log_threaded_dest_driver_queue;
   self->super.super.super.free_fn = log_threaded_dest_driver_free;
   self->time_reopen = -1;
+  self->num_workers = 1;
 
   self->retries.max = MAX_RETRIES_OF_FAILED_INSERT_DEFAULT;
 }
 
 void
-log_threaded_dest_driver_message_accept(LogThrDestDriver *self,
-                                        LogMessage *msg)
+log_threaded_dest_driver_set_max_retries(LogDriver *s, gint max_retries)
 {
-  self->retries.counter = 0;
-  step_sequence_number(&self->seq_num);
-  log_queue_ack_backlog(self->queue, 1);
-  log_msg_unref(msg);
+  LogThrDestDriver *self = (LogThrDestDriver *)s;
+
+  self->retries.max = max_retries;
 }
 
 void
-log_threaded_dest_driver_message_drop(LogThrDestDriver *self,
-                                      LogMessage *msg)
+log_threaded_dest_driver_set_num_workers(LogDriver *s, gint num_workers)
 {
-  stats_counter_inc(self->dropped_messages);
-  log_threaded_dest_driver_message_accept(self, msg);
+  LogThrDestDriver *self = (LogThrDestDriver *)s;
+
+  self->num_workers = num_workers;
 }
 
 void
-log_threaded_dest_driver_message_rewind(LogThrDestDriver *self,
-                                        LogMessage *msg)
+log_threaded_dest_driver_set_partition_key(LogDriver *s, LogTemplate *partition_key)
 {
-  log_queue_rewind_backlog(self->queue, 1);
-  log_msg_unref(msg);
+  LogThrDestDriver *self = (LogThrDestDriver *)s;
+
+  log_template_unref(self->partition_key);
+  self->partition_key = log_template_ref(partition_key);
 }
 
 void
-log_threaded_dest_driver_set_max_retries(LogDriver *s, gint max_retries)
+log_threaded_dest_driver_set_batch_lines(LogDriver *s, gint batch_lines)
 {
   LogThrDestDriver *self = (LogThrDestDriver *)s;
 
-  self->retries.max = max_retries;
+  self->batch_lines = batch_lines;
+}
+
+void
+log_threaded_dest_driver_set_batch_bytes(LogDriver *s, gint batch_bytes)
+{
+  LogThrDestDriver *self = (LogThrDestDriver *)s;
+
+  self->batch_bytes = batch_bytes;
+}
+
+void
+log_threaded_dest_driver_set_batch_timeout(LogDriver *s, glong batch_timeout)
+{
+  LogThrDestDriver *self = (LogThrDestDriver *)s;
+
+  self->batch_timeout = batch_timeout;
 }
@@ -30,6 +30,8 @@
 #include "stats/stats-registry.h"
 #include "logqueue.h"
 #include "mainloop-worker.h"
+#include "template/templates.h"
+#include "atomic.h"
 #include <iv.h>
 #include <iv_event.h>
 
@@ -39,10 +41,89 @@ typedef enum
   WORKER_INSERT_RESULT_ERROR,
   WORKER_INSERT_RESULT_REWIND,
   WORKER_INSERT_RESULT_SUCCESS,
-  WORKER_INSERT_RESULT_NOT_CONNECTED
+  WORKER_INSERT_RESULT_NOT_CONNECTED,
+  WORKER_INSERT_RESULT_QUEUED,
+  WORKER_INSERT_RESULT_PENDING,
+  WORKER_INSERT_RESULT_RETRY
 } worker_insert_result_t;
 
 typedef struct _LogThrDestDriver LogThrDestDriver;
+typedef struct _LogThrDestWorker LogThrDestWorker;
+
+/*
+ * A LogThrDestWorker is a single thread that consumes messages for a
+ * threaded destination.  Each worker has its own LogQueue, its own
+ * connection state and its own ivykis loop, so acks and rewinds are
+ * tracked per worker.  Drivers that support workers(N) set
+ * construct_worker() in their LogThrDestDriver and return a subclass of
+ * this struct which holds the per-connection state.  Drivers that don't,
+ * get a single worker that delegates to the legacy worker.* callbacks of
+ * the driver.
+ *
+ * Batching: insert() may return WORKER_INSERT_RESULT_QUEUED to indicate
+ * that the message was added to the current batch, which is then sent by
+ * flush() once batch-lines()/batch-bytes() is reached, batch-timeout()
+ * elapses or (without batch-timeout()) the queue becomes empty.  The
+ * result of flush() applies to every message in the batch: they are acked,
+ * dropped or rewound together.  Any other result returned by insert() while
+ * a batch is open is applied to the whole batch as well, including the
+ * current message.  Drivers that know the size of their payload should
+ * maintain batch.bytes in insert(), otherwise the size of the messages is
+ * accounted.
+ *
+ * Errors: WORKER_INSERT_RESULT_ERROR rewinds the batch and reconnects after
+ * time-reopen(), WORKER_INSERT_RESULT_RETRY is meant for messages the
+ * destination rejected over a healthy connection and retries them right
+ * away.  Both drop the batch after retries.max attempts.
+ *
+ * Asynchronous delivery: flush() may return WORKER_INSERT_RESULT_PENDING
+ * once the batch has been submitted but not yet confirmed.  The messages
+ * stay on the backlog until the worker reports the outcome with
+ * log_threaded_dest_worker_complete_batch(), which must be called in the
+ * same order the batches were flushed.  At most max_pending_batches may be
+ * outstanding, the worker stops consuming its queue while the pipeline is
+ * full.  Any failure other than a dropped batch rewinds every outstanding
+ * batch and disconnects the worker, so disconnect() has to abandon the
+ * requests that are still in flight without reporting them.  While batches
+ * are outstanding, any result of insert() or flush() other than QUEUED or
+ * PENDING is handled as WORKER_INSERT_RESULT_NOT_CONNECTED.
+ */
+struct _LogThrDestWorker
+{
+  LogThrDestDriver *owner;
+  gint worker_index;
+  LogQueue *queue;
+
+  gboolean connected;
+  gboolean suspended;
+  gint retries_counter;
+
+  struct
+  {
+    gint lines;
+    gsize bytes;
+  } batch;
+  gint pending_batches;
+  gint pending_lines;
+  gint max_pending_batches;
+
+  void (*thread_init) (LogThrDestWorker *s);
+  void (*thread_deinit) (LogThrDestWorker *s);
+  gboolean (*connect) (LogThrDestWorker *s);
+  void (*disconnect) (LogThrDestWorker *s);
+  worker_insert_result_t (*insert) (LogThrDestWorker *s, LogMessage *msg);
+  worker_insert_result_t (*flush) (LogThrDestWorker *s);
+  void (*worker_message_queue_empty)(LogThrDestWorker *s);
+  void (*free_fn) (LogThrDestWorker *s);
+
+  struct iv_event wake_up_event;
+  struct iv_event shutdown_event;
+  struct iv_timer timer_reopen;
+  struct iv_timer timer_throttle;
+  struct iv_timer timer_flush;
+  struct iv_task  do_work;
+};
+
 struct _LogThrDestDriver
 {
   LogDestDriver super;
@@ -53,24 +134,27 @@ struct _LogThrDestDriver
   StatsCounterItem *written_messages;
   StatsCounterItem *memory_usage;
 
-  gboolean suspended;
   gboolean under_termination;
   time_t time_reopen;
 
-  LogQueue *queue;
-
   /* Worker stuff */
   struct
   {
-    gboolean connected;
     void (*thread_init) (LogThrDestDriver *s);
     void (*thread_deinit) (LogThrDestDriver *s);
     worker_insert_result_t (*insert) (LogThrDestDriver *s, LogMessage *msg);
+    worker_insert_result_t (*flush) (LogThrDestDriver *s);
     gboolean (*connect) (LogThrDestDriver *s);
     void (*worker_message_queue_empty)(LogThrDestDriver *s);
     void (*disconnect) (LogThrDestDriver *s);
   } worker;
 
+  LogThrDestWorker *(*construct_worker)(LogThrDestDriver *s, gint worker_index);
+  LogThrDestWorker **workers;
+  gint num_workers;
+  GAtomicCounter last_worker;
+  LogTemplate *partition_key;
+
   struct
   {
     void (*retry_over) (LogThrDestDriver *s, LogMessage *msg);
@@ -79,38 +163,41 @@ struct _LogThrDestDriver
   struct
   {
     gchar *(*stats_instance) (LogThrDestDriver *s);
+    /* optional, the key the driver persisted its sequence number under
+     * before it was handled by LogThrDestDriver */
+    gchar *(*legacy_seqnum_persist_name) (LogThrDestDriver *s);
   } format;
   gint stats_source;
   gint32 seq_num;
 
   struct
   {
-    gint counter;
     gint max;
   } retries;
 
+  gint batch_lines;
+  gint batch_bytes;
+  glong batch_timeout;
+
   void (*queue_method) (LogThrDestDriver *s);
   WorkerOptions worker_options;
-  struct iv_event wake_up_event;
-  struct iv_event shutdown_event;
-  struct iv_timer timer_reopen;
-  struct iv_timer timer_throttle;
-  struct iv_task  do_work;
 };
 
+void log_threaded_dest_worker_init_instance(LogThrDestWorker *self, LogThrDestDriver *owner, gint worker_index);
+void log_threaded_dest_worker_free(LogThrDestWorker *self);
+void log_threaded_dest_worker_complete_batch(LogThrDestWorker *self, gint lines, worker_insert_result_t result);
+
 gboolean log_threaded_dest_driver_deinit_method(LogPipe *s);
 gboolean log_threaded_dest_driver_start(LogPipe *s);
 
 void log_threaded_dest_driver_init_instance(LogThrDestDriver *self, GlobalConfig *cfg);
 void log_threaded_dest_driver_free(LogPipe *s);
 
-void log_threaded_dest_driver_message_accept(LogThrDestDriver *self,
-                                             LogMessage *msg);
-void log_threaded_dest_driver_message_drop(LogThrDestDriver *self,
-                                           LogMessage *msg);
-void log_threaded_dest_driver_message_rewind(LogThrDestDriver *self,
-                                             LogMessage *msg);
-
 void log_threaded_dest_driver_set_max_retries(LogDriver *s, gint max_retries);
+void log_threaded_dest_driver_set_num_workers(LogDriver *s, gint num_workers);
+void log_threaded_dest_driver_set_partition_key(LogDriver *s, LogTemplate *partition_key);
+void log_threaded_dest_driver_set_batch_lines(LogDriver *s, gint batch_lines);
+void log_threaded_dest_driver_set_batch_bytes(LogDriver *s, gint batch_bytes);
+void log_threaded_dest_driver_set_batch_timeout(LogDriver *s, glong batch_timeout);
 
 #endif
@@ -40,5 +40,18 @@ step_sequence_number(gint32 *seqnum)
     *seqnum = 1;
 }
 
+/* used when several threads step the same sequence number */
+static inline void
+step_sequence_number_atomic(gint32 *seqnum)
+{
+  gint old_value, new_value;
+
+  do
+    {
+      old_value = g_atomic_int_get(seqnum);
+      new_value = (old_value == G_MAXINT32) ? 1 : old_value + 1;
+    }
+  while (!g_atomic_int_compare_and_exchange(seqnum, old_value, new_value));
+}
 
 #endif
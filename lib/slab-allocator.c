@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "slab-allocator.h"
+#include "tls-support.h"
+#include "stats/stats-registry.h"
+#include "stats/stats-cluster-single.h"
+
+/*
+ * slab_alloc
+ *
+ * A size-classed allocator for objects that are typically allocated in
+ * one thread and freed in another, like LogMessage instances (allocated
+ * by the source thread, freed by whichever thread drops the last
+ * reference) or queue nodes.
+ *
+ * Every thread keeps a cache of free objects for each size class, which
+ * are used by slab_alloc() and slab_free() without any locking.  A thread
+ * that frees more than it allocates (a destination) hands its surplus to
+ * the global depot in batches of SLAB_BATCH_SIZE objects, a thread that
+ * allocates more than it frees (a source) takes whole batches from there.
+ * This way the depot lock is taken at most once for every SLAB_BATCH_SIZE
+ * operations, regardless of how objects cross thread boundaries.
+ *
+ * Objects larger than the largest size class are served by g_malloc()
+ * directly.  With memtrace enabled, every allocation goes to g_malloc(),
+ * so that leaks remain attributable to their call-site.
+ */
+
+#define SLAB_MIN_SHIFT 6
+/* 64 bytes .. 32KiB, including the header */
+#define SLAB_NUM_CLASSES 10
+#define SLAB_BATCH_SIZE 64
+/* at most this much memory is kept in the depot per size class, but at
+ * least one batch */
+#define SLAB_DEPOT_MAX_BYTES (4 * 1024 * 1024)
+#define SLAB_LARGE_OBJECT 0xFF
+
+typedef union _SlabHeader
+{
+  guint32 size_class;
+  /* keep the object itself as aligned as g_malloc() would */
+  gdouble __align[2];
+} SlabHeader;
+
+typedef struct _SlabFreeObject SlabFreeObject;
+struct _SlabFreeObject
+{
+  SlabFreeObject *next;
+  /* only used by the first object of a batch stored in the depot */
+  SlabFreeObject *next_batch;
+};
+
+typedef struct _SlabCache
+{
+  SlabFreeObject *objects;
+  gint count;
+} SlabCache;
+
+TLS_BLOCK_START
+{
+  SlabCache slab_caches[SLAB_NUM_CLASSES];
+}
+TLS_BLOCK_END;
+
+#define slab_caches __tls_deref(slab_caches)
+
+static GStaticMutex slab_depot_lock = G_STATIC_MUTEX_INIT;
+static SlabFreeObject *slab_depot[SLAB_NUM_CLASSES];
+static gint slab_depot_batches[SLAB_NUM_CLASSES];
+
+static StatsCounterItem *stats_slab_allocated_bytes;
+static StatsCounterItem *stats_slab_cached_bytes;
+
+static inline gsize
+_get_class_size(gint size_class)
+{
+  return ((gsize) 1) << (SLAB_MIN_SHIFT + size_class);
+}
+
+static inline gint
+_get_depot_max_batches(gint size_class)
+{
+  return MAX(SLAB_DEPOT_MAX_BYTES / (SLAB_BATCH_SIZE * _get_class_size(size_class)), 1);
+}
+
+static inline gint
+_get_size_class(gsize size)
+{
+#if SYSLOG_NG_ENABLE_MEMTRACE
+  return SLAB_NUM_CLASSES;
+#else
+  if (size <= _get_class_size(0))
+    return 0;
+  return g_bit_storage(size - 1) - SLAB_MIN_SHIFT;
+#endif
+}
+
+static inline SlabHeader *
+_get_header(gpointer p)
+{
+  return ((SlabHeader *) p) - 1;
+}
+
+static void
+_free_objects(SlabFreeObject *objects, gint size_class)
+{
+  gint count = 0;
+
+  while (objects)
+    {
+      SlabFreeObject *next = objects->next;
+
+      g_free(_get_header(objects));
+      objects = next;
+      count++;
+    }
+  stats_counter_sub(stats_slab_allocated_bytes, count * _get_class_size(size_class));
+}
+
+static void
+_return_batch_to_depot(SlabCache *cache, gint size_class)
+{
+  SlabFreeObject *batch = cache->objects;
+  SlabFreeObject *last = batch;
+  gint i;
+
+  for (i = 1; i < SLAB_BATCH_SIZE; i++)
+    last = last->next;
+
+  cache->objects = last->next;
+  cache->count -= SLAB_BATCH_SIZE;
+  last->next = NULL;
+
+  g_static_mutex_lock(&slab_depot_lock);
+  if (slab_depot_batches[size_class] < _get_depot_max_batches(size_class))
+    {
+      batch->next_batch = slab_depot[size_class];
+      slab_depot[size_class] = batch;
+      slab_depot_batches[size_class]++;
+      batch = NULL;
+    }
+  g_static_mutex_unlock(&slab_depot_lock);
+
+  if (batch)
+    _free_objects(batch, size_class);
+  else
+    stats_counter_add(stats_slab_cached_bytes, SLAB_BATCH_SIZE * _get_class_size(size_class));
+}
+
+static gboolean
+_take_batch_from_depot(SlabCache *cache, gint size_class)
+{
+  SlabFreeObject *batch;
+
+  g_static_mutex_lock(&slab_depot_lock);
+  batch = slab_depot[size_class];
+  if (batch)
+    {
+      slab_depot[size_class] = batch->next_batch;
+      slab_depot_batches[size_class]--;
+    }
+  g_static_mutex_unlock(&slab_depot_lock);
+
+  if (!batch)
+    return FALSE;
+
+  stats_counter_sub(stats_slab_cached_bytes, SLAB_BATCH_SIZE * _get_class_size(size_class));
+  cache->objects = batch;
+  cache->count = SLAB_BATCH_SIZE;
+  return TRUE;
+}
+
+gpointer
+slab_alloc(gsize size)
+{
+  gint size_class = _get_size_class(size + sizeof(SlabHeader));
+  SlabHeader *header;
+  SlabFreeObject *obj;
+  SlabCache *cache;
+
+  if (size_class >= SLAB_NUM_CLASSES)
+    {
+      header = g_malloc(size + sizeof(SlabHeader));
+      header->size_class = SLAB_LARGE_OBJECT;
+      return header + 1;
+    }
+
+  cache = &slab_caches[size_class];
+  if (!cache->objects && !_take_batch_from_depot(cache, size_class))
+    {
+      header = g_malloc(_get_class_size(size_class));
+      header->size_class = size_class;
+      stats_counter_add(stats_slab_allocated_bytes, _get_class_size(size_class));
+      return header + 1;
+    }
+
+  obj = cache->objects;
+  cache->objects = obj->next;
+  cache->count--;
+  return obj;
+}
+
+void
+slab_free(gpointer p)
+{
+  SlabHeader *header;
+  SlabFreeObject *obj = (SlabFreeObject *) p;
+  SlabCache *cache;
+  gint size_class;
+
+  if (!p)
+    return;
+
+  header = _get_header(p);
+  size_class = header->size_class;
+  if (size_class == SLAB_LARGE_OBJECT)
+    {
+      g_free(header);
+      return;
+    }
+
+  cache = &slab_caches[size_class];
+  obj->next = cache->objects;
+  cache->objects = obj;
+  cache->count++;
+
+  /* keep one batch worth of objects locally, so that a thread freeing and
+   * allocating alternately does not bounce batches to and from the depot */
+  if (cache->count >= 2 * SLAB_BATCH_SIZE)
+    _return_batch_to_depot(cache, size_class);
+}
+
+/* the memory held by the depot for objects of @size, for tests */
+gsize
+slab_allocator_get_depot_bytes(gsize size)
+{
+  gint size_class = _get_size_class(size + sizeof(SlabHeader));
+  gint batches;
+
+  if (size_class >= SLAB_NUM_CLASSES)
+    return 0;
+
+  g_static_mutex_lock(&slab_depot_lock);
+  batches = slab_depot_batches[size_class];
+  g_static_mutex_unlock(&slab_depot_lock);
+  return batches * SLAB_BATCH_SIZE * _get_class_size(size_class);
+}
+
+/* hand the objects cached by the current thread over to other threads */
+void
+slab_allocator_thread_deinit(void)
+{
+  gint size_class;
+
+  for (size_class = 0; size_class < SLAB_NUM_CLASSES; size_class++)
+    {
+      SlabCache *cache = &slab_caches[size_class];
+
+      while (cache->count >= SLAB_BATCH_SIZE)
+        _return_batch_to_depot(cache, size_class);
+
+      _free_objects(cache->objects, size_class);
+      cache->objects = NULL;
+      cache->count = 0;
+    }
+}
+
+void
+slab_allocator_global_init(void)
+{
+  StatsClusterKey sc_key;
+
+  stats_lock();
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "slab_allocated_bytes", NULL);
+  stats_register_counter(1, &sc_key, SC_TYPE_SINGLE_VALUE, &stats_slab_allocated_bytes);
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "slab_cached_bytes", NULL);
+  stats_register_counter(1, &sc_key, SC_TYPE_SINGLE_VALUE, &stats_slab_cached_bytes);
+  stats_unlock();
+}
+
+void
+slab_allocator_global_deinit(void)
+{
+  StatsClusterKey sc_key;
+  gint size_class;
+
+  g_static_mutex_lock(&slab_depot_lock);
+  for (size_class = 0; size_class < SLAB_NUM_CLASSES; size_class++)
+    {
+      SlabFreeObject *batch = slab_depot[size_class];
+
+      while (batch)
+        {
+          SlabFreeObject *next_batch = batch->next_batch;
+
+          _free_objects(batch, size_class);
+          stats_counter_sub(stats_slab_cached_bytes, SLAB_BATCH_SIZE * _get_class_size(size_class));
+          batch = next_batch;
+        }
+      slab_depot[size_class] = NULL;
+      slab_depot_batches[size_class] = 0;
+    }
+  g_static_mutex_unlock(&slab_depot_lock);
+
+  stats_lock();
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "slab_allocated_bytes", NULL);
+  stats_unregister_counter(&sc_key, SC_TYPE_SINGLE_VALUE, &stats_slab_allocated_bytes);
+  stats_cluster_single_key_set(&sc_key, SCS_GLOBAL, "slab_cached_bytes", NULL);
+  stats_unregister_counter(&sc_key, SC_TYPE_SINGLE_VALUE, &stats_slab_cached_bytes);
+  stats_unlock();
+}
@@ -88,6 +88,8 @@ struct _StatsCounterGroup
   StatsCounterItem *counters;
   const gchar **counter_names;
   guint16 capacity;
+  /* counters updated concurrently by many threads, see StatsCounterShard */
+  guint16 sharded_mask;
   void (*free_fn)(StatsCounterGroup *self);
 };
 
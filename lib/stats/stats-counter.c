@@ -24,6 +24,10 @@
 #include "stats/stats-counter.h"
 #include "stats/stats-cluster.h"
 #include "stats/stats-registry.h"
+#include "mainloop-worker.h"
+
+#include <stdlib.h>
+#include <string.h>
 
 static void
 _reset_counter(StatsCluster *sc, gint type, StatsCounterItem *counter, gpointer user_data)
@@ -52,9 +56,56 @@ stats_reset_counters(void)
   stats_unlock();
 }
 
+/* NOTE: called with the stats lock held, concurrent updates either see the
+ * shards or update the value field, both are included in the sum. */
+void
+stats_counter_enable_sharding(StatsCounterItem *counter)
+{
+  gpointer shards;
+
+  if (counter->shards)
+    return;
+
+  if (posix_memalign(&shards, STATS_COUNTER_CACHE_LINE_SIZE, STATS_COUNTER_SHARDS * sizeof(StatsCounterShard)) != 0)
+    g_error("Error allocating sharded stats counter");
+  memset(shards, 0, STATS_COUNTER_SHARDS * sizeof(StatsCounterShard));
+  g_atomic_pointer_set(&counter->shards, shards);
+}
+
+void
+stats_counter_add_to_shard(StatsCounterItem *counter, gssize add)
+{
+  /* threads without an ID (-1) end up using the last shard */
+  gint shard = main_loop_worker_get_thread_id() & (STATS_COUNTER_SHARDS - 1);
+
+  g_atomic_pointer_add(&counter->shards[shard].value, add);
+}
+
+void
+stats_counter_set_sharded(StatsCounterItem *counter, gsize value)
+{
+  gint i;
+
+  for (i = 0; i < STATS_COUNTER_SHARDS; i++)
+    counter->shards[i].value = 0;
+  counter->value = value;
+}
+
+gsize
+stats_counter_get_sharded(StatsCounterItem *counter)
+{
+  gssize result = counter->value;
+  gint i;
+
+  for (i = 0; i < STATS_COUNTER_SHARDS; i++)
+    result += counter->shards[i].value;
+  return result;
+}
+
 void
 stats_counter_free(StatsCounterItem *counter)
 {
   if (counter->name)
     g_free(counter->name);
+  free(counter->shards);
 }
@@ -26,47 +26,75 @@
 
 #include "syslog-ng.h"
 
+#define STATS_COUNTER_SHARDS 16
+#define STATS_COUNTER_CACHE_LINE_SIZE 64
+
+/*
+ * Counters updated by all worker threads (e.g. processed/queued of a
+ * destination fed by many sources) are sharded: each thread updates the
+ * shard selected by its worker thread ID, so threads don't keep stealing
+ * the same cache line from each other.  The value of the counter is the
+ * sum of its shards and the value field.
+ */
+typedef struct _StatsCounterShard
+{
+  gssize value;
+  gchar padding[STATS_COUNTER_CACHE_LINE_SIZE - sizeof(gssize)];
+} StatsCounterShard;
+
 typedef struct _StatsCounterItem
 {
   gssize value;
   gchar *name;
   gint type;
+  StatsCounterShard *shards;
 } StatsCounterItem;
 
+void stats_counter_enable_sharding(StatsCounterItem *counter);
+void stats_counter_add_to_shard(StatsCounterItem *counter, gssize add);
+void stats_counter_set_sharded(StatsCounterItem *counter, gsize value);
+gsize stats_counter_get_sharded(StatsCounterItem *counter);
 
 static inline void
 stats_counter_add(StatsCounterItem *counter, gssize add)
 {
-  if (counter)
+  if (!counter)
+    return;
+
+  if (counter->shards)
+    stats_counter_add_to_shard(counter, add);
+  else
     g_atomic_pointer_add(&counter->value, add);
 }
 
 static inline void
 stats_counter_sub(StatsCounterItem *counter, gssize sub)
 {
-  if (counter)
-    g_atomic_pointer_add(&counter->value, -1 * sub);
+  stats_counter_add(counter, -1 * sub);
 }
 
 static inline void
 stats_counter_inc(StatsCounterItem *counter)
 {
-  if (counter)
-    g_atomic_pointer_add(&counter->value, 1);
+  stats_counter_add(counter, 1);
 }
 
 static inline void
 stats_counter_dec(StatsCounterItem *counter)
 {
-  if (counter)
-    g_atomic_pointer_add(&counter->value, -1);
+  stats_counter_add(counter, -1);
 }
 
 /* NOTE: this is _not_ atomic and doesn't have to be as sets would race anyway */
 static inline void
 stats_counter_set(StatsCounterItem *counter, gsize value)
 {
-  if (counter)
+  if (!counter)
+    return;
+
+  if (counter->shards)
+    stats_counter_set_sharded(counter, value);
+  else
     counter->value = value;
 }
 
@@ -76,8 +104,13 @@ stats_counter_get(StatsCounterItem *counter)
 {
   gssize result = 0;
 
-  if (counter)
-    result = counter->value;
+  if (!counter)
+    return 0;
+
+  if (counter->shards)
+    return stats_counter_get_sharded(counter);
+
+  result = counter->value;
   return result;
 }
 
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "stats/stats-counter.h"
+#include "mainloop-worker.h"
+#include "testutils.h"
+#include "stopwatch.h"
+
+#define NUM_THREADS 16
+#define ITERATIONS_PER_THREAD 1000000
+
+typedef struct _IncrementerArgs
+{
+  StatsCounterItem *counter;
+  gint thread_id;
+} IncrementerArgs;
+
+static gpointer
+_increment_counter_thread(gpointer user_data)
+{
+  IncrementerArgs *args = (IncrementerArgs *) user_data;
+  gint i;
+
+  main_loop_worker_set_thread_id(args->thread_id);
+  for (i = 0; i < ITERATIONS_PER_THREAD; i++)
+    stats_counter_inc(args->counter);
+  return NULL;
+}
+
+static void
+_perftest_counter(StatsCounterItem *counter, const gchar *name)
+{
+  GThread *threads[NUM_THREADS];
+  IncrementerArgs args[NUM_THREADS];
+  gint i;
+
+  start_stopwatch();
+  for (i = 0; i < NUM_THREADS; i++)
+    {
+      args[i].counter = counter;
+      args[i].thread_id = i;
+      threads[i] = g_thread_create(_increment_counter_thread, &args[i], TRUE, NULL);
+    }
+  for (i = 0; i < NUM_THREADS; i++)
+    g_thread_join(threads[i]);
+  stop_stopwatch_and_display_result(NUM_THREADS * ITERATIONS_PER_THREAD,
+                                    "%s counter, %d threads incrementing", name, NUM_THREADS);
+
+  assert_gint64(stats_counter_get(counter), (gint64) NUM_THREADS * ITERATIONS_PER_THREAD,
+                "%s counter lost increments", name);
+}
+
+static void
+test_sharded_counter_semantics(void)
+{
+  StatsCounterItem counter = { 0 };
+
+  stats_counter_add(&counter, 5);
+  stats_counter_enable_sharding(&counter);
+  assert_gint64(stats_counter_get(&counter), 5, "value before sharding is lost");
+
+  main_loop_worker_set_thread_id(3);
+  stats_counter_add(&counter, 10);
+  main_loop_worker_set_thread_id(4);
+  stats_counter_sub(&counter, 3);
+  stats_counter_dec(&counter);
+  assert_gint64(stats_counter_get(&counter), 11, "sharded counter sums its shards incorrectly");
+
+  stats_counter_set(&counter, 42);
+  assert_gint64(stats_counter_get(&counter), 42, "set does not override the shards");
+
+  stats_counter_free(&counter);
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  StatsCounterItem shared = { 0 };
+  StatsCounterItem sharded = { 0 };
+
+  test_sharded_counter_semantics();
+
+  stats_counter_enable_sharding(&sharded);
+  _perftest_counter(&shared, "shared");
+  _perftest_counter(&sharded, "sharded");
+
+  stats_counter_free(&shared);
+  stats_counter_free(&sharded);
+  return 0;
+}
@@ -54,6 +54,42 @@ log_template_compile(LogTemplate *self, const gchar *template, GError **error)
   return result;
 }
 
+static gboolean
+_is_literal_string_elem(LogTemplateElem *e)
+{
+  return e->type == LTE_MACRO && e->macro == M_NONE;
+}
+
+/* TRUE if the template expands to the same string regardless of the message */
+gboolean
+log_template_is_literal_string(const LogTemplate *self)
+{
+  if (!self->compiled_template)
+    return TRUE;
+
+  return !self->compiled_template->next && _is_literal_string_elem((LogTemplateElem *) self->compiled_template->data);
+}
+
+const gchar *
+log_template_get_literal_value(const LogTemplate *self, gssize *value_len)
+{
+  LogTemplateElem *e;
+
+  g_assert(log_template_is_literal_string(self));
+
+  if (!self->compiled_template)
+    {
+      if (value_len)
+        *value_len = 0;
+      return "";
+    }
+
+  e = (LogTemplateElem *) self->compiled_template->data;
+  if (value_len)
+    *value_len = e->text_len;
+  return e->text ? e->text : "";
+}
+
 void
 log_template_set_escape(LogTemplate *self, gboolean enable)
 {
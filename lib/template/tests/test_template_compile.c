@@ -291,6 +291,34 @@ test_double_at_is_a_literal_at(void)
   assert_compiled_template(text = "@12", default_value = NULL, macro = M_NONE, type = LTE_MACRO, msg_ref = 0);
 }
 
+static void
+test_literal_string_is_detected(void)
+{
+  gssize len;
+
+  assert_template_compile("$$alma");
+  assert_true(log_template_is_literal_string(template), ASSERTION_ERROR("Template should be a literal string"));
+  assert_string(log_template_get_literal_value(template, &len), "$alma", ASSERTION_ERROR("Bad literal value"));
+  assert_gint(len, 5, ASSERTION_ERROR("Bad literal value length"));
+
+  assert_template_compile("alma$MESSAGE");
+  assert_false(log_template_is_literal_string(template), ASSERTION_ERROR("Template with a macro is not a literal string"));
+
+  assert_template_compile("${VALUE_NAME}");
+  assert_false(log_template_is_literal_string(template), ASSERTION_ERROR("Template with a value is not a literal string"));
+}
+
+static void
+test_empty_template_is_an_empty_literal_string(void)
+{
+  gssize len;
+
+  assert_true(log_template_compile(template, "", NULL), ASSERTION_ERROR("Can't compile template"));
+  assert_true(log_template_is_literal_string(template), ASSERTION_ERROR("Empty template should be a literal string"));
+  assert_string(log_template_get_literal_value(template, &len), "", ASSERTION_ERROR("Bad literal value"));
+  assert_gint(len, 0, ASSERTION_ERROR("Bad literal value length"));
+}
+
 static void
 test_template_compile_macro(void)
 {
@@ -308,6 +336,8 @@ test_template_compile_macro(void)
   TEMPLATE_TESTCASE(test_dollar_with_an_invalid_macro_name_without_braces_is_parsed_as_a_literal_dollar);
   TEMPLATE_TESTCASE(test_backslash_without_finishing_the_escape_sequence_is_ignored);
   TEMPLATE_TESTCASE(test_double_at_is_a_literal_at);
+  TEMPLATE_TESTCASE(test_literal_string_is_detected);
+  TEMPLATE_TESTCASE(test_empty_template_is_an_empty_literal_string);
 }
 
 static void
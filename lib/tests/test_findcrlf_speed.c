@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "find-crlf.h"
+#include "testutils.h"
+#include "stopwatch.h"
+
+#include <string.h>
+
+/* every testcase scans roughly this many bytes */
+#define BYTES_PER_TESTCASE (64 * 1024 * 1024)
+
+static gchar *
+_generate_buffer(gsize line_len)
+{
+  gchar *buffer = g_malloc(line_len + 1);
+  gsize i;
+
+  for (i = 0; i < line_len - 1; i++)
+    buffer[i] = 'a' + (i % 26);
+  buffer[line_len - 1] = '\n';
+  buffer[line_len] = 0;
+  return buffer;
+}
+
+static void
+_perftest_find_cr_or_lf(gsize line_len)
+{
+  gchar *buffer = _generate_buffer(line_len);
+  gint iterations = BYTES_PER_TESTCASE / line_len;
+  gint i;
+  gsize found = 0;
+
+  start_stopwatch();
+  for (i = 0; i < iterations; i++)
+    found += find_cr_or_lf(buffer, line_len) - buffer;
+  stop_stopwatch_and_display_result(iterations, "find_cr_or_lf(), line_len=%6" G_GSIZE_FORMAT, line_len);
+
+  assert_gint64(found, (gint64) iterations * (line_len - 1), "find_cr_or_lf() returned a wrong position");
+  g_free(buffer);
+}
+
+static void
+_perftest_find_lf_or_nul(gsize line_len)
+{
+  gchar *buffer = _generate_buffer(line_len);
+  gint iterations = BYTES_PER_TESTCASE / line_len;
+  gint i;
+  gsize found = 0;
+
+  start_stopwatch();
+  for (i = 0; i < iterations; i++)
+    found += find_lf_or_nul((guchar *) buffer, line_len) - (guchar *) buffer;
+  stop_stopwatch_and_display_result(iterations, "find_lf_or_nul(), line_len=%6" G_GSIZE_FORMAT, line_len);
+
+  assert_gint64(found, (gint64) iterations * (line_len - 1), "find_lf_or_nul() returned a wrong position");
+  g_free(buffer);
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  const gsize line_lengths[] = { 50, 128, 256, 512, 1024, 4096, 16384, 65536 };
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS(line_lengths); i++)
+    _perftest_find_cr_or_lf(line_lengths[i]);
+  for (i = 0; i < G_N_ELEMENTS(line_lengths); i++)
+    _perftest_find_lf_or_nul(line_lengths[i]);
+  return 0;
+}
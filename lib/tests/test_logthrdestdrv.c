@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "testutils.h"
+#include "logthrdestdrv.c"
+#include "logqueue-fifo.h"
+#include "apphook.h"
+#include "cfg.h"
+
+#include <stdlib.h>
+
+/* the worker is driven directly from the test, without a worker thread,
+ * flush() submits the batch and the test reports its outcome */
+
+#define BATCH_LINES 2
+#define MAX_PENDING_BATCHES 3
+
+typedef struct _StubWorker
+{
+  LogThrDestWorker super;
+  GArray *inserted;
+  gint disconnects;
+} StubWorker;
+
+static GArray *acked;
+static NVHandle seq_handle;
+
+static gint
+_get_seq(LogMessage *msg)
+{
+  return atoi(log_msg_get_value(msg, seq_handle, NULL));
+}
+
+static void
+_record_ack(LogMessage *msg, AckType ack_type)
+{
+  gint seq = _get_seq(msg);
+
+  g_array_append_val(acked, seq);
+}
+
+static worker_insert_result_t
+_stub_insert(LogThrDestWorker *s, LogMessage *msg)
+{
+  StubWorker *self = (StubWorker *) s;
+  gint seq = _get_seq(msg);
+
+  g_array_append_val(self->inserted, seq);
+  return WORKER_INSERT_RESULT_QUEUED;
+}
+
+static worker_insert_result_t
+_stub_flush(LogThrDestWorker *s)
+{
+  return WORKER_INSERT_RESULT_PENDING;
+}
+
+static void
+_stub_disconnect(LogThrDestWorker *s)
+{
+  StubWorker *self = (StubWorker *) s;
+
+  self->disconnects++;
+}
+
+static LogThrDestDriver *
+_create_driver(void)
+{
+  LogThrDestDriver *driver = g_new0(LogThrDestDriver, 1);
+
+  log_threaded_dest_driver_init_instance(driver, configuration);
+  driver->super.super.id = g_strdup("test_logthrdestdrv");
+  driver->time_reopen = 60;
+  driver->batch_lines = BATCH_LINES;
+  return driver;
+}
+
+static StubWorker *
+_create_worker(LogThrDestDriver *driver)
+{
+  StubWorker *self = g_new0(StubWorker, 1);
+
+  log_threaded_dest_worker_init_instance(&self->super, driver, 0);
+  self->super.insert = _stub_insert;
+  self->super.flush = _stub_flush;
+  self->super.disconnect = _stub_disconnect;
+  self->super.max_pending_batches = MAX_PENDING_BATCHES;
+  self->super.queue = log_queue_fifo_new(1000, NULL);
+  log_queue_set_use_backlog(self->super.queue, TRUE);
+  self->super.connected = TRUE;
+  self->inserted = g_array_new(FALSE, FALSE, sizeof(gint));
+
+  log_threaded_dest_worker_init_watches(&self->super);
+  return self;
+}
+
+static void
+_free_worker(StubWorker *self)
+{
+  LogThrDestDriver *driver = self->super.owner;
+
+  log_threaded_dest_worker_stop_watches(&self->super);
+  iv_event_unregister(&self->super.wake_up_event);
+  iv_event_unregister(&self->super.shutdown_event);
+
+  log_queue_unref(self->super.queue);
+  g_array_free(self->inserted, TRUE);
+  g_free(self);
+  log_pipe_unref(&driver->super.super.super);
+}
+
+static void
+_feed_messages(StubWorker *self, gint first, gint count)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  gint i;
+
+  path_options.ack_needed = TRUE;
+  path_options.flow_control_requested = TRUE;
+  for (i = first; i < first + count; i++)
+    {
+      LogMessage *msg = log_msg_new_empty();
+      gchar seq[16];
+
+      g_snprintf(seq, sizeof(seq), "%d", i);
+      log_msg_set_value(msg, seq_handle, seq, -1);
+      log_msg_add_ack(msg, &path_options);
+      msg->ack_func = _record_ack;
+      log_queue_push_tail(self->super.queue, msg, &path_options);
+    }
+}
+
+static void
+_resume_worker(StubWorker *self)
+{
+  log_threaded_dest_worker_stop_watches(&self->super);
+  self->super.suspended = FALSE;
+  self->super.connected = TRUE;
+}
+
+static void
+assert_sequence(GArray *seqs, gint first, gint count, const gchar *what)
+{
+  gint i;
+
+  assert_gint(seqs->len, count, "unexpected number of %s messages", what);
+  for (i = 0; i < count; i++)
+    assert_gint(g_array_index(seqs, gint, i), first + i, "%s messages are out of order at position %d", what, i);
+}
+
+static void
+test_pending_batches_are_acked_in_order(void)
+{
+  StubWorker *worker = _create_worker(_create_driver());
+  gint i;
+
+  testcase_begin("%s", __FUNCTION__);
+  g_array_set_size(acked, 0);
+  _feed_messages(worker, 0, MAX_PENDING_BATCHES * BATCH_LINES);
+
+  log_threaded_dest_worker_do_insert(&worker->super);
+  assert_gint(worker->super.pending_batches, MAX_PENDING_BATCHES, "batches are not outstanding");
+  assert_gint(worker->super.pending_lines, MAX_PENDING_BATCHES * BATCH_LINES, "lines are not outstanding");
+  assert_gint(acked->len, 0, "outstanding batches were acked before they were completed");
+
+  for (i = 0; i < MAX_PENDING_BATCHES; i++)
+    {
+      log_threaded_dest_worker_complete_batch(&worker->super, BATCH_LINES, WORKER_INSERT_RESULT_SUCCESS);
+      assert_sequence(acked, 0, (i + 1) * BATCH_LINES, "acked");
+    }
+
+  assert_gint(worker->super.pending_batches, 0, "completed batches are still outstanding");
+  assert_gint(worker->super.pending_lines, 0, "completed lines are still outstanding");
+  assert_gint(log_queue_get_length(worker->super.queue), 0, "messages were left in the queue");
+  assert_false(worker->super.suspended, "the worker was suspended");
+
+  _free_worker(worker);
+  testcase_end();
+}
+
+static void
+test_failed_batch_rewinds_every_outstanding_batch(void)
+{
+  StubWorker *worker = _create_worker(_create_driver());
+  gint num_lines = MAX_PENDING_BATCHES * BATCH_LINES;
+
+  testcase_begin("%s", __FUNCTION__);
+  g_array_set_size(acked, 0);
+  _feed_messages(worker, 0, num_lines);
+
+  log_threaded_dest_worker_do_insert(&worker->super);
+  log_threaded_dest_worker_complete_batch(&worker->super, BATCH_LINES, WORKER_INSERT_RESULT_SUCCESS);
+  log_threaded_dest_worker_complete_batch(&worker->super, BATCH_LINES, WORKER_INSERT_RESULT_ERROR);
+
+  assert_sequence(acked, 0, BATCH_LINES, "acked");
+  assert_gint(worker->super.pending_batches, 0, "the outstanding batches were not rewound");
+  assert_gint(worker->super.pending_lines, 0, "the outstanding lines were not rewound");
+  assert_gint(log_queue_get_length(worker->super.queue), num_lines - BATCH_LINES,
+              "the outstanding messages were not put back to the queue");
+  assert_true(worker->super.suspended, "the worker was not suspended after a failure");
+  assert_false(worker->super.connected, "the worker was not disconnected after a failure");
+  assert_gint(worker->disconnects, 1, "disconnect() was not called once");
+
+  /* the rewound messages are sent again, in their original order */
+  _resume_worker(worker);
+  g_array_set_size(worker->inserted, 0);
+  log_threaded_dest_worker_do_insert(&worker->super);
+  assert_sequence(worker->inserted, BATCH_LINES, num_lines - BATCH_LINES, "resent");
+
+  while (worker->super.pending_batches > 0)
+    log_threaded_dest_worker_complete_batch(&worker->super, BATCH_LINES, WORKER_INSERT_RESULT_SUCCESS);
+  assert_sequence(acked, 0, num_lines, "acked");
+
+  _free_worker(worker);
+  testcase_end();
+}
+
+static void
+test_consumption_stops_at_max_pending_batches(void)
+{
+  StubWorker *worker = _create_worker(_create_driver());
+  gint num_lines = (MAX_PENDING_BATCHES + 2) * BATCH_LINES;
+
+  testcase_begin("%s", __FUNCTION__);
+  g_array_set_size(acked, 0);
+  _feed_messages(worker, 0, num_lines);
+
+  log_threaded_dest_worker_do_insert(&worker->super);
+  assert_gint(worker->super.pending_batches, MAX_PENDING_BATCHES, "unexpected number of outstanding batches");
+  assert_sequence(worker->inserted, 0, MAX_PENDING_BATCHES * BATCH_LINES, "inserted");
+  assert_gint(log_queue_get_length(worker->super.queue), num_lines - MAX_PENDING_BATCHES * BATCH_LINES,
+              "messages were consumed while the pipeline was full");
+
+  /* nothing is consumed until a batch completes */
+  log_threaded_dest_worker_do_insert(&worker->super);
+  assert_gint(worker->inserted->len, MAX_PENDING_BATCHES * BATCH_LINES,
+              "messages were inserted while the pipeline was full");
+
+  log_threaded_dest_worker_complete_batch(&worker->super, BATCH_LINES, WORKER_INSERT_RESULT_SUCCESS);
+  assert_true(iv_task_registered(&worker->super.do_work), "the worker was not woken up by a completed batch");
+
+  log_threaded_dest_worker_do_insert(&worker->super);
+  assert_gint(worker->super.pending_batches, MAX_PENDING_BATCHES, "unexpected number of outstanding batches");
+  assert_sequence(worker->inserted, 0, (MAX_PENDING_BATCHES + 1) * BATCH_LINES, "inserted");
+  assert_gint(log_queue_get_length(worker->super.queue), BATCH_LINES,
+              "the queue was not consumed up to max_pending_batches");
+
+  while (worker->super.pending_batches > 0)
+    {
+      log_threaded_dest_worker_complete_batch(&worker->super, BATCH_LINES, WORKER_INSERT_RESULT_SUCCESS);
+      log_threaded_dest_worker_do_insert(&worker->super);
+    }
+  assert_sequence(acked, 0, num_lines, "acked");
+
+  _free_worker(worker);
+  testcase_end();
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  app_startup();
+  configuration = cfg_new_snippet();
+  seq_handle = log_msg_get_value_handle("SEQ");
+  acked = g_array_new(FALSE, FALSE, sizeof(gint));
+
+  test_pending_batches_are_acked_in_order();
+  test_failed_batch_rewinds_every_outstanding_batch();
+  test_consumption_stops_at_max_pending_batches();
+
+  g_array_free(acked, TRUE);
+  cfg_free(configuration);
+  app_shutdown();
+  return 0;
+}
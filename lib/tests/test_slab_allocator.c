@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "slab-allocator.h"
+#include "testutils.h"
+
+#include <string.h>
+
+/* more than a few batches in the thread caches and the depot */
+#define NUM_OBJECTS 1024
+#define SMALL_OBJECT 100
+/* served by the largest size class */
+#define LARGE_CLASS_OBJECT 30000
+/* the number of objects handed over to the depot at once */
+#define SLAB_BATCH_OBJECTS 64
+
+typedef struct _ObjectSet
+{
+  gsize size;
+  gpointer objects[NUM_OBJECTS];
+} ObjectSet;
+
+static void
+_alloc_objects(ObjectSet *set)
+{
+  gint i;
+
+  for (i = 0; i < NUM_OBJECTS; i++)
+    {
+      set->objects[i] = slab_alloc(set->size);
+      memset(set->objects[i], 'x', set->size);
+    }
+}
+
+static void
+_free_objects(ObjectSet *set)
+{
+  gint i;
+
+  for (i = 0; i < NUM_OBJECTS; i++)
+    slab_free(set->objects[i]);
+}
+
+static gpointer
+_alloc_thread(gpointer user_data)
+{
+  _alloc_objects((ObjectSet *) user_data);
+  slab_allocator_thread_deinit();
+  return NULL;
+}
+
+static gpointer
+_free_thread(gpointer user_data)
+{
+  _free_objects((ObjectSet *) user_data);
+  slab_allocator_thread_deinit();
+  return NULL;
+}
+
+static void
+_run_in_thread(GThreadFunc func, ObjectSet *set)
+{
+  GThread *thread = g_thread_create(func, set, TRUE, NULL);
+
+  g_thread_join(thread);
+}
+
+static gboolean
+_contains(ObjectSet *set, gpointer p)
+{
+  gint i;
+
+  for (i = 0; i < NUM_OBJECTS; i++)
+    if (set->objects[i] == p)
+      return TRUE;
+  return FALSE;
+}
+
+static void
+test_slab_alloc_semantics(void)
+{
+  gpointer small, reused, large;
+
+  small = slab_alloc(SMALL_OBJECT);
+  assert_true(((gsize) small % sizeof(gdouble)) == 0, "slab object is not aligned properly");
+  memset(small, 'x', SMALL_OBJECT);
+  slab_free(small);
+
+  reused = slab_alloc(SMALL_OBJECT - 10);
+#if !SYSLOG_NG_ENABLE_MEMTRACE
+  assert_true(reused == small, "a freed object of the same size class is not reused by the same thread");
+#endif
+  slab_free(reused);
+
+  large = slab_alloc(1024 * 1024);
+  memset(large, 'x', 1024 * 1024);
+  slab_free(large);
+  assert_gint(slab_allocator_get_depot_bytes(1024 * 1024), 0, "objects above the largest size class are cached");
+
+  slab_free(NULL);
+  slab_allocator_thread_deinit();
+}
+
+static void
+test_objects_freed_by_another_thread_are_reused(void)
+{
+  ObjectSet freed = { .size = SMALL_OBJECT };
+  ObjectSet reused = { .size = SMALL_OBJECT };
+  gsize depot_bytes = slab_allocator_get_depot_bytes(SMALL_OBJECT);
+  gint i, found = 0;
+
+  _run_in_thread(_alloc_thread, &freed);
+  _run_in_thread(_free_thread, &freed);
+
+#if !SYSLOG_NG_ENABLE_MEMTRACE
+  assert_true(slab_allocator_get_depot_bytes(SMALL_OBJECT) > depot_bytes,
+              "objects freed by a thread were not handed over to the depot");
+#endif
+
+  _run_in_thread(_alloc_thread, &reused);
+  for (i = 0; i < NUM_OBJECTS; i++)
+    if (_contains(&freed, reused.objects[i]))
+      found++;
+
+#if !SYSLOG_NG_ENABLE_MEMTRACE
+  assert_true(found > 0, "objects freed by one thread were not reused by another");
+  assert_true(slab_allocator_get_depot_bytes(SMALL_OBJECT) <= depot_bytes,
+              "the depot was not consumed by the allocating thread");
+#endif
+
+  _run_in_thread(_free_thread, &reused);
+}
+
+static void
+test_depot_is_capped(void)
+{
+  ObjectSet first = { .size = LARGE_CLASS_OBJECT };
+  ObjectSet second = { .size = LARGE_CLASS_OBJECT };
+  gsize capped_bytes;
+
+  _alloc_objects(&first);
+  _alloc_objects(&second);
+
+  _free_objects(&first);
+  slab_allocator_thread_deinit();
+  capped_bytes = slab_allocator_get_depot_bytes(LARGE_CLASS_OBJECT);
+#if !SYSLOG_NG_ENABLE_MEMTRACE
+  assert_true(capped_bytes > 0, "no objects were cached in the depot");
+  assert_true(capped_bytes < NUM_OBJECTS * LARGE_CLASS_OBJECT, "every freed object was kept in the depot");
+#endif
+
+  _free_objects(&second);
+  slab_allocator_thread_deinit();
+  assert_gint64(slab_allocator_get_depot_bytes(LARGE_CLASS_OBJECT), capped_bytes,
+                "the depot kept growing above its limit");
+}
+
+static void
+test_thread_exit_flushes_the_thread_cache(void)
+{
+  /* fewer than two batches: all of them stay in the thread cache */
+  gint count = SLAB_BATCH_OBJECTS + SLAB_BATCH_OBJECTS / 2;
+  gsize size = SMALL_OBJECT * 4;
+  gpointer objects[count];
+  gsize depot_bytes;
+  gint i;
+
+  depot_bytes = slab_allocator_get_depot_bytes(size);
+  for (i = 0; i < count; i++)
+    objects[i] = slab_alloc(size);
+  for (i = 0; i < count; i++)
+    slab_free(objects[i]);
+  assert_gint(slab_allocator_get_depot_bytes(size), depot_bytes, "objects left the thread cache before the thread exited");
+
+  slab_allocator_thread_deinit();
+#if !SYSLOG_NG_ENABLE_MEMTRACE
+  assert_true(slab_allocator_get_depot_bytes(size) > depot_bytes,
+              "the objects cached by an exiting thread were not handed over to the depot");
+#endif
+
+  for (i = 0; i < count; i++)
+    objects[i] = slab_alloc(size);
+  assert_gint(slab_allocator_get_depot_bytes(size), depot_bytes, "the flushed objects were not reused");
+  for (i = 0; i < count; i++)
+    slab_free(objects[i]);
+  slab_allocator_thread_deinit();
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  test_slab_alloc_semantics();
+  test_objects_freed_by_another_thread_are_reused();
+  test_depot_is_capped();
+  test_thread_exit_flushes_the_thread_cache();
+  return 0;
+}
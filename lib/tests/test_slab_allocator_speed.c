@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "slab-allocator.h"
+#include "testutils.h"
+#include "stopwatch.h"
+
+#include <string.h>
+
+#define OBJECTS_PER_PRODUCER (1024 * 1024)
+/* objects are passed between threads in chunks, to keep the overhead of
+ * the GAsyncQueue out of the measurement */
+#define CHUNK_SIZE 256
+/* producers wait for their consumer above this many chunks in flight */
+#define MAX_CHUNKS_IN_FLIGHT 64
+
+typedef struct _Allocator
+{
+  const gchar *name;
+  gpointer (*alloc)(gsize size);
+  void (*free)(gpointer p);
+} Allocator;
+
+typedef struct _ThreadPair
+{
+  const Allocator *allocator;
+  GAsyncQueue *chunks;
+} ThreadPair;
+
+/* a queue node, a short and a long message */
+static const gsize object_sizes[] = { 48, 640, 1800 };
+
+static gpointer
+_producer_thread(gpointer user_data)
+{
+  ThreadPair *pair = (ThreadPair *) user_data;
+  gpointer *chunk = NULL;
+  gint i;
+
+  for (i = 0; i < OBJECTS_PER_PRODUCER; i++)
+    {
+      gsize size = object_sizes[i % G_N_ELEMENTS(object_sizes)];
+
+      if (!chunk)
+        {
+          while (g_async_queue_length(pair->chunks) > MAX_CHUNKS_IN_FLIGHT)
+            g_thread_yield();
+          chunk = g_new(gpointer, CHUNK_SIZE);
+        }
+
+      chunk[i % CHUNK_SIZE] = pair->allocator->alloc(size);
+      memset(chunk[i % CHUNK_SIZE], 0, 16);
+      if ((i % CHUNK_SIZE) == CHUNK_SIZE - 1)
+        {
+          g_async_queue_push(pair->chunks, chunk);
+          chunk = NULL;
+        }
+    }
+  slab_allocator_thread_deinit();
+  return NULL;
+}
+
+static gpointer
+_consumer_thread(gpointer user_data)
+{
+  ThreadPair *pair = (ThreadPair *) user_data;
+  gint i, j;
+
+  for (i = 0; i < OBJECTS_PER_PRODUCER / CHUNK_SIZE; i++)
+    {
+      gpointer *chunk = g_async_queue_pop(pair->chunks);
+
+      for (j = 0; j < CHUNK_SIZE; j++)
+        pair->allocator->free(chunk[j]);
+      g_free(chunk);
+    }
+  slab_allocator_thread_deinit();
+  return NULL;
+}
+
+static void
+_perftest_cross_thread_free(const Allocator *allocator, gint num_threads)
+{
+  gint num_pairs = num_threads / 2;
+  ThreadPair pairs[num_pairs];
+  GThread *threads[num_threads];
+  gint i;
+
+  for (i = 0; i < num_pairs; i++)
+    {
+      pairs[i].allocator = allocator;
+      pairs[i].chunks = g_async_queue_new();
+    }
+
+  start_stopwatch();
+  for (i = 0; i < num_pairs; i++)
+    {
+      threads[2 * i] = g_thread_create(_consumer_thread, &pairs[i], TRUE, NULL);
+      threads[2 * i + 1] = g_thread_create(_producer_thread, &pairs[i], TRUE, NULL);
+    }
+  for (i = 0; i < num_threads; i++)
+    g_thread_join(threads[i]);
+  stop_stopwatch_and_display_result(num_pairs * OBJECTS_PER_PRODUCER,
+                                    "%s, alloc/free across %2d threads", allocator->name, num_threads);
+
+  for (i = 0; i < num_pairs; i++)
+    g_async_queue_unref(pairs[i].chunks);
+}
+
+static gpointer
+_g_malloc(gsize size)
+{
+  return g_malloc(size);
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  const Allocator allocators[] =
+  {
+    { "g_malloc", _g_malloc, g_free },
+    { "slab_alloc", slab_alloc, slab_free },
+  };
+  const gint thread_counts[] = { 2, 8, 32 };
+  gint i, j;
+
+  for (i = 0; i < G_N_ELEMENTS(allocators); i++)
+    for (j = 0; j < G_N_ELEMENTS(thread_counts); j++)
+      _perftest_cross_thread_free(&allocators[i], thread_counts[j]);
+
+  return 0;
+}
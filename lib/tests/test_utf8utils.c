@@ -72,6 +72,48 @@ assert_escaped_text(const gchar *str, const gchar *expected_escaped_str)
   assert_escaped_text_with_unsafe_chars(str, expected_escaped_str, NULL);
 }
 
+void
+assert_utf8_validate_with_len(const gchar *str, gssize str_len, gboolean expected)
+{
+  assert_gboolean(utf8_validate(str, str_len), expected, "utf8_validate() returned an unexpected result, str=%s", str);
+  assert_gboolean(g_utf8_validate(str, str_len, NULL), expected,
+                  "utf8_validate() and g_utf8_validate() disagree, str=%s", str);
+}
+
+void
+assert_utf8_validate(const gchar *str, gboolean expected)
+{
+  assert_utf8_validate_with_len(str, -1, expected);
+}
+
+static void
+test_escaping_long_strings(void)
+{
+  /* the escapes are placed around the boundaries of the vectorized fast path */
+  assert_escaped_text_with_unsafe_chars("0123456789abcdef\"0123456789abcdef\n0123456789abcde\\",
+                                        "0123456789abcdef\\\"0123456789abcdef\\n0123456789abcde\\\\", "\"");
+  assert_escaped_text("0123456789abcdeá0123456789abcdef\x01",
+                      "0123456789abcdeá0123456789abcdef\\u0001");
+  assert_escaped_binary("0123456789abcdef0123456789abcdef\xad""0123456789",
+                        "0123456789abcdef0123456789abcdef\\xad""0123456789");
+  assert_escaped_binary_with_len("0123456789abcdef0123456789abcdef\n", 32,
+                                 "0123456789abcdef0123456789abcdef");
+}
+
+static void
+test_utf8_validate(void)
+{
+  assert_utf8_validate("", TRUE);
+  assert_utf8_validate("ascii only text, long enough to cover the vectorized path", TRUE);
+  assert_utf8_validate("árvíztűrőtükörfúrógép", TRUE);
+  assert_utf8_validate("0123456789abcdefárvíztűrőtükörfúrógép0123456789abcdef", TRUE);
+  assert_utf8_validate("0123456789abcdef\xad""0123456789abcdef", FALSE);
+  assert_utf8_validate("0123456789abcdef0123456789abcde\xc3", FALSE);
+  assert_utf8_validate_with_len("0123456789abcdef0123456789abcde\xc3\xa1", 32, FALSE);
+  assert_utf8_validate_with_len("0123456789abcdef0123456789abcde\xc3\xa1", 33, TRUE);
+  assert_utf8_validate_with_len("0123456789abcdef\0000123456789abcdef", 33, FALSE);
+}
+
 int
 main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
 {
@@ -106,5 +148,7 @@ main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
   assert_escaped_text_with_unsafe_chars("\"text\"", "\\\"text\\\"", "\"");
   assert_escaped_text_with_unsafe_chars("\"text\"", "\\\"te\\xt\\\"", "\"x");
 
+  test_escaping_long_strings();
+  test_utf8_validate();
   return 0;
 }
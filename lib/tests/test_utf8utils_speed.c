@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+#include "utf8utils.h"
+#include "testutils.h"
+#include "stopwatch.h"
+
+#include <string.h>
+
+#define ITERATION_NUMBER 100000
+
+static void
+_perftest_escape(const gchar *str)
+{
+  GString *escaped_str = g_string_sized_new(1024);
+  gsize str_len = strlen(str);
+  gint i;
+
+  start_stopwatch();
+  for (i = 0; i < ITERATION_NUMBER; i++)
+    {
+      g_string_truncate(escaped_str, 0);
+      append_unsafe_utf8_as_escaped_text(escaped_str, str, str_len, "\"");
+    }
+  stop_stopwatch_and_display_result(i, "escape %.40s...", str);
+  g_string_free(escaped_str, TRUE);
+}
+
+static void
+_perftest_validate(const gchar *str)
+{
+  gsize str_len = strlen(str);
+  gint i;
+
+  start_stopwatch();
+  for (i = 0; i < ITERATION_NUMBER; i++)
+    utf8_validate(str, str_len);
+  stop_stopwatch_and_display_result(i, "validate %.40s...", str);
+}
+
+static void
+test_performance(void)
+{
+  const gchar *ascii = "Oct 11 22:14:15 mymachine su: 'su root' failed for lonvick on /dev/pts/8, "
+                       "session opened for user root by (uid=0), this is a typical log message of ascii characters";
+  const gchar *escapes = "{\"msg\": \"key=value\tkey2=value2\\n\"}, \"path\": \"C:\\\\Windows\\\\System32\"}";
+  const gchar *multibyte = "árvíztűrőtükörfúrógép árvíztűrőtükörfúrógép árvíztűrőtükörfúrógép árvíztűrőtükörfúrógép";
+
+  _perftest_escape(ascii);
+  _perftest_escape(escapes);
+  _perftest_escape(multibyte);
+  _perftest_validate(ascii);
+  _perftest_validate(multibyte);
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  test_performance();
+  return 0;
+}
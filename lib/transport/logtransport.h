@@ -30,11 +30,23 @@
 
 typedef struct _LogTransport LogTransport;
 
+/* a single record received by read_batch() */
+typedef struct _LogTransportDatagram
+{
+  gpointer buf;
+  gsize buflen;
+  gsize len;
+  LogTransportAuxData aux;
+} LogTransportDatagram;
+
 struct _LogTransport
 {
   gint fd;
   GIOCondition cond;
   gssize (*read)(LogTransport *self, gpointer buf, gsize count, LogTransportAuxData *aux);
+  /* optional, receives up to @count records with a single call, returns
+   * the number of records received or -1 and errno set */
+  gint (*read_batch)(LogTransport *self, LogTransportDatagram *datagrams, gint count);
   gssize (*write)(LogTransport *self, const gpointer buf, gsize count);
   void (*free_fn)(LogTransport *self);
 };
@@ -51,6 +63,18 @@ log_transport_read(LogTransport *self, gpointer buf, gsize count, LogTransportAu
   return self->read(self, buf, count, aux);
 }
 
+static inline gboolean
+log_transport_can_read_batch(LogTransport *self)
+{
+  return self->read_batch != NULL;
+}
+
+static inline gint
+log_transport_read_batch(LogTransport *self, LogTransportDatagram *datagrams, gint count)
+{
+  return self->read_batch(self, datagrams, count);
+}
+
 void log_transport_init_instance(LogTransport *s, gint fd);
 void log_transport_free_method(LogTransport *s);
 void log_transport_free(LogTransport *s);
@@ -25,6 +25,7 @@
 
 #include <errno.h>
 #include <unistd.h>
+#include <string.h>
 
 static gssize
 log_transport_dgram_socket_read_method(LogTransport *s, gpointer buf, gsize buflen, LogTransportAuxData *aux)
@@ -52,6 +53,50 @@ log_transport_dgram_socket_read_method(LogTransport *s, gpointer buf, gsize bufl
   return rc;
 }
 
+#if defined(SYSLOG_NG_HAVE_RECVMMSG)
+static gint
+log_transport_dgram_socket_read_batch_method(LogTransport *s, LogTransportDatagram *datagrams, gint count)
+{
+  LogTransportSocket *self = (LogTransportSocket *) s;
+  struct mmsghdr *msgs = g_alloca(count * sizeof(struct mmsghdr));
+  struct iovec *iov = g_alloca(count * sizeof(struct iovec));
+  struct sockaddr_storage *ss = g_alloca(count * sizeof(struct sockaddr_storage));
+  gint rc, i;
+
+  memset(msgs, 0, count * sizeof(struct mmsghdr));
+  for (i = 0; i < count; i++)
+    {
+      iov[i].iov_base = datagrams[i].buf;
+      iov[i].iov_len = datagrams[i].buflen;
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = &ss[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(ss[i]);
+    }
+
+  do
+    {
+      rc = recvmmsg(self->super.fd, msgs, count, 0, NULL);
+    }
+  while (rc == -1 && errno == EINTR);
+
+  if (rc == 0)
+    {
+      rc = -1;
+      errno = EAGAIN;
+    }
+
+  for (i = 0; i < rc; i++)
+    {
+      datagrams[i].len = msgs[i].msg_len;
+      if (msgs[i].msg_hdr.msg_namelen)
+        log_transport_aux_data_set_peer_addr_ref(&datagrams[i].aux,
+                                                 g_sockaddr_new((struct sockaddr *) &ss[i], msgs[i].msg_hdr.msg_namelen));
+    }
+  return rc;
+}
+#endif
+
 static gssize
 log_transport_dgram_socket_write_method(LogTransport *s, const gpointer buf, gsize buflen)
 {
@@ -83,6 +128,9 @@ log_transport_dgram_socket_init_instance(LogTransportSocket *self, gint fd)
 {
   log_transport_init_instance(&self->super, fd);
   self->super.read = log_transport_dgram_socket_read_method;
+#if defined(SYSLOG_NG_HAVE_RECVMMSG)
+  self->super.read_batch = log_transport_dgram_socket_read_batch_method;
+#endif
   self->super.write = log_transport_dgram_socket_write_method;
 }
 
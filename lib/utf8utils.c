@@ -24,6 +24,134 @@
 #include "utf8utils.h"
 #include "str-utils.h"
 
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#define UTF8UTILS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/*
+ * Fast paths for the common case of ASCII input: instead of decoding the
+ * input character by character, we look for the first byte that may need
+ * attention, 16 bytes at a time where SSE2 is available (always the case
+ * on x86_64), and copy the bytes in front of it in bulk.
+ */
+
+static inline gboolean
+_is_byte_safe(guchar c, const gchar *unsafe_chars)
+{
+  if (c < 32 || c >= 128 || c == '\\')
+    return FALSE;
+
+  return !unsafe_chars || _strchr_optimized_for_single_char_haystack(unsafe_chars, c) == NULL;
+}
+
+/* returns the length of the prefix that can be copied without escaping */
+static gsize
+_find_safe_ascii_prefix(const gchar *str, gsize str_len, const gchar *unsafe_chars)
+{
+  gsize i = 0;
+
+#if UTF8UTILS_SSE2
+  /* a signed comparison against 32 covers both control characters and
+   * bytes with the highest bit set, e.g. multibyte utf8 sequences */
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i backslash = _mm_set1_epi8('\\');
+
+  for (; i + sizeof(__m128i) <= str_len; i += sizeof(__m128i))
+    {
+      __m128i chunk = _mm_loadu_si128((const __m128i *) (str + i));
+      __m128i special = _mm_or_si128(_mm_cmplt_epi8(chunk, space),
+                                     _mm_cmpeq_epi8(chunk, backslash));
+      guint mask;
+
+      if (unsafe_chars)
+        {
+          const gchar *unsafe;
+
+          for (unsafe = unsafe_chars; *unsafe; unsafe++)
+            special = _mm_or_si128(special, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(*unsafe)));
+        }
+
+      mask = _mm_movemask_epi8(special);
+      if (mask)
+        return i + __builtin_ctz(mask);
+    }
+#endif
+
+  for (; i < str_len; i++)
+    {
+      if (!_is_byte_safe(str[i], unsafe_chars))
+        break;
+    }
+  return i;
+}
+
+/* returns the length of the prefix that is ASCII, except for NUL */
+static gsize
+_find_ascii_prefix(const gchar *str, gsize str_len)
+{
+  gsize i = 0;
+
+#if UTF8UTILS_SSE2
+  const __m128i nul = _mm_setzero_si128();
+
+  for (; i + sizeof(__m128i) <= str_len; i += sizeof(__m128i))
+    {
+      __m128i chunk = _mm_loadu_si128((const __m128i *) (str + i));
+      guint mask = _mm_movemask_epi8(_mm_or_si128(chunk, _mm_cmpeq_epi8(chunk, nul)));
+
+      if (mask)
+        return i + __builtin_ctz(mask);
+    }
+#endif
+
+  for (; i < str_len; i++)
+    {
+      guchar c = str[i];
+
+      if (c == 0 || c >= 128)
+        break;
+    }
+  return i;
+}
+
+/**
+ * Validate that @str is a valid utf8 string, the same way g_utf8_validate()
+ * does: a NUL character within @str_len makes it invalid.
+ *
+ * Runs of ASCII characters are validated in bulk and only multibyte
+ * sequences get decoded one by one.
+ */
+gboolean
+utf8_validate(const gchar *str, gssize str_len)
+{
+  const gchar *end;
+
+  if (str_len < 0)
+    str_len = strlen(str);
+  end = str + str_len;
+
+  while (str < end)
+    {
+      gunichar uchar;
+
+      str += _find_ascii_prefix(str, end - str);
+      if (str == end)
+        break;
+
+      if (*str == 0)
+        return FALSE;
+
+      uchar = g_utf8_get_char_validated(str, end - str);
+      if (uchar == (gunichar) -1 || uchar == (gunichar) -2)
+        return FALSE;
+      str = g_utf8_next_char(str);
+    }
+  return TRUE;
+}
+
 static inline gboolean
 _is_character_unsafe(gunichar uchar, const gchar *unsafe_chars)
 {
@@ -119,8 +247,19 @@ _append_unsafe_utf8_as_escaped_with_specific_length(GString *escaped_output, con
   const gchar *raw_end = raw + raw_len;
 
   while (raw < raw_end)
-    _append_escaped_utf8_character(escaped_output, &raw, raw_end - raw, unsafe_chars,
-                                   control_format, invalid_format);
+    {
+      if (_is_byte_safe(*raw, unsafe_chars))
+        {
+          gsize safe_len = _find_safe_ascii_prefix(raw, raw_end - raw, unsafe_chars);
+
+          g_string_append_len(escaped_output, raw, safe_len);
+          raw += safe_len;
+          if (raw == raw_end)
+            break;
+        }
+      _append_escaped_utf8_character(escaped_output, &raw, raw_end - raw, unsafe_chars,
+                                     control_format, invalid_format);
+    }
 }
 
 static void
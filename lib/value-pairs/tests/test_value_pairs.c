@@ -205,6 +205,51 @@ Test(value_pairs, test_transformers)
   g_ptr_array_free(transformers, TRUE);
 }
 
+static gboolean
+vp_values_foreach(const gchar *name, TypeHint type, const gchar *value,
+                  gsize value_len, gpointer user_data)
+{
+  GString *res = (GString *) user_data;
+
+  if (res->len > 0)
+    g_string_append_c(res, ',');
+  g_string_append_printf(res, "%s=%.*s", name, (gint) value_len, value);
+  return FALSE;
+}
+
+Test(value_pairs, test_repeated_use_gives_the_same_results)
+{
+  ValuePairs *vp;
+  LogTemplate *template;
+  GString *result = g_string_sized_new(0);
+  gint i;
+
+  vp = value_pairs_new();
+  value_pairs_add_scope(vp, "nv-pairs");
+  value_pairs_add_glob_pattern(vp, "MSGID", FALSE);
+  value_pairs_add_glob_pattern(vp, "MESSAGE", FALSE);
+
+  /* explicitly added pairs override the name-value pairs of the message */
+  template = create_template("string", "override");
+  value_pairs_add_pair(vp, "HOST", template);
+  log_template_unref(template);
+
+  /* the include decisions are cached after the first message */
+  for (i = 0; i < 3; i++)
+    {
+      LogMessage *msg = create_message();
+
+      g_string_truncate(result, 0);
+      value_pairs_foreach(vp, vp_values_foreach, msg, 11, LTZ_LOCAL, &template_options, result);
+      cr_expect_str_eq(result->str, "HOST=override,PID=20208,PROGRAM=MSExchange_ADAccess",
+                       "Unexpected value-pairs result in iteration %d", i);
+      log_msg_unref(msg);
+    }
+
+  g_string_free(result, TRUE);
+  value_pairs_unref(vp);
+}
+
 GlobalConfig *cfg;
 
 void
@@ -51,19 +51,49 @@ typedef struct
   /* we don't own any of the fields here, it is assumed that allocations are
    * managed by the caller */
 
-  GString *name;
+  const gchar *name;
   GString *value;
   TypeHint type_hint;
+
+  /* insertion order, if the same name is added twice, the last one wins */
+  gint order;
 } VPResultValue;
 
+/* the number of results that fit without allocating memory */
+#define VP_RESULTS_PREALLOC_SIZE 64
+
 typedef struct
 {
-  GTree *result_tree;
-
-  /* array of VPResultValue instances */
-  GArray *values;
+  VPResultValue *values;
+  gint len;
+  gint size;
+  VPResultValue prealloc_values[VP_RESULTS_PREALLOC_SIZE];
 } VPResults;
 
+/*
+ * Whether a name-value pair of a message is included in the result and
+ * the name it is included with only depend on its name, so the decision is
+ * cached for each NVHandle.  The cache is filled lazily by the threads
+ * formatting messages: pages and entries are published with atomic
+ * compare-and-exchange and are never changed or freed while the
+ * ValuePairs instance is in use.
+ */
+#define VP_HANDLE_CACHE_PAGE_BITS 8
+#define VP_HANDLE_CACHE_PAGE_SIZE (1 << VP_HANDLE_CACHE_PAGE_BITS)
+#define VP_HANDLE_CACHE_NUM_PAGES 256
+
+typedef struct
+{
+  gboolean include;
+  /* the name after the transformations, NULL if not included */
+  gchar *name;
+} VPHandleCacheEntry;
+
+typedef struct
+{
+  VPHandleCacheEntry *entries[VP_HANDLE_CACHE_PAGE_SIZE];
+} VPHandleCachePage;
+
 struct _ValuePairs
 {
   GAtomicCounter ref_cnt;
@@ -74,6 +104,8 @@ struct _ValuePairs
 
   /* guint32 as CfgFlagHandler only supports 32 bit integers */
   guint32 scopes;
+
+  VPHandleCachePage *handle_cache[VP_HANDLE_CACHE_NUM_PAGES];
 };
 
 typedef enum
@@ -191,39 +223,140 @@ vp_pair_conf_free(VPPairConf *vpc)
 }
 
 static void
-vp_result_value_init(VPResultValue *rv, GString *name, TypeHint type_hint, GString *value)
+vp_result_value_init(VPResultValue *rv, const gchar *name, TypeHint type_hint, GString *value, gint order)
 {
   rv->type_hint = type_hint;
   rv->name = name;
   rv->value = value;
+  rv->order = order;
 }
 
 static void
-vp_results_init(VPResults *results, GCompareFunc compare_func)
+vp_results_init(VPResults *results)
 {
-  results->values = g_array_sized_new(FALSE, FALSE, sizeof(VPResultValue), 16);
-  results->result_tree = g_tree_new_full((GCompareDataFunc) compare_func, NULL,
-                                         NULL, NULL);
+  results->values = results->prealloc_values;
+  results->len = 0;
+  results->size = VP_RESULTS_PREALLOC_SIZE;
 }
 
 static void
 vp_results_deinit(VPResults *results)
 {
-  g_tree_destroy(results->result_tree);
-  g_array_free(results->values, TRUE);
+  if (results->values != results->prealloc_values)
+    g_free(results->values);
+}
+
+static void
+vp_results_insert(VPResults *results, const gchar *name, TypeHint type_hint, GString *value)
+{
+  if (results->len == results->size)
+    {
+      results->size *= 2;
+      if (results->values == results->prealloc_values)
+        results->values = g_memdup(results->prealloc_values, sizeof(VPResultValue) * results->len);
+      results->values = g_renew(VPResultValue, results->values, results->size);
+    }
+
+  vp_result_value_init(&results->values[results->len], name, type_hint, value, results->len);
+  results->len++;
+}
+
+static gint
+vp_results_compare(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  const VPResultValue *rv1 = (const VPResultValue *) a;
+  const VPResultValue *rv2 = (const VPResultValue *) b;
+  GCompareFunc compare_func = *((GCompareFunc *) user_data);
+  gint result;
+
+  result = compare_func(rv1->name, rv2->name);
+  if (result == 0)
+    result = rv1->order - rv2->order;
+  return result;
 }
 
 static void
-vp_results_insert(VPResults *results, GString *name, TypeHint type_hint, GString *value)
+vp_results_sort(VPResults *results, GCompareFunc compare_func)
 {
-  VPResultValue *rv;
-  gint ndx = results->values->len;
+  g_qsort_with_data(results->values, results->len, sizeof(VPResultValue), vp_results_compare, &compare_func);
+}
+
+static VPHandleCacheEntry *
+vp_handle_cache_lookup(ValuePairs *vp, NVHandle handle)
+{
+  VPHandleCachePage *page;
+  guint page_ndx = handle >> VP_HANDLE_CACHE_PAGE_BITS;
+
+  if (page_ndx >= VP_HANDLE_CACHE_NUM_PAGES)
+    return NULL;
+
+  page = (VPHandleCachePage *) g_atomic_pointer_get(&vp->handle_cache[page_ndx]);
+  if (!page)
+    return NULL;
+  return (VPHandleCacheEntry *) g_atomic_pointer_get(&page->entries[handle & (VP_HANDLE_CACHE_PAGE_SIZE - 1)]);
+}
+
+/* returns the entry in the cache, which may have been stored by another
+ * thread in the meantime, or NULL if the handle is too large to be cached */
+static VPHandleCacheEntry *
+vp_handle_cache_store(ValuePairs *vp, NVHandle handle, gboolean include, const gchar *name)
+{
+  VPHandleCachePage *page;
+  VPHandleCacheEntry *entry;
+  guint page_ndx = handle >> VP_HANDLE_CACHE_PAGE_BITS;
+  guint entry_ndx = handle & (VP_HANDLE_CACHE_PAGE_SIZE - 1);
+
+  if (page_ndx >= VP_HANDLE_CACHE_NUM_PAGES)
+    return NULL;
+
+  page = (VPHandleCachePage *) g_atomic_pointer_get(&vp->handle_cache[page_ndx]);
+  if (!page)
+    {
+      page = g_new0(VPHandleCachePage, 1);
+      if (!g_atomic_pointer_compare_and_exchange(&vp->handle_cache[page_ndx], NULL, page))
+        {
+          g_free(page);
+          page = (VPHandleCachePage *) g_atomic_pointer_get(&vp->handle_cache[page_ndx]);
+        }
+    }
 
-  g_array_set_size(results->values, ndx + 1);
-  rv = &g_array_index(results->values, VPResultValue, ndx);
-  vp_result_value_init(rv, name, type_hint, value);
-  /* GTree takes over ownership of name */
-  g_tree_insert(results->result_tree, name->str, GINT_TO_POINTER(ndx));
+  entry = g_new(VPHandleCacheEntry, 1);
+  entry->include = include;
+  entry->name = include ? g_strdup(name) : NULL;
+  if (!g_atomic_pointer_compare_and_exchange(&page->entries[entry_ndx], NULL, entry))
+    {
+      g_free(entry->name);
+      g_free(entry);
+      entry = (VPHandleCacheEntry *) g_atomic_pointer_get(&page->entries[entry_ndx]);
+    }
+  return entry;
+}
+
+/* only called while the configuration is parsed, the cache is not used
+ * concurrently at that time */
+static void
+vp_handle_cache_clear(ValuePairs *vp)
+{
+  gint i, j;
+
+  for (i = 0; i < VP_HANDLE_CACHE_NUM_PAGES; i++)
+    {
+      VPHandleCachePage *page = vp->handle_cache[i];
+
+      if (!page)
+        continue;
+
+      for (j = 0; j < VP_HANDLE_CACHE_PAGE_SIZE; j++)
+        {
+          if (page->entries[j])
+            {
+              g_free(page->entries[j]->name);
+              g_free(page->entries[j]);
+            }
+        }
+      g_free(page);
+      vp->handle_cache[i] = NULL;
+    }
 }
 
 static GString *
@@ -264,7 +397,7 @@ vp_pairs_foreach(gpointer data, gpointer user_data)
                              template_options,
                              time_zone_mode, seq_num, NULL, sb);
 
-  vp_results_insert(results, vp_transform_apply(vp, vpc->name), vpc->template->type_hint, sb);
+  vp_results_insert(results, vp_transform_apply(vp, vpc->name)->str, vpc->template->type_hint, sb);
 }
 
 /* runs over the LogMessage nv-pairs, and inserts them unless excluded */
@@ -275,19 +408,35 @@ vp_msg_nvpairs_foreach(NVHandle handle, gchar *name,
 {
   ValuePairs *vp = ((gpointer *)user_data)[0];
   VPResults *results = ((gpointer *)user_data)[5];
+  VPHandleCacheEntry *entry;
+  const gchar *result_name;
   guint j;
   gboolean inc;
   GString *sb;
 
-  inc = (name[0] == '.' && (vp->scopes & VPS_DOT_NV_PAIRS)) ||
-  (name[0] != '.' && (vp->scopes & VPS_NV_PAIRS)) ||
-  (log_msg_is_handle_sdata(handle) && (vp->scopes & (VPS_SDATA + VPS_RFC5424)));
-
-  for (j = 0; j < vp->patterns->len; j++)
+  entry = vp_handle_cache_lookup(vp, handle);
+  if (entry)
     {
-      VPPatternSpec *vps = (VPPatternSpec *) g_ptr_array_index(vp->patterns, j);
-      if (vp_pattern_spec_eval(vps, name))
-        inc = vps->include;
+      inc = entry->include;
+      result_name = entry->name;
+    }
+  else
+    {
+      inc = (name[0] == '.' && (vp->scopes & VPS_DOT_NV_PAIRS)) ||
+      (name[0] != '.' && (vp->scopes & VPS_NV_PAIRS)) ||
+      (log_msg_is_handle_sdata(handle) && (vp->scopes & (VPS_SDATA + VPS_RFC5424)));
+
+      for (j = 0; j < vp->patterns->len; j++)
+        {
+          VPPatternSpec *vps = (VPPatternSpec *) g_ptr_array_index(vp->patterns, j);
+          if (vp_pattern_spec_eval(vps, name))
+            inc = vps->include;
+        }
+
+      result_name = inc ? vp_transform_apply(vp, name)->str : NULL;
+      entry = vp_handle_cache_store(vp, handle, inc, result_name);
+      if (entry)
+        result_name = entry->name;
     }
 
   if (!inc)
@@ -296,7 +445,7 @@ vp_msg_nvpairs_foreach(NVHandle handle, gchar *name,
   sb = scratch_buffers_alloc();
 
   g_string_append_len(sb, value, value_len);
-  vp_results_insert(results, vp_transform_apply(vp, name), TYPE_HINT_STRING, sb);
+  vp_results_insert(results, result_name, TYPE_HINT_STRING, sb);
 
   return FALSE;
 }
@@ -350,6 +499,7 @@ vp_merge_set(ValuePairs *vp, ValuePairSpec *set)
 static void
 vp_update_builtin_list_of_values(ValuePairs *vp)
 {
+  vp_handle_cache_clear(vp);
   g_ptr_array_set_size(vp->builtins, 0);
 
   if (vp->patterns->len > 0)
@@ -405,26 +555,10 @@ vp_merge_builtins(ValuePairs *vp, VPResults *results, LogMessage *msg, gint32 se
           continue;
         }
 
-      vp_results_insert(results, vp_transform_apply(vp, spec->name), TYPE_HINT_STRING, sb);
+      vp_results_insert(results, vp_transform_apply(vp, spec->name)->str, TYPE_HINT_STRING, sb);
     }
 }
 
-static gboolean
-vp_foreach_helper(const gchar *name, gpointer ndx_as_pointer, gpointer data)
-{
-  VPResults *results = ((gpointer *)data)[0];
-  gint ndx = GPOINTER_TO_INT(ndx_as_pointer);
-  VPResultValue *rv = &g_array_index(results->values, VPResultValue, ndx);
-  VPForeachFunc func = ((gpointer *)data)[1];
-  gpointer user_data = ((gpointer *)data)[2];
-  gboolean *r = ((gpointer *)data)[3];
-
-  *r &= !func(name, rv->type_hint,
-              rv->value->str,
-              rv->value->len, user_data);
-  return !*r;
-}
-
 
 gboolean
 value_pairs_foreach_sorted (ValuePairs *vp, VPForeachFunc func,
@@ -439,11 +573,11 @@ value_pairs_foreach_sorted (ValuePairs *vp, VPForeachFunc func,
                     };
   gboolean result = TRUE;
   VPResults results;
-  gpointer helper_args[] = { &results, func, user_data, &result };
   ScratchBuffersMarker mark;
+  gint i;
 
   scratch_buffers_mark(&mark);
-  vp_results_init(&results, compare_func);
+  vp_results_init(&results);
   args[5] = &results;
 
   /*
@@ -451,8 +585,7 @@ value_pairs_foreach_sorted (ValuePairs *vp, VPForeachFunc func,
    */
   if (vp->scopes & (VPS_NV_PAIRS + VPS_DOT_NV_PAIRS + VPS_SDATA + VPS_RFC5424) ||
       vp->patterns->len > 0)
-    nv_table_foreach(msg->payload, logmsg_registry,
-                     (NVTableForeachFunc) vp_msg_nvpairs_foreach, args);
+    log_msg_values_foreach(msg, (NVTableForeachFunc) vp_msg_nvpairs_foreach, args);
 
   vp_merge_builtins(vp, &results, msg, seq_num, time_zone_mode, template_options);
 
@@ -460,7 +593,21 @@ value_pairs_foreach_sorted (ValuePairs *vp, VPForeachFunc func,
   g_ptr_array_foreach(vp->vpairs, (GFunc)vp_pairs_foreach, args);
 
   /* Aaand we run it through the callback! */
-  g_tree_foreach(results.result_tree, (GTraverseFunc)vp_foreach_helper, helper_args);
+  vp_results_sort(&results, compare_func);
+  for (i = 0; i < results.len; i++)
+    {
+      VPResultValue *rv = &results.values[i];
+
+      /* a value added later with the same name overrides this one */
+      if (i + 1 < results.len && compare_func(rv->name, results.values[i + 1].name) == 0)
+        continue;
+
+      if (func(rv->name, rv->type_hint, rv->value->str, rv->value->len, user_data))
+        {
+          result = FALSE;
+          break;
+        }
+    }
   vp_results_deinit(&results);
   scratch_buffers_reclaim_marked(mark);
 
@@ -550,6 +697,12 @@ typedef struct
   gpointer data;
 } vp_walk_stack_data_t;
 
+typedef struct
+{
+  const gchar *start;
+  gsize len;
+} vp_walk_token_t;
+
 typedef struct
 {
   VPWalkCallbackFunc obj_start;
@@ -558,6 +711,9 @@ typedef struct
 
   gpointer user_data;
   vp_stack_t stack;
+
+  /* array of vp_walk_token_t, reused for every name during the walk */
+  GArray *tokens;
 } vp_walk_state_t;
 
 static vp_walk_stack_data_t *
@@ -648,13 +804,24 @@ vp_walker_skip_sdata_enterprise_id(const gchar *name)
   return name;
 }
 
-static GPtrArray *
+static void
+vp_walker_add_token(GArray *tokens, const gchar *start, const gchar *end)
+{
+  vp_walk_token_t token = { start, end - start };
+
+  g_array_append_val(tokens, token);
+}
+
+/* the tokens point into name, they are valid as long as name is */
+static GArray *
 vp_walker_split_name_to_tokens(vp_walk_state_t *state, const gchar *name)
 {
   const gchar *token_start = name;
   const gchar *token_end = name;
 
-  GPtrArray *array = g_ptr_array_sized_new(VP_STACK_INITIAL_SIZE);
+  GArray *array = state->tokens;
+
+  g_array_set_size(array, 0);
 
   while (*token_end)
     {
@@ -666,7 +833,7 @@ vp_walker_split_name_to_tokens(vp_walk_state_t *state, const gchar *name)
         case '.':
           if (token_start != token_end)
             {
-              g_ptr_array_add(array, g_strndup(token_start, token_end - token_start));
+              vp_walker_add_token(array, token_start, token_end);
               ++token_end;
               token_start = token_end;
               break;
@@ -680,53 +847,67 @@ vp_walker_split_name_to_tokens(vp_walk_state_t *state, const gchar *name)
     }
 
   if (token_start != token_end)
-    g_ptr_array_add(array, g_strndup(token_start, token_end - token_start));
-
-  if (array->len == 0)
-    {
-      g_ptr_array_free(array, TRUE);
-      return NULL;
-    }
+    vp_walker_add_token(array, token_start, token_end);
 
   return array;
 }
 
 static gchar *
-vp_walker_name_combine_prefix(GPtrArray *tokens, gint until)
+vp_walker_name_combine_prefix(GArray *tokens, gint until)
 {
   GString *s = scratch_buffers_alloc();
+  vp_walk_token_t *token;
   gchar *str;
   gint i;
 
   for (i = 0; i < until; i++)
     {
-      g_string_append(s, g_ptr_array_index(tokens, i));
+      token = &g_array_index(tokens, vp_walk_token_t, i);
+      g_string_append_len(s, token->start, token->len);
       g_string_append_c(s, '.');
     }
-  g_string_append(s, g_ptr_array_index(tokens, until));
+  token = &g_array_index(tokens, vp_walk_token_t, until);
+  g_string_append_len(s, token->start, token->len);
 
   str = g_strdup(s->str);
   return str;
 }
 
-static gchar *
+/* the last token is used as the key of the value, it usually lasts until
+ * the end of the name, so it needs no copying */
+static const gchar *
+vp_walker_token_to_key(vp_walk_token_t *token)
+{
+  GString *key;
+
+  if (token->start[token->len] == 0)
+    return token->start;
+
+  key = scratch_buffers_alloc();
+  g_string_append_len(key, token->start, token->len);
+  return key->str;
+}
+
+static const gchar *
 vp_walker_start_containers_for_name(vp_walk_state_t *state,
                                     const gchar *name)
 {
-  GPtrArray *tokens;
-  gchar *key = NULL;
+  GArray *tokens;
   guint i, start;
 
   tokens = vp_walker_split_name_to_tokens(state, name);
+  if (tokens->len == 0)
+    return name;
 
   start = vp_stack_height(&state->stack);
   for (i = start; i < tokens->len - 1; i++)
     {
       vp_walk_stack_data_t *p, *nt;
+      vp_walk_token_t *token = &g_array_index(tokens, vp_walk_token_t, i);
 
       p = vp_walker_stack_peek(&state->stack);
       nt = vp_walker_stack_push(&state->stack,
-                                g_strdup(g_ptr_array_index(tokens, i)),
+                                g_strndup(token->start, token->len),
                                 vp_walker_name_combine_prefix(tokens, i));
 
       if (p)
@@ -738,15 +919,8 @@ vp_walker_start_containers_for_name(vp_walk_state_t *state,
                          NULL, NULL, state->user_data);
     }
 
-  /* The last token is the key (well, second to last, last being
-     NULL), so treat that normally. */
-  key = g_ptr_array_index(tokens, tokens->len - 1);
-  g_ptr_array_index(tokens, tokens->len - 1) = NULL;
-
-  g_ptr_array_foreach(tokens, (GFunc)g_free, NULL);
-  g_ptr_array_free(tokens, TRUE);
-
-  return key;
+  /* The last token is the key, so treat that normally. */
+  return vp_walker_token_to_key(&g_array_index(tokens, vp_walk_token_t, tokens->len - 1));
 }
 
 static gboolean
@@ -755,7 +929,7 @@ value_pairs_walker(const gchar *name, TypeHint type, const gchar *value, gsize v
 {
   vp_walk_state_t *state = (vp_walk_state_t *)user_data;
   vp_walk_stack_data_t *data;
-  gchar *key;
+  const gchar *key;
   gboolean result;
 
   vp_walker_stack_unwind_containers_until(state, name);
@@ -773,8 +947,6 @@ value_pairs_walker(const gchar *name, TypeHint type, const gchar *value, gsize v
                                   NULL,
                                   state->user_data);
 
-  g_free(key);
-
   return result;
 }
 
@@ -805,6 +977,7 @@ value_pairs_walk(ValuePairs *vp,
   state.obj_end = obj_end_func;
   state.process_value = process_value_func;
   vp_stack_init(&state.stack);
+  state.tokens = g_array_sized_new(FALSE, FALSE, sizeof(vp_walk_token_t), VP_STACK_INITIAL_SIZE);
 
   state.obj_start(NULL, NULL, NULL, NULL, NULL, user_data);
   result = value_pairs_foreach_sorted(vp, value_pairs_walker,
@@ -813,6 +986,7 @@ value_pairs_walk(ValuePairs *vp,
   vp_walker_stack_unwind_all_containers(&state);
   state.obj_end(NULL, NULL, NULL, NULL, NULL, user_data);
   vp_stack_destroy(&state.stack);
+  g_array_free(state.tokens, TRUE);
 
   return result;
 }
@@ -913,6 +1087,7 @@ value_pairs_free (ValuePairs *vp)
     }
   g_ptr_array_free(vp->transforms, TRUE);
   g_ptr_array_free(vp->builtins, TRUE);
+  vp_handle_cache_clear(vp);
   g_free(vp);
 }
 
@@ -118,6 +118,33 @@ exit:
   return count;
 }
 
+/* emulates recvmmsg(): returns every record available without EAGAIN
+ * being injected between them */
+static gint
+log_transport_mock_read_batch_method(LogTransport *s, LogTransportDatagram *datagrams, gint count)
+{
+  LogTransportMock *self = (LogTransportMock *) s;
+  gint i;
+
+  for (i = 0; i < count; i++)
+    {
+      gssize rc;
+
+      self->inject_eagain = FALSE;
+      rc = log_transport_mock_read_method(s, datagrams[i].buf, datagrams[i].buflen, &datagrams[i].aux);
+      if (rc <= 0)
+        return i > 0 ? i : rc;
+      datagrams[i].len = rc;
+    }
+  return count;
+}
+
+void
+log_transport_mock_enable_read_batch(LogTransport *s)
+{
+  s->read_batch = log_transport_mock_read_batch_method;
+}
+
 static void
 log_transport_mock_init(LogTransportMock *self, gchar *read_buffer1, gssize read_buffer_length1, va_list va)
 {
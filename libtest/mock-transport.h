@@ -46,4 +46,6 @@ log_transport_mock_records_new(gchar *read_buffer1, gssize read_buffer_length1,
 LogTransport *
 log_transport_mock_endless_records_new(gchar *read_buffer1, gssize read_buffer_length1, ...);
 
+void log_transport_mock_enable_read_batch(LogTransport *s);
+
 #endif
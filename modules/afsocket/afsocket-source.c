@@ -45,6 +45,7 @@ typedef struct _AFSocketSourceConnection
   struct _AFSocketSourceDriver *owner;
   LogReader *reader;
   int sock;
+  gint listener_index;
   GSockAddr *peer_addr;
 } AFSocketSourceConnection;
 
@@ -58,10 +59,16 @@ afsocket_sc_stats_instance(AFSocketSourceConnection *self)
 
   if (!self->peer_addr)
     {
-      /* dgram connection, which means we have no peer, use the bind address */
+      /* dgram connection, which means we have no peer, use the bind
+       * address, suffixed by the listener index for listeners(N) */
       if (self->owner->bind_addr)
         {
           g_sockaddr_format(self->owner->bind_addr, buf, sizeof(buf), GSA_ADDRESS_ONLY);
+          if (self->listener_index > 0)
+            {
+              gsize len = strlen(buf);
+              g_snprintf(buf + len, sizeof(buf) - len, ",%d", self->listener_index);
+            }
           return buf;
         }
       else
@@ -260,6 +267,14 @@ afsocket_sd_set_listen_backlog(LogDriver *s, gint listen_backlog)
   self->listen_backlog = listen_backlog;
 }
 
+void
+afsocket_sd_set_listeners(LogDriver *s, gint num_listeners)
+{
+  AFSocketSourceDriver *self = (AFSocketSourceDriver *) s;
+
+  self->num_listeners = num_listeners;
+}
+
 static const gchar *
 afsocket_sd_format_name(const LogPipe *s)
 {
@@ -283,13 +298,18 @@ afsocket_sd_format_name(const LogPipe *s)
   return persist_name;
 }
 
+/* the first listener keeps the name used without listeners(N) */
 static const gchar *
-afsocket_sd_format_listener_name(const AFSocketSourceDriver *self)
+afsocket_sd_format_listener_name(const AFSocketSourceDriver *self, gint listener_index)
 {
   static gchar persist_name[1024];
 
-  g_snprintf(persist_name, sizeof(persist_name), "%s.listen_fd",
-             afsocket_sd_format_name((const LogPipe *)self));
+  if (listener_index == 0)
+    g_snprintf(persist_name, sizeof(persist_name), "%s.listen_fd",
+               afsocket_sd_format_name((const LogPipe *)self));
+  else
+    g_snprintf(persist_name, sizeof(persist_name), "%s.listen_fd.%d",
+               afsocket_sd_format_name((const LogPipe *)self), listener_index);
 
   return persist_name;
 }
@@ -306,7 +326,8 @@ afsocket_sd_format_connections_name(const AFSocketSourceDriver *self)
 }
 
 static gboolean
-afsocket_sd_process_connection(AFSocketSourceDriver *self, GSockAddr *client_addr, GSockAddr *local_addr, gint fd)
+afsocket_sd_process_connection(AFSocketSourceDriver *self, GSockAddr *client_addr, GSockAddr *local_addr, gint fd,
+                               gint listener_index)
 {
   gchar buf[MAX_SOCKADDR_STRING], buf2[MAX_SOCKADDR_STRING];
 #if SYSLOG_NG_ENABLE_TCP_WRAPPER
@@ -332,7 +353,8 @@ afsocket_sd_process_connection(AFSocketSourceDriver *self, GSockAddr *client_add
 
 #endif
 
-  if (self->num_connections >= self->max_connections)
+  /* dgram sources have a connection per listener, max-connections() doesn't apply */
+  if (client_addr && self->num_connections >= self->max_connections)
     {
       msg_error("Number of allowed concurrent connections reached, rejecting connection",
                 evt_tag_str("client", g_sockaddr_format(client_addr, buf, sizeof(buf), GSA_FULL)),
@@ -345,6 +367,7 @@ afsocket_sd_process_connection(AFSocketSourceDriver *self, GSockAddr *client_add
       AFSocketSourceConnection *conn;
 
       conn = afsocket_sc_new(client_addr, fd, self->super.super.super.cfg);
+      conn->listener_index = listener_index;
       afsocket_sc_set_owner(conn, self);
       if (log_pipe_init(&conn->super))
         {
@@ -366,7 +389,8 @@ afsocket_sd_process_connection(AFSocketSourceDriver *self, GSockAddr *client_add
 static void
 afsocket_sd_accept(gpointer s)
 {
-  AFSocketSourceDriver *self = (AFSocketSourceDriver *) s;
+  AFSocketSourceListener *listener = (AFSocketSourceListener *) s;
+  AFSocketSourceDriver *self = listener->owner;
   GSockAddr *peer_addr;
   gchar buf1[256], buf2[256];
   gint new_fd;
@@ -377,7 +401,7 @@ afsocket_sd_accept(gpointer s)
     {
       GIOStatus status;
 
-      status = g_accept(self->fd, &new_fd, &peer_addr);
+      status = g_accept(listener->fd, &new_fd, &peer_addr);
       if (status == G_IO_STATUS_AGAIN)
         {
           /* no more connections to accept */
@@ -393,7 +417,7 @@ afsocket_sd_accept(gpointer s)
       g_fd_set_nonblock(new_fd, TRUE);
       g_fd_set_cloexec(new_fd, TRUE);
 
-      res = afsocket_sd_process_connection(self, peer_addr, self->bind_addr, new_fd);
+      res = afsocket_sd_process_connection(self, peer_addr, self->bind_addr, new_fd, listener->index);
 
       if (res)
         {
@@ -443,18 +467,30 @@ afsocket_sd_close_connection(AFSocketSourceDriver *self, AFSocketSourceConnectio
 static void
 afsocket_sd_start_watches(AFSocketSourceDriver *self)
 {
-  IV_FD_INIT(&self->listen_fd);
-  self->listen_fd.fd = self->fd;
-  self->listen_fd.cookie = self;
-  self->listen_fd.handler_in = afsocket_sd_accept;
-  iv_fd_register(&self->listen_fd);
+  gint i;
+
+  for (i = 0; i < self->num_listeners; i++)
+    {
+      AFSocketSourceListener *listener = &self->listeners[i];
+
+      IV_FD_INIT(&listener->listen_fd);
+      listener->listen_fd.fd = listener->fd;
+      listener->listen_fd.cookie = listener;
+      listener->listen_fd.handler_in = afsocket_sd_accept;
+      iv_fd_register(&listener->listen_fd);
+    }
 }
 
 static void
 afsocket_sd_stop_watches(AFSocketSourceDriver *self)
 {
-  if (iv_fd_registered (&self->listen_fd))
-    iv_fd_unregister(&self->listen_fd);
+  gint i;
+
+  for (i = 0; i < self->num_listeners; i++)
+    {
+      if (iv_fd_registered (&self->listeners[i].listen_fd))
+        iv_fd_unregister(&self->listeners[i].listen_fd);
+    }
 }
 
 static gboolean
@@ -536,24 +572,45 @@ afsocket_sd_restore_kept_alive_connections(AFSocketSourceDriver *self)
   return TRUE;
 }
 
+static void
+_sd_close_listeners(AFSocketSourceDriver *self)
+{
+  gint i;
+
+  for (i = 0; i < self->num_listeners; i++)
+    {
+      if (self->listeners[i].fd != -1)
+        close(self->listeners[i].fd);
+    }
+  g_free(self->listeners);
+  self->listeners = NULL;
+}
+
 static gboolean
 _finalize_init(gpointer arg)
 {
   AFSocketSourceDriver *self = (AFSocketSourceDriver *)arg;
+  gint i;
+
   /* set up listening source */
-  if (listen(self->fd, self->listen_backlog) < 0)
+  for (i = 0; i < self->num_listeners; i++)
     {
-      msg_error("Error during listen()",
-                evt_tag_errno(EVT_TAG_OSERROR, errno));
-      close(self->fd);
-      self->fd = -1;
-      return FALSE;
+      AFSocketSourceListener *listener = &self->listeners[i];
+
+      if (listen(listener->fd, self->listen_backlog) < 0)
+        {
+          msg_error("Error during listen()",
+                    evt_tag_errno(EVT_TAG_OSERROR, errno));
+          _sd_close_listeners(self);
+          return FALSE;
+        }
     }
 
   afsocket_sd_start_watches(self);
   char buf[256];
   msg_info("Accepting connections",
-           evt_tag_str("addr", g_sockaddr_format(self->bind_addr, buf, sizeof(buf), GSA_FULL)));
+           evt_tag_str("addr", g_sockaddr_format(self->bind_addr, buf, sizeof(buf), GSA_FULL)),
+           evt_tag_int("listeners", self->num_listeners));
   return TRUE;
 }
 
@@ -561,48 +618,112 @@ static gboolean
 _sd_open_stream(AFSocketSourceDriver *self)
 {
   GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
-  gint sock = -1;
-  if (self->connections_kept_alive_across_reloads)
+  gint i;
+
+  self->listeners = g_new0(AFSocketSourceListener, self->num_listeners);
+  for (i = 0; i < self->num_listeners; i++)
     {
-      /* NOTE: this assumes that fd 0 will never be used for listening fds,
-       * main.c opens fd 0 so this assumption can hold */
-      sock = GPOINTER_TO_UINT(
-               cfg_persist_config_fetch(cfg, afsocket_sd_format_listener_name(self))) -
-             1;
+      self->listeners[i].owner = self;
+      self->listeners[i].index = i;
+      self->listeners[i].fd = -1;
     }
 
-  if (sock == -1)
+  for (i = 0; i < self->num_listeners; i++)
     {
-      if (!afsocket_sd_acquire_socket(self, &sock))
-        return self->super.super.optional;
-      if (sock == -1
-          && !transport_mapper_open_socket(self->transport_mapper, self->socket_options, self->bind_addr, AFSOCKET_DIR_RECV,
-                                           &sock))
-        return self->super.super.optional;
+      gint sock = -1;
+
+      if (self->connections_kept_alive_across_reloads)
+        {
+          /* NOTE: this assumes that fd 0 will never be used for listening fds,
+           * main.c opens fd 0 so this assumption can hold */
+          sock = GPOINTER_TO_UINT(
+                   cfg_persist_config_fetch(cfg, afsocket_sd_format_listener_name(self, i))) -
+                 1;
+        }
+
+      if (sock == -1)
+        {
+          /* a socket acquired from the environment can only be the first listener */
+          if (i == 0 && !afsocket_sd_acquire_socket(self, &sock))
+            goto error;
+          if (sock == -1
+              && !transport_mapper_open_socket(self->transport_mapper, self->socket_options, self->bind_addr, AFSOCKET_DIR_RECV,
+                                               &sock))
+            goto error;
+        }
+      self->listeners[i].fd = sock;
     }
-  self->fd = sock;
   return transport_mapper_async_init(self->transport_mapper, _finalize_init, self);
+
+error:
+  _sd_close_listeners(self);
+  return self->super.super.optional;
+}
+
+static AFSocketSourceConnection *
+_sd_find_dgram_connection(AFSocketSourceDriver *self, gint listener_index)
+{
+  GList *p;
+
+  for (p = self->connections; p; p = p->next)
+    {
+      AFSocketSourceConnection *sc = (AFSocketSourceConnection *) p->data;
+
+      if (sc->listener_index == listener_index)
+        return sc;
+    }
+  return NULL;
+}
+
+/* listeners(N) may have been decreased since the connections were kept alive */
+static void
+_sd_drop_excess_dgram_connections(AFSocketSourceDriver *self)
+{
+  GList *p, *next;
+
+  for (p = self->connections; p; p = next)
+    {
+      AFSocketSourceConnection *sc = (AFSocketSourceConnection *) p->data;
+
+      next = p->next;
+      if (sc->listener_index < self->num_listeners)
+        continue;
+
+      log_pipe_deinit(&sc->super);
+      self->connections = g_list_remove(self->connections, sc);
+      afsocket_sd_kill_connection(sc);
+      self->num_connections--;
+    }
 }
 
 static gboolean
 _sd_open_dgram(AFSocketSourceDriver *self)
 {
-  gint sock = -1;
-  if (!self->connections)
+  gint i;
+
+  _sd_drop_excess_dgram_connections(self);
+
+  /* each listener has its own connection, either kept alive from the
+   * previous configuration or opened here */
+  for (i = 0; i < self->num_listeners; i++)
     {
-      if (!afsocket_sd_acquire_socket(self, &sock))
+      gint sock = -1;
+
+      if (_sd_find_dgram_connection(self, i))
+        continue;
+
+      if (i == 0 && !afsocket_sd_acquire_socket(self, &sock))
         return self->super.super.optional;
       if (sock == -1
           && !transport_mapper_open_socket(self->transport_mapper, self->socket_options, self->bind_addr, AFSOCKET_DIR_RECV,
                                            &sock))
         return self->super.super.optional;
+
+      if (!afsocket_sd_process_connection(self, NULL, self->bind_addr, sock, i))
+        return FALSE;
     }
-  self->fd = -1;
 
-  /* we either have self->connections != NULL, or sock contains a new fd */
-  if (self->connections || afsocket_sd_process_connection(self, NULL, self->bind_addr, sock))
-    return transport_mapper_init(self->transport_mapper);
-  return FALSE;
+  return transport_mapper_init(self->transport_mapper);
 }
 
 static gboolean
@@ -655,25 +776,36 @@ static void
 afsocket_sd_save_listener(AFSocketSourceDriver *self)
 {
   GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
+  gint i;
 
-  if (self->transport_mapper->sock_type == SOCK_STREAM)
+  if (self->transport_mapper->sock_type != SOCK_STREAM || !self->listeners)
+    return;
+
+  afsocket_sd_stop_watches(self);
+  for (i = 0; i < self->num_listeners; i++)
     {
-      afsocket_sd_stop_watches(self);
+      gint fd = self->listeners[i].fd;
+
+      if (fd == -1)
+        continue;
+
       if (!self->connections_kept_alive_across_reloads)
         {
           msg_verbose("Closing listener fd",
-                      evt_tag_int("fd", self->fd));
-          close(self->fd);
+                      evt_tag_int("fd", fd));
+          close(fd);
         }
       else
         {
           /* NOTE: the fd is incremented by one when added to persistent config
            * as persist config cannot store NULL */
 
-          cfg_persist_config_add(cfg, afsocket_sd_format_listener_name(self),
-                                 GUINT_TO_POINTER(self->fd + 1), afsocket_sd_close_fd, FALSE);
+          cfg_persist_config_add(cfg, afsocket_sd_format_listener_name(self, i),
+                                 GUINT_TO_POINTER(fd + 1), afsocket_sd_close_fd, FALSE);
         }
     }
+  g_free(self->listeners);
+  self->listeners = NULL;
 }
 
 
@@ -683,12 +815,26 @@ afsocket_sd_setup_addresses_method(AFSocketSourceDriver *self)
   return TRUE;
 }
 
+static gboolean
+afsocket_sd_validate_listeners(AFSocketSourceDriver *self)
+{
+  if (self->num_listeners > 1 && !self->socket_options->so_reuseport)
+    {
+      msg_error("listeners() requires so-reuseport(yes), as the listeners share the same address",
+                evt_tag_int("listeners", self->num_listeners),
+                log_pipe_location_tag(&self->super.super.super));
+      return FALSE;
+    }
+  return TRUE;
+}
+
 gboolean
 afsocket_sd_init_method(LogPipe *s)
 {
   AFSocketSourceDriver *self = (AFSocketSourceDriver *) s;
 
   return log_src_driver_init_method(s) &&
+         afsocket_sd_validate_listeners(self) &&
          afsocket_sd_setup_transport(self) &&
          afsocket_sd_setup_addresses(self) &&
          afsocket_sd_restore_kept_alive_connections(self) &&
@@ -725,6 +871,7 @@ afsocket_sd_free_method(LogPipe *s)
 {
   AFSocketSourceDriver *self = (AFSocketSourceDriver *) s;
 
+  g_free(self->listeners);
   log_reader_options_destroy(&self->reader_options);
   transport_mapper_free(self->transport_mapper);
   socket_options_free(self->socket_options);
@@ -751,6 +898,7 @@ afsocket_sd_init_instance(AFSocketSourceDriver *self,
   self->transport_mapper = transport_mapper;
   self->max_connections = 10;
   self->listen_backlog = 255;
+  self->num_listeners = 1;
   self->connections_kept_alive_across_reloads = TRUE;
   log_reader_options_defaults(&self->reader_options);
   self->reader_options.super.stats_level = STATS_LEVEL1;
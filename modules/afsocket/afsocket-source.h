@@ -36,6 +36,16 @@
 
 typedef struct _AFSocketSourceDriver AFSocketSourceDriver;
 
+/* a listening socket, with so-reuseport(yes) listeners(N) opens N of them
+ * on the same address and the kernel distributes the load between them */
+typedef struct _AFSocketSourceListener
+{
+  AFSocketSourceDriver *owner;
+  gint index;
+  gint fd;
+  struct iv_fd listen_fd;
+} AFSocketSourceListener;
+
 struct _AFSocketSourceDriver
 {
   LogSrcDriver super;
@@ -43,8 +53,8 @@ struct _AFSocketSourceDriver
           connections_kept_alive_across_reloads:1,
           require_tls:1,
           window_size_initialized:1;
-  struct iv_fd listen_fd;
-  gint fd;
+  AFSocketSourceListener *listeners;
+  gint num_listeners;
   LogReaderOptions reader_options;
   LogProtoServerFactory *proto_factory;
   GSockAddr *bind_addr;
@@ -74,6 +84,7 @@ struct _AFSocketSourceDriver
 void afsocket_sd_set_keep_alive(LogDriver *self, gint enable);
 void afsocket_sd_set_max_connections(LogDriver *self, gint max_connections);
 void afsocket_sd_set_listen_backlog(LogDriver *self, gint listen_backlog);
+void afsocket_sd_set_listeners(LogDriver *self, gint num_listeners);
 
 static inline gboolean
 afsocket_sd_acquire_socket(AFSocketSourceDriver *s, gint *fd)
@@ -25,6 +25,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <errno.h>
 
 gboolean
 socket_options_setup_socket_method(SocketOptions *self, gint fd, GSockAddr *bind_addr, AFSocketDirection dir)
@@ -33,6 +34,20 @@ socket_options_setup_socket_method(SocketOptions *self, gint fd, GSockAddr *bind
   gint rc;
   if (dir & AFSOCKET_DIR_RECV)
     {
+      if (self->so_reuseport)
+        {
+#ifdef SO_REUSEPORT
+          if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &self->so_reuseport, sizeof(self->so_reuseport)) < 0)
+            {
+              msg_error("Error setting SO_REUSEPORT on socket",
+                        evt_tag_errno(EVT_TAG_OSERROR, errno));
+              return FALSE;
+            }
+#else
+          msg_error("SO_REUSEPORT is not supported on this platform");
+          return FALSE;
+#endif
+        }
       if (self->so_rcvbuf)
         {
           gint so_rcvbuf_set = 0;
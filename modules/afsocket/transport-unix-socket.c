@@ -33,6 +33,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
+#include <string.h>
 
 static void
 _add_nv_pair_int(LogTransportAuxData *aux, const gchar *name, gint value)
@@ -262,6 +263,58 @@ log_transport_unix_dgram_socket_read_method(LogTransport *s, gpointer buf, gsize
   return rc;
 }
 
+#if defined(SYSLOG_NG_HAVE_RECVMMSG)
+static gint
+log_transport_unix_dgram_socket_read_batch_method(LogTransport *s, LogTransportDatagram *datagrams, gint count)
+{
+  struct mmsghdr *msgs = g_alloca(count * sizeof(struct mmsghdr));
+  struct iovec *iov = g_alloca(count * sizeof(struct iovec));
+  struct sockaddr_storage *ss = g_alloca(count * sizeof(struct sockaddr_storage));
+#if defined(SYSLOG_NG_HAVE_CTRLBUF_IN_MSGHDR)
+  gchar *ctlbufs = g_alloca(count * 32);
+#endif
+  gint rc, i;
+
+  memset(msgs, 0, count * sizeof(struct mmsghdr));
+  for (i = 0; i < count; i++)
+    {
+      iov[i].iov_base = datagrams[i].buf;
+      iov[i].iov_len = datagrams[i].buflen;
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = &ss[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(ss[i]);
+#if defined(SYSLOG_NG_HAVE_CTRLBUF_IN_MSGHDR)
+      msgs[i].msg_hdr.msg_control = ctlbufs + i * 32;
+      msgs[i].msg_hdr.msg_controllen = 32;
+#endif
+    }
+
+  do
+    {
+      rc = recvmmsg(s->fd, msgs, count, 0, NULL);
+    }
+  while (rc == -1 && errno == EINTR);
+
+  if (rc == 0)
+    {
+      rc = -1;
+      errno = EAGAIN;
+    }
+
+  for (i = 0; i < rc; i++)
+    {
+      datagrams[i].len = msgs[i].msg_len;
+      if (msgs[i].msg_hdr.msg_namelen)
+        log_transport_aux_data_set_peer_addr_ref(&datagrams[i].aux,
+                                                 g_sockaddr_new((struct sockaddr *) &ss[i], msgs[i].msg_hdr.msg_namelen));
+
+      _feed_aux_from_cmsg(&datagrams[i].aux, &msgs[i].msg_hdr);
+    }
+  return rc;
+}
+#endif
+
 LogTransport *
 log_transport_unix_dgram_socket_new(gint fd)
 {
@@ -269,6 +322,9 @@ log_transport_unix_dgram_socket_new(gint fd)
 
   log_transport_dgram_socket_init_instance(self, fd);
   self->super.read = log_transport_unix_dgram_socket_read_method;
+#if defined(SYSLOG_NG_HAVE_RECVMMSG)
+  self->super.read_batch = log_transport_unix_dgram_socket_read_batch_method;
+#endif
 
   return &self->super;
 }
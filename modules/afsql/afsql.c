@@ -176,24 +176,19 @@ afsql_dd_set_null_value(LogDriver *s, const gchar *null)
 void
 afsql_dd_set_retries(LogDriver *s, gint num_retries)
 {
-  AFSqlDestDriver *self = (AFSqlDestDriver *) s;
-  self->num_retries = num_retries;
+  log_threaded_dest_driver_set_max_retries(s, num_retries);
 }
 
 void
 afsql_dd_set_flush_lines(LogDriver *s, gint flush_lines)
 {
-  AFSqlDestDriver *self = (AFSqlDestDriver *) s;
-
-  self->flush_lines = flush_lines;
+  log_threaded_dest_driver_set_batch_lines(s, flush_lines);
 }
 
 void
 afsql_dd_set_flush_timeout(LogDriver *s, gint flush_timeout)
 {
-  AFSqlDestDriver *self = (AFSqlDestDriver *) s;
-
-  self->flush_timeout = flush_timeout;
+  log_threaded_dest_driver_set_batch_timeout(s, flush_timeout);
 }
 
 void
@@ -262,20 +257,6 @@ afsql_dd_run_query(AFSqlDestDriver *self, const gchar *query, gboolean silent, d
   return TRUE;
 }
 
-/**
- * afsql_dd_handle_transaction_error:
- *
- * Handle errors inside during a SQL transaction (e.g. INSERT or COMMIT failures).
- *
- * NOTE: This function can only be called from the database thread.
- **/
-static void
-afsql_dd_handle_transaction_error(AFSqlDestDriver *self)
-{
-  log_queue_rewind_backlog_all(self->queue);
-  self->flush_lines_queued = 0;
-}
-
 /**
  * afsql_dd_commit_transaction:
  *
@@ -294,14 +275,11 @@ afsql_dd_commit_transaction(AFSqlDestDriver *self)
   success = afsql_dd_run_query(self, "COMMIT", FALSE, NULL);
   if (success)
     {
-      log_queue_ack_backlog(self->queue, self->flush_lines_queued);
-      self->flush_lines_queued = 0;
       self->transaction_active = FALSE;
     }
   else
     {
       msg_error("SQL transaction commit failed, rewinding backlog and starting again");
-      afsql_dd_handle_transaction_error(self);
     }
   return success;
 }
@@ -331,6 +309,7 @@ afsql_dd_begin_transaction(AFSqlDestDriver *self)
     }
 
   self->transaction_active = success;
+  self->transaction_rows = 0;
 
   return success;
 }
@@ -346,21 +325,6 @@ afsql_dd_rollback_transaction(AFSqlDestDriver *self)
   return afsql_dd_run_query(self, "ROLLBACK", FALSE, NULL);
 }
 
-static gboolean
-afsql_dd_begin_new_transaction(AFSqlDestDriver *self)
-{
-  if (self->transaction_active)
-    {
-      if (!afsql_dd_commit_transaction(self))
-        {
-          afsql_dd_rollback_transaction(self);
-          return FALSE;
-        }
-    }
-
-  return afsql_dd_begin_transaction(self);
-}
-
 static gboolean _sql_identifier_is_valid_char(gchar c)
 {
   return ((c == '.') ||
@@ -654,26 +618,15 @@ afsql_dd_ensure_table_is_syslogng_conform(AFSqlDestDriver *self, GString *table)
 }
 
 
-/**
- * afsql_dd_suspend:
- * timeout: in milliseconds
- *
- * This function is assumed to be called from the database thread
- * only!
- **/
 static void
-afsql_dd_suspend(AFSqlDestDriver *self)
+afsql_dd_disconnect(LogThrDestDriver *s)
 {
-  self->db_thread_suspended = TRUE;
-  g_get_current_time(&self->db_thread_suspend_target);
-  g_time_val_add(&self->db_thread_suspend_target, self->time_reopen * 1000 * 1000); /* the timeout expects microseconds */
-}
+  AFSqlDestDriver *self = (AFSqlDestDriver *) s;
 
-static void
-afsql_dd_disconnect(AFSqlDestDriver *self)
-{
-  dbi_conn_close(self->dbi_ctx);
+  if (self->dbi_ctx)
+    dbi_conn_close(self->dbi_ctx);
   self->dbi_ctx = NULL;
+  self->transaction_active = FALSE;
   g_hash_table_remove_all(self->syslogng_conform_tables);
 }
 
@@ -773,7 +726,7 @@ afsql_dd_ensure_accessible_database_table(AFSqlDestDriver *self, LogMessage *msg
     {
       /* If validate table is FALSE then close the connection and wait time_reopen time (next call) */
       msg_error("Error checking table, disconnecting from database, trying again shortly",
-                evt_tag_int("time_reopen", self->time_reopen));
+                evt_tag_int("time_reopen", self->super.time_reopen));
       g_string_free(table, TRUE);
       return NULL;
     }
@@ -813,7 +766,7 @@ afsql_dd_build_insert_command(AFSqlDestDriver *self, LogMessage *msg, GString *t
 
       if ((self->fields[i].flags & AFSQL_FF_DEFAULT) == 0 && self->fields[i].value != NULL)
         {
-          log_template_format(self->fields[i].value, msg, &self->template_options, LTZ_SEND, self->seq_num, NULL, value);
+          log_template_format(self->fields[i].value, msg, &self->template_options, LTZ_SEND, self->super.seq_num, NULL, value);
           if (self->null_value && strcmp(self->null_value, value->str) == 0)
             {
               g_string_append(insert_command, "NULL");
@@ -850,53 +803,64 @@ afsql_dd_build_insert_command(AFSqlDestDriver *self, LogMessage *msg, GString *t
 static inline gboolean
 afsql_dd_is_transaction_handling_enabled(const AFSqlDestDriver *self)
 {
-  return self->flush_lines_queued != -1;
+  return (self->flags & AFSQL_DDF_EXPLICIT_COMMITS);
 }
 
 static inline gboolean
 afsql_dd_should_begin_new_transaction(const AFSqlDestDriver *self)
 {
-  return self->flush_lines_queued == 0;
+  return afsql_dd_is_transaction_handling_enabled(self) && !self->transaction_active;
 }
 
-static inline gboolean
-afsql_dd_should_commit_transaction(const AFSqlDestDriver *self)
+static gboolean
+afsql_dd_connect(LogThrDestDriver *s)
 {
-  return afsql_dd_is_transaction_handling_enabled(self) && self->flush_lines_queued == self->flush_lines;
-}
+  AFSqlDestDriver *self = (AFSqlDestDriver *) s;
 
-static inline void
-afsql_dd_rollback_msg(AFSqlDestDriver *self, LogMessage *msg, LogPathOptions *path_options)
-{
-  if (self->flags & AFSQL_DDF_EXPLICIT_COMMITS)
-    log_queue_rewind_backlog(self->queue, 1);
-  else
-    log_queue_push_head(self->queue, msg, path_options);
+  if (!afsql_dd_ensure_initialized_connection(self))
+    {
+      afsql_dd_disconnect(s);
+      return FALSE;
+    }
+  return TRUE;
 }
 
-static inline gboolean
-afsql_dd_handle_insert_row_error_depending_on_connection_availability(AFSqlDestDriver *self,
-    LogMessage *msg,
-    LogPathOptions *path_options)
+/* If the connection is still alive, the row itself is at fault.  The rows
+ * inserted earlier in the same transaction are lost by the rollback, so
+ * the batch is rewound and replayed committing each row on its own up to
+ * and including the failing one.  That way only the failing row is
+ * retried right away and eventually dropped by LogThrDestDriver, without
+ * reconnecting. */
+static worker_insert_result_t
+afsql_dd_handle_insert_row_error_depending_on_connection_availability(AFSqlDestDriver *self)
 {
   const gchar *dbi_error, *error_message;
 
   if (dbi_conn_ping(self->dbi_ctx) == 1)
     {
-      afsql_dd_rollback_msg(self, msg, path_options);
-      return TRUE;
+      gint rows = self->transaction_rows;
+
+      afsql_dd_rollback_transaction(self);
+      if (rows > 0)
+        {
+          msg_warning("Error inserting row into SQL table, replaying the rest of the transaction one row at a time",
+                      evt_tag_str("type", self->type),
+                      evt_tag_str("database", self->database),
+                      evt_tag_int("rows", rows));
+          self->isolated_rows = rows + 1;
+          return WORKER_INSERT_RESULT_REWIND;
+        }
+      return WORKER_INSERT_RESULT_RETRY;
     }
 
-  if (afsql_dd_is_transaction_handling_enabled(self))
+  if (self->transaction_active)
     {
       error_message = "SQL connection lost in the middle of a transaction,"
                       " rewinding backlog and starting again";
-      afsql_dd_handle_transaction_error(self);
     }
   else
     {
       error_message = "Error, no SQL connection after failed query attempt";
-      afsql_dd_rollback_msg(self, msg, path_options);
     }
 
   dbi_conn_error(self->dbi_ctx, &dbi_error);
@@ -908,234 +872,105 @@ afsql_dd_handle_insert_row_error_depending_on_connection_availability(AFSqlDestD
             evt_tag_str("database", self->database),
             evt_tag_str("error", dbi_error));
 
-  return FALSE;
+  return WORKER_INSERT_RESULT_NOT_CONNECTED;
 }
 
 /**
- * afsql_dd_insert_db:
+ * afsql_dd_insert:
  *
- * This function is running in the database thread
+ * This function is running in the database thread.
  *
- * Returns: FALSE to indicate that the connection should be closed and
- * this destination suspended for time_reopen() time.
+ * With explicit-commits, messages are inserted in a transaction which is
+ * committed by afsql_dd_flush() when the batch is complete.  After a row
+ * failed, the rows rewound with it are committed one by one (see
+ * isolated_rows).
  **/
-static gboolean
-afsql_dd_insert_db(AFSqlDestDriver *self)
+static worker_insert_result_t
+afsql_dd_insert(LogThrDestDriver *s, LogMessage *msg)
 {
+  AFSqlDestDriver *self = (AFSqlDestDriver *) s;
   GString *table = NULL;
   GString *insert_command = NULL;
-  LogMessage *msg;
-  gboolean success = TRUE;
-  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
-
-  if (!afsql_dd_ensure_initialized_connection(self))
-    return FALSE;
-
-  /* connection established, try to insert a message */
-  msg = log_queue_pop_head(self->queue, &path_options);
-  if (!msg)
-    return TRUE;
-
-  msg_set_context(msg);
+  worker_insert_result_t retval;
 
   table = afsql_dd_ensure_accessible_database_table(self, msg);
 
   if (!table)
-    {
-      success = FALSE;
-      goto out;
-    }
+    return WORKER_INSERT_RESULT_NOT_CONNECTED;
 
   if (afsql_dd_should_begin_new_transaction(self) && !afsql_dd_begin_transaction(self))
     {
-      success = FALSE;
+      retval = afsql_dd_handle_insert_row_error_depending_on_connection_availability(self);
       goto out;
     }
 
   insert_command = afsql_dd_build_insert_command(self, msg, table);
-  success = afsql_dd_run_query(self, insert_command->str, FALSE, NULL);
-
-  if (success && self->flush_lines_queued != -1)
+  if (!afsql_dd_run_query(self, insert_command->str, FALSE, NULL))
     {
-      self->flush_lines_queued++;
+      retval = afsql_dd_handle_insert_row_error_depending_on_connection_availability(self);
+      goto out;
+    }
 
-      if (afsql_dd_should_commit_transaction(self) && !afsql_dd_commit_transaction(self))
+  if (afsql_dd_is_transaction_handling_enabled(self) && self->isolated_rows > 0)
+    {
+      if (!afsql_dd_commit_transaction(self))
         {
-          /* Assuming that in case of error, the queue is rewound by afsql_dd_commit_transaction() */
-          afsql_dd_rollback_transaction(self);
-
-          g_string_free(insert_command, TRUE);
-          msg_set_context(NULL);
-
-          success = FALSE;
+          retval = afsql_dd_handle_insert_row_error_depending_on_connection_availability(self);
+          goto out;
         }
+      self->isolated_rows--;
+      retval = WORKER_INSERT_RESULT_SUCCESS;
     }
-
-out:
-
-  if (table != NULL)
-    g_string_free(table, TRUE);
-
-  if (insert_command != NULL)
-    g_string_free(insert_command, TRUE);
-
-  msg_set_context(NULL);
-
-  if (success)
+  else if (afsql_dd_is_transaction_handling_enabled(self))
     {
-      log_msg_ack(msg, &path_options, AT_PROCESSED);
-      log_msg_unref(msg);
-      step_sequence_number(&self->seq_num);
-      self->failed_message_counter = 0;
+      self->transaction_rows++;
+      retval = WORKER_INSERT_RESULT_QUEUED;
     }
   else
-    {
-      if (self->failed_message_counter < self->num_retries)
-        {
-          if (!afsql_dd_handle_insert_row_error_depending_on_connection_availability(self, msg, &path_options))
-            return FALSE;
+    retval = WORKER_INSERT_RESULT_SUCCESS;
 
-          self->failed_message_counter++;
-        }
-      else
-        {
-          msg_error("Multiple failures while inserting this record into the database, message dropped",
-                    evt_tag_int("attempts", self->num_retries));
-          stats_counter_inc(self->dropped_messages);
-          log_msg_drop(msg, &path_options, AT_PROCESSED);
-          self->failed_message_counter = 0;
-          success = TRUE;
-        }
-    }
-
-  return success;
-}
-
-static void
-afsql_dd_message_became_available_in_the_queue(gpointer user_data)
-{
-  AFSqlDestDriver *self = (AFSqlDestDriver *) user_data;
+out:
+  g_string_free(table, TRUE);
 
-  g_mutex_lock(self->db_thread_mutex);
-  g_cond_signal(self->db_thread_wakeup_cond);
-  g_mutex_unlock(self->db_thread_mutex);
-}
+  if (insert_command != NULL)
+    g_string_free(insert_command, TRUE);
 
-/* assumes that db_thread_mutex is held */
-static void
-afsql_dd_wait_for_suspension_wakeup(AFSqlDestDriver *self)
-{
-  /* we got suspended, probably because of a connection error,
-   * during this time we only get wakeups if we need to be
-   * terminated. */
-  if (!self->db_thread_terminate)
-    g_cond_timed_wait(self->db_thread_wakeup_cond, self->db_thread_mutex, &self->db_thread_suspend_target);
-  self->db_thread_suspended = FALSE;
+  return retval;
 }
 
-/**
- * afsql_dd_database_thread:
- *
- * This is the thread inserting records into the database.
- **/
-static void
-afsql_dd_database_thread(gpointer arg)
+static worker_insert_result_t
+afsql_dd_flush(LogThrDestDriver *s)
 {
-  AFSqlDestDriver *self = (AFSqlDestDriver *) arg;
-
-  msg_verbose("Database thread started",
-              evt_tag_str("driver", self->super.super.id));
-  while (!self->db_thread_terminate)
-    {
-      main_loop_worker_run_gc();
-      g_mutex_lock(self->db_thread_mutex);
-      if (self->db_thread_suspended)
-        {
-          afsql_dd_wait_for_suspension_wakeup(self);
-          /* we loop back to check if the thread was requested to terminate */
-        }
-      else if (!log_queue_check_items(self->queue, NULL, afsql_dd_message_became_available_in_the_queue, self, NULL))
-        {
-          /* we have nothing to INSERT into the database, let's wait we get some new stuff */
-
-          if (self->flush_lines_queued > 0)
-            {
-              if (!afsql_dd_commit_transaction(self))
-                {
-                  if (!afsql_dd_rollback_transaction(self))
-                    {
-                      afsql_dd_disconnect(self);
-                      afsql_dd_suspend(self);
-                    }
-                  g_mutex_unlock(self->db_thread_mutex);
-                  continue;
-                }
-            }
-          else if (!self->db_thread_terminate)
-            {
-              g_cond_wait(self->db_thread_wakeup_cond, self->db_thread_mutex);
-            }
-
-          /* we loop back to check if the thread was requested to terminate */
-        }
-      g_mutex_unlock(self->db_thread_mutex);
-
-      if (self->db_thread_terminate)
-        break;
-
-      if (!afsql_dd_insert_db(self))
-        {
-          afsql_dd_disconnect(self);
-          afsql_dd_suspend(self);
-        }
-    }
+  AFSqlDestDriver *self = (AFSqlDestDriver *) s;
 
-  while (log_queue_get_length(self->queue) > 0)
-    {
-      if (!afsql_dd_insert_db(self))
-        {
-          goto exit;
-        }
-    }
+  if (!self->transaction_active)
+    return WORKER_INSERT_RESULT_SUCCESS;
 
-  if (self->flush_lines_queued > 0)
+  if (!afsql_dd_commit_transaction(self))
     {
-      /* we can't do anything with the return value here. if commit isn't
-       * successful, we get our backlog back, but we have no chance
-       * submitting that back to the SQL engine.
-       */
-
-      if (!afsql_dd_commit_transaction(self))
-        afsql_dd_rollback_transaction(self);
+      /* Assuming that in case of error, the backlog is rewound by LogThrDestDriver */
+      if (!afsql_dd_rollback_transaction(self))
+        return WORKER_INSERT_RESULT_NOT_CONNECTED;
+      return WORKER_INSERT_RESULT_ERROR;
     }
-exit:
-  afsql_dd_disconnect(self);
 
-  msg_verbose("Database thread finished",
-              evt_tag_str("driver", self->super.super.id));
+  return WORKER_INSERT_RESULT_SUCCESS;
 }
 
+/* the isolated row was dropped, the rows after it are batched again */
 static void
-afsql_dd_stop_thread(gpointer s)
+afsql_dd_retry_over_message(LogThrDestDriver *s, LogMessage *msg)
 {
   AFSqlDestDriver *self = (AFSqlDestDriver *) s;
-  g_mutex_lock(self->db_thread_mutex);
-  self->db_thread_terminate = TRUE;
-  g_cond_signal(self->db_thread_wakeup_cond);
-  g_mutex_unlock(self->db_thread_mutex);
-}
 
-static void
-afsql_dd_start_thread(AFSqlDestDriver *self)
-{
-  self->db_thread_terminate = FALSE;
-  main_loop_create_worker_thread(afsql_dd_database_thread, afsql_dd_stop_thread, self, &self->worker_options);
+  if (self->isolated_rows > 0)
+    self->isolated_rows--;
 }
 
-
 static gchar *
-afsql_dd_format_stats_instance(AFSqlDestDriver *self)
+afsql_dd_format_stats_instance(LogThrDestDriver *s)
 {
+  AFSqlDestDriver *self = (AFSqlDestDriver *) s;
   static gchar persist_name[64];
 
   g_snprintf(persist_name, sizeof(persist_name),
@@ -1159,14 +994,15 @@ afsql_dd_format_persist_name(const LogPipe *s)
   return persist_name;
 }
 
-static inline gchar *
-afsql_dd_format_persist_sequence_number(AFSqlDestDriver *self)
+static gchar *
+afsql_dd_format_legacy_persist_sequence_number(LogThrDestDriver *s)
 {
+  AFSqlDestDriver *self = (AFSqlDestDriver *) s;
   static gchar persist_name[256];
 
   g_snprintf(persist_name, sizeof(persist_name),
              "afsql_dd_sequence_number(%s,%s,%s,%s,%s)",
-             self->type,self->host, self->port, self->database, self->table->template);
+             self->type, self->host, self->port, self->database, self->table->template);
 
   return persist_name;
 }
@@ -1188,33 +1024,6 @@ afsql_dd_init(LogPipe *s)
       return FALSE;
     }
 
-  stats_lock();
-  {
-    StatsClusterKey sc_key;
-    stats_cluster_logpipe_key_set(&sc_key, SCS_SQL | SCS_DESTINATION, self->super.super.id,
-                                  afsql_dd_format_stats_instance(self) );
-    stats_register_counter(0, &sc_key, SC_TYPE_QUEUED, &self->queued_messages);
-    stats_register_counter(0, &sc_key, SC_TYPE_DROPPED, &self->dropped_messages);
-    stats_register_counter(STATS_LEVEL1, &sc_key, SC_TYPE_MEMORY_USAGE, &self->memory_usage);
-  }
-  stats_unlock();
-
-  self->seq_num = GPOINTER_TO_INT(cfg_persist_config_fetch(cfg, afsql_dd_format_persist_sequence_number(self)));
-  if (!self->seq_num)
-    init_sequence_number(&self->seq_num);
-
-  self->queue = log_dest_driver_acquire_queue(&self->super,
-                                              afsql_dd_format_persist_name((const LogPipe *)self));
-  if (self->queue == NULL)
-    {
-      return FALSE;
-    }
-  else
-    {
-      if (self->flags & AFSQL_DDF_EXPLICIT_COMMITS)
-        log_queue_set_use_backlog(self->queue, TRUE);
-    }
-  log_queue_set_counters(self->queue, self->queued_messages, self->dropped_messages, self->memory_usage);
   if (!self->fields)
     {
       GList *col, *value;
@@ -1227,7 +1036,7 @@ afsql_dd_init(LogPipe *s)
           msg_error("The number of columns and values do not match",
                     evt_tag_int("len_columns", len_cols),
                     evt_tag_int("len_values", len_values));
-          goto error;
+          return FALSE;
         }
       self->fields_len = len_cols;
       self->fields = g_new0(AFSqlField, len_cols);
@@ -1279,17 +1088,15 @@ afsql_dd_init(LogPipe *s)
         }
     }
 
-  self->time_reopen = cfg->time_reopen;
-
   log_template_options_init(&self->template_options, cfg);
 
-  if (self->flush_lines == -1)
-    self->flush_lines = cfg->flush_lines;
-  if (self->flush_timeout == -1)
-    self->flush_timeout = cfg->flush_timeout;
-
-  if ((self->flags & AFSQL_DDF_EXPLICIT_COMMITS) && (self->flush_lines > 0 || self->flush_timeout > 0))
-    self->flush_lines_queued = 0;
+  if (self->super.batch_lines == -1)
+    self->super.batch_lines = cfg->flush_lines;
+  /* without an explicit flush-timeout() the transaction is committed as
+   * soon as the queue becomes empty, the global flush_timeout() default
+   * would keep it open for seconds */
+  if (self->super.batch_timeout == -1)
+    self->super.batch_timeout = 0;
 
   if (!dbi_initialized)
     {
@@ -1302,12 +1109,12 @@ afsql_dd_init(LogPipe *s)
           msg_error("Unable to initialize database access (DBI)",
                     evt_tag_int("rc", rc),
                     evt_tag_errno("error", errno));
-          goto error;
+          return FALSE;
         }
       else if (rc == 0)
         {
           msg_error("The database access library (DBI) reports no usable SQL drivers, perhaps DBI drivers are not installed properly");
-          goto error;
+          return FALSE;
         }
       else
         {
@@ -1315,62 +1122,13 @@ afsql_dd_init(LogPipe *s)
         }
     }
 
-  afsql_dd_start_thread(self);
-  return TRUE;
-
-error:
-
-  stats_lock();
-  {
-    StatsClusterKey sc_key;
-    stats_cluster_logpipe_key_set(&sc_key, SCS_SQL | SCS_DESTINATION, self->super.super.id,
-                                  afsql_dd_format_stats_instance(self) );
-    stats_unregister_counter(&sc_key, SC_TYPE_QUEUED, &self->queued_messages);
-    stats_unregister_counter(&sc_key, SC_TYPE_DROPPED, &self->dropped_messages);
-    stats_unregister_counter(&sc_key, SC_TYPE_MEMORY_USAGE, &self->memory_usage);
-  }
-  stats_unlock();
-
-  return FALSE;
+  return log_threaded_dest_driver_start(s);
 }
 
 static gboolean
 afsql_dd_deinit(LogPipe *s)
 {
-  AFSqlDestDriver *self = (AFSqlDestDriver *) s;
-
-  log_queue_reset_parallel_push(self->queue);
-
-  log_queue_set_counters(self->queue, NULL, NULL, NULL);
-  cfg_persist_config_add(log_pipe_get_config(s), afsql_dd_format_persist_sequence_number(self),
-                         GINT_TO_POINTER(self->seq_num), NULL, FALSE);
-
-  stats_lock();
-  StatsClusterKey sc_key;
-  stats_cluster_logpipe_key_set(&sc_key, SCS_SQL | SCS_DESTINATION, self->super.super.id,
-                                afsql_dd_format_stats_instance(self) );
-  stats_unregister_counter(&sc_key, SC_TYPE_QUEUED, &self->queued_messages);
-  stats_unregister_counter(&sc_key, SC_TYPE_DROPPED, &self->dropped_messages);
-  stats_unlock();
-
-  if (!log_dest_driver_deinit_method(s))
-    return FALSE;
-
-  return TRUE;
-}
-
-static void
-afsql_dd_queue(LogPipe *s, LogMessage *msg, const LogPathOptions *path_options, gpointer user_data)
-{
-  AFSqlDestDriver *self = (AFSqlDestDriver *) s;
-  LogPathOptions local_options;
-
-  if (!path_options->flow_control_requested)
-    path_options = log_msg_break_ack(msg, path_options, &local_options);
-
-  log_msg_add_ack(msg, path_options);
-  log_queue_push_tail(self->queue, log_msg_ref(msg), path_options);
-  log_dest_driver_queue_method(s, msg, path_options, user_data);
+  return log_threaded_dest_driver_deinit_method(s);
 }
 
 static void
@@ -1407,9 +1165,7 @@ afsql_dd_free(LogPipe *s)
   g_hash_table_destroy(self->dbd_options_numeric);
   if (self->session_statements)
     string_list_free(self->session_statements);
-  g_mutex_free(self->db_thread_mutex);
-  g_cond_free(self->db_thread_wakeup_cond);
-  log_dest_driver_free(s);
+  log_threaded_dest_driver_free(s);
 }
 
 LogDriver *
@@ -1417,13 +1173,21 @@ afsql_dd_new(GlobalConfig *cfg)
 {
   AFSqlDestDriver *self = g_new0(AFSqlDestDriver, 1);
 
-  log_dest_driver_init_instance(&self->super, cfg);
+  log_threaded_dest_driver_init_instance(&self->super, cfg);
 
-  self->super.super.super.init = afsql_dd_init;
-  self->super.super.super.deinit = afsql_dd_deinit;
-  self->super.super.super.queue = afsql_dd_queue;
-  self->super.super.super.free_fn = afsql_dd_free;
-  self->super.super.super.generate_persist_name = afsql_dd_format_persist_name;
+  self->super.super.super.super.init = afsql_dd_init;
+  self->super.super.super.super.deinit = afsql_dd_deinit;
+  self->super.super.super.super.free_fn = afsql_dd_free;
+  self->super.super.super.super.generate_persist_name = afsql_dd_format_persist_name;
+
+  self->super.worker.connect = afsql_dd_connect;
+  self->super.worker.disconnect = afsql_dd_disconnect;
+  self->super.worker.insert = afsql_dd_insert;
+  self->super.worker.flush = afsql_dd_flush;
+  self->super.format.stats_instance = afsql_dd_format_stats_instance;
+  self->super.messages.retry_over = afsql_dd_retry_over_message;
+  self->super.format.legacy_seqnum_persist_name = afsql_dd_format_legacy_persist_sequence_number;
+  self->super.stats_source = SCS_SQL;
 
   self->type = g_strdup("mysql");
   self->host = g_strdup("");
@@ -1436,13 +1200,11 @@ afsql_dd_new(GlobalConfig *cfg)
 
   self->table = log_template_new(configuration, NULL);
   log_template_compile(self->table, "messages", NULL);
-  self->failed_message_counter = 0;
 
-  self->flush_lines = -1;
-  self->flush_timeout = -1;
-  self->flush_lines_queued = -1;
+  self->super.batch_lines = -1;
+  self->super.batch_timeout = -1;
   self->session_statements = NULL;
-  self->num_retries = MAX_FAILED_ATTEMPTS;
+  self->super.retries.max = MAX_FAILED_ATTEMPTS;
 
   self->syslogng_conform_tables = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
   self->dbd_options = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
@@ -1450,11 +1212,7 @@ afsql_dd_new(GlobalConfig *cfg)
 
   log_template_options_defaults(&self->template_options);
 
-  self->db_thread_wakeup_cond = g_cond_new();
-  self->db_thread_mutex = g_mutex_new();
-
-  self->worker_options.is_output_thread = TRUE;
-  return &self->super.super;
+  return &self->super.super.super;
 }
 
 gint
@@ -24,8 +24,7 @@
 #ifndef AFSQL_H_INCLUDED
 #define AFSQL_H_INCLUDED
 
-#include "driver.h"
-#include "mainloop-worker.h"
+#include "logthrdestdrv.h"
 #include "string-list.h"
 
 #include <dbi.h>
@@ -60,16 +59,15 @@ typedef struct _AFSqlField
  * AFSqlDestDriver:
  *
  * This structure encapsulates an SQL destination driver. SQL insert
- * statements are generated from a separate thread because of the blocking
- * nature of the DBI API. It is ensured that while the thread is running,
- * the reference count to the driver structure is increased, thus the db
- * thread can read any of the fields in this structure. To do anything more
- * than simple reading out a value, some kind of locking mechanism shall be
+ * statements are generated from the worker thread of LogThrDestDriver
+ * because of the blocking nature of the DBI API. The worker thread can
+ * read any of the fields in this structure. To do anything more than
+ * simple reading out a value, some kind of locking mechanism shall be
  * used.
  **/
 typedef struct _AFSqlDestDriver
 {
-  LogDestDriver super;
+  LogThrDestDriver super;
   /* read by the db thread */
   gchar *type;
   gchar *host;
@@ -86,37 +84,20 @@ typedef struct _AFSqlDestDriver
   gint fields_len;
   AFSqlField *fields;
   gchar *null_value;
-  gint time_reopen;
-  gint num_retries;
-  gint flush_lines;
-  gint flush_timeout;
-  gint flush_lines_queued;
   gint flags;
   GList *session_statements;
 
   LogTemplateOptions template_options;
 
-  StatsCounterItem *dropped_messages;
-  StatsCounterItem *queued_messages;
-  StatsCounterItem *memory_usage;
-
   GHashTable *dbd_options;
   GHashTable *dbd_options_numeric;
 
-  /* shared by the main/db thread */
-  GMutex *db_thread_mutex;
-  GCond *db_thread_wakeup_cond;
-  gboolean db_thread_terminate;
-  gboolean db_thread_suspended;
-  GTimeVal db_thread_suspend_target;
-  LogQueue *queue;
   /* used exclusively by the db thread */
-  gint32 seq_num;
   dbi_conn dbi_ctx;
   GHashTable *syslogng_conform_tables;
-  guint32 failed_message_counter;
-  WorkerOptions worker_options;
   gboolean transaction_active;
+  gint transaction_rows;
+  gint isolated_rows;
 } AFSqlDestDriver;
 
 
@@ -43,6 +43,10 @@ struct _LogDBParser
   time_t db_file_last_check;
   ino_t db_file_inode;
   time_t db_file_mtime;
+  gchar *db_file_checksum;
+  gchar *db_file_contents;
+  gsize db_file_length;
+  GThread *reload_thread;
   gboolean db_file_reloading;
   gboolean drop_unmatched;
 };
@@ -60,39 +64,154 @@ log_db_parser_emit(LogMessage *msg, gboolean synthetic, gpointer user_data)
     }
 }
 
+/* the contents of the last successfully loaded database are persisted
+ * along with it: the ruleset itself has to be compiled against the new
+ * configuration, and if the file became unloadable in the meantime it is
+ * compiled from these instead of leaving the parser without rules */
+typedef struct _LogDBParserPersistData
+{
+  PatternDB *db;
+  gchar *db_file_contents;
+  gsize db_file_length;
+} LogDBParserPersistData;
+
 static void
+log_db_parser_persist_data_free(LogDBParserPersistData *data)
+{
+  if (data->db)
+    pattern_db_free(data->db);
+  g_free(data->db_file_contents);
+  g_free(data);
+}
+
+static gboolean
 log_db_parser_reload_database(LogDBParser *self)
 {
   struct stat st;
   GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
+  gchar *contents;
+  gsize length;
+  gchar *checksum;
+  GError *error = NULL;
 
   if (stat(self->db_file, &st) < 0)
     {
       msg_error("Error stating pattern database file, no automatic reload will be performed",
                 evt_tag_str("error", g_strerror(errno)));
-      return;
+      return FALSE;
     }
   if ((self->db_file_inode == st.st_ino && self->db_file_mtime == st.st_mtime))
     {
-      return;
+      return TRUE;
     }
 
   self->db_file_inode = st.st_ino;
   self->db_file_mtime = st.st_mtime;
 
-  if (!pattern_db_reload_ruleset(self->db, cfg, self->db_file))
+  if (!g_file_get_contents(self->db_file, &contents, &length, &error))
+    {
+      msg_error("Error reading pattern database file, no automatic reload will be performed",
+                evt_tag_str("file", self->db_file),
+                evt_tag_str("error", error->message));
+      g_clear_error(&error);
+      return FALSE;
+    }
+
+  /* tools like update-patterndb regenerate the file even if its contents
+   * remain the same, parsing it is much more expensive than reading it */
+  checksum = g_compute_checksum_for_data(G_CHECKSUM_SHA1, (const guchar *) contents, length);
+  if (self->db_file_checksum && strcmp(checksum, self->db_file_checksum) == 0)
+    {
+      msg_debug("Pattern database file was rewritten with the same contents, not reloading",
+                evt_tag_str("file", self->db_file));
+      g_free(checksum);
+      g_free(contents);
+      return TRUE;
+    }
+
+  if (!pattern_db_reload_ruleset_from_string(self->db, cfg, self->db_file, contents, length))
     {
       msg_error("Error reloading pattern database, no automatic reload will be performed");
+      g_free(checksum);
+      g_free(contents);
+      return FALSE;
     }
   else
     {
+      g_free(self->db_file_checksum);
+      self->db_file_checksum = checksum;
+      g_free(self->db_file_contents);
+      self->db_file_contents = contents;
+      self->db_file_length = length;
+
       /* free the old database if the new was loaded successfully */
       msg_notice("Log pattern database reloaded",
                  evt_tag_str("file", self->db_file),
                  evt_tag_str("version", pattern_db_get_ruleset_version(self->db)),
                  evt_tag_str("pub_date", pattern_db_get_ruleset_pub_date(self->db)));
     }
+  return TRUE;
+}
+
+/* recompiles the last successfully loaded contents against the current
+ * configuration */
+static gboolean
+log_db_parser_restore_previous_database(LogDBParser *self)
+{
+  GlobalConfig *cfg = log_pipe_get_config(&self->super.super.super);
+
+  if (!self->db_file_contents)
+    return FALSE;
 
+  msg_warning("Error loading pattern database, using the previously loaded version",
+              evt_tag_str("file", self->db_file));
+  return pattern_db_reload_ruleset_from_string(self->db, cfg, self->db_file,
+                                               self->db_file_contents, self->db_file_length);
+}
+
+static gpointer
+log_db_parser_reload_thread(gpointer s)
+{
+  LogDBParser *self = (LogDBParser *) s;
+
+  app_thread_start();
+  log_db_parser_reload_database(self);
+  app_thread_stop();
+
+  g_static_mutex_lock(&self->lock);
+  self->db_file_reloading = FALSE;
+  g_static_mutex_unlock(&self->lock);
+  return NULL;
+}
+
+/* Loads the database in a separate thread, while messages are still
+ * processed using the old ruleset.  pattern_db_reload_ruleset() swaps the
+ * rulesets once the new one is complete.  Must be called with
+ * self->lock held and db_file_reloading set. */
+static void
+log_db_parser_start_reload(LogDBParser *self)
+{
+  /* db_file_reloading is cleared as the last step of the previous reload,
+   * so this does not block */
+  if (self->reload_thread)
+    g_thread_join(self->reload_thread);
+
+  self->reload_thread = g_thread_create(log_db_parser_reload_thread, self, TRUE, NULL);
+  if (!self->reload_thread)
+    {
+      log_db_parser_reload_database(self);
+      self->db_file_reloading = FALSE;
+    }
+}
+
+static void
+log_db_parser_wait_for_reload(LogDBParser *self)
+{
+  if (self->reload_thread)
+    {
+      g_thread_join(self->reload_thread);
+      self->reload_thread = NULL;
+    }
 }
 
 static void
@@ -121,22 +240,32 @@ log_db_parser_init(LogPipe *s)
 {
   LogDBParser *self = (LogDBParser *) s;
   GlobalConfig *cfg = log_pipe_get_config(s);
+  LogDBParserPersistData *persist_data;
 
-  self->db = cfg_persist_config_fetch(cfg, log_db_parser_format_persist_name(self));
-  if (self->db)
+  persist_data = cfg_persist_config_fetch(cfg, log_db_parser_format_persist_name(self));
+  if (persist_data)
     {
-      struct stat st;
-
-      if (stat(self->db_file, &st) < 0)
-        {
-          msg_error("Error stating pattern database file, no automatic reload will be performed",
-                    evt_tag_str("error", g_strerror(errno)));
-        }
-      else if (self->db_file_inode != st.st_ino || self->db_file_mtime != st.st_mtime)
+      self->db = persist_data->db;
+      g_free(self->db_file_contents);
+      self->db_file_contents = persist_data->db_file_contents;
+      self->db_file_length = persist_data->db_file_length;
+      g_free(persist_data);
+
+      /* The templates and conditions of the persisted ruleset were compiled
+       * against the previous configuration, which is freed once this one
+       * is started, so the ruleset is always compiled again, on this
+       * thread.  Only the periodic checks of the file are done in the
+       * background.  The file identity is only used to skip reloads within
+       * one configuration.
+       */
+      self->db_file_inode = 0;
+      self->db_file_mtime = 0;
+      g_free(self->db_file_checksum);
+      self->db_file_checksum = NULL;
+      if (!log_db_parser_reload_database(self) && !log_db_parser_restore_previous_database(self))
         {
-          log_db_parser_reload_database(self);
-          self->db_file_inode = st.st_ino;
-          self->db_file_mtime = st.st_mtime;
+          pattern_db_free(self->db);
+          self->db = pattern_db_new();
         }
     }
   else
@@ -164,14 +293,24 @@ log_db_parser_deinit(LogPipe *s)
 {
   LogDBParser *self = (LogDBParser *) s;
   GlobalConfig *cfg = log_pipe_get_config(s);
+  LogDBParserPersistData *persist_data;
 
   if (iv_timer_registered(&self->tick))
     {
       iv_timer_unregister(&self->tick);
     }
 
-  cfg_persist_config_add(cfg, log_db_parser_format_persist_name(self), self->db, (GDestroyNotify) pattern_db_free, FALSE);
+  log_db_parser_wait_for_reload(self);
+
+  persist_data = g_new0(LogDBParserPersistData, 1);
+  persist_data->db = self->db;
+  persist_data->db_file_contents = self->db_file_contents;
+  persist_data->db_file_length = self->db_file_length;
+  cfg_persist_config_add(cfg, log_db_parser_format_persist_name(self), persist_data,
+                         (GDestroyNotify) log_db_parser_persist_data_free, FALSE);
   self->db = NULL;
+  self->db_file_contents = NULL;
+  self->db_file_length = 0;
   return stateful_parser_deinit_method(s);
 }
 
@@ -196,13 +335,10 @@ log_db_parser_process(LogParser *s, LogMessage **pmsg, const LogPathOptions *pat
         {
           self->db_file_last_check = (*pmsg)->timestamps[LM_TS_RECVD].tv_sec;
           self->db_file_reloading = TRUE;
-          g_static_mutex_unlock(&self->lock);
-
-          /* only one thread may come here, the others may continue to use self->db, until we update it here. */
-          log_db_parser_reload_database(self);
 
-          g_static_mutex_lock(&self->lock);
-          self->db_file_reloading = FALSE;
+          /* only one thread may come here, the others may continue to use
+           * self->db, the new ruleset is loaded in the background. */
+          log_db_parser_start_reload(self);
         }
       g_static_mutex_unlock(&self->lock);
     }
@@ -261,10 +397,13 @@ log_db_parser_free(LogPipe *s)
 {
   LogDBParser *self = (LogDBParser *) s;
 
+  log_db_parser_wait_for_reload(self);
   g_static_mutex_free(&self->lock);
 
   if (self->db)
     pattern_db_free(self->db);
+  g_free(self->db_file_checksum);
+  g_free(self->db_file_contents);
 
   if (self->db_file)
     g_free(self->db_file);
@@ -56,21 +56,46 @@ typedef struct _PDBProcessParams
   gpointer emitted_messages[EXPECTED_NUMBER_OF_MESSAGES_EMITTED];
   GPtrArray *emitted_messages_overflow;
   gint num_emitted_messages;
+
+  /* contexts created by create-context actions, these are stored in their
+   * shard by _store_created_contexts() once no shard lock is held */
+  GPtrArray *created_contexts;
 } PDBProcessParams;
 
-struct _PatternDB
+typedef struct _PatternDBShard
 {
-  GStaticRWLock lock;
-  PDBRuleSet *ruleset;
+  GStaticMutex lock;
   CorrellationState correllation;
-  GHashTable *rate_limits;
   TimerWheel *timer_wheel;
-  GTimeVal last_tick;
 
   /* process_params used by the timer expiration callback.  Should only be
-   * set with the write lock held and only during the duration of
+   * set with the shard lock held and only during the duration of
    * timer_wheel_set_time() */
   PDBProcessParams *timer_process_params;
+  PatternDB *db;
+} PatternDBShard;
+
+struct _PatternDB
+{
+  /* protects the ruleset, message processing only takes it for reading
+   * while looking up the matching rule */
+  GStaticRWLock lock;
+  PDBRuleSet *ruleset;
+  PatternDBShard shards[PATTERN_DB_NUM_SHARDS];
+  GStaticMutex rate_limits_lock;
+  GHashTable *rate_limits;
+
+  /* current time of the correllation engine in seconds, it is only moved
+   * forward, using atomic operations (see _update_current_time()) */
+  volatile gint current_time;
+
+  /* the system time (in seconds) the last message was processed at, it is
+   * updated without locks and is consumed by the timer tick */
+  volatile gint last_message_time;
+  GStaticMutex tick_lock;
+  gint last_seen_message_time;
+  GTimeVal last_tick;
+
   PatternDBEmitFunc emit;
   gpointer emit_data;
 };
@@ -189,8 +214,34 @@ _flush_emitted_messages(PatternDB *self, PDBProcessParams *process_params)
  *    2) process an incoming message stream on-line, expiring correllation
  *    states even if there are no incoming messages
  *
+ * The current time is a single atomic value shared by all threads.  The
+ * thread that moves it forward walks all shards and advances their timer
+ * wheels, so timeouts are not delayed until a message hits the shard.
+ * Shards also catch up with the current time whenever they are locked.
  */
 
+static inline guint64
+_get_current_time(PatternDB *self)
+{
+  return (guint) g_atomic_int_get(&self->current_time);
+}
+
+/* returns TRUE if new_time was stored, FALSE if the current time was
+ * already at or beyond that point (e.g. another thread moved it) */
+static gboolean
+_update_current_time(PatternDB *self, guint64 new_time)
+{
+  gint old_time;
+
+  do
+    {
+      old_time = g_atomic_int_get(&self->current_time);
+      if ((guint) old_time >= new_time)
+        return FALSE;
+    }
+  while (!g_atomic_int_compare_and_exchange(&self->current_time, old_time, (gint) new_time));
+  return TRUE;
+}
 
 /*********************************************
  * Rule evaluation
@@ -207,6 +258,7 @@ _is_action_within_rate_limit(PatternDB *db, PDBProcessParams *process_params)
   CorrellationKey key;
   PDBRateLimit *rl;
   guint64 now;
+  gboolean within_rate_limit = FALSE;
 
   if (action->rate == 0)
     return TRUE;
@@ -214,6 +266,7 @@ _is_action_within_rate_limit(PatternDB *db, PDBProcessParams *process_params)
   g_string_printf(buffer, "%s:%d", rule->rule_id, action->id);
   correllation_key_setup(&key, rule->context.scope, msg, buffer->str);
 
+  g_static_mutex_lock(&db->rate_limits_lock);
   rl = g_hash_table_lookup(db->rate_limits, &key);
   if (!rl)
     {
@@ -221,7 +274,7 @@ _is_action_within_rate_limit(PatternDB *db, PDBProcessParams *process_params)
       g_hash_table_insert(db->rate_limits, &rl->key, rl);
       g_string_steal(buffer);
     }
-  now = timer_wheel_get_time(db->timer_wheel);
+  now = _get_current_time(db);
   if (rl->last_check == 0)
     {
       rl->last_check = now;
@@ -245,9 +298,10 @@ _is_action_within_rate_limit(PatternDB *db, PDBProcessParams *process_params)
   if (rl->buckets)
     {
       rl->buckets--;
-      return TRUE;
+      within_rate_limit = TRUE;
     }
-  return FALSE;
+  g_static_mutex_unlock(&db->rate_limits_lock);
+  return within_rate_limit;
 }
 
 static gboolean
@@ -300,8 +354,6 @@ _execute_action_message(PatternDB *db, PDBProcessParams *process_params)
   log_msg_unref(genmsg);
 }
 
-static void pattern_db_expire_entry(TimerWheel *wheel, guint64 now, gpointer user_data);
-
 static void
 _execute_action_create_context(PatternDB *db, PDBProcessParams *process_params)
 {
@@ -337,19 +389,20 @@ _execute_action_create_context(PatternDB *db, PDBProcessParams *process_params)
             evt_tag_str("rule", rule->rule_id),
             evt_tag_str("context", buffer->str),
             evt_tag_int("context_timeout", syn_context->timeout),
-            evt_tag_int("context_expiration", timer_wheel_get_time(db->timer_wheel) + syn_context->timeout));
+            evt_tag_int("context_expiration", _get_current_time(db) + syn_context->timeout));
 
   correllation_key_setup(&key, syn_context->scope, context_msg, buffer->str);
   new_context = pdb_context_new(&key);
-  g_hash_table_insert(db->correllation.state, &new_context->super.key, new_context);
   g_string_steal(buffer);
 
   g_ptr_array_add(new_context->super.messages, context_msg);
-
-  new_context->super.timer = timer_wheel_add_timer(db->timer_wheel, rule->context.timeout, pattern_db_expire_entry,
-                                                   correllation_context_ref(&new_context->super),
-                                                   (GDestroyNotify) correllation_context_unref);
   new_context->rule = pdb_rule_ref(rule);
+
+  /* the new context may belong to a different shard than the one we are
+   * holding the lock of, so it is only stored after that lock is released */
+  if (!process_params->created_contexts)
+    process_params->created_contexts = g_ptr_array_new();
+  g_ptr_array_add(process_params->created_contexts, new_context);
 }
 
 static void
@@ -401,8 +454,8 @@ _execute_rule_actions(PatternDB *db, PDBProcessParams *process_params, PDBAction
  * PatternDB
  *********************************************************/
 
-/* NOTE: this function requires PatternDB reader/writer lock to be
- * write-locked.
+/* NOTE: this function requires the lock of the shard owning the timer
+ * wheel to be held.
  *
  * Currently, it is, as timer_wheel_set_time() is only called with that
  * precondition, and timer-wheel callbacks are only called from within
@@ -413,20 +466,21 @@ static void
 pattern_db_expire_entry(TimerWheel *wheel, guint64 now, gpointer user_data)
 {
   PDBContext *context = user_data;
-  PatternDB *pdb = (PatternDB *) timer_wheel_get_associated_data(wheel);
+  PatternDBShard *shard = (PatternDBShard *) timer_wheel_get_associated_data(wheel);
+  PatternDB *pdb = shard->db;
   GString *buffer = g_string_sized_new(256);
   LogMessage *msg = correllation_context_get_last_message(&context->super);
-  PDBProcessParams *process_params = pdb->timer_process_params;
+  PDBProcessParams *process_params = shard->timer_process_params;
 
   msg_debug("Expiring patterndb correllation context",
             evt_tag_str("last_rule", context->rule->rule_id),
-            evt_tag_long("utc", timer_wheel_get_time(pdb->timer_wheel)));
+            evt_tag_long("utc", timer_wheel_get_time(wheel)));
   process_params->context = context;
   process_params->rule = context->rule;
   process_params->msg = msg;
   process_params->buffer = buffer;
   _execute_rule_actions(pdb, process_params, RAT_TIMEOUT);
-  g_hash_table_remove(pdb->correllation.state, &context->super.key);
+  g_hash_table_remove(shard->correllation.state, &context->super.key);
   g_string_free(buffer, TRUE);
 
   /* pdb_context_free is automatically called when returning from
@@ -434,6 +488,83 @@ pattern_db_expire_entry(TimerWheel *wheel, guint64 now, gpointer user_data)
      callback. */
 }
 
+static PatternDBShard *
+_get_shard(PatternDB *self, CorrellationKey *key)
+{
+  return &self->shards[correllation_key_hash(key) % PATTERN_DB_NUM_SHARDS];
+}
+
+/* Locks the shard and catches its timer wheel up with the current time.
+ * Expiring contexts emit their messages into process_params, which
+ * overwrites its rule/context/msg/buffer members. */
+static void
+_lock_shard(PatternDBShard *shard, PDBProcessParams *process_params)
+{
+  g_static_mutex_lock(&shard->lock);
+
+  /* the expire callback uses this pointer to find the process_params it
+   * needs to emit messages.  ProcessParams itself is a per-thread value,
+   * however the timer callback is executing with the shard lock held.
+   * There's no other mechanism to pass this pointer to the timer callback,
+   * so we add it to the shard, but make sure it is properly protected by
+   * locks.
+   * */
+  shard->timer_process_params = process_params;
+  timer_wheel_set_time(shard->timer_wheel, _get_current_time(shard->db));
+  shard->timer_process_params = NULL;
+}
+
+static void
+_unlock_shard(PatternDBShard *shard)
+{
+  g_static_mutex_unlock(&shard->lock);
+}
+
+static void
+_advance_time(PatternDB *self, PDBProcessParams *process_params, guint64 new_time)
+{
+  gint i;
+
+  if (!_update_current_time(self, new_time))
+    return;
+
+  for (i = 0; i < PATTERN_DB_NUM_SHARDS; i++)
+    {
+      _lock_shard(&self->shards[i], process_params);
+      _unlock_shard(&self->shards[i]);
+    }
+}
+
+/* This function stores the contexts created by create-context actions.  It
+ * must be called without any shard locks held, as the contexts may belong
+ * to any of the shards. */
+static void
+_store_created_contexts(PatternDB *self, PDBProcessParams *process_params)
+{
+  gint i;
+
+  if (!process_params->created_contexts)
+    return;
+
+  /* locking a shard may expire further contexts, whose actions may append
+   * to created_contexts, so its length is evaluated in every iteration */
+  for (i = 0; i < process_params->created_contexts->len; i++)
+    {
+      PDBContext *context = (PDBContext *) g_ptr_array_index(process_params->created_contexts, i);
+      PatternDBShard *shard = _get_shard(self, &context->super.key);
+
+      _lock_shard(shard, process_params);
+      g_hash_table_insert(shard->correllation.state, &context->super.key, context);
+      context->super.timer = timer_wheel_add_timer(shard->timer_wheel, context->rule->context.timeout,
+                                                   pattern_db_expire_entry,
+                                                   correllation_context_ref(&context->super),
+                                                   (GDestroyNotify) correllation_context_unref);
+      _unlock_shard(shard);
+    }
+  g_ptr_array_free(process_params->created_contexts, TRUE);
+  process_params->created_contexts = NULL;
+}
+
 /*
  * This function can be called any time when pattern-db is not processing
  * messages, but we expect the correllation timer to move forward.  It
@@ -447,21 +578,31 @@ pattern_db_timer_tick(PatternDB *self)
 {
   GTimeVal now;
   glong diff;
+  gint last_message_time;
   PDBProcessParams process_params_p = {0};
   PDBProcessParams *process_params = &process_params_p;
 
-  g_static_rw_lock_writer_lock(&self->lock);
-  self->timer_process_params = process_params;
+  g_static_mutex_lock(&self->tick_lock);
   cached_g_current_time(&now);
+
+  /* messages only record the second they were processed in, assume the
+   * end of that second, so that time is never advanced too early */
+  last_message_time = g_atomic_int_get(&self->last_message_time);
+  if (last_message_time != self->last_seen_message_time)
+    {
+      self->last_seen_message_time = last_message_time;
+      self->last_tick.tv_sec = last_message_time + 1;
+      self->last_tick.tv_usec = 0;
+    }
   diff = g_time_val_diff(&now, &self->last_tick);
 
   if (diff > 1e6)
     {
       glong diff_sec = diff / 1e6;
 
-      timer_wheel_set_time(self->timer_wheel, timer_wheel_get_time(self->timer_wheel) + diff_sec);
+      _advance_time(self, process_params, _get_current_time(self) + diff_sec);
       msg_debug("Advancing patterndb current time because of timer tick",
-                evt_tag_long("utc", timer_wheel_get_time(self->timer_wheel)));
+                evt_tag_long("utc", _get_current_time(self)));
       /* update last_tick, take the fraction of the seconds not calculated into this update into account */
 
       self->last_tick = now;
@@ -475,12 +616,12 @@ pattern_db_timer_tick(PatternDB *self)
        */
       self->last_tick = now;
     }
-  self->timer_process_params = NULL;
-  g_static_rw_lock_writer_unlock(&self->lock);
+  g_static_mutex_unlock(&self->tick_lock);
+  _store_created_contexts(self, process_params);
   _flush_emitted_messages(self, process_params);
 }
 
-/* NOTE: lock should be acquired for writing before calling this function. */
+/* NOTE: no shard locks may be held when calling this function. */
 static void
 _advance_time_based_on_message(PatternDB *self, PDBProcessParams *process_params, const LogStamp *ls)
 {
@@ -492,24 +633,21 @@ _advance_time_based_on_message(PatternDB *self, PDBProcessParams *process_params
    * correllation engine too much. */
 
   cached_g_current_time(&now);
-  self->last_tick = now;
+
+  /* only write the shared value when it changes, which is at most once
+   * per second, to avoid bouncing its cache line between the workers */
+  if (g_atomic_int_get(&self->last_message_time) != now.tv_sec)
+    g_atomic_int_set(&self->last_message_time, (gint) now.tv_sec);
 
   if (ls->tv_sec < now.tv_sec)
     now.tv_sec = ls->tv_sec;
 
-  /* the expire callback uses this pointer to find the process_params it
-   * needs to emit messages.  ProcessParams itself is a per-thread value,
-   * however the timer callback is executing with the writer lock held.
-   * There's no other mechanism to pass this pointer to the timer callback,
-   * so we add it to PatternDB, but make sure it is properly protected by
-   * locks.
-   * */
-  self->timer_process_params = process_params;
-  timer_wheel_set_time(self->timer_wheel, now.tv_sec);
-  self->timer_process_params = NULL;
-
-  msg_debug("Advancing patterndb current time because of an incoming message",
-            evt_tag_long("utc", timer_wheel_get_time(self->timer_wheel)));
+  if (now.tv_sec > _get_current_time(self))
+    {
+      _advance_time(self, process_params, now.tv_sec);
+      msg_debug("Advancing patterndb current time because of an incoming message",
+                evt_tag_long("utc", _get_current_time(self)));
+    }
 }
 
 void
@@ -517,15 +655,20 @@ pattern_db_advance_time(PatternDB *self, gint timeout)
 {
   PDBProcessParams process_params_p = {0};
   PDBProcessParams *process_params = &process_params_p;
-  time_t new_time;
 
+  _advance_time(self, process_params, _get_current_time(self) + timeout);
+  _store_created_contexts(self, process_params);
+  _flush_emitted_messages(self, process_params);
+}
+
+static void
+_swap_ruleset(PatternDB *self, PDBRuleSet *new_ruleset)
+{
   g_static_rw_lock_writer_lock(&self->lock);
-  new_time = timer_wheel_get_time(self->timer_wheel) + timeout;
-  self->timer_process_params = process_params;
-  timer_wheel_set_time(self->timer_wheel, new_time);
-  self->timer_process_params = NULL;
+  if (self->ruleset)
+    pdb_rule_set_free(self->ruleset);
+  self->ruleset = new_ruleset;
   g_static_rw_lock_writer_unlock(&self->lock);
-  _flush_emitted_messages(self, process_params);
 }
 
 gboolean
@@ -539,15 +682,24 @@ pattern_db_reload_ruleset(PatternDB *self, GlobalConfig *cfg, const gchar *pdb_f
       pdb_rule_set_free(new_ruleset);
       return FALSE;
     }
-  else
+  _swap_ruleset(self, new_ruleset);
+  return TRUE;
+}
+
+gboolean
+pattern_db_reload_ruleset_from_string(PatternDB *self, GlobalConfig *cfg, const gchar *pdb_file,
+                                      const gchar *contents, gsize length)
+{
+  PDBRuleSet *new_ruleset;
+
+  new_ruleset = pdb_rule_set_new();
+  if (!pdb_rule_set_load_from_string(new_ruleset, cfg, pdb_file, contents, length, NULL))
     {
-      g_static_rw_lock_writer_lock(&self->lock);
-      if (self->ruleset)
-        pdb_rule_set_free(self->ruleset);
-      self->ruleset = new_ruleset;
-      g_static_rw_lock_writer_unlock(&self->lock);
-      return TRUE;
+      pdb_rule_set_free(new_ruleset);
+      return FALSE;
     }
+  _swap_ruleset(self, new_ruleset);
+  return TRUE;
 }
 
 
@@ -582,15 +734,17 @@ _pattern_db_is_empty(PatternDB *self)
   return (G_UNLIKELY(!self->ruleset) || self->ruleset->is_empty);
 }
 
+/* Rules without a context are processed without taking any locks, only
+ * correllating rules lock the shard their context belongs to. */
 static void
 _pattern_db_process_matching_rule(PatternDB *self, PDBProcessParams *process_params)
 {
+  PatternDBShard *shard = NULL;
   PDBContext *context = NULL;
   PDBRule *rule = process_params->rule;
   LogMessage *msg = process_params->msg;
   GString *buffer = g_string_sized_new(32);
 
-  g_static_rw_lock_writer_lock(&self->lock);
   _advance_time_based_on_message(self, process_params, &msg->timestamps[LM_TS_STAMP]);
   if (rule->context.id_template)
     {
@@ -600,16 +754,18 @@ _pattern_db_process_matching_rule(PatternDB *self, PDBProcessParams *process_par
       log_msg_set_value(msg, context_id_handle, buffer->str, -1);
 
       correllation_key_setup(&key, rule->context.scope, msg, buffer->str);
-      context = g_hash_table_lookup(self->correllation.state, &key);
+      shard = _get_shard(self, &key);
+      _lock_shard(shard, process_params);
+      context = g_hash_table_lookup(shard->correllation.state, &key);
       if (!context)
         {
           msg_debug("Correllation context lookup failure, starting a new context",
                     evt_tag_str("rule", rule->rule_id),
                     evt_tag_str("context", buffer->str),
                     evt_tag_int("context_timeout", rule->context.timeout),
-                    evt_tag_int("context_expiration", timer_wheel_get_time(self->timer_wheel) + rule->context.timeout));
+                    evt_tag_int("context_expiration", timer_wheel_get_time(shard->timer_wheel) + rule->context.timeout));
           context = pdb_context_new(&key);
-          g_hash_table_insert(self->correllation.state, &context->super.key, context);
+          g_hash_table_insert(shard->correllation.state, &context->super.key, context);
           g_string_steal(buffer);
         }
       else
@@ -618,7 +774,7 @@ _pattern_db_process_matching_rule(PatternDB *self, PDBProcessParams *process_par
                     evt_tag_str("rule", rule->rule_id),
                     evt_tag_str("context", buffer->str),
                     evt_tag_int("context_timeout", rule->context.timeout),
-                    evt_tag_int("context_expiration", timer_wheel_get_time(self->timer_wheel) + rule->context.timeout),
+                    evt_tag_int("context_expiration", timer_wheel_get_time(shard->timer_wheel) + rule->context.timeout),
                     evt_tag_int("num_messages", context->super.messages->len));
         }
 
@@ -626,11 +782,11 @@ _pattern_db_process_matching_rule(PatternDB *self, PDBProcessParams *process_par
 
       if (context->super.timer)
         {
-          timer_wheel_mod_timer(self->timer_wheel, context->super.timer, rule->context.timeout);
+          timer_wheel_mod_timer(shard->timer_wheel, context->super.timer, rule->context.timeout);
         }
       else
         {
-          context->super.timer = timer_wheel_add_timer(self->timer_wheel, rule->context.timeout, pattern_db_expire_entry,
+          context->super.timer = timer_wheel_add_timer(shard->timer_wheel, rule->context.timeout, pattern_db_expire_entry,
                                                        correllation_context_ref(&context->super),
                                                        (GDestroyNotify) correllation_context_unref);
         }
@@ -646,6 +802,9 @@ _pattern_db_process_matching_rule(PatternDB *self, PDBProcessParams *process_par
       context = NULL;
     }
 
+  /* expiring contexts above may have changed these */
+  process_params->rule = rule;
+  process_params->msg = msg;
   process_params->context = context;
   process_params->buffer = buffer;
   synthetic_message_apply(&rule->msg, &context->super, msg, buffer);
@@ -653,8 +812,9 @@ _pattern_db_process_matching_rule(PatternDB *self, PDBProcessParams *process_par
   _emit_message(self, process_params, FALSE, msg);
   _execute_rule_actions(self, process_params, RAT_MATCH);
 
+  if (shard)
+    _unlock_shard(shard);
   pdb_rule_unref(rule);
-  g_static_rw_lock_writer_unlock(&self->lock);
 
   if (context)
     log_msg_write_protect(msg);
@@ -667,10 +827,8 @@ _pattern_db_process_unmatching_rule(PatternDB *self, PDBProcessParams *process_p
 {
   LogMessage *msg = process_params->msg;
 
-  g_static_rw_lock_writer_lock(&self->lock);
   _advance_time_based_on_message(self, process_params, &msg->timestamps[LM_TS_STAMP]);
   _emit_message(self, process_params, FALSE, msg);
-  g_static_rw_lock_writer_unlock(&self->lock);
 }
 
 static gboolean
@@ -679,6 +837,7 @@ _pattern_db_process(PatternDB *self, PDBLookupParams *lookup, GArray *dbg_list)
   LogMessage *msg = lookup->msg;
   PDBProcessParams process_params_p = {0};
   PDBProcessParams *process_params = &process_params_p;
+  gboolean matched;
 
   g_static_rw_lock_reader_lock(&self->lock);
   if (_pattern_db_is_empty(self))
@@ -689,12 +848,15 @@ _pattern_db_process(PatternDB *self, PDBLookupParams *lookup, GArray *dbg_list)
   process_params->rule = pdb_ruleset_lookup(self->ruleset, lookup, dbg_list);
   process_params->msg = msg;
   g_static_rw_lock_reader_unlock(&self->lock);
-  if (process_params->rule)
+
+  matched = process_params->rule != NULL;
+  if (matched)
     _pattern_db_process_matching_rule(self, process_params);
   else
     _pattern_db_process_unmatching_rule(self, process_params);
+  _store_created_contexts(self, process_params);
   _flush_emitted_messages(self, process_params);
-  return process_params->rule != NULL;
+  return matched;
 }
 
 gboolean
@@ -732,42 +894,80 @@ pattern_db_expire_state(PatternDB *self)
 {
   PDBProcessParams process_params_p = {0};
   PDBProcessParams *process_params = &process_params_p;
+  gboolean contexts_created;
+  gint i;
 
-  g_static_rw_lock_writer_lock(&self->lock);
-  self->timer_process_params = process_params;
-  timer_wheel_expire_all(self->timer_wheel);
-  self->timer_process_params = NULL;
-  g_static_rw_lock_writer_unlock(&self->lock);
-  _flush_emitted_messages(self, process_params);
+  /* timeout actions may create new contexts, expire those too */
+  do
+    {
+      for (i = 0; i < PATTERN_DB_NUM_SHARDS; i++)
+        {
+          PatternDBShard *shard = &self->shards[i];
 
+          _lock_shard(shard, process_params);
+          shard->timer_process_params = process_params;
+          timer_wheel_expire_all(shard->timer_wheel);
+          shard->timer_process_params = NULL;
+          _unlock_shard(shard);
+        }
+      contexts_created = process_params->created_contexts != NULL;
+      _store_created_contexts(self, process_params);
+    }
+  while (contexts_created);
+  _flush_emitted_messages(self, process_params);
 }
 
 static void
 _init_state(PatternDB *self)
 {
+  gint i;
+
   self->rate_limits = g_hash_table_new_full(correllation_key_hash, correllation_key_equal, NULL,
                                             (GDestroyNotify) pdb_rate_limit_free);
-  correllation_state_init_instance(&self->correllation);
-  self->timer_wheel = timer_wheel_new();
-  timer_wheel_set_associated_data(self->timer_wheel, self, NULL);
+  for (i = 0; i < PATTERN_DB_NUM_SHARDS; i++)
+    {
+      PatternDBShard *shard = &self->shards[i];
+
+      correllation_state_init_instance(&shard->correllation);
+      shard->timer_wheel = timer_wheel_new();
+      timer_wheel_set_associated_data(shard->timer_wheel, shard, NULL);
+    }
+  self->current_time = 0;
 }
 
 static void
 _destroy_state(PatternDB *self)
 {
-  if (self->timer_wheel)
-    timer_wheel_free(self->timer_wheel);
+  gint i;
+
+  for (i = 0; i < PATTERN_DB_NUM_SHARDS; i++)
+    {
+      PatternDBShard *shard = &self->shards[i];
+
+      if (shard->timer_wheel)
+        timer_wheel_free(shard->timer_wheel);
+      correllation_state_deinit_instance(&shard->correllation);
+    }
 
   g_hash_table_destroy(self->rate_limits);
-  correllation_state_deinit_instance(&self->correllation);
 }
 
 void
 pattern_db_forget_state(PatternDB *self)
 {
+  gint i;
+
   g_static_rw_lock_writer_lock(&self->lock);
+  for (i = 0; i < PATTERN_DB_NUM_SHARDS; i++)
+    g_static_mutex_lock(&self->shards[i].lock);
+  g_static_mutex_lock(&self->rate_limits_lock);
+
   _destroy_state(self);
   _init_state(self);
+
+  g_static_mutex_unlock(&self->rate_limits_lock);
+  for (i = PATTERN_DB_NUM_SHARDS - 1; i >= 0; i--)
+    g_static_mutex_unlock(&self->shards[i].lock);
   g_static_rw_lock_writer_unlock(&self->lock);
 }
 
@@ -775,10 +975,18 @@ PatternDB *
 pattern_db_new(void)
 {
   PatternDB *self = g_new0(PatternDB, 1);
+  gint i;
 
   self->ruleset = pdb_rule_set_new();
+  for (i = 0; i < PATTERN_DB_NUM_SHARDS; i++)
+    {
+      g_static_mutex_init(&self->shards[i].lock);
+      self->shards[i].db = self;
+    }
   _init_state(self);
   cached_g_current_time(&self->last_tick);
+  g_static_mutex_init(&self->rate_limits_lock);
+  g_static_mutex_init(&self->tick_lock);
   g_static_rw_lock_init(&self->lock);
   return self;
 }
@@ -786,9 +994,15 @@ pattern_db_new(void)
 void
 pattern_db_free(PatternDB *self)
 {
+  gint i;
+
   if (self->ruleset)
     pdb_rule_set_free(self->ruleset);
   _destroy_state(self);
+  for (i = 0; i < PATTERN_DB_NUM_SHARDS; i++)
+    g_static_mutex_free(&self->shards[i].lock);
+  g_static_mutex_free(&self->rate_limits_lock);
+  g_static_mutex_free(&self->tick_lock);
   g_static_rw_lock_free(&self->lock);
   g_free(self);
 }
@@ -30,6 +30,10 @@
 
 typedef struct _PatternDB PatternDB;
 
+/* correllation contexts are distributed among this many independently
+ * locked shards based on the hash of their key */
+#define PATTERN_DB_NUM_SHARDS 16
+
 typedef void (*PatternDBEmitFunc)(LogMessage *msg, gboolean synthetic, gpointer user_data);
 void pattern_db_set_emit_func(PatternDB *self, PatternDBEmitFunc emit_func, gpointer emit_data);
 
@@ -37,6 +41,8 @@ PDBRuleSet *pattern_db_get_ruleset(PatternDB *self);
 const gchar *pattern_db_get_ruleset_version(PatternDB *self);
 const gchar *pattern_db_get_ruleset_pub_date(PatternDB *self);
 gboolean pattern_db_reload_ruleset(PatternDB *self, GlobalConfig *cfg, const gchar *pdb_file);
+gboolean pattern_db_reload_ruleset_from_string(PatternDB *self, GlobalConfig *cfg, const gchar *pdb_file,
+                                               const gchar *contents, gsize length);
 
 void pattern_db_advance_time(PatternDB *self, gint timeout);
 void pattern_db_timer_tick(PatternDB *self);
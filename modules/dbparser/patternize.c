@@ -40,6 +40,7 @@
 #define PTZ_MAXWORDS 512      /* maximum number of words in one line */
 #define PTZ_LOGTABLE_ALLOC_BASE 3000
 #define PTZ_WORDLIST_CACHE 3 /* FIXME: make this a commandline parameter? */
+#define PTZ_SKETCH_DEPTH 4
 
 static LogTagId cluster_tag_id;
 
@@ -95,93 +96,273 @@ ptz_find_frequent_words_remove_key_predicate(gpointer key, gpointer value, gpoin
   return (*((guint *) value) < GPOINTER_TO_UINT(support));
 }
 
-GHashTable *
-ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gboolean two_pass)
+/*
+ * Count-min sketch
+ *
+ * Used to estimate the number of occurrences of the words in a first pass,
+ * so that the exact counts are only collected for the words that may reach
+ * the support threshold.  The estimate never underestimates the real count,
+ * so no frequent word is lost.  The counters are shared by all threads and
+ * updated using atomic operations.
+ */
+
+typedef struct _PtzSketch
 {
-  int i, j, pass;
-  guint *curr_count;
+  guint width;
+  guint seeds[PTZ_SKETCH_DEPTH];
+  gint *counters;
+} PtzSketch;
+
+static PtzSketch *
+ptz_sketch_new(guint size)
+{
+  PtzSketch *self = g_new0(PtzSketch, 1);
+  gint i;
+
+  self->width = MAX(size / PTZ_SKETCH_DEPTH, 1);
+  for (i = 0; i < PTZ_SKETCH_DEPTH; i++)
+    self->seeds[i] = rand();
+  self->counters = g_new0(gint, self->width * PTZ_SKETCH_DEPTH);
+  return self;
+}
+
+static void
+ptz_sketch_free(PtzSketch *self)
+{
+  g_free(self->counters);
+  g_free(self);
+}
+
+static void
+ptz_sketch_add(PtzSketch *self, gchar *key)
+{
+  gint i;
+
+  for (i = 0; i < PTZ_SKETCH_DEPTH; i++)
+    g_atomic_int_inc(&self->counters[i * self->width + ptz_str2hash(key, self->width, self->seeds[i])]);
+}
+
+static guint
+ptz_sketch_estimate(PtzSketch *self, gchar *key)
+{
+  guint estimate = G_MAXUINT;
+  gint i;
+
+  for (i = 0; i < PTZ_SKETCH_DEPTH; i++)
+    {
+      guint count = self->counters[i * self->width + ptz_str2hash(key, self->width, self->seeds[i])];
+
+      estimate = MIN(estimate, count);
+    }
+  return estimate;
+}
+
+/*
+ * Parallel processing
+ *
+ * The input lines are split into consecutive ranges, each of them processed
+ * by a separate thread into its own hash table.  The tables are merged in
+ * the order of the ranges, which gives the same result as processing the
+ * lines in a single thread.
+ */
+
+typedef struct _PtzWorker
+{
+  GPtrArray *logs;
+  guint first;
+  guint last;
+
+  guint support;
+  gchar *delimiters;
+  guint num_of_samples;
+  PtzSketch *sketch;
+  GHashTable *wordlist;
+
+  GHashTable *result;
+} PtzWorker;
+
+static PtzWorker *
+ptz_workers_new(GPtrArray *logs, guint support, gchar *delimiters, guint *num_of_threads)
+{
+  PtzWorker *workers;
+  guint range;
+  gint i;
+
+  *num_of_threads = CLAMP(*num_of_threads, 1, MAX(logs->len, 1));
+  range = logs->len / *num_of_threads;
+
+  workers = g_new0(PtzWorker, *num_of_threads);
+  for (i = 0; i < *num_of_threads; i++)
+    {
+      workers[i].logs = logs;
+      workers[i].first = i * range;
+      workers[i].last = (i == *num_of_threads - 1) ? logs->len : (i + 1) * range;
+      workers[i].support = support;
+      workers[i].delimiters = delimiters;
+    }
+  return workers;
+}
+
+static void
+ptz_workers_run(PtzWorker *workers, guint num_of_threads, GThreadFunc func)
+{
+  GThread **threads = g_new0(GThread *, num_of_threads);
+  gint i;
+
+  for (i = 1; i < num_of_threads; i++)
+    threads[i] = g_thread_create(func, &workers[i], TRUE, NULL);
+
+  /* the first range is processed by the calling thread */
+  func(&workers[0]);
+
+  for (i = 1; i < num_of_threads; i++)
+    {
+      if (threads[i])
+        g_thread_join(threads[i]);
+      else
+        func(&workers[i]);
+    }
+  g_free(threads);
+}
+
+static gpointer
+ptz_find_frequent_words_sketch_worker(gpointer user_data)
+{
+  PtzWorker *self = (PtzWorker *) user_data;
+  GString *hash_key = g_string_sized_new(64);
   LogMessage *msg;
   gchar *msgstr;
   gssize msglen;
   gchar **words;
-  GHashTable *wordlist;
-  int *wordlist_cache = NULL;
-  guint cachesize = 0, cacheseed = 0, cacheindex = 0;
-  gchar *hash_key;
+  gint i, j;
 
-  wordlist = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
-
-  for (pass = (two_pass ? 1 : 2); pass <= 2; ++pass)
+  for (i = self->first; i < self->last; ++i)
     {
-      if (pass == 1)
-        {
-          msg_progress("Finding frequent words",
-                       evt_tag_str("phase", "caching"));
-          srand(time(NULL));
-          cachesize = (guint) ((logs->len * PTZ_WORDLIST_CACHE));
-          cacheseed = rand();
-          wordlist_cache = g_new0(int, cachesize);
-        }
-      else
+      msg = (LogMessage *) g_ptr_array_index(self->logs, i);
+      msgstr = (gchar *) log_msg_get_value(msg, LM_V_MESSAGE, &msglen);
+
+      words = g_strsplit_set(msgstr, self->delimiters, PTZ_MAXWORDS);
+      for (j = 0; words[j]; ++j)
         {
-          msg_progress("Finding frequent words",
-                       evt_tag_str("phase", "searching"));
+          g_string_printf(hash_key, "%d %s", j, words[j]);
+          ptz_sketch_add(self->sketch, hash_key->str);
         }
+      g_strfreev(words);
+    }
 
-      for (i = 0; i < logs->len; ++i)
+  g_string_free(hash_key, TRUE);
+  return NULL;
+}
+
+static gpointer
+ptz_find_frequent_words_worker(gpointer user_data)
+{
+  PtzWorker *self = (PtzWorker *) user_data;
+  GString *hash_key = g_string_sized_new(64);
+  guint *curr_count;
+  LogMessage *msg;
+  gchar *msgstr;
+  gssize msglen;
+  gchar **words;
+  gint i, j;
+
+  self->result = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  for (i = self->first; i < self->last; ++i)
+    {
+      msg = (LogMessage *) g_ptr_array_index(self->logs, i);
+      msgstr = (gchar *) log_msg_get_value(msg, LM_V_MESSAGE, &msglen);
+
+      words = g_strsplit_set(msgstr, self->delimiters, PTZ_MAXWORDS);
+
+      for (j = 0; words[j]; ++j)
         {
-          msg = (LogMessage *) g_ptr_array_index(logs, i);
-          msgstr = (gchar *) log_msg_get_value(msg, LM_V_MESSAGE, &msglen);
+          /* NOTE: to calculate the key for the hash, we prefix a word with
+           * its position in the row and a space -- as we always split at
+           * spaces, this should not create confusion
+           */
+          g_string_printf(hash_key, "%d %s", j, words[j]);
 
-          words = g_strsplit_set(msgstr, delimiters, PTZ_MAXWORDS);
+          if (self->sketch && ptz_sketch_estimate(self->sketch, hash_key->str) < self->support)
+            continue;
 
-          for (j = 0; words[j]; ++j)
+          curr_count = (guint *) g_hash_table_lookup(self->result, hash_key->str);
+          if (!curr_count)
+            {
+              guint *currcount_ref = g_new(guint, 1);
+              (*currcount_ref) = 1;
+              g_hash_table_insert(self->result, g_strdup(hash_key->str), currcount_ref);
+            }
+          else
             {
-              /* NOTE: to calculate the key for the hash, we prefix a word with
-               * its position in the row and a space -- as we always split at
-               * spaces, this should not create confusion
-               */
-              hash_key = g_strdup_printf("%d %s", j, words[j]);
+              (*curr_count)++;
+            }
+        }
 
-              if (two_pass)
-                cacheindex = ptz_str2hash(hash_key, cachesize, cacheseed);
+      g_strfreev(words);
+    }
 
-              if (pass == 1)
-                {
-                  wordlist_cache[cacheindex]++;
-                }
-              else if (pass == 2)
-                {
-                  if (!two_pass || wordlist_cache[cacheindex] >= support)
-                    {
-                      curr_count = (guint *) g_hash_table_lookup(wordlist, hash_key);
-                      if (!curr_count)
-                        {
-                          guint *currcount_ref = g_new(guint, 1);
-                          (*currcount_ref) = 1;
-                          g_hash_table_insert(wordlist, g_strdup(hash_key), currcount_ref);
-                        }
-                      else
-                        {
-                          (*curr_count)++;
-                        }
-                    }
-                }
+  g_string_free(hash_key, TRUE);
+  return NULL;
+}
 
-              g_free(hash_key);
+/* callback function for g_hash_table_foreach_steal to sum up the word counts of two hashes */
+static gboolean
+ptz_merge_word_counts(gpointer key, gpointer value, gpointer _target)
+{
+  GHashTable *target = _target;
+  guint *curr_count;
 
-            }
+  curr_count = (guint *) g_hash_table_lookup(target, key);
+  if (curr_count)
+    {
+      (*curr_count) += *((guint *) value);
+      return FALSE;
+    }
 
-          g_strfreev(words);
-        }
+  g_hash_table_insert(target, key, value);
+  return TRUE;
+}
+
+GHashTable *
+ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gboolean two_pass, guint num_of_threads)
+{
+  PtzWorker *workers;
+  GHashTable *wordlist;
+  PtzSketch *sketch = NULL;
+  gint i;
 
-      /* g_hash_table_foreach(wordlist, _ptz_debug_print_word, NULL); */
+  workers = ptz_workers_new(logs, support, delimiters, &num_of_threads);
 
-      g_hash_table_foreach_remove(wordlist, ptz_find_frequent_words_remove_key_predicate, GUINT_TO_POINTER(support));
+  if (two_pass)
+    {
+      msg_progress("Finding frequent words",
+                   evt_tag_str("phase", "caching"));
+      srand(time(NULL));
+      sketch = ptz_sketch_new(logs->len * PTZ_WORDLIST_CACHE);
+      for (i = 0; i < num_of_threads; i++)
+        workers[i].sketch = sketch;
+
+      ptz_workers_run(workers, num_of_threads, ptz_find_frequent_words_sketch_worker);
+    }
+
+  msg_progress("Finding frequent words",
+               evt_tag_str("phase", "searching"));
+  ptz_workers_run(workers, num_of_threads, ptz_find_frequent_words_worker);
+
+  wordlist = workers[0].result;
+  for (i = 1; i < num_of_threads; i++)
+    {
+      g_hash_table_foreach_steal(workers[i].result, ptz_merge_word_counts, wordlist);
+      g_hash_table_destroy(workers[i].result);
     }
 
-  if (wordlist_cache)
-    g_free(wordlist_cache);
+  /* g_hash_table_foreach(wordlist, _ptz_debug_print_word, NULL); */
+
+  g_hash_table_foreach_remove(wordlist, ptz_find_frequent_words_remove_key_predicate, GUINT_TO_POINTER(support));
+
+  if (sketch)
+    ptz_sketch_free(sketch);
+  g_free(workers);
 
   return wordlist;
 }
@@ -229,56 +410,51 @@ cluster_free(Cluster *cluster)
   g_free(cluster);
 }
 
-GHashTable *
-ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint num_of_samples)
+static gpointer
+ptz_find_clusters_slct_worker(gpointer user_data)
 {
-  GHashTable *wordlist;
+  PtzWorker *self = (PtzWorker *) user_data;
   GHashTable *clusters;
   int i, j;
   LogMessage *msg;
   gchar *msgstr;
   gssize msglen;
   gchar **words;
-  gchar *hash_key;
+  GString *hash_key;
   gboolean is_candidate;
   Cluster *cluster;
   GString *cluster_key;
   gchar *msgdelimiters;
 
-  /* get the frequent word list */
-  wordlist = ptz_find_frequent_words(logs, support, delimiters, TRUE);
-  /* g_hash_table_foreach(wordlist, _ptz_debug_print_word, NULL); */
-
   /* find the cluster candidates */
   clusters = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) cluster_free);
   cluster_key = g_string_sized_new(0);
-  for (i = 0; i < logs->len; ++i)
+  hash_key = g_string_sized_new(64);
+  for (i = self->first; i < self->last; ++i)
     {
-      msg = (LogMessage *) g_ptr_array_index(logs, i);
+      msg = (LogMessage *) g_ptr_array_index(self->logs, i);
       msgstr = (gchar *) log_msg_get_value(msg, LM_V_MESSAGE, &msglen);
 
       g_string_truncate(cluster_key, 0);
 
-      words = g_strsplit_set(msgstr, delimiters, PTZ_MAXWORDS);
-      msgdelimiters = ptz_find_delimiters(msgstr, delimiters);
+      words = g_strsplit_set(msgstr, self->delimiters, PTZ_MAXWORDS);
+      msgdelimiters = ptz_find_delimiters(msgstr, self->delimiters);
 
       is_candidate = FALSE;
       for (j = 0; words[j]; ++j)
         {
-          hash_key = g_strdup_printf("%d %s", j, words[j]);
+          g_string_printf(hash_key, "%d %s", j, words[j]);
 
-          if (g_hash_table_lookup(wordlist, hash_key))
+          if (g_hash_table_lookup(self->wordlist, hash_key->str))
             {
               is_candidate = TRUE;
-              g_string_append(cluster_key, hash_key);
+              g_string_append(cluster_key, hash_key->str);
               g_string_append_c(cluster_key, PTZ_SEPARATOR_CHAR);
             }
           else
             {
               g_string_append_printf(cluster_key, "%d %c%c", j, PTZ_PARSER_MARKER_CHAR, PTZ_SEPARATOR_CHAR);
             }
-
-          g_free(hash_key);
         }
 
       /* append the delimiters of the message to the cluster key to assure unicity
@@ -296,7 +472,7 @@ ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint
             {
               cluster = g_new0(Cluster, 1);
 
-              if (num_of_samples > 0)
+              if (self->num_of_samples > 0)
                 {
                   cluster->samples = g_ptr_array_sized_new(5);
                   g_ptr_array_add(cluster->samples, g_strdup(msgstr));
@@ -310,7 +486,7 @@ ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint
           else
             {
               g_ptr_array_add(cluster->loglines, (gpointer) msg);
-              if (cluster->samples && cluster->samples->len < num_of_samples)
+              if (cluster->samples && cluster->samples->len < self->num_of_samples)
                 {
                   g_ptr_array_add(cluster->samples, g_strdup(msgstr));
                 }
@@ -321,12 +497,85 @@ ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint
       g_strfreev(words);
     }
 
+  g_string_free(hash_key, TRUE);
+  g_string_free(cluster_key, TRUE);
+
+  self->result = clusters;
+  return NULL;
+}
+
+typedef struct _PtzClusterMergeState
+{
+  GHashTable *target;
+  guint num_of_samples;
+} PtzClusterMergeState;
+
+/* callback function for g_hash_table_foreach_steal to merge the clusters found by different threads */
+static gboolean
+ptz_merge_cluster_candidates(gpointer key, gpointer value, gpointer user_data)
+{
+  PtzClusterMergeState *state = (PtzClusterMergeState *) user_data;
+  Cluster *cluster = (Cluster *) value;
+  Cluster *target_cluster;
+  gint i;
+
+  target_cluster = (Cluster *) g_hash_table_lookup(state->target, key);
+  if (!target_cluster)
+    {
+      g_hash_table_insert(state->target, key, cluster);
+      return TRUE;
+    }
+
+  for (i = 0; i < cluster->loglines->len; i++)
+    g_ptr_array_add(target_cluster->loglines, g_ptr_array_index(cluster->loglines, i));
+
+  if (cluster->samples)
+    {
+      for (i = 0; i < cluster->samples->len && target_cluster->samples->len < state->num_of_samples; i++)
+        {
+          g_ptr_array_add(target_cluster->samples, g_ptr_array_index(cluster->samples, i));
+          g_ptr_array_index(cluster->samples, i) = NULL;
+        }
+    }
+  return FALSE;
+}
+
+GHashTable *
+ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint num_of_samples, guint num_of_threads)
+{
+  PtzWorker *workers;
+  PtzClusterMergeState merge_state;
+  GHashTable *wordlist;
+  GHashTable *clusters;
+  gint i;
+
+  /* get the frequent word list */
+  wordlist = ptz_find_frequent_words(logs, support, delimiters, TRUE, num_of_threads);
+  /* g_hash_table_foreach(wordlist, _ptz_debug_print_word, NULL); */
+
+  workers = ptz_workers_new(logs, support, delimiters, &num_of_threads);
+  for (i = 0; i < num_of_threads; i++)
+    {
+      workers[i].wordlist = wordlist;
+      workers[i].num_of_samples = num_of_samples;
+    }
+  ptz_workers_run(workers, num_of_threads, ptz_find_clusters_slct_worker);
+
+  clusters = workers[0].result;
+  merge_state.target = clusters;
+  merge_state.num_of_samples = num_of_samples;
+  for (i = 1; i < num_of_threads; i++)
+    {
+      g_hash_table_foreach_steal(workers[i].result, ptz_merge_cluster_candidates, &merge_state);
+      g_hash_table_destroy(workers[i].result);
+    }
+  g_free(workers);
+
   g_hash_table_foreach_remove(clusters, ptz_find_clusters_remove_cluster_predicate, GUINT_TO_POINTER(support));
 
   /* g_hash_table_foreach(clusters, _ptz_debug_print_cluster, NULL); */
 
   g_hash_table_unref(wordlist);
-  g_string_free(cluster_key, TRUE);
 
   return clusters;
 }
@@ -348,7 +597,7 @@ ptz_find_clusters_step(Patternizer *self, GPtrArray *logs, guint support, guint
 {
   msg_progress("Searching clusters", evt_tag_int("input lines", logs->len));
   if (self->algo == PTZ_ALGO_SLCT)
-    return ptz_find_clusters_slct(logs, support, self->delimiters, num_of_samples);
+    return ptz_find_clusters_slct(logs, support, self->delimiters, num_of_samples, self->num_of_threads);
   else
     {
       msg_error("Unknown clustering algorithm", evt_tag_int("algo_id", self->algo));
@@ -624,7 +873,8 @@ ptz_load_file(Patternizer *self, gchar *input_file, gboolean no_parse, GError **
 }
 
 Patternizer *
-ptz_new(gdouble support_treshold, guint algo, guint iterate, guint num_of_samples, gchar *delimiters)
+ptz_new(gdouble support_treshold, guint algo, guint iterate, guint num_of_samples, gchar *delimiters,
+        guint num_of_threads)
 {
   Patternizer *self = g_new0(Patternizer, 1);
 
@@ -634,6 +884,7 @@ ptz_new(gdouble support_treshold, guint algo, guint iterate, guint num_of_sample
   self->support_treshold = support_treshold;
   self->num_of_samples = num_of_samples;
   self->delimiters = delimiters;
+  self->num_of_threads = num_of_threads;
   self->logs = g_ptr_array_sized_new(PTZ_LOGTABLE_ALLOC_BASE);
 
   cluster_tag_id = log_tags_get_by_name(".in_patternize_cluster");
@@ -47,6 +47,7 @@ typedef struct _Patternizer
   guint num_of_samples;
   gdouble support_treshold;
   gchar *delimiters;
+  guint num_of_threads;
 
   // NOTE: for now, we store all logs read in in the memory.
   // This brings in some obvious constraints and should be solved
@@ -63,8 +64,10 @@ typedef struct _Cluster
 } Cluster;
 
 /* only declared for the test program */
-GHashTable *ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gboolean two_pass);
-GHashTable *ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint num_of_samples);
+GHashTable *ptz_find_frequent_words(GPtrArray *logs, guint support, gchar *delimiters, gboolean two_pass,
+                                    guint num_of_threads);
+GHashTable *ptz_find_clusters_slct(GPtrArray *logs, guint support, gchar *delimiters, guint num_of_samples,
+                                   guint num_of_threads);
 
 
 GHashTable *ptz_find_clusters(Patternizer *self);
@@ -72,7 +75,8 @@ void ptz_print_patterndb(GHashTable *clusters, gchar *delimiters, gboolean named
 
 gboolean ptz_load_file(Patternizer *self, gchar *input_file, gboolean no_parse, GError **error);
 
-Patternizer *ptz_new(gdouble support_treshold, guint algo, guint iterate, guint num_of_samples, gchar *delimiters);
+Patternizer *ptz_new(gdouble support_treshold, guint algo, guint iterate, guint num_of_samples, gchar *delimiters,
+                     guint num_of_threads);
 void ptz_free(Patternizer *self);
 
 #endif
@@ -1128,12 +1128,71 @@ GMarkupParser db_parser =
   .error = NULL
 };
 
+static void
+_pdb_loader_init(PDBLoader *state, PDBRuleSet *ruleset, GlobalConfig *cfg, const gchar *filename,
+                 gboolean load_examples)
+{
+  memset(state, 0x0, sizeof(*state));
+
+  state->ruleset = ruleset;
+  state->root_program = pdb_program_new();
+  state->load_examples = load_examples;
+  state->ruleset_patterns = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) pdb_program_unref);
+  state->cfg = cfg;
+  state->filename = filename;
+  state->context = g_markup_parse_context_new(&db_parser, 0, state, NULL);
+
+  ruleset->programs = r_new_node("", state->root_program);
+}
+
+static void
+_pdb_loader_deinit(PDBLoader *state)
+{
+  g_markup_parse_context_free(state->context);
+  g_hash_table_unref(state->ruleset_patterns);
+}
+
+static gboolean
+_pdb_loader_parse(PDBLoader *state, const gchar *text, gssize text_len)
+{
+  GError *error = NULL;
+
+  if (!g_markup_parse_context_parse(state->context, text, text_len, &error))
+    {
+      msg_error("Error parsing pattern database file",
+                evt_tag_str(EVT_TAG_FILENAME, state->filename),
+                evt_tag_str("error", error ? error->message : "unknown"));
+      g_clear_error(&error);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static gboolean
+_pdb_loader_finish(PDBLoader *state, GList **examples)
+{
+  GError *error = NULL;
+
+  if (!g_markup_parse_context_end_parse(state->context, &error))
+    {
+      msg_error("Error parsing pattern database file",
+                evt_tag_str(EVT_TAG_FILENAME, state->filename),
+                evt_tag_str("error", error ? error->message : "unknown"));
+      g_clear_error(&error);
+      return FALSE;
+    }
+
+  if (state->load_examples)
+    *examples = state->examples;
+
+  pdb_rule_set_compile(state->ruleset);
+  return TRUE;
+}
+
 gboolean
 pdb_rule_set_load(PDBRuleSet *self, GlobalConfig *cfg, const gchar *config, GList **examples)
 {
   PDBLoader state;
-  GMarkupParseContext *parse_ctx = NULL;
-  GError *error = NULL;
   FILE *dbfile = NULL;
   gint bytes_read;
   gchar buff[4096];
@@ -1147,49 +1206,34 @@ pdb_rule_set_load(PDBRuleSet *self, GlobalConfig *cfg, const gchar *config, GLis
       return FALSE;
     }
 
-  memset(&state, 0x0, sizeof(state));
-
-  state.ruleset = self;
-  state.root_program = pdb_program_new();
-  state.load_examples = !!examples;
-  state.ruleset_patterns = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify) pdb_program_unref);
-  state.cfg = cfg;
-  state.filename = config;
-  state.context = parse_ctx = g_markup_parse_context_new(&db_parser, 0, &state, NULL);
-
-  self->programs = r_new_node("", state.root_program);
+  _pdb_loader_init(&state, self, cfg, config, !!examples);
 
   while ((bytes_read = fread(buff, sizeof(gchar), 4096, dbfile)) != 0)
     {
-      if (!g_markup_parse_context_parse(parse_ctx, buff, bytes_read, &error))
-        {
-          msg_error("Error parsing pattern database file",
-                    evt_tag_str(EVT_TAG_FILENAME, config),
-                    evt_tag_str("error", error ? error->message : "unknown"));
-          goto error;
-        }
+      if (!_pdb_loader_parse(&state, buff, bytes_read))
+        goto error;
     }
-  fclose(dbfile);
-  dbfile = NULL;
 
-  if (!g_markup_parse_context_end_parse(parse_ctx, &error))
-    {
-      msg_error("Error parsing pattern database file",
-                evt_tag_str(EVT_TAG_FILENAME, config),
-                evt_tag_str("error", error ? error->message : "unknown"));
-      goto error;
-    }
+  success = _pdb_loader_finish(&state, examples);
 
-  if (state.load_examples)
-    *examples = state.examples;
+error:
+  fclose(dbfile);
+  _pdb_loader_deinit(&state);
+  return success;
+}
 
-  success = TRUE;
+/* same as pdb_rule_set_load(), but the database was already read into
+ * memory, @filename is only used in error messages */
+gboolean
+pdb_rule_set_load_from_string(PDBRuleSet *self, GlobalConfig *cfg, const gchar *filename,
+                              const gchar *contents, gsize length, GList **examples)
+{
+  PDBLoader state;
+  gboolean success = FALSE;
 
-error:
-  if (dbfile)
-    fclose(dbfile);
-  if (parse_ctx)
-    g_markup_parse_context_free(parse_ctx);
-  g_hash_table_unref(state.ruleset_patterns);
+  _pdb_loader_init(&state, self, cfg, filename, !!examples);
+  if (_pdb_loader_parse(&state, contents, length))
+    success = _pdb_loader_finish(&state, examples);
+  _pdb_loader_deinit(&state);
   return success;
 }
@@ -28,5 +28,7 @@
 #include "cfg.h"
 
 gboolean pdb_rule_set_load(PDBRuleSet *self, GlobalConfig *cfg, const gchar *config, GList **examples);
+gboolean pdb_rule_set_load_from_string(PDBRuleSet *self, GlobalConfig *cfg, const gchar *filename,
+                                       const gchar *contents, gsize length, GList **examples);
 
 #endif
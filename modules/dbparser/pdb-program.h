@@ -36,6 +36,8 @@ typedef struct _PDBProgram
 {
   guint ref_cnt;
   RNode *rules;
+  /* built from rules once the ruleset is completely loaded */
+  RCompiledTree *compiled_rules;
 } PDBProgram;
 
 PDBProgram *pdb_program_new(void);
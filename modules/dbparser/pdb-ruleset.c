@@ -84,7 +84,10 @@ pdb_ruleset_lookup(PDBRuleSet *rule_set, PDBLookupParams *lookup, GArray *dbg_li
 
   program_value = log_msg_get_value(msg, lookup->program_handle, &program_len);
   prg_matches = g_array_new(FALSE, TRUE, sizeof(RParserMatch));
-  node = r_find_node(rule_set->programs, (guint8 *) program_value, program_len, prg_matches);
+  if (rule_set->compiled_programs)
+    node = r_compiled_find_node(rule_set->compiled_programs, (guint8 *) program_value, program_len, prg_matches);
+  else
+    node = r_find_node(rule_set->programs, (guint8 *) program_value, program_len, prg_matches);
 
   if (node)
     {
@@ -118,6 +121,8 @@ pdb_ruleset_lookup(PDBRuleSet *rule_set, PDBLookupParams *lookup, GArray *dbg_li
 
           if (G_UNLIKELY(dbg_list))
             msg_node = r_find_node_dbg(program->rules, (guint8 *) message, message_len, matches, dbg_list);
+          else if (program->compiled_rules)
+            msg_node = r_compiled_find_node(program->compiled_rules, (guint8 *) message, message_len, matches);
           else
             msg_node = r_find_node(program->rules, (guint8 *) message, message_len, matches);
 
@@ -161,6 +166,36 @@ pdb_ruleset_lookup(PDBRuleSet *rule_set, PDBLookupParams *lookup, GArray *dbg_li
 }
 
 
+static void
+_compile_programs(RNode *node)
+{
+  PDBProgram *program = (PDBProgram *) node->value;
+  gint i;
+
+  /* the same program may be stored at several nodes */
+  if (program && program->rules && !program->compiled_rules)
+    program->compiled_rules = r_compile_tree(program->rules);
+
+  for (i = 0; i < node->num_children; i++)
+    _compile_programs(node->children[i]);
+  for (i = 0; i < node->num_pchildren; i++)
+    _compile_programs(node->pchildren[i]);
+}
+
+/*
+ * Builds the compiled representation of the radix trees, which is used
+ * for lookups from then on.  The trees must not be changed afterwards.
+ */
+void
+pdb_rule_set_compile(PDBRuleSet *self)
+{
+  if (!self->programs)
+    return;
+
+  _compile_programs(self->programs);
+  self->compiled_programs = r_compile_tree(self->programs);
+}
+
 PDBRuleSet *
 pdb_rule_set_new(void)
 {
@@ -173,6 +208,8 @@ pdb_rule_set_new(void)
 void
 pdb_rule_set_free(PDBRuleSet *self)
 {
+  if (self->compiled_programs)
+    r_compiled_tree_free(self->compiled_programs);
   if (self->programs)
     r_free_node(self->programs, (GDestroyNotify) pdb_program_unref);
   if (self->version)
@@ -32,6 +32,8 @@
 typedef struct _PDBRuleSet
 {
   RNode *programs;
+  /* built from programs once the ruleset is completely loaded */
+  RCompiledTree *compiled_programs;
   gchar *version;
   gchar *pub_date;
   gboolean is_empty;
@@ -40,6 +42,7 @@ typedef struct _PDBRuleSet
 PDBRule *pdb_ruleset_lookup(PDBRuleSet *rule_set, PDBLookupParams *lookup, GArray *dbg_list);
 PDBRuleSet *pdb_rule_set_new(void);
 void pdb_rule_set_free(PDBRuleSet *self);
+void pdb_rule_set_compile(PDBRuleSet *self);
 
 void pdb_rule_set_global_init(void);
 
@@ -44,6 +44,9 @@
 #include "crypto.h"
 #include "compat/openssl_support.h"
 #include "scratch-buffers.h"
+#include "logpipe.h"
+#include "slab-allocator.h"
+#include "filter/filter-re-prefilter.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -359,7 +362,7 @@ pdbtool_pdb_emit(LogMessage *msg, gboolean synthetic, gpointer user_data)
           if (debug_pattern && !debug_pattern_parse)
             printf("\nValues:\n");
 
-          nv_table_foreach(msg->payload, logmsg_registry, pdbtool_match_values, ret);
+          log_msg_values_foreach(msg, pdbtool_match_values, ret);
           g_string_truncate(output, 0);
           log_msg_print_tags(msg, output);
           printf("TAGS=%s\n", output->str);
@@ -652,6 +655,172 @@ static GOptionEntry match_options[] =
   { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL }
 };
 
+static gchar *benchmark_file = NULL;
+static gint benchmark_threads = 1;
+static gint benchmark_iterations = 1;
+
+typedef struct _PdbtoolBenchmarkThread
+{
+  PatternDB *patterndb;
+  GPtrArray *messages;
+} PdbtoolBenchmarkThread;
+
+static void
+pdbtool_benchmark_emit(LogMessage *msg, gboolean synthetic, gpointer user_data)
+{
+  gint *num_emitted = (gint *) user_data;
+
+  g_atomic_int_inc(num_emitted);
+}
+
+static gpointer
+pdbtool_benchmark_thread(gpointer user_data)
+{
+  PdbtoolBenchmarkThread *args = (PdbtoolBenchmarkThread *) user_data;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  gint i, iteration;
+
+  scratch_buffers_allocator_init();
+  for (iteration = 0; iteration < benchmark_iterations; iteration++)
+    {
+      for (i = 0; i < args->messages->len; i++)
+        {
+          LogMessage *msg = log_msg_clone_cow(g_ptr_array_index(args->messages, i), &path_options);
+
+          pattern_db_process(args->patterndb, msg);
+          log_msg_unref(msg);
+        }
+    }
+  scratch_buffers_allocator_deinit();
+  filter_re_prefilter_thread_deinit();
+  slab_allocator_thread_deinit();
+  return NULL;
+}
+
+static GPtrArray *
+pdbtool_benchmark_load_messages(const gchar *filename, MsgFormatOptions *parse_options)
+{
+  GPtrArray *messages;
+  gchar *contents;
+  gchar **lines;
+  GError *error = NULL;
+  gint i;
+
+  if (!g_file_get_contents(filename, &contents, NULL, &error))
+    {
+      fprintf(stderr, "Error reading file to be processed: %s\n", error->message);
+      g_clear_error(&error);
+      return NULL;
+    }
+
+  messages = g_ptr_array_new();
+  lines = g_strsplit(contents, "\n", -1);
+  for (i = 0; lines[i]; i++)
+    {
+      LogMessage *msg;
+
+      if (!lines[i][0])
+        continue;
+
+      msg = log_msg_new_empty();
+      parse_options->format_handler->parse(parse_options, (guchar *) lines[i], strlen(lines[i]), msg);
+      /* the threads process copy-on-write clones of these */
+      log_msg_write_protect(msg);
+      g_ptr_array_add(messages, msg);
+    }
+  g_strfreev(lines);
+  g_free(contents);
+  return messages;
+}
+
+static gint
+pdbtool_benchmark(int argc, char *argv[])
+{
+  PatternDB *patterndb;
+  MsgFormatOptions parse_options;
+  PdbtoolBenchmarkThread args;
+  GThread *threads[benchmark_threads > 0 ? benchmark_threads : 1];
+  GPtrArray *messages;
+  GTimer *timer;
+  gdouble elapsed;
+  gint num_emitted = 0;
+  gint num_messages;
+  gint i, ret = 1;
+
+  if (!benchmark_file)
+    {
+      fprintf(stderr, "The -f option is required to specify the messages to be processed\n");
+      return 1;
+    }
+  if (benchmark_threads < 1 || benchmark_iterations < 1)
+    {
+      fprintf(stderr, "The number of threads and iterations must be positive\n");
+      return 1;
+    }
+
+  memset(&parse_options, 0, sizeof(parse_options));
+  msg_format_options_defaults(&parse_options);
+  /* the syslog protocol parser automatically falls back to RFC3164 format */
+  parse_options.flags |= LP_SYSLOG_PROTOCOL | LP_EXPECT_HOSTNAME;
+  msg_format_options_init(&parse_options, configuration);
+
+  patterndb = pattern_db_new();
+  if (!pattern_db_reload_ruleset(patterndb, configuration, patterndb_file))
+    goto error;
+
+  messages = pdbtool_benchmark_load_messages(benchmark_file, &parse_options);
+  if (!messages)
+    goto error;
+
+  pattern_db_set_emit_func(patterndb, pdbtool_benchmark_emit, &num_emitted);
+  args.patterndb = patterndb;
+  args.messages = messages;
+
+  timer = g_timer_new();
+  for (i = 0; i < benchmark_threads; i++)
+    threads[i] = g_thread_create(pdbtool_benchmark_thread, &args, TRUE, NULL);
+  for (i = 0; i < benchmark_threads; i++)
+    g_thread_join(threads[i]);
+  elapsed = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  pattern_db_expire_state(patterndb);
+
+  num_messages = messages->len * benchmark_iterations * benchmark_threads;
+  printf("Processed %d messages in %d threads in %.3f seconds, %.0f msg/sec, %d messages emitted\n",
+         num_messages, benchmark_threads, elapsed, elapsed > 0 ? num_messages / elapsed : 0.0,
+         g_atomic_int_get(&num_emitted));
+
+  g_ptr_array_foreach(messages, (GFunc) log_msg_unref, NULL);
+  g_ptr_array_free(messages, TRUE);
+  ret = 0;
+error:
+  pattern_db_free(patterndb);
+  msg_format_options_destroy(&parse_options);
+  return ret;
+}
+
+static GOptionEntry benchmark_options[] =
+{
+  {
+    "pdb",       'p', 0, G_OPTION_ARG_STRING, &patterndb_file,
+    "Name of the patterndb file", "<patterndb_file>"
+  },
+  {
+    "file", 'f', 0, G_OPTION_ARG_STRING, &benchmark_file,
+    "Read the messages from the file specified", "<path>"
+  },
+  {
+    "threads", 't', 0, G_OPTION_ARG_INT, &benchmark_threads,
+    "Number of threads processing the messages concurrently (default: 1)", "<threads>"
+  },
+  {
+    "iterations", 'i', 0, G_OPTION_ARG_INT, &benchmark_iterations,
+    "Number of times each thread processes the messages (default: 1)", "<iterations>"
+  },
+  { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL }
+};
+
 static gboolean test_validate = FALSE;
 static gchar *test_ruleid = NULL;
 
@@ -1033,6 +1202,7 @@ static gdouble support_treshold = 4.0;
 static gboolean iterate_outliers = FALSE;
 static gboolean named_parsers = FALSE;
 static gint num_of_samples = 1;
+static gint num_of_threads = 1;
 static gchar *delimiters = " :&~?![]=,;()'\"";
 
 static gint
@@ -1048,6 +1218,13 @@ pdbtool_patternize(int argc, char *argv[])
   if (iterate_outliers)
     iterate = PTZ_ITERATE_OUTLIERS;
 
+  if (num_of_threads < 1)
+    {
+      fprintf(stderr, "The number of threads must be positive\n");
+      g_string_free(delimcheck, TRUE);
+      return 1;
+    }
+
   /* make sure that every character is unique in the delimiter list */
   for (i = 0; delimiters[i]; i++)
     {
@@ -1057,7 +1234,7 @@ pdbtool_patternize(int argc, char *argv[])
   delimiters = g_strdup(delimcheck->str);
   g_string_free(delimcheck, TRUE);
 
-  if (!(ptz = ptz_new(support_treshold, PTZ_ALGO_SLCT, iterate, num_of_samples, delimiters)))
+  if (!(ptz = ptz_new(support_treshold, PTZ_ALGO_SLCT, iterate, num_of_samples, delimiters, num_of_threads)))
     {
       return 1;
     }
@@ -1113,6 +1290,10 @@ static GOptionEntry patternize_options[] =
     "samples",           0, 0, G_OPTION_ARG_INT, &num_of_samples,
     "Number of example lines to add for the patterns (default: 1)", "<samples>"
   },
+  {
+    "threads",          't', 0, G_OPTION_ARG_INT, &num_of_threads,
+    "Number of threads searching for frequent words and clusters (default: 1)", "<threads>"
+  },
   { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL }
 };
 
@@ -1171,6 +1352,7 @@ static struct
   { "test", test_options, "Test pattern databases", pdbtool_test },
   { "patternize", patternize_options, "Create a pattern database from logs", pdbtool_patternize },
   { "dictionary", dictionary_options, "Dump pattern dictionary", pdbtool_dictionary },
+  { "benchmark", benchmark_options, "Measure the message processing speed of a pattern database", pdbtool_benchmark },
   { NULL, NULL },
 };
 
@@ -1222,6 +1404,8 @@ main(int argc, char *argv[])
 
   setlocale(LC_ALL, "");
 
+  /* the benchmark command processes messages in multiple threads */
+  g_thread_init(NULL);
   msg_init(TRUE);
   resolved_configurable_paths_init(&resolvedConfigurablePaths);
   stats_init();
@@ -878,7 +878,8 @@ RNode *
 r_find_child_by_first_character(RNode *root, char key)
 {
   register gint l, u, idx;
-  register char k = key;
+  /* children are sorted as unsigned characters, see r_node_cmp() */
+  register guint8 k = (guint8) key;
 
   l = 0;
   u = root->num_children;
@@ -1143,12 +1144,12 @@ _truncate_debug_info(RFindNodeState *state, gint truncated_size)
     g_array_set_size(state->dbg_list, truncated_size);
 }
 
-static void
-_find_matching_literal_prefix(RNode *root, guint8 *key, gint keylen,
-                              gint *literal_prefix_inputlen,
-                              gint *literal_prefix_radixlen)
+static inline void
+_match_literal_prefix(const guint8 *radix_key, gint radix_keylen, guint8 *key, gint keylen,
+                      gint *literal_prefix_inputlen,
+                      gint *literal_prefix_radixlen)
 {
-  gint current_node_key_length = root->keylen;
+  gint current_node_key_length = radix_keylen;
   gint input_length;
   gint radix_length;
 
@@ -1167,12 +1168,12 @@ _find_matching_literal_prefix(RNode *root, guint8 *key, gint keylen,
       input_length = radix_length = 0;
       while (input_length < keylen && radix_length < current_node_key_length)
         {
-          if (key[input_length] == '\r' && root->key[radix_length] == '\n')
+          if (key[input_length] == '\r' && radix_key[radix_length] == '\n')
             {
               /* skip CR from input if the radix contains a newline */
               input_length++;
             }
-          if (key[input_length] != root->key[radix_length])
+          if (key[input_length] != radix_key[radix_length])
             break;
 
           input_length++;
@@ -1183,6 +1184,14 @@ _find_matching_literal_prefix(RNode *root, guint8 *key, gint keylen,
   *literal_prefix_radixlen = radix_length;
 }
 
+static void
+_find_matching_literal_prefix(RNode *root, guint8 *key, gint keylen,
+                              gint *literal_prefix_inputlen,
+                              gint *literal_prefix_radixlen)
+{
+  _match_literal_prefix(root->key, root->keylen, key, keylen, literal_prefix_inputlen, literal_prefix_radixlen);
+}
+
 static RNode *
 _find_child_by_remaining_key(RFindNodeState *state, RNode *root, guint8 *remaining_key, gint remaining_keylen)
 {
@@ -1480,6 +1489,330 @@ r_find_all_applicable_nodes(RNode *root, guint8 *key, gint keylen, RNodeGetValue
   return (gchar **) g_ptr_array_free(result, FALSE);
 }
 
+/**************************************************************
+ * Compiled trees.
+ *
+ * A compiled tree is a read-only copy of an RNode tree, stored in a few
+ * contiguous arrays instead of separately allocated nodes:
+ *
+ *   - nodes are laid out in breadth-first order, thus the literal and
+ *     parser children of a node are stored next to each other
+ *   - the literal prefixes of all nodes are stored in a single buffer
+ *   - nodes with many literal children have a jump table indexed by the
+ *     first character of the remaining input, others store the first
+ *     characters of their children in a sorted array
+ *   - parser nodes copy the range of their accepted initial characters,
+ *     and the most common parsers are called directly
+ *
+ * The lookup algorithm is the same as that of r_find_node(), the
+ * compiled tree has to be rebuilt if the original tree changes.
+ **************************************************************/
+
+/* nodes with fewer literal children are searched linearly */
+#define R_COMPILED_JUMP_TABLE_MIN_CHILDREN 8
+
+typedef struct _RCompiledNode
+{
+  const guint8 *key;
+  gint keylen;
+  gint jump_table;
+  guint32 first_child;
+  guint32 num_children;
+  guint32 first_pchild;
+  guint32 num_pchildren;
+  gpointer value;
+  RParserNode *parser;
+  guint8 parser_first;
+  guint8 parser_last;
+  RNode *node;
+} RCompiledNode;
+
+struct _RCompiledTree
+{
+  RCompiledNode *nodes;
+  guint32 num_nodes;
+  /* first character of the literal prefix of each node, indexed like nodes */
+  guint8 *first_chars;
+  /* 256 entries per node, child index + 1, 0 if there's no such child */
+  guint32 *jump_tables;
+  guint8 *keys;
+};
+
+static RCompiledNode *_find_compiled_node_recursively(RFindNodeState *state, RCompiledTree *tree,
+                                                      RCompiledNode *root, guint8 *key, gint keylen);
+
+static inline RCompiledNode *
+_find_compiled_child_by_first_character(RCompiledTree *tree, RCompiledNode *root, guint8 key)
+{
+  guint32 i;
+
+  if (root->jump_table >= 0)
+    {
+      guint32 child = tree->jump_tables[(root->jump_table << 8) + key];
+
+      return child ? &tree->nodes[child - 1] : NULL;
+    }
+
+  for (i = root->first_child; i < root->first_child + root->num_children; i++)
+    {
+      if (tree->first_chars[i] == key)
+        return &tree->nodes[i];
+      if (tree->first_chars[i] > key)
+        break;
+    }
+  return NULL;
+}
+
+static RCompiledNode *
+_find_compiled_child_by_remaining_key(RFindNodeState *state, RCompiledTree *tree, RCompiledNode *root,
+                                      guint8 *remaining_key, gint remaining_keylen)
+{
+  RCompiledNode *candidate;
+
+  if (remaining_keylen >= 2 && remaining_key[0] == '\r' && remaining_key[1] == '\n')
+    {
+      remaining_key++;
+      remaining_keylen--;
+    }
+  candidate = _find_compiled_child_by_first_character(tree, root, remaining_key[0]);
+  if (candidate)
+    return _find_compiled_node_recursively(state, tree, candidate, remaining_key, remaining_keylen);
+  return NULL;
+}
+
+static inline gboolean
+_compiled_pnode_parse(RParserNode *parser_node, guint8 *key, gint *extracted_match_len, RParserMatch *match)
+{
+  /* the parsers used most often are called directly, so that they can be
+   * inlined */
+  switch (parser_node->type)
+    {
+    case RPT_STRING:
+      return r_parser_string(key, extracted_match_len, parser_node->param, parser_node->state, match);
+    case RPT_QSTRING:
+      return r_parser_qstring(key, extracted_match_len, parser_node->param, parser_node->state, match);
+    case RPT_ESTRING:
+      if (parser_node->state)
+        return r_parser_estring(key, extracted_match_len, parser_node->param, parser_node->state, match);
+      return r_parser_estring_c(key, extracted_match_len, parser_node->param, parser_node->state, match);
+    case RPT_NUMBER:
+      return r_parser_number(key, extracted_match_len, parser_node->param, parser_node->state, match);
+    case RPT_IPV4:
+      return r_parser_ipv4(key, extracted_match_len, parser_node->param, parser_node->state, match);
+    case RPT_ANYSTRING:
+      return r_parser_anystring(key, extracted_match_len, parser_node->param, parser_node->state, match);
+    default:
+      return parser_node->parse(key, extracted_match_len, parser_node->param, parser_node->state, match);
+    }
+}
+
+static RCompiledNode *
+_try_parse_with_a_given_compiled_child(RFindNodeState *state, RCompiledTree *tree, RCompiledNode *child_node,
+                                       gint matches_slot_index, guint8 *remaining_key, gint remaining_keylen)
+{
+  RParserNode *parser_node = child_node->parser;
+  RParserMatch *match_slot;
+  gint extracted_match_len;
+  RCompiledNode *ret = NULL;
+
+  if (remaining_key[0] < child_node->parser_first || remaining_key[0] > child_node->parser_last)
+    return NULL;
+
+  match_slot = _clear_match_slot(state, matches_slot_index);
+  if (_compiled_pnode_parse(parser_node, remaining_key, &extracted_match_len, match_slot))
+    {
+      ret = _find_compiled_node_recursively(state, tree, child_node, remaining_key + extracted_match_len,
+                                            remaining_keylen - extracted_match_len);
+
+      /* the GArray may have been reallocated while looking up the child */
+      match_slot = _get_match_slot(state, matches_slot_index);
+      if (match_slot)
+        {
+          if (ret)
+            _fixup_match_offsets(state, parser_node, extracted_match_len, remaining_key, match_slot);
+          else
+            _clear_match_content(match_slot);
+        }
+    }
+  return ret;
+}
+
+static RCompiledNode *
+_find_compiled_child_by_parser(RFindNodeState *state, RCompiledTree *tree, RCompiledNode *root,
+                               guint8 *remaining_key, gint remaining_keylen)
+{
+  gint matches_slot_index;
+  guint32 i;
+  RCompiledNode *ret = NULL;
+
+  matches_slot_index = _alloc_slot_in_matches(state);
+  for (i = root->first_pchild; !ret && i < root->first_pchild + root->num_pchildren; i++)
+    ret = _try_parse_with_a_given_compiled_child(state, tree, &tree->nodes[i], matches_slot_index,
+                                                 remaining_key, remaining_keylen);
+
+  if (!ret && state->stored_matches)
+    _reset_matches_to_original_state(state, matches_slot_index);
+  return ret;
+}
+
+static RCompiledNode *
+_find_compiled_node_recursively(RFindNodeState *state, RCompiledTree *tree, RCompiledNode *root,
+                                guint8 *key, gint keylen)
+{
+  gint literal_prefix_inputlen, literal_prefix_radixlen;
+
+  _match_literal_prefix(root->key, root->keylen, key, keylen,
+                        &literal_prefix_inputlen,
+                        &literal_prefix_radixlen);
+
+  if (literal_prefix_inputlen == keylen && (literal_prefix_radixlen == root->keylen || root->keylen == -1))
+    {
+      /* key completely consumed by the literal */
+      if (root->value)
+        return root;
+    }
+  else if ((root->keylen < 1) || (literal_prefix_inputlen < keylen && literal_prefix_radixlen >= root->keylen))
+    {
+      /* we matched the key partially, go on with child nodes */
+      RCompiledNode *ret;
+      guint8 *remaining_key = key + literal_prefix_inputlen;
+      gint remaining_keylen = keylen - literal_prefix_inputlen;
+
+      /* prefer a literal match over parsers */
+      ret = _find_compiled_child_by_remaining_key(state, tree, root, remaining_key, remaining_keylen);
+
+      /* then try parsers in order */
+      if (!ret && root->num_pchildren)
+        ret = _find_compiled_child_by_parser(state, tree, root, remaining_key, remaining_keylen);
+
+      if (!ret && root->value)
+        {
+          if (!state->require_complete_match)
+            return root;
+          state->partial_match_found = TRUE;
+        }
+
+      return ret;
+    }
+
+  return NULL;
+}
+
+RNode *
+r_compiled_find_node(RCompiledTree *self, guint8 *key, gint keylen, GArray *stored_matches)
+{
+  RFindNodeState state =
+  {
+    .whole_key = key,
+    .stored_matches = stored_matches,
+    .require_complete_match = TRUE,
+  };
+  RCompiledNode *ret;
+
+  ret = _find_compiled_node_recursively(&state, self, &self->nodes[0], key, keylen);
+  if (!ret && state.partial_match_found)
+    {
+      state.require_complete_match = FALSE;
+      ret = _find_compiled_node_recursively(&state, self, &self->nodes[0], key, keylen);
+    }
+  return ret ? ret->node : NULL;
+}
+
+static void
+_compile_node(RCompiledTree *self, RNode *node, guint32 index, guint32 *next_child, gsize *keys_pos,
+              gint *next_jump_table)
+{
+  RCompiledNode *compiled = &self->nodes[index];
+  gint i;
+
+  compiled->node = node;
+  compiled->value = node->value;
+  compiled->keylen = node->keylen;
+  if (node->keylen > 0)
+    {
+      memcpy(self->keys + *keys_pos, node->key, node->keylen);
+      compiled->key = self->keys + *keys_pos;
+      *keys_pos += node->keylen;
+      self->first_chars[index] = node->key[0];
+    }
+
+  compiled->parser = node->parser;
+  if (node->parser)
+    {
+      compiled->parser_first = node->parser->first;
+      compiled->parser_last = node->parser->last;
+    }
+
+  /* children are assigned consecutive indexes by the breadth-first walk in
+   * r_compile_tree(), literal children first */
+  compiled->first_child = *next_child;
+  compiled->num_children = node->num_children;
+  *next_child += node->num_children;
+  compiled->first_pchild = *next_child;
+  compiled->num_pchildren = node->num_pchildren;
+  *next_child += node->num_pchildren;
+
+  compiled->jump_table = -1;
+  if (node->num_children >= R_COMPILED_JUMP_TABLE_MIN_CHILDREN)
+    {
+      guint32 *jump_table;
+
+      compiled->jump_table = (*next_jump_table)++;
+      jump_table = &self->jump_tables[compiled->jump_table << 8];
+      for (i = 0; i < node->num_children; i++)
+        jump_table[node->children[i]->key[0]] = compiled->first_child + i + 1;
+    }
+}
+
+RCompiledTree *
+r_compile_tree(RNode *root)
+{
+  RCompiledTree *self = g_new0(RCompiledTree, 1);
+  GPtrArray *nodes = g_ptr_array_new();
+  guint32 i, next_child = 1;
+  gsize keys_size = 0, keys_pos = 0;
+  gint num_jump_tables = 0, next_jump_table = 0;
+  gint j;
+
+  g_ptr_array_add(nodes, root);
+  for (i = 0; i < nodes->len; i++)
+    {
+      RNode *node = (RNode *) g_ptr_array_index(nodes, i);
+
+      if (node->keylen > 0)
+        keys_size += node->keylen;
+      if (node->num_children >= R_COMPILED_JUMP_TABLE_MIN_CHILDREN)
+        num_jump_tables++;
+
+      for (j = 0; j < node->num_children; j++)
+        g_ptr_array_add(nodes, node->children[j]);
+      for (j = 0; j < node->num_pchildren; j++)
+        g_ptr_array_add(nodes, node->pchildren[j]);
+    }
+
+  self->num_nodes = nodes->len;
+  self->nodes = g_new0(RCompiledNode, self->num_nodes);
+  self->first_chars = g_new0(guint8, self->num_nodes);
+  self->jump_tables = g_new0(guint32, num_jump_tables * 256);
+  self->keys = g_malloc(keys_size + 1);
+
+  for (i = 0; i < nodes->len; i++)
+    _compile_node(self, (RNode *) g_ptr_array_index(nodes, i), i, &next_child, &keys_pos, &next_jump_table);
+
+  g_ptr_array_free(nodes, TRUE);
+  return self;
+}
+
+void
+r_compiled_tree_free(RCompiledTree *self)
+{
+  g_free(self->nodes);
+  g_free(self->first_chars);
+  g_free(self->jump_tables);
+  g_free(self->keys);
+  g_free(self);
+}
+
 /**
  * r_new_node:
  */
@@ -153,5 +153,12 @@ RNode *r_find_node(RNode *root, guint8 *key, gint keylen, GArray *matches);
 RNode *r_find_node_dbg(RNode *root, guint8 *key, gint keylen, GArray *matches, GArray *dbg_list);
 gchar **r_find_all_applicable_nodes(RNode *root, guint8 *key, gint keylen, RNodeGetValueFunc value_func);
 
+/* read-only, cache friendly representation of a complete tree */
+typedef struct _RCompiledTree RCompiledTree;
+
+RCompiledTree *r_compile_tree(RNode *root);
+void r_compiled_tree_free(RCompiledTree *self);
+RNode *r_compiled_find_node(RCompiledTree *self, guint8 *key, gint keylen, GArray *matches);
+
 #endif
 
@@ -30,6 +30,8 @@
 #include "plugin.h"
 #include "cfg.h"
 #include "timerwheel.h"
+#include "correllation-key.h"
+#include "scratch-buffers.h"
 #include "libtest/msg_parse_lib.h"
 
 #include <stdio.h>
@@ -1109,6 +1111,187 @@ test_patterndb_tags_outside_of_rule(void)
   _destroy_pattern_db();
 }
 
+void
+test_patterndb_reload_ruleset_from_string(void)
+{
+  const gchar *invalid_pdb = "<patterndb version='4' pub_date='2010-02-22'><ruleset";
+
+  _load_pattern_db_from_string(pdb_ruletest_skeleton);
+
+  assert_true(pattern_db_reload_ruleset_from_string(patterndb, configuration, filename,
+                                                    pdb_ruletest_skeleton, strlen(pdb_ruletest_skeleton)),
+              "Error loading ruleset from memory");
+  assert_msg_with_program_matches_and_nvpair_equals("prog1", "simple-message", "simple-msg-value-1", "value1");
+
+  assert_false(pattern_db_reload_ruleset_from_string(patterndb, configuration, filename,
+                                                     invalid_pdb, strlen(invalid_pdb)),
+               "successfully loaded an invalid patterndb");
+  /* the previous ruleset is kept */
+  assert_msg_with_program_matches_and_nvpair_equals("prog1", "simple-message", "simple-msg-value-1", "value1");
+  _destroy_pattern_db();
+}
+
+#define NUM_CONTEXTS 64
+#define NUM_THREADS 8
+#define MESSAGES_PER_THREAD 1000
+
+static LogMessage *
+_construct_message_with_pid(const gchar *message, gint pid)
+{
+  gchar pid_str[16];
+
+  g_snprintf(pid_str, sizeof(pid_str), "%d", pid);
+  return _construct_message_with_nvpair("prog1", message, "PID", pid_str);
+}
+
+static gint
+_get_shard_of_pid(gint pid)
+{
+  LogMessage *msg = _construct_message_with_pid("correllated-message-based-on-pid", pid);
+  CorrellationKey key;
+  gchar pid_str[16];
+  gint shard;
+
+  g_snprintf(pid_str, sizeof(pid_str), "%d", pid);
+  correllation_key_setup(&key, RCS_PROGRAM, msg, pid_str);
+  shard = correllation_key_hash(&key) % PATTERN_DB_NUM_SHARDS;
+  log_msg_unref(msg);
+  return shard;
+}
+
+static void
+assert_msg_with_pid_matches_and_nvpair_equals(const gchar *message, gint pid, const gchar *name, const gchar *value)
+{
+  LogMessage *msg = _construct_message_with_pid(message, pid);
+
+  assert_true(pattern_db_process(patterndb, msg), "patterndb expected to match but it didn't");
+  assert_log_message_value(msg, log_msg_get_value_handle(name), value);
+  log_msg_unref(msg);
+}
+
+static gint
+_count_output_messages(const gchar *message)
+{
+  gint i, count = 0;
+
+  for (i = 0; i < messages->len; i++)
+    {
+      LogMessage *msg = (LogMessage *) g_ptr_array_index(messages, i);
+
+      if (strcmp(log_msg_get_value(msg, LM_V_MESSAGE, NULL), message) == 0)
+        count++;
+    }
+  return count;
+}
+
+static void
+test_correllation_contexts_in_different_shards(void)
+{
+  gboolean shards_used[PATTERN_DB_NUM_SHARDS] = { 0 };
+  gint pid, i, num_shards_used = 0;
+
+  _reset_pattern_db_state();
+  for (pid = 0; pid < NUM_CONTEXTS; pid++)
+    shards_used[_get_shard_of_pid(pid)] = TRUE;
+  for (i = 0; i < PATTERN_DB_NUM_SHARDS; i++)
+    num_shards_used += shards_used[i];
+  assert_true(num_shards_used > 1, "the contexts of the test all hash to the same shard");
+
+  for (pid = 0; pid < NUM_CONTEXTS; pid++)
+    assert_msg_with_pid_matches_and_nvpair_equals("correllated-message-based-on-pid", pid,
+                                                  "correllated-msg-context-length", "1");
+  for (pid = 0; pid < NUM_CONTEXTS; pid++)
+    assert_msg_with_pid_matches_and_nvpair_equals("correllated-message-based-on-pid", pid,
+                                                  "correllated-msg-context-length", "2");
+}
+
+static void
+test_correllation_contexts_expire_in_every_shard(void)
+{
+  gint pid;
+
+  _reset_pattern_db_state();
+  for (pid = 0; pid < NUM_CONTEXTS; pid++)
+    assert_msg_with_pid_matches_and_nvpair_equals("correllated-message-with-action-on-timeout", pid,
+                                                  ".classifier.rule_id", "10c");
+  assert_msg_with_pid_matches_and_nvpair_equals("correllated-message-based-on-pid", NUM_CONTEXTS,
+                                                "correllated-msg-context-length", "1");
+
+  pattern_db_advance_time(patterndb, 30);
+  assert_gint(_count_output_messages("generated-message-on-timeout"), 0, "contexts expired before their timeout");
+
+  pattern_db_advance_time(patterndb, 31);
+  assert_gint(_count_output_messages("generated-message-on-timeout"), NUM_CONTEXTS,
+              "not every context expired after its timeout");
+
+  /* the expired context is gone, a new one is started */
+  assert_msg_with_pid_matches_and_nvpair_equals("correllated-message-based-on-pid", NUM_CONTEXTS,
+                                                "correllated-msg-context-length", "1");
+}
+
+static gint emitted_message_count;
+
+static void
+_count_emitted_messages(LogMessage *msg, gboolean synthetic, gpointer user_data)
+{
+  g_atomic_int_inc(&emitted_message_count);
+}
+
+static gpointer
+_process_messages_with_shared_context(gpointer user_data)
+{
+  gint i;
+
+  scratch_buffers_allocator_init();
+  for (i = 0; i < MESSAGES_PER_THREAD; i++)
+    {
+      LogMessage *msg = _construct_message("prog1", "correllated-message-based-on-pid");
+
+      pattern_db_process(patterndb, msg);
+      log_msg_unref(msg);
+      scratch_buffers_explicit_gc();
+    }
+  scratch_buffers_allocator_deinit();
+  return NULL;
+}
+
+static void
+test_correllation_context_shared_between_threads(void)
+{
+  GThread *threads[NUM_THREADS];
+  gchar expected_length[16];
+  gint i;
+
+  _reset_pattern_db_state();
+  emitted_message_count = 0;
+  pattern_db_set_emit_func(patterndb, _count_emitted_messages, NULL);
+
+  for (i = 0; i < NUM_THREADS; i++)
+    threads[i] = g_thread_create(_process_messages_with_shared_context, NULL, TRUE, NULL);
+  for (i = 0; i < NUM_THREADS; i++)
+    g_thread_join(threads[i]);
+
+  assert_gint(emitted_message_count, NUM_THREADS * MESSAGES_PER_THREAD, "messages were lost while processing");
+
+  /* every message was added to the very same context */
+  g_snprintf(expected_length, sizeof(expected_length), "%d", NUM_THREADS * MESSAGES_PER_THREAD + 1);
+  assert_msg_with_pid_matches_and_nvpair_equals("correllated-message-based-on-pid", atoi(MYPID),
+                                                "correllated-msg-context-length", expected_length);
+
+  pattern_db_set_emit_func(patterndb, _emit_func, NULL);
+}
+
+static void
+test_patterndb_sharded_correllation(void)
+{
+  _load_pattern_db_from_string(pdb_ruletest_skeleton);
+
+  test_correllation_contexts_in_different_shards();
+  test_correllation_contexts_expire_in_every_shard();
+  test_correllation_context_shared_between_threads();
+  _destroy_pattern_db();
+}
+
 #include "test_parsers_e2e.c"
 
 int
@@ -1133,6 +1316,8 @@ main(int argc, char *argv[])
   test_patterndb_message_property_inheritance();
   test_patterndb_context_length();
   test_patterndb_tags_outside_of_rule();
+  test_patterndb_reload_ruleset_from_string();
+  test_patterndb_sharded_correllation();
 
   app_shutdown();
   return 0;
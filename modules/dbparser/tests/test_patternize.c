@@ -35,6 +35,9 @@ gboolean fail = FALSE;
 
 MsgFormatOptions parse_options;
 
+/* every test case is run in a single thread and split between a few threads */
+static guint test_num_of_threads[] = { 1, 3 };
+
 static void _debug_print(gpointer key, gpointer value, gpointer dummy)
 {
   fprintf(stderr, "%s: %d\n", (gchar *) key, *((guint *) value));
@@ -88,7 +91,7 @@ testcase_get_logmessages(gchar *logs)
 void
 testcase_frequent_words(gchar *logs, guint support, gchar *expected)
 {
-  int i, twopass;
+  int i, run, twopass;
   gchar **expecteds;
   GHashTable *wordlist;
   loglinesType *logmessages;
@@ -98,9 +101,11 @@ testcase_frequent_words(gchar *logs, guint support, gchar *expected)
 
   expecteds = g_strsplit(expected, ",", 0);
 
-  for (twopass = 1; twopass <= 2; ++twopass)
+  for (run = 0; run < G_N_ELEMENTS(test_num_of_threads) * 2; ++run)
     {
-      wordlist = ptz_find_frequent_words(logmessages->logmessages, support, delimiters, twopass == 1);
+      twopass = run % 2 + 1;
+      wordlist = ptz_find_frequent_words(logmessages->logmessages, support, delimiters, twopass == 1,
+                                         test_num_of_threads[run / 2]);
 
       for (i = 0; expecteds[i]; ++i)
         {
@@ -128,8 +133,8 @@ testcase_frequent_words(gchar *logs, guint support, gchar *expected)
           if (ret != (guint) expected_occurrence)
             {
               fail = TRUE;
-              fprintf(stderr, "Frequent words test case failed; word: '%s', expected=%d, got=%d, support=%d\n",
-                      expected_word, expected_occurrence, ret, support);
+              fprintf(stderr, "Frequent words test case failed; word: '%s', expected=%d, got=%d, support=%d, threads=%d\n",
+                      expected_word, expected_occurrence, ret, support, test_num_of_threads[run / 2]);
 
               fprintf(stderr, "Input:\n%s\n", logs);
               fprintf(stderr, "Full results:\n");
@@ -139,6 +144,7 @@ testcase_frequent_words(gchar *logs, guint support, gchar *expected)
 
           g_strfreev(expected_item);
         }
+      g_hash_table_unref(wordlist);
     }
 
   // cleanup
@@ -296,8 +302,8 @@ test_clusters_find(gpointer key, gpointer value, gpointer user_data)
 
 }
 
-void
-testcase_find_clusters_slct(gchar *logs, guint support, gchar *expected)
+static void
+testcase_find_clusters_slct_in_threads(gchar *logs, guint support, gchar *expected, guint num_of_threads)
 {
   int i,j;
   gchar **expecteds;
@@ -309,7 +315,7 @@ testcase_find_clusters_slct(gchar *logs, guint support, gchar *expected)
 
   logmessages = testcase_get_logmessages(logs);
 
-  clusters = ptz_find_clusters_slct(logmessages->logmessages, support, delimiters, 0);
+  clusters = ptz_find_clusters_slct(logmessages->logmessages, support, delimiters, 0, num_of_threads);
 
   expecteds = g_strsplit(expected, "|", 0);
   for (i = 0; expecteds[i]; ++i)
@@ -343,7 +349,8 @@ testcase_find_clusters_slct(gchar *logs, guint support, gchar *expected)
           else
             fprintf(stderr, "Support value does not match;");
 
-          fprintf(stderr, " expected_cluster='%s', expected_support='%d'\n", expected_item[0], expected_support);
+          fprintf(stderr, " expected_cluster='%s', expected_support='%d', threads='%d'\n", expected_item[0], expected_support,
+                  num_of_threads);
           fprintf(stderr, "Input:\n%s\n", logs);
           fprintf(stderr, "Got clusters:\n");
           g_hash_table_foreach(clusters, _debug_print2, NULL);
@@ -366,6 +373,15 @@ testcase_find_clusters_slct(gchar *logs, guint support, gchar *expected)
   g_strfreev(expecteds);
 }
 
+void
+testcase_find_clusters_slct(gchar *logs, guint support, gchar *expected)
+{
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS(test_num_of_threads); ++i)
+    testcase_find_clusters_slct_in_threads(logs, support, expected, test_num_of_threads[i]);
+}
+
 void
 find_clusters_slct_tests(void)
 {
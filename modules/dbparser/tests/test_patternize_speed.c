@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "patternize.h"
+#include "logmsg/logmsg.h"
+#include "apphook.h"
+#include "testutils.h"
+#include "stopwatch.h"
+
+#include <string.h>
+
+#define NUM_MESSAGES 200000
+#define SUPPORT (NUM_MESSAGES / 100)
+
+static const gchar *delimiters = " :&~?![]=,;()'\"";
+
+static const gchar *templates[] =
+{
+  "Accepted password for %s from 10.0.%d.%d port %d ssh2",
+  "Failed password for invalid user %s from 192.168.%d.%d port %d ssh2",
+  "pam_unix(cron:session): session opened for user %s by (uid=%d) %d %d",
+  "Connection closed by authenticating user %s 172.16.%d.%d port %d [preauth]",
+  "usb-storage %s %d-%d: new high-speed USB device number %d",
+};
+
+static const gchar *users[] =
+{
+  "root", "admin", "bazsi", "www-data", "postgres", "nobody", "guest", "backup"
+};
+
+static GPtrArray *
+_generate_messages(void)
+{
+  GPtrArray *logs = g_ptr_array_sized_new(NUM_MESSAGES);
+  GRand *rand = g_rand_new_with_seed(12345);
+  gint i;
+
+  for (i = 0; i < NUM_MESSAGES; i++)
+    {
+      LogMessage *msg = log_msg_new_empty();
+      gchar *line;
+
+      /* every twentieth line is random noise that does not belong to any cluster */
+      if (i % 20 == 0)
+        line = g_strdup_printf("noise%d %d %x", g_rand_int(rand), i, g_rand_int(rand));
+      else
+        line = g_strdup_printf(templates[g_rand_int_range(rand, 0, G_N_ELEMENTS(templates))],
+                               users[g_rand_int_range(rand, 0, G_N_ELEMENTS(users))],
+                               g_rand_int_range(rand, 0, 256), g_rand_int_range(rand, 0, 256),
+                               g_rand_int_range(rand, 1024, 65536));
+      log_msg_set_value(msg, LM_V_MESSAGE, line, -1);
+      g_ptr_array_add(logs, msg);
+      g_free(line);
+    }
+
+  g_rand_free(rand);
+  return logs;
+}
+
+static void
+_count_loglines(gpointer key, gpointer value, gpointer user_data)
+{
+  *((guint *) user_data) += ((Cluster *) value)->loglines->len;
+}
+
+static void
+_perftest_find_clusters(GPtrArray *logs, guint num_of_threads, guint *num_of_clusters, guint *num_of_loglines)
+{
+  GHashTable *clusters;
+
+  start_stopwatch();
+  clusters = ptz_find_clusters_slct(logs, SUPPORT, (gchar *) delimiters, 1, num_of_threads);
+  stop_stopwatch_and_display_result(logs->len, "patternize %d lines in %d threads", logs->len, num_of_threads);
+
+  *num_of_clusters = g_hash_table_size(clusters);
+  *num_of_loglines = 0;
+  g_hash_table_foreach(clusters, _count_loglines, num_of_loglines);
+  g_hash_table_unref(clusters);
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  guint threads[] = { 1, 2, 4 };
+  guint expected_clusters, expected_loglines;
+  guint num_of_clusters, num_of_loglines;
+  GPtrArray *logs;
+  gint i;
+
+  app_startup();
+
+  logs = _generate_messages();
+
+  _perftest_find_clusters(logs, threads[0], &expected_clusters, &expected_loglines);
+  assert_true(expected_clusters > 0, "No clusters were found in the synthetic input");
+  for (i = 1; i < G_N_ELEMENTS(threads); i++)
+    {
+      _perftest_find_clusters(logs, threads[i], &num_of_clusters, &num_of_loglines);
+      assert_guint(num_of_clusters, expected_clusters, "Different number of clusters in %d threads", threads[i]);
+      assert_guint(num_of_loglines, expected_loglines, "Different number of clustered lines in %d threads", threads[i]);
+    }
+
+  for (i = 0; i < logs->len; i++)
+    log_msg_unref((LogMessage *) g_ptr_array_index(logs, i));
+  g_ptr_array_free(logs, TRUE);
+  app_shutdown();
+  return 0;
+}
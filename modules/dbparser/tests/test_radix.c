@@ -89,11 +89,77 @@ insert_node(RNode *root, gchar *key)
   insert_node_with_value(root, key, NULL);
 }
 
+static RNode *
+find_node_in_compiled_tree(RNode *root, gchar *key, GArray *matches)
+{
+  RCompiledTree *compiled = r_compile_tree(root);
+  RNode *ret;
+
+  ret = r_compiled_find_node(compiled, key, strlen(key), matches);
+  r_compiled_tree_free(compiled);
+  return ret;
+}
+
+static gboolean
+parser_matches_equal(RParserMatch *a, RParserMatch *b)
+{
+  if (a->handle != b->handle || a->type != b->type || a->ofs != b->ofs || a->len != b->len)
+    return FALSE;
+  if (a->match && b->match)
+    return strcmp(a->match, b->match) == 0;
+  return a->match == b->match;
+}
+
+/* the compiled tree has to find the same node with the same matches */
+static void
+test_compiled_search_matches(RNode *root, gchar *key, RNode *expected_node, GArray *expected_matches)
+{
+  GArray *matches = g_array_new(FALSE, TRUE, sizeof(RParserMatch));
+  RNode *ret;
+  gint i;
+
+  g_array_set_size(matches, 1);
+  ret = find_node_in_compiled_tree(root, key, matches);
+  if (ret != expected_node)
+    {
+      printf("FAIL: compiled tree returned a different node: '%s'\n", key);
+      fail = TRUE;
+    }
+  else if (ret && matches->len != expected_matches->len)
+    {
+      printf("FAIL: compiled tree returned a different number of matches: '%s' => %u != %u\n",
+             key, matches->len, expected_matches->len);
+      fail = TRUE;
+    }
+  else if (ret)
+    {
+      for (i = 0; i < matches->len; i++)
+        {
+          if (!parser_matches_equal(&g_array_index(matches, RParserMatch, i),
+                                    &g_array_index(expected_matches, RParserMatch, i)))
+            {
+              printf("FAIL: compiled tree returned a different match: '%s' => %d. match\n", key, i);
+              fail = TRUE;
+            }
+        }
+    }
+
+  for (i = 0; i < matches->len; i++)
+    g_free(g_array_index(matches, RParserMatch, i).match);
+  g_array_free(matches, TRUE);
+}
+
 void
 test_search_value(RNode *root, gchar *key, gchar *expected_value)
 {
   RNode *ret = r_find_node(root, key, strlen(key), NULL);
 
+  if (find_node_in_compiled_tree(root, key, NULL) != ret)
+    {
+      printf("FAIL: compiled tree returned a different node: '%s'\n", key);
+      fail = TRUE;
+    }
+
   if (ret && expected_value)
     {
       if (strcmp(ret->value, expected_value) != 0)
@@ -137,6 +203,7 @@ test_search_matches(RNode *root, gchar *key, gchar *name1, ...)
   va_start(args, name1);
 
   ret = r_find_node(root, key, strlen(key), matches);
+  test_compiled_search_matches(root, key, ret, matches);
   if (ret && !name1)
     {
       printf("FAIL: found unexpected: '%s' => '%s' matches: ", key, (gchar *) ret->value);
@@ -897,6 +964,33 @@ test_zorp_logs(void)
 
 }
 
+void
+test_compiled_jump_tables(void)
+{
+  RNode *root = r_new_node("", NULL);
+  gchar *keys[] =
+  {
+    "apple", "banana", "cherry", "date", "elderberry", "fig", "grape", "honeydew", "kiwi", "lemon",
+    "\xc3\xa9clair", "@NUMBER:number@ apples",
+  };
+  gint i;
+
+  /* enough literal children for a first character jump table */
+  for (i = 0; i < G_N_ELEMENTS(keys); i++)
+    insert_node(root, keys[i]);
+
+  test_search(root, "apple", TRUE);
+  test_search(root, "kiwi", TRUE);
+  test_search(root, "lemon", TRUE);
+  test_search(root, "\xc3\xa9clair", TRUE);
+  test_search(root, "mango", FALSE);
+  test_search(root, "fig tree", FALSE);
+  test_search_value(root, "12 apples", "@NUMBER:number@ apples");
+  test_search_matches(root, "42 apples", "number", "42", NULL);
+
+  r_free_node(root, NULL);
+}
+
 
 int
 main(int argc, char *argv[])
@@ -928,6 +1022,7 @@ main(int argc, char *argv[])
   test_nlstring_matches();
 
   test_zorp_logs();
+  test_compiled_jump_tables();
 
   app_shutdown();
   return  (fail ? 1 : 0);
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2018 Balabit
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ *
+ */
+
+#include "radix.h"
+#include "apphook.h"
+#include "testutils.h"
+#include "stopwatch.h"
+
+#include <string.h>
+
+#define NUM_RULES 10000
+#define NUM_MESSAGES 1000
+#define ITERATIONS 1000000
+
+static const gchar *programs[] =
+{
+  "sshd", "su", "sudo", "cron", "postfix", "dovecot", "kernel", "systemd", "named", "ntpd", "dhclient", "login"
+};
+
+static const gchar *events[] =
+{
+  "Accepted", "Failed", "Invalid", "Disconnected", "Connection", "Received", "Starting", "Stopping", "Reloading"
+};
+
+static RNode *
+_build_tree(void)
+{
+  RNode *root = r_new_node("", NULL);
+  gint i;
+
+  for (i = 0; i < NUM_RULES; i++)
+    {
+      gchar *pattern;
+
+      pattern = g_strdup_printf("%s %s[%d]: session @ESTRING:action: @for user @ESTRING:user: @"
+                                "from @IPv4:ip@ port @NUMBER:port@",
+                                events[i % G_N_ELEMENTS(events)],
+                                programs[(i / G_N_ELEMENTS(events)) % G_N_ELEMENTS(programs)], i);
+      r_insert_node(root, pattern, GINT_TO_POINTER(i + 1), NULL);
+      g_free(pattern);
+    }
+  return root;
+}
+
+static GPtrArray *
+_generate_messages(void)
+{
+  GPtrArray *messages = g_ptr_array_new();
+  gint i;
+
+  for (i = 0; i < NUM_MESSAGES; i++)
+    {
+      gint rule = (i * 7919) % NUM_RULES;
+
+      /* every tenth message does not match any of the rules */
+      if (i % 10 == 0)
+        g_ptr_array_add(messages, g_strdup_printf("%s unknown[%d]: something else happened", events[0], rule));
+      else
+        g_ptr_array_add(messages,
+                        g_strdup_printf("%s %s[%d]: session opened for user root from 10.0.%d.%d port %d",
+                                        events[rule % G_N_ELEMENTS(events)],
+                                        programs[(rule / G_N_ELEMENTS(events)) % G_N_ELEMENTS(programs)], rule,
+                                        i / 256, i % 256, 1024 + i));
+    }
+  return messages;
+}
+
+static gint
+_perftest_lookup(RNode *root, GPtrArray *messages, gboolean compile)
+{
+  RCompiledTree *compiled = compile ? r_compile_tree(root) : NULL;
+  GArray *matches = g_array_new(FALSE, TRUE, sizeof(RParserMatch));
+  gint found = 0;
+  gint i;
+
+  start_stopwatch();
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      gchar *message = (gchar *) g_ptr_array_index(messages, i % messages->len);
+      gint message_len = strlen(message);
+      RNode *node;
+
+      g_array_set_size(matches, 1);
+      if (compiled)
+        node = r_compiled_find_node(compiled, (guint8 *) message, message_len, matches);
+      else
+        node = r_find_node(root, (guint8 *) message, message_len, matches);
+      if (node)
+        found++;
+    }
+  stop_stopwatch_and_display_result(ITERATIONS, "radix lookup with %d rules, %s", NUM_RULES,
+                                    compile ? "compiled" : "tree walk");
+
+  g_array_free(matches, TRUE);
+  if (compiled)
+    r_compiled_tree_free(compiled);
+  return found;
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  RNode *root;
+  GPtrArray *messages;
+  gint found;
+
+  app_startup();
+
+  root = _build_tree();
+  messages = _generate_messages();
+
+  found = _perftest_lookup(root, messages, FALSE);
+  assert_gint(found, ITERATIONS - ITERATIONS / 10, "Unexpected number of matching messages");
+  assert_gint(_perftest_lookup(root, messages, TRUE), found,
+              "The compiled tree matched a different number of messages");
+
+  g_ptr_array_foreach(messages, (GFunc) g_free, NULL);
+  g_ptr_array_free(messages, TRUE);
+  r_free_node(root, NULL);
+  app_shutdown();
+  return 0;
+}
@@ -72,6 +72,42 @@ disk_queue_options_mem_buf_length_set(DiskQueueOptions *self, gint mem_buf_lengt
   self->mem_buf_length = mem_buf_length;
 }
 
+void
+disk_queue_options_sync_batch_set(DiskQueueOptions *self, gint sync_batch)
+{
+  self->sync_batch = sync_batch;
+}
+
+void
+disk_queue_options_fsync_set(DiskQueueOptions *self, gboolean fsync_)
+{
+  self->fsync = fsync_;
+}
+
+void
+disk_queue_options_mmap_set(DiskQueueOptions *self, gboolean use_mmap)
+{
+  self->use_mmap = use_mmap;
+}
+
+void
+disk_queue_options_compress_set(DiskQueueOptions *self, gboolean compress)
+{
+#if SYSLOG_NG_ENABLE_LZ4
+  self->compress = compress;
+#else
+  if (compress)
+    msg_warning("WARNING: compress() parameter was ignored as syslog-ng was compiled without LZ4 support");
+  self->compress = FALSE;
+#endif
+}
+
+void
+disk_queue_options_prealloc_set(DiskQueueOptions *self, gboolean prealloc)
+{
+  self->prealloc = prealloc;
+}
+
 void
 disk_queue_options_check_plugin_settings(DiskQueueOptions *self)
 {
@@ -81,6 +117,11 @@ disk_queue_options_check_plugin_settings(DiskQueueOptions *self)
         {
           msg_warning("WARNING: mem-buf-length parameter was ignored as it is not compatible with reliable queue. Did you mean mem-buf-size?");
         }
+      if (self->compress)
+        {
+          msg_warning("WARNING: compress() parameter was ignored as it is only supported by the non-reliable queue");
+          self->compress = FALSE;
+        }
     }
   else
     {
@@ -88,6 +129,10 @@ disk_queue_options_check_plugin_settings(DiskQueueOptions *self)
         {
           msg_warning("WARNING: mem-buf-size parameter was ignored as it is not compatible with non-reliable queue. Did you mean mem-buf-length?");
         }
+      if (self->sync_batch > 1 || self->fsync)
+        {
+          msg_warning("WARNING: sync-batch() and fsync() parameters were ignored as they are only supported by the reliable queue");
+        }
     }
 }
 
@@ -121,6 +166,11 @@ disk_queue_options_set_default_options(DiskQueueOptions *self)
   self->reliable = FALSE;
   self->mem_buf_size = -1;
   self->qout_size = -1;
+  self->sync_batch = 0;
+  self->fsync = FALSE;
+  self->use_mmap = FALSE;
+  self->compress = FALSE;
+  self->prealloc = FALSE;
   self->dir = g_strdup(get_installation_path_for(SYSLOG_NG_PATH_LOCALSTATEDIR));
 }
 
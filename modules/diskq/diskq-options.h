@@ -37,6 +37,11 @@ typedef struct _DiskQueueOptions
   gboolean reliable;
   gint mem_buf_size;
   gint mem_buf_length;
+  gint sync_batch;
+  gboolean fsync;
+  gboolean use_mmap;
+  gboolean compress;
+  gboolean prealloc;
   gchar *dir;
 } DiskQueueOptions;
 
@@ -45,6 +50,11 @@ void disk_queue_options_disk_buf_size_set(DiskQueueOptions *self, gint64 disk_bu
 void disk_queue_options_reliable_set(DiskQueueOptions *self, gboolean reliable);
 void disk_queue_options_mem_buf_size_set(DiskQueueOptions *self, gint mem_buf_size);
 void disk_queue_options_mem_buf_length_set(DiskQueueOptions *self, gint mem_buf_length);
+void disk_queue_options_sync_batch_set(DiskQueueOptions *self, gint sync_batch);
+void disk_queue_options_fsync_set(DiskQueueOptions *self, gboolean fsync_);
+void disk_queue_options_mmap_set(DiskQueueOptions *self, gboolean use_mmap);
+void disk_queue_options_compress_set(DiskQueueOptions *self, gboolean compress);
+void disk_queue_options_prealloc_set(DiskQueueOptions *self, gboolean prealloc);
 void disk_queue_options_check_plugin_settings(DiskQueueOptions *self);
 void disk_queue_options_set_dir(DiskQueueOptions *self, const gchar *dir);
 void disk_queue_options_set_default_options(DiskQueueOptions *self);
@@ -37,6 +37,11 @@ static CfgLexerKeyword diskq_keywords[] =
   { "mem_buf_size",      KW_MEM_BUF_SIZE },
   { "qout_size",         KW_QOUT_SIZE },
   { "dir",               KW_DIR },
+  { "sync_batch",        KW_SYNC_BATCH },
+  { "fsync",             KW_FSYNC },
+  { "mmap",              KW_MMAP },
+  { "compress",          KW_COMPRESS },
+  { "prealloc",          KW_PREALLOC },
   { NULL }
 };
 
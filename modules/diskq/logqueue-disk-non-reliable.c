@@ -24,6 +24,7 @@
 #include "logqueue-disk-non-reliable.h"
 #include "logpipe.h"
 #include "messages.h"
+#include "apphook.h"
 #include "syslog-ng.h"
 
 #define ITEM_NUMBER_PER_MESSAGE 2
@@ -54,10 +55,93 @@ _update_memory_usage_during_load(gpointer data, gpointer s)
   state->index_in_queue++;
 }
 
+static void
+_replay_overflow(LogQueueDiskNonReliable *self)
+{
+  GQueue *replayed = g_queue_new();
+  gssize replayed_size = 0;
+  gint lost;
+
+  DiskqMemusageLoaderState overflow_sum = { .index_in_queue = 0,
+                                            .item_number_per_message = ITEM_NUMBER_PER_MESSAGE,
+                                            .value_accumulator = &replayed_size
+                                          };
+
+  qdisk_deserialize_queue(self->replay_filename, self->replay_section, self->replay_pending, replayed);
+  g_queue_foreach(replayed, _update_memory_usage_during_load, &overflow_sum);
+
+  g_static_mutex_lock(&self->super.super.lock);
+
+  lost = self->replay_pending - replayed->length / ITEM_NUMBER_PER_MESSAGE;
+  stats_counter_sub(self->super.super.queued_messages, lost);
+
+  /* the replayed messages precede the ones put into qoverflow since the start */
+  while (!g_queue_is_empty(self->qoverflow))
+    g_queue_push_tail(replayed, g_queue_pop_head(self->qoverflow));
+  g_queue_free(self->qoverflow);
+  self->qoverflow = replayed;
+  self->replay_pending = 0;
+
+  self->super.super.memory_usage_overflow_initial_value += replayed_size;
+  stats_counter_add(self->super.super.memory_usage, replayed_size);
+
+  log_queue_push_notify(&self->super.super);
+  g_static_mutex_unlock(&self->super.super.lock);
+}
+
+static gpointer
+_replay_overflow_thread(gpointer s)
+{
+  LogQueueDiskNonReliable *self = (LogQueueDiskNonReliable *) s;
+
+  app_thread_start();
+  _replay_overflow(self);
+  app_thread_stop();
+  return NULL;
+}
+
+/* Deserializing a large qoverflow takes a while, the destination can
+ * consume qout and the disk part of the queue in the meantime. Until the
+ * replay is finished, nothing is taken from qoverflow and new messages are
+ * not allowed to overtake the replayed ones. */
+static void
+_start_overflow_replay(LogQueueDiskNonReliable *self, GString *section, gint32 count)
+{
+  const gchar *filename = qdisk_get_filename(self->super.qdisk);
+
+  if (count <= 0 || self->replay_thread)
+    {
+      qdisk_deserialize_queue(filename, section, count, self->qoverflow);
+      g_string_free(section, TRUE);
+      return;
+    }
+
+  self->replay_section = section;
+  self->replay_filename = g_strdup(filename);
+  self->replay_pending = count;
+  self->replay_thread = g_thread_create(_replay_overflow_thread, self, TRUE, NULL);
+}
+
+static void
+_wait_for_overflow_replay(LogQueueDiskNonReliable *self)
+{
+  if (!self->replay_thread)
+    return;
+
+  g_thread_join(self->replay_thread);
+  self->replay_thread = NULL;
+  g_string_free(self->replay_section, TRUE);
+  self->replay_section = NULL;
+  g_free(self->replay_filename);
+  self->replay_filename = NULL;
+}
+
 static gboolean
 _start(LogQueueDisk *s, const gchar *filename)
 {
   LogQueueDiskNonReliable *self = (LogQueueDiskNonReliable *) s;
+  GString *overflow_section;
+  gint32 overflow_count;
 
   gboolean retval = qdisk_start(s->qdisk, filename, self->qout, self->qbacklog, self->qoverflow);
 
@@ -74,6 +158,10 @@ _start(LogQueueDisk *s, const gchar *filename)
   g_queue_foreach(self->qout, _update_memory_usage_during_load, &qout_sum);
   g_queue_foreach(self->qoverflow, _update_memory_usage_during_load, &overflow_sum);
 
+  overflow_section = qdisk_take_overflow_section(s->qdisk, &overflow_count);
+  if (overflow_section)
+    _start_overflow_replay(self, overflow_section, overflow_count);
+
   return retval;
 }
 
@@ -85,13 +173,20 @@ _get_message_number_in_queue(GQueue *queue)
 
 #define HAS_SPACE_IN_QUEUE(queue) _get_message_number_in_queue(queue) < queue ## _size
 
+static inline gboolean
+_has_space_in_overflow(LogQueueDiskNonReliable *self)
+{
+  return _get_message_number_in_queue(self->qoverflow) + self->replay_pending < self->qoverflow_size;
+}
+
 static gint64
 _get_length (LogQueueDisk *s)
 {
   LogQueueDiskNonReliable *self = (LogQueueDiskNonReliable *) s;
   return _get_message_number_in_queue(self->qout)
          + qdisk_get_length (s->qdisk)
-         + _get_message_number_in_queue(self->qoverflow);
+         + _get_message_number_in_queue(self->qoverflow)
+         + self->replay_pending;
 }
 
 static LogMessage *
@@ -105,7 +200,7 @@ _get_next_message(LogQueueDiskNonReliable *self, LogPathOptions *path_options)
       stats_counter_add(self->super.super.memory_usage, log_msg_get_size(result));
       path_options->ack_needed = FALSE;
     }
-  else if (self->qoverflow->length > 0)
+  else if (self->qoverflow->length > 0 && !self->replay_pending)
     {
       result = g_queue_pop_head (self->qoverflow);
       POINTER_TO_LOG_PATH_OPTIONS (g_queue_pop_head (self->qoverflow), path_options);
@@ -134,7 +229,7 @@ _add_message_to_qout(LogQueueDiskNonReliable *self, LogMessage *msg, LogPathOpti
 static inline gboolean
 _has_movable_message(LogQueueDiskNonReliable *self)
 {
-  return self->qoverflow->length > 0
+  return self->qoverflow->length > 0 && !self->replay_pending
          && ((HAS_SPACE_IN_QUEUE(self->qout) && qdisk_get_length (self->super.qdisk) == 0)
              || qdisk_is_space_avail (self->super.qdisk, 4096));
 }
@@ -308,7 +403,7 @@ _push_tail (LogQueueDisk *s, LogMessage *msg, LogPathOptions *local_options, con
 {
   LogQueueDiskNonReliable *self = (LogQueueDiskNonReliable *) s;
 
-  if (HAS_SPACE_IN_QUEUE(self->qout) && qdisk_get_length (self->super.qdisk) == 0)
+  if (HAS_SPACE_IN_QUEUE(self->qout) && qdisk_get_length (self->super.qdisk) == 0 && !self->replay_pending)
     {
       /* simple push never generates flow-control enabled entries to qout, they only get there
        * when rewinding the backlog */
@@ -321,9 +416,9 @@ _push_tail (LogQueueDisk *s, LogMessage *msg, LogPathOptions *local_options, con
     }
   else
     {
-      if (self->qoverflow->length != 0 || !s->write_message(s, msg))
+      if (self->qoverflow->length != 0 || self->replay_pending || !s->write_message(s, msg))
         {
-          if (HAS_SPACE_IN_QUEUE(self->qoverflow))
+          if (_has_space_in_overflow(self))
             {
               g_queue_push_tail (self->qoverflow, msg);
               g_queue_push_tail (self->qoverflow, LOG_PATH_OPTIONS_TO_POINTER (path_options));
@@ -366,6 +461,7 @@ static void
 _freefn (LogQueueDisk *s)
 {
   LogQueueDiskNonReliable *self = (LogQueueDiskNonReliable *) s;
+  _wait_for_overflow_replay (self);
   _free_queue (self->qoverflow);
   self->qoverflow = NULL;
   _free_queue (self->qout);
@@ -388,6 +484,8 @@ static gboolean
 _save_queue (LogQueueDisk *s, gboolean *persistent)
 {
   LogQueueDiskNonReliable *self = (LogQueueDiskNonReliable *) s;
+
+  _wait_for_overflow_replay (self);
   if (qdisk_save_state (s->qdisk, self->qout, self->qbacklog, self->qoverflow))
     {
       *persistent = TRUE;
@@ -34,6 +34,12 @@ typedef struct _LogQueueDiskNonReliable
   GQueue *qbacklog;
   gint qoverflow_size;
   gint qout_size;
+
+  /* qoverflow of the queue file is restored in the background */
+  GThread *replay_thread;
+  GString *replay_section;
+  gchar *replay_filename;
+  gint replay_pending;
 } LogQueueDiskNonReliable;
 
 LogQueue *log_queue_disk_non_reliable_new(DiskQueueOptions *options, const gchar *persist_name);
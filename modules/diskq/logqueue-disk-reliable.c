@@ -26,6 +26,15 @@
 #include "logpipe.h"
 #include "logqueue-disk-reliable.h"
 #include "messages.h"
+#include "mainloop-worker.h"
+
+#include <string.h>
+
+typedef struct _LogQueueDiskReliablePending
+{
+  LogMessage *msg;
+  LogPathOptions path_options;
+} LogQueueDiskReliablePending;
 
 static gboolean
 _start(LogQueueDisk *s, const gchar *filename)
@@ -249,6 +258,49 @@ _pop_head(LogQueueDisk *s, LogPathOptions *path_options)
   return msg;
 }
 
+/* check the remaining space: if it is less than the mem_buf_size, the message cannot be acked */
+static gboolean
+_is_reserved_buffer_reached(LogQueueDiskReliable *self)
+{
+  gint64 wpos = qdisk_get_writer_head (self->super.qdisk);
+  gint64 bpos = qdisk_get_backlog_head (self->super.qdisk);
+  gint64 diff;
+  if (wpos > bpos)
+    diff = qdisk_get_size (self->super.qdisk) - wpos + bpos - QDISK_RESERVED_SPACE;
+  else
+    diff = bpos - wpos;
+  return diff < qdisk_get_memory_size (self->super.qdisk);
+}
+
+/* we have reached the reserved buffer size, keep the msg in memory
+ * the message is written but into the overflow area
+ */
+static void
+_keep_in_memory(LogQueueDiskReliable *self, LogMessage *msg, gint64 pos,
+                LogPathOptions *local_options, const LogPathOptions *path_options)
+{
+  gint64 *temppos = g_malloc (sizeof(gint64));
+  *temppos = pos;
+  g_queue_push_tail (self->qreliable, temppos);
+  g_queue_push_tail (self->qreliable, msg);
+  g_queue_push_tail (self->qreliable, LOG_PATH_OPTIONS_TO_POINTER(path_options));
+  log_msg_ref (msg);
+
+  stats_counter_add(self->super.super.memory_usage, log_msg_get_size(msg));
+  local_options->ack_needed = FALSE;
+}
+
+static void
+_warn_queue_full(LogQueueDiskReliable *self)
+{
+  msg_error("Destination reliable queue full, dropping message",
+            evt_tag_str("filename", qdisk_get_filename (self->super.qdisk)),
+            evt_tag_int("queue_len", _get_length(&self->super)),
+            evt_tag_int("mem_buf_size", qdisk_get_memory_size (self->super.qdisk)),
+            evt_tag_int("disk_buf_size", qdisk_get_size (self->super.qdisk)),
+            evt_tag_str("persist_name", self->super.super.persist_name));
+}
+
 static gboolean
 _push_tail(LogQueueDisk *s, LogMessage *msg, LogPathOptions *local_options, const LogPathOptions *path_options)
 {
@@ -258,49 +310,229 @@ _push_tail(LogQueueDisk *s, LogMessage *msg, LogPathOptions *local_options, cons
   if (!s->write_message(s, msg))
     {
       /* we were not able to store the msg, warn */
-      msg_error("Destination reliable queue full, dropping message",
-                evt_tag_str("filename", qdisk_get_filename (self->super.qdisk)),
-                evt_tag_int("queue_len", _get_length(s)),
-                evt_tag_int("mem_buf_size", qdisk_get_memory_size (self->super.qdisk)),
-                evt_tag_int("disk_buf_size", qdisk_get_size (self->super.qdisk)),
-                evt_tag_str("persist_name", self->super.super.persist_name));
-
+      _warn_queue_full(self);
       return FALSE;
     }
 
-  /* check the remaining space: if it is less than the mem_buf_size, the message cannot be acked */
-  gint64 wpos = qdisk_get_writer_head (self->super.qdisk);
-  gint64 bpos = qdisk_get_backlog_head (self->super.qdisk);
-  gint64 diff;
-  if (wpos > bpos)
-    diff = qdisk_get_size (self->super.qdisk) - wpos + bpos - QDISK_RESERVED_SPACE;
+  if (qdisk_get_options(self->super.qdisk)->fsync)
+    qdisk_sync(self->super.qdisk);
+
+  if (_is_reserved_buffer_reached(self))
+    _keep_in_memory(self, msg, last_wpos, local_options, path_options);
+
+  return TRUE;
+}
+
+/*
+ * Group commit
+ *
+ * With sync-batch() set, incoming messages are not written one-by-one,
+ * rather they are serialized into commit_frames and written to the queue
+ * file with a single write once sync-batch() messages are collected or the
+ * input thread finishes its current batch of work, whichever happens
+ * first. With fsync(yes) the write is followed by a single fdatasync().
+ *
+ * Messages are acked to the source only after their batch has been
+ * committed, so flow-control keeps working in terms of durable messages.
+ */
+
+static void
+_drop_message(LogQueueDiskReliable *self, LogMessage *msg, const LogPathOptions *path_options)
+{
+  stats_counter_inc (self->super.super.dropped_messages);
+
+  if (path_options->flow_control_requested)
+    log_msg_drop(msg, path_options, AT_SUSPENDED);
   else
-    diff = bpos - wpos;
-  gboolean overflow = diff < qdisk_get_memory_size (self->super.qdisk);
+    log_msg_drop(msg, path_options, AT_PROCESSED);
+}
+
+static guint32
+_get_frame_length(GString *frames, gsize frame_start)
+{
+  guint32 n;
+
+  memcpy(&n, frames->str + frame_start, sizeof(n));
+  return GUINT32_FROM_BE(n) + sizeof(n);
+}
+
+static void
+_ack_committed_message(LogQueueDiskReliable *self, LogQueueDiskReliablePending *pending, gint64 wpos,
+                       gboolean overflow)
+{
+  LogPathOptions local_options = pending->path_options;
 
   if (overflow)
+    _keep_in_memory(self, pending->msg, wpos, &local_options, &pending->path_options);
+
+  stats_counter_inc(self->super.super.queued_messages);
+  log_msg_ack(pending->msg, &local_options, AT_PROCESSED);
+  log_msg_unref(pending->msg);
+}
+
+/* the batch does not fit into the queue file as a whole, the messages are
+ * written one by one and only the ones that don't fit are dropped */
+static gint
+_commit_batch_by_frames(LogQueueDiskReliable *self, gint64 *wpos)
+{
+  gint count = self->commit_pending->len;
+  gsize frame_start = 0;
+  gsize frame_len;
+  gint committed = 0;
+  gint i;
+
+  for (i = 0; i < count; i++)
     {
-      /* we have reached the reserved buffer size, keep the msg in memory
-       * the message is written but into the overflow area
-       */
-      gint64 *temppos = g_malloc (sizeof(gint64));
-      *temppos = last_wpos;
-      g_queue_push_tail (self->qreliable, temppos);
-      g_queue_push_tail (self->qreliable, msg);
-      g_queue_push_tail (self->qreliable, LOG_PATH_OPTIONS_TO_POINTER(path_options));
-      log_msg_ref (msg);
-
-      stats_counter_add(self->super.super.memory_usage, log_msg_get_size(msg));
-      local_options->ack_needed = FALSE;
+      wpos[i] = qdisk_get_writer_head(self->super.qdisk);
+      if (qdisk_push_tail_frame(self->super.qdisk, self->commit_frames, frame_start, &frame_len))
+        committed++;
+      else
+        wpos[i] = -1;
+      frame_start += frame_len;
     }
+  return committed;
+}
 
-  return TRUE;
+static void
+_commit_batch(LogQueueDiskReliable *self)
+{
+  gint count = self->commit_pending->len;
+  gint64 batch_wpos = qdisk_get_writer_head (self->super.qdisk);
+  gint64 *wpos = NULL;
+  gint committed = 0;
+  gboolean overflow;
+  gsize frame_start = 0;
+  gint i;
+
+  if (count == 0)
+    return;
+
+  if (qdisk_initialized(self->super.qdisk))
+    {
+      if (qdisk_push_tail_frames(self->super.qdisk, self->commit_frames, count))
+        {
+          committed = count;
+        }
+      else
+        {
+          wpos = g_new(gint64, count);
+          committed = _commit_batch_by_frames(self, wpos);
+        }
+    }
+
+  if (committed < count)
+    _warn_queue_full(self);
+  if (committed > 0 && qdisk_get_options(self->super.qdisk)->fsync)
+    qdisk_sync(self->super.qdisk);
+
+  overflow = committed > 0 && _is_reserved_buffer_reached(self);
+  for (i = 0; i < count; i++)
+    {
+      LogQueueDiskReliablePending *pending = &g_array_index(self->commit_pending, LogQueueDiskReliablePending, i);
+
+      if (!wpos)
+        {
+          if (committed == count)
+            _ack_committed_message(self, pending, batch_wpos + frame_start, overflow);
+          else
+            _drop_message(self, pending->msg, &pending->path_options);
+          frame_start += _get_frame_length(self->commit_frames, frame_start);
+        }
+      else if (wpos[i] >= 0)
+        _ack_committed_message(self, pending, wpos[i], overflow);
+      else
+        _drop_message(self, pending->msg, &pending->path_options);
+    }
+  g_free(wpos);
+
+  g_string_truncate(self->commit_frames, 0);
+  g_array_set_size(self->commit_pending, 0);
+
+  if (committed > 0)
+    log_queue_push_notify(&self->super.super);
+}
+
+/* registered as a batch callback, called when the input worker thread
+ * finishes its job */
+static gpointer
+_commit_batch_at_end_of_input(gpointer user_data)
+{
+  LogQueueDiskReliable *self = (LogQueueDiskReliable *) user_data;
+  gint thread_id = main_loop_worker_get_thread_id();
+
+  g_assert(thread_id >= 0);
+
+  g_static_mutex_lock(&self->super.super.lock);
+  _commit_batch(self);
+  self->commit_input[thread_id].cb_registered = FALSE;
+  g_static_mutex_unlock(&self->super.super.lock);
+
+  log_queue_unref(&self->super.super);
+  return NULL;
+}
+
+static void
+_push_tail_group_commit(LogQueue *s, LogMessage *msg, const LogPathOptions *path_options)
+{
+  LogQueueDiskReliable *self = (LogQueueDiskReliable *) s;
+  LogQueueDiskReliablePending pending = { .msg = msg, .path_options = LOG_PATH_OPTIONS_INIT };
+  gint thread_id = main_loop_worker_get_thread_id();
+  gsize frame_start;
+
+  g_assert(thread_id < 0 || log_queue_max_threads > thread_id);
+
+  g_static_mutex_lock(&self->super.super.lock);
+
+  if (!qdisk_initialized(self->super.qdisk))
+    {
+      _warn_queue_full(self);
+      _drop_message(self, msg, path_options);
+      g_static_mutex_unlock(&self->super.super.lock);
+      return;
+    }
+
+  /* the frames already contain their length headers, which
+   * qdisk_is_space_avail() adds for a single record */
+  frame_start = self->commit_frames->len;
+  log_queue_disk_serialize_frame(self->commit_frames, msg);
+  if (!qdisk_is_space_avail(self->super.qdisk, self->commit_frames->len - sizeof(guint32)))
+    {
+      g_string_truncate(self->commit_frames, frame_start);
+      _warn_queue_full(self);
+      _drop_message(self, msg, path_options);
+      g_static_mutex_unlock(&self->super.super.lock);
+      return;
+    }
+  pending.path_options.ack_needed = path_options->ack_needed;
+  pending.path_options.flow_control_requested = path_options->flow_control_requested;
+  g_array_append_val(self->commit_pending, pending);
+
+  if (thread_id < 0 || self->commit_pending->len >= qdisk_get_options(self->super.qdisk)->sync_batch)
+    {
+      _commit_batch(self);
+    }
+  else if (!self->commit_input[thread_id].cb_registered)
+    {
+      /* make sure the batch is committed once the input thread finishes,
+       * the registered callback holds a reference to the queue */
+      main_loop_worker_register_batch_callback(&self->commit_input[thread_id].cb);
+      self->commit_input[thread_id].cb_registered = TRUE;
+      log_queue_ref(s);
+    }
+
+  g_static_mutex_unlock(&self->super.super.lock);
 }
 
 static void
 _free_queue(LogQueueDisk *s)
 {
   LogQueueDiskReliable *self = (LogQueueDiskReliable *) s;
+
+  /* registered commit callbacks hold a reference, nothing can be pending here */
+  g_assert(self->commit_pending->len == 0);
+  g_string_free(self->commit_frames, TRUE);
+  g_array_free(self->commit_pending, TRUE);
+
   _empty_queue(self->qreliable);
   _empty_queue(self->qbacklog);
   g_queue_free(self->qreliable);
@@ -320,6 +552,12 @@ _load_queue(LogQueueDisk *s, const gchar *filename)
 static gboolean
 _save_queue (LogQueueDisk *s, gboolean *persistent)
 {
+  LogQueueDiskReliable *self = (LogQueueDiskReliable *) s;
+
+  g_static_mutex_lock(&self->super.super.lock);
+  _commit_batch(self);
+  g_static_mutex_unlock(&self->super.super.lock);
+
   *persistent = TRUE;
   qdisk_deinit (s->qdisk);
   return TRUE;
@@ -344,11 +582,25 @@ LogQueue *
 log_queue_disk_reliable_new(DiskQueueOptions *options, const gchar *persist_name)
 {
   g_assert(options->reliable == TRUE);
-  LogQueueDiskReliable *self = g_new0(LogQueueDiskReliable, 1);
+  LogQueueDiskReliable *self = g_malloc0(sizeof(LogQueueDiskReliable) + log_queue_max_threads * sizeof(self->commit_input[0]));
+  gint i;
+
   log_queue_disk_init_instance(&self->super, persist_name);
   qdisk_init(self->super.qdisk, options);
   self->qreliable = g_queue_new();
   self->qbacklog = g_queue_new();
   _set_virtual_functions(&self->super);
+
+  self->commit_frames = g_string_sized_new(4096);
+  self->commit_pending = g_array_new(FALSE, FALSE, sizeof(LogQueueDiskReliablePending));
+  for (i = 0; i < log_queue_max_threads; i++)
+    {
+      worker_batch_callback_init(&self->commit_input[i].cb);
+      self->commit_input[i].cb.func = _commit_batch_at_end_of_input;
+      self->commit_input[i].cb.user_data = self;
+    }
+  if (options->sync_batch > 1)
+    self->super.super.push_tail = _push_tail_group_commit;
+
   return &self->super.super;
 }
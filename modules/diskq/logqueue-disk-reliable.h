@@ -25,12 +25,23 @@
 #define LOGQUEUE_DISK_RELIABLE_H_
 
 #include "logqueue-disk.h"
+#include "mainloop-worker.h"
 
 typedef struct _LogQueueDiskReliable
 {
   LogQueueDisk super;
   GQueue *qreliable;
   GQueue *qbacklog;
+
+  /* group commit: messages serialized into commit_frames, waiting to be
+   * written with a single write and acked once they are on disk */
+  GString *commit_frames;
+  GArray *commit_pending;
+  struct
+  {
+    WorkerBatchCallback cb;
+    gboolean cb_registered;
+  } commit_input[0];
 } LogQueueDiskReliable;
 
 LogQueue *log_queue_disk_reliable_new(DiskQueueOptions *options, const gchar *persist_name);
@@ -219,40 +219,36 @@ _free(LogQueue *s)
   log_queue_free_method(s);
 }
 
-static gboolean
-_pop_disk(LogQueueDisk *self, LogMessage **msg)
+static void
+_deserialize_record(const gchar *record, gsize record_len, gpointer user_data)
 {
-  GString *serialized;
+  LogMessage **msg = (LogMessage **) user_data;
   SerializeArchive *sa;
 
-  *msg = NULL;
-
-  if (!qdisk_initialized(self->qdisk))
-    return FALSE;
-
-  serialized = g_string_sized_new(64);
-  if (!qdisk_pop_head(self->qdisk, serialized))
-    {
-      g_string_free(serialized, TRUE);
-      return FALSE;
-    }
-
-  sa = serialize_string_archive_new(serialized);
+  sa = serialize_buffer_archive_new((gchar *) record, record_len);
   *msg = log_msg_new_empty();
 
   if (!log_msg_deserialize(*msg, sa))
     {
-      g_string_free(serialized, TRUE);
-      serialize_archive_free(sa);
       log_msg_unref(*msg);
       *msg = NULL;
-      msg_error("Can't read correct message from disk-queue file",evt_tag_str("filename",qdisk_get_filename(self->qdisk)));
-      return TRUE;
     }
-
   serialize_archive_free(sa);
+}
+
+static gboolean
+_pop_disk(LogQueueDisk *self, LogMessage **msg)
+{
+  *msg = NULL;
 
-  g_string_free(serialized, TRUE);
+  if (!qdisk_initialized(self->qdisk))
+    return FALSE;
+
+  if (!qdisk_pop_head_with(self->qdisk, _deserialize_record, msg))
+    return FALSE;
+
+  if (!*msg)
+    msg_error("Can't read correct message from disk-queue file",evt_tag_str("filename",qdisk_get_filename(self->qdisk)));
   return TRUE;
 }
 
@@ -281,20 +277,34 @@ _read_message(LogQueueDisk *self, LogPathOptions *path_options)
   return msg;
 }
 
+/* serializes @msg as a length-prefixed record appended to @frames, ready
+ * to be written by qdisk_push_tail_frames() */
+void
+log_queue_disk_serialize_frame(GString *frames, LogMessage *msg)
+{
+  SerializeArchive *sa;
+  gsize frame_start;
+
+  frame_start = qdisk_frame_begin(frames);
+  sa = serialize_string_archive_new(frames);
+  log_msg_serialize(msg, sa);
+  serialize_archive_free(sa);
+  qdisk_frame_end(frames, frame_start);
+}
+
+static gboolean
+_serialize_message(SerializeArchive *sa, gpointer user_data)
+{
+  return log_msg_serialize((LogMessage *) user_data, sa);
+}
+
 static gboolean
 _write_message(LogQueueDisk *self, LogMessage *msg)
 {
-  GString *serialized;
-  SerializeArchive *sa;
   gboolean consumed = FALSE;
   if (qdisk_initialized(self->qdisk) && qdisk_is_space_avail(self->qdisk, 64))
     {
-      serialized = g_string_sized_new(64);
-      sa = serialize_string_archive_new(serialized);
-      log_msg_serialize(msg, sa);
-      consumed = qdisk_push_tail(self->qdisk, serialized);
-      serialize_archive_free(sa);
-      g_string_free(serialized, TRUE);
+      consumed = qdisk_push_tail_with(self->qdisk, _serialize_message, msg);
     }
   return consumed;
 }
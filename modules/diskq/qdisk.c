@@ -36,6 +36,11 @@
 #include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <string.h>
+
+#if SYSLOG_NG_ENABLE_LZ4
+#include <lz4.h>
+#endif
 
 /* MADV_RANDOM not defined on legacy Linux systems. Could be removed in the
  * future, when support for Glibc 2.1.X drops.*/
@@ -48,6 +53,31 @@
 
 #define MAX_RECORD_LENGTH 100 * 1024 * 1024
 
+/* size of the sliding windows the mmap backend maps from the ring, and the
+ * amount of consumed data after which the pages behind the read head are
+ * dropped */
+#define QDISK_MMAP_WINDOW_SIZE (16 * 1024 * 1024)
+#define QDISK_MMAP_DROP_CHUNK (1024 * 1024)
+
+/* the ring is managed in segments of this size (at most 1/8th of the
+ * ring): consumed segments are punched out of the file, and with
+ * prealloc(yes) the segment ahead of the write head is allocated in
+ * advance */
+#define QDISK_SEGMENT_SIZE (8 * 1024 * 1024)
+
+/* compress(yes) collects this many bytes of serialized messages before
+ * compressing them into a single block record.
+ *
+ * A block record has the QDISK_RECORD_COMPRESSED bit set in its length
+ * word (never set by older versions, as records are limited to
+ * MAX_RECORD_LENGTH), its payload is the big-endian length of the
+ * uncompressed data, the number of messages in the block and the LZ4
+ * compressed data.  The uncompressed data is a series of ordinary
+ * length-prefixed records. */
+#define QDISK_COMPRESS_BLOCK_SIZE (64 * 1024)
+#define QDISK_RECORD_COMPRESSED 0x80000000
+#define QDISK_BLOCK_HEADER_SIZE (2 * sizeof(guint32))
+
 #define PATH_QDISK              PATH_LOCALSTATEDIR
 
 typedef union _QDiskFileHeader
@@ -74,10 +104,30 @@ typedef union _QDiskFileHeader
     gint32 qoverflow_count;
     gint64 backlog_head;
     gint64 backlog_len;
+    /* number of messages already consumed from the compressed block at read_head */
+    guint32 read_block_skip;
   };
   gchar _pad2[QDISK_RESERVED_SPACE];
 } QDiskFileHeader;
 
+typedef struct _QDiskMapWindow
+{
+  gchar *base;
+  gint64 ofs;
+  gsize len;
+  gint64 dropped;
+} QDiskMapWindow;
+
+typedef struct _QDiskReadBlock
+{
+  GString *data;
+  gint64 ofs;
+  /* length of the block record, 0 if no block is loaded */
+  guint32 record_len;
+  guint32 count;
+  gsize pos;
+} QDiskReadBlock;
+
 struct _QDisk
 {
   gchar *filename;
@@ -86,6 +136,29 @@ struct _QDisk
   gint64 file_size;
   QDiskFileHeader *hdr;
   DiskQueueOptions *options;
+
+  /* mmap backend */
+  QDiskMapWindow read_window;
+  QDiskMapWindow write_window;
+  gint64 mapped_file_size;
+
+  /* segments */
+  gint64 segment_size;
+  gint64 release_head;
+  gint64 prealloc_start;
+  gint64 prealloc_end;
+  gboolean punch_hole_failed;
+  gboolean prealloc_failed;
+
+  /* compression */
+  GString *write_block;
+  gint write_block_count;
+  GString *compress_buffer;
+  QDiskReadBlock read_block;
+
+  /* see qdisk_take_overflow_section() */
+  GString *overflow_section;
+  gint32 overflow_section_count;
 };
 
 static gboolean
@@ -124,6 +197,100 @@ _correct_position_if_eof(QDisk *self, gint64 *position)
   return *position;
 }
 
+static void
+_unmap_window(QDiskMapWindow *window)
+{
+  if (window->base)
+    munmap(window->base, window->len);
+  memset(window, 0, sizeof(*window));
+}
+
+static void
+_unmap_windows(QDisk *self)
+{
+  _unmap_window(&self->read_window);
+  _unmap_window(&self->write_window);
+}
+
+/* returns a pointer to [position, position + len) of the queue file, moving
+ * the window if the range is not mapped yet. The caller must make sure
+ * that the range is within the file before touching it. */
+static gchar *
+_map_range(QDisk *self, QDiskMapWindow *window, gint64 position, gsize len, gboolean writable)
+{
+  gint64 page_size = getpagesize();
+  gint64 start;
+  gsize window_len;
+  gpointer p;
+
+  if (window->base && position >= window->ofs && position + len <= window->ofs + window->len)
+    return window->base + (position - window->ofs);
+
+  _unmap_window(window);
+
+  start = position & ~(page_size - 1);
+  window_len = MAX(QDISK_MMAP_WINDOW_SIZE, position + len - start);
+  window_len = (window_len + page_size - 1) & ~(page_size - 1);
+
+  p = mmap(NULL, window_len, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, self->fd, start);
+  if (p == MAP_FAILED)
+    {
+      msg_error("Error mapping disk-queue file",
+                evt_tag_errno("error", errno),
+                evt_tag_str("filename", self->filename),
+                evt_tag_long("offset", start),
+                evt_tag_long("length", window_len));
+      return NULL;
+    }
+
+#ifdef MADV_SEQUENTIAL
+  madvise(p, window_len, MADV_SEQUENTIAL);
+#endif
+
+  window->base = p;
+  window->ofs = start;
+  window->len = window_len;
+  window->dropped = start;
+  return window->base + (position - window->ofs);
+}
+
+/* pages behind the read head are not needed anymore (a rewind would
+ * fault them back from the page cache), drop them every now and then to
+ * keep the resident size of the mapping low */
+static void
+_drop_consumed_pages(QDisk *self, QDiskMapWindow *window, gint64 position)
+{
+#ifdef MADV_DONTNEED
+  gint64 page_size = getpagesize();
+  gint64 drop_end;
+
+  if (!window->base || position < window->dropped || position > window->ofs + window->len)
+    return;
+
+  if (position - window->dropped < QDISK_MMAP_DROP_CHUNK)
+    return;
+
+  drop_end = position & ~(page_size - 1);
+  madvise(window->base + (window->dropped - window->ofs), drop_end - window->dropped, MADV_DONTNEED);
+  window->dropped = drop_end;
+#endif
+}
+
+static gboolean
+_is_range_in_mapped_file(QDisk *self, gint64 position, gsize len)
+{
+  struct stat st;
+
+  if (position + len <= self->mapped_file_size)
+    return TRUE;
+
+  /* the file might have been extended behind our back, e.g. by
+   * qdisk_save_state(), check the real size before giving up */
+  if (fstat(self->fd, &st) == 0)
+    self->mapped_file_size = st.st_size;
+  return position + len <= self->mapped_file_size;
+}
+
 static gchar *
 _next_filename(QDisk *self)
 {
@@ -179,21 +346,25 @@ _is_able_to_reset_write_head_to_beginning_of_qdisk(QDisk *self)
 }
 
 static inline gboolean
-_is_free_space_between_write_head_and_backlog_head(QDisk *self, gint msg_len)
+_is_free_space_between_write_head_and_backlog_head(QDisk *self, gint64 msg_len)
 {
   return self->hdr->write_head + msg_len < self->hdr->backlog_head;
 }
 
 
-gboolean
-qdisk_is_space_avail(QDisk *self, gint at_least)
+static gboolean
+_is_space_avail(QDisk *self, gint64 len)
 {
-  gint64 msg_len = at_least + sizeof(guint32);
   return (
            (_is_backlog_head_prevent_write_head(self)) &&
            (_is_write_head_less_than_max_size(self) || _is_able_to_reset_write_head_to_beginning_of_qdisk(self))
-         ) || (_is_free_space_between_write_head_and_backlog_head(self, msg_len));
+         ) || (_is_free_space_between_write_head_and_backlog_head(self, len));
+}
 
+gboolean
+qdisk_is_space_avail(QDisk *self, gint at_least)
+{
+  return _is_space_avail(self, at_least + sizeof(guint32));
 }
 
 static gboolean
@@ -201,6 +372,11 @@ _truncate_file(QDisk *self, gint64 new_size)
 {
   gboolean success = TRUE;
 
+  _unmap_windows(self);
+  self->mapped_file_size = new_size;
+  self->read_block.record_len = 0;
+  self->release_head = MIN(self->release_head, new_size);
+  self->prealloc_start = self->prealloc_end = 0;
   if (ftruncate(self->fd, (glong)new_size) < 0)
     {
       success = FALSE;
@@ -214,38 +390,92 @@ _truncate_file(QDisk *self, gint64 new_size)
   return success;
 }
 
-gboolean
-qdisk_push_tail(QDisk *self, GString *record)
+/* Gives the disk blocks behind the backlog head back to the file system
+ * once a whole segment of them was consumed, so that disk usage follows
+ * the backlog instead of the size of the ring. The file keeps its size, as
+ * its end marks the end of the ring. */
+static void
+_release_consumed_segments(QDisk *self)
 {
-  guint32 n = GUINT32_TO_BE(record->len);
+#if SYSLOG_NG_HAVE_FALLOCATE && defined(FALLOC_FL_PUNCH_HOLE)
+  gint64 page_size = getpagesize();
+  gint64 start = self->release_head;
+  gint64 end = self->hdr->backlog_head;
 
-  /* write follows read (e.g. we are appending to the file) OR
-   * there's enough space between write and read.
-   *
-   * If write follows read we need to check two things:
-   *   - either we are below the maximum limit (GINT64_FROM_BE(self->hdr->write_head) < self->options->disk_buf_size)
-   *   - or we can wrap around (GINT64_FROM_BE(self->hdr->read_head) != QDISK_RESERVED_SPACE)
-   * If neither of the above is true, the buffer is full.
-   */
-  if (!qdisk_is_space_avail(self, record->len))
-    return FALSE;
+  if (self->options->read_only || self->punch_hole_failed)
+    return;
 
-  if (n == 0)
+  if (end < start)
     {
-      msg_error("Error writing empty message into the disk-queue file");
-      return FALSE;
+      /* the backlog head wrapped around, the end of the ring is cut off
+       * by the writer */
+      self->release_head = end;
+      return;
     }
 
-  if (!pwrite_strict(self->fd, (gchar *) &n, sizeof(n), self->hdr->write_head) ||
-      !pwrite_strict(self->fd, record->str, record->len, self->hdr->write_head + sizeof(n)))
+  /* if the ring has wrapped around, the data before the write head is
+   * live, and the preallocated segment ahead of it is kept */
+  if (self->hdr->write_head < end)
+    start = MAX(start, MAX(self->hdr->write_head, self->prealloc_end));
+
+  start = (start + page_size - 1) & ~(page_size - 1);
+  end = end & ~(page_size - 1);
+  if (end - start < self->segment_size)
+    return;
+
+  if (fallocate(self->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, start, end - start) < 0)
     {
-      msg_error("Error writing disk-queue file",
-                evt_tag_errno("error", errno));
-      return FALSE;
+      msg_debug("Error releasing consumed part of disk-queue file, disk usage will not shrink",
+                evt_tag_errno("error", errno),
+                evt_tag_str("filename", self->filename));
+      self->punch_hole_failed = TRUE;
+      return;
     }
+  self->release_head = end;
+#endif
+}
+
+/* Allocates the segment ahead of the write head in advance, so that the
+ * queue file is not fragmented by the small appends */
+static void
+_preallocate_segment(QDisk *self)
+{
+#if SYSLOG_NG_HAVE_FALLOCATE && defined(FALLOC_FL_KEEP_SIZE)
+  gint64 start = self->hdr->write_head;
+  gint64 end;
+
+  if (!self->options->prealloc || self->options->read_only || self->prealloc_failed)
+    return;
 
-  self->hdr->write_head = self->hdr->write_head + record->len + sizeof(n);
+  if (start >= self->prealloc_start && start + self->segment_size / 2 <= self->prealloc_end)
+    return;
+
+  if (start < self->hdr->backlog_head)
+    end = MIN(start + self->segment_size, self->hdr->backlog_head);
+  else
+    end = MIN(start + self->segment_size, self->options->disk_buf_size);
+
+  if (end <= start)
+    return;
+
+  if (fallocate(self->fd, FALLOC_FL_KEEP_SIZE, start, end - start) < 0)
+    {
+      msg_debug("Error preallocating disk-queue file",
+                evt_tag_errno("error", errno),
+                evt_tag_str("filename", self->filename));
+      self->prealloc_failed = TRUE;
+      return;
+    }
+  self->prealloc_start = start;
+  self->prealloc_end = end;
+#endif
+}
 
+static void
+_advance_write_head(QDisk *self, gsize written, gint count)
+{
+  self->hdr->write_head = self->hdr->write_head + written;
+  self->mapped_file_size = MAX(self->mapped_file_size, self->hdr->write_head);
 
   /* NOTE: we only wrap around if the read head is before the write,
    * otherwise we'd truncate the data the read head is still processing, e.g.
@@ -289,7 +519,289 @@ qdisk_push_tail(QDisk *self, GString *record)
           self->hdr->write_head = QDISK_RESERVED_SPACE;
         }
     }
-  self->hdr->length++;
+  self->hdr->length += count;
+  _preallocate_segment(self);
+}
+
+gboolean
+qdisk_push_tail(QDisk *self, GString *record)
+{
+  guint32 n = GUINT32_TO_BE(record->len);
+
+  /* write follows read (e.g. we are appending to the file) OR
+   * there's enough space between write and read.
+   *
+   * If write follows read we need to check two things:
+   *   - either we are below the maximum limit (GINT64_FROM_BE(self->hdr->write_head) < self->options->disk_buf_size)
+   *   - or we can wrap around (GINT64_FROM_BE(self->hdr->read_head) != QDISK_RESERVED_SPACE)
+   * If neither of the above is true, the buffer is full.
+   */
+  if (!qdisk_is_space_avail(self, record->len))
+    return FALSE;
+
+  if (n == 0)
+    {
+      msg_error("Error writing empty message into the disk-queue file");
+      return FALSE;
+    }
+
+  if (!pwrite_strict(self->fd, (gchar *) &n, sizeof(n), self->hdr->write_head) ||
+      !pwrite_strict(self->fd, record->str, record->len, self->hdr->write_head + sizeof(n)))
+    {
+      msg_error("Error writing disk-queue file",
+                evt_tag_errno("error", errno));
+      return FALSE;
+    }
+
+  _advance_write_head(self, record->len + sizeof(n), 1);
+  return TRUE;
+}
+
+gsize
+qdisk_frame_begin(GString *frames)
+{
+  gsize frame_start = frames->len;
+
+  g_string_set_size(frames, frame_start + sizeof(guint32));
+  return frame_start;
+}
+
+void
+qdisk_frame_end(GString *frames, gsize frame_start)
+{
+  guint32 n = GUINT32_TO_BE(frames->len - frame_start - sizeof(n));
+
+  memcpy(frames->str + frame_start, &n, sizeof(n));
+}
+
+static gboolean
+_push_tail_frames(QDisk *self, const gchar *frames, gsize frames_len, gint count)
+{
+  if (!_is_space_avail(self, frames_len))
+    return FALSE;
+
+  if (frames_len == 0 || count == 0)
+    {
+      msg_error("Error writing empty message into the disk-queue file");
+      return FALSE;
+    }
+
+  if (!pwrite_strict(self->fd, frames, frames_len, self->hdr->write_head))
+    {
+      msg_error("Error writing disk-queue file",
+                evt_tag_errno("error", errno));
+      return FALSE;
+    }
+
+  _advance_write_head(self, frames_len, count);
+  return TRUE;
+}
+
+/* Appends a series of records that were framed with
+ * qdisk_frame_begin()/qdisk_frame_end() to the queue file using a single
+ * write.  The batch is placed contiguously at the write head, wrapping
+ * around is only considered once the whole batch is written, just like
+ * with a single record. */
+gboolean
+qdisk_push_tail_frames(QDisk *self, GString *frames, gint count)
+{
+  return _push_tail_frames(self, frames->str, frames->len, count);
+}
+
+/* Appends the single record of @frames starting at @frame_start, used when
+ * a batch does not fit into the queue file as a whole.  Returns the length
+ * of the frame in @frame_len even if it could not be written. */
+gboolean
+qdisk_push_tail_frame(QDisk *self, GString *frames, gsize frame_start, gsize *frame_len)
+{
+  guint32 n;
+
+  memcpy(&n, frames->str + frame_start, sizeof(n));
+  *frame_len = GUINT32_FROM_BE(n) + sizeof(n);
+  return _push_tail_frames(self, frames->str + frame_start, *frame_len, 1);
+}
+
+/* Serializes a record straight into the mapped queue file. This is only
+ * possible if the write head is behind the backlog head (the ring has
+ * wrapped around), as appending would need the file to be extended first
+ * and the on-disk format uses the end of file to find the end of the ring.
+ *
+ * The header is only updated once the record is in place, so the header
+ * never points to a partially written record.
+ */
+static gboolean
+_push_tail_mapped(QDisk *self, QDiskSerializeFunc serialize_func, gpointer user_data)
+{
+  gint64 space = MIN(self->hdr->backlog_head - self->hdr->write_head - 1, QDISK_MMAP_WINDOW_SIZE);
+  SerializeArchive *sa;
+  gboolean success;
+  gchar *p;
+  guint32 n;
+
+  if (self->hdr->write_head >= self->hdr->backlog_head || space <= (gint64) sizeof(n))
+    return FALSE;
+
+  p = _map_range(self, &self->write_window, self->hdr->write_head, space, TRUE);
+  if (!p)
+    return FALSE;
+
+  sa = serialize_buffer_archive_new(p + sizeof(n), space - sizeof(n));
+  sa->silent = TRUE;
+  success = serialize_func(sa, user_data) && !sa->error && serialize_buffer_archive_get_pos(sa) > 0;
+  n = serialize_buffer_archive_get_pos(sa);
+  serialize_archive_free(sa);
+
+  if (!success)
+    return FALSE;
+
+  n = GUINT32_TO_BE(n);
+  memcpy(p, &n, sizeof(n));
+  _advance_write_head(self, GUINT32_FROM_BE(n) + sizeof(n), 1);
+  return TRUE;
+}
+
+#if SYSLOG_NG_ENABLE_LZ4
+
+static gboolean
+_flush_write_block(QDisk *self)
+{
+  GString *block = self->write_block;
+  gchar *header;
+  guint32 n;
+  gint bound, compressed_len;
+  gboolean success;
+
+  if (self->write_block_count == 0)
+    return TRUE;
+
+  bound = LZ4_compressBound(block->len);
+  g_string_set_size(self->compress_buffer, sizeof(n) + QDISK_BLOCK_HEADER_SIZE + bound);
+  header = self->compress_buffer->str;
+  compressed_len = LZ4_compress_default(block->str, header + sizeof(n) + QDISK_BLOCK_HEADER_SIZE, block->len, bound);
+
+  if (compressed_len <= 0 || compressed_len + QDISK_BLOCK_HEADER_SIZE >= block->len)
+    {
+      /* incompressible, the frames are valid records on their own */
+      success = qdisk_push_tail_frames(self, block, self->write_block_count);
+    }
+  else
+    {
+      n = GUINT32_TO_BE((compressed_len + QDISK_BLOCK_HEADER_SIZE) | QDISK_RECORD_COMPRESSED);
+      memcpy(header, &n, sizeof(n));
+      n = GUINT32_TO_BE(block->len);
+      memcpy(header + sizeof(n), &n, sizeof(n));
+      n = GUINT32_TO_BE(self->write_block_count);
+      memcpy(header + 2 * sizeof(n), &n, sizeof(n));
+      g_string_set_size(self->compress_buffer, sizeof(n) + QDISK_BLOCK_HEADER_SIZE + compressed_len);
+
+      success = qdisk_push_tail_frames(self, self->compress_buffer, self->write_block_count);
+    }
+
+  if (success)
+    {
+      g_string_truncate(block, 0);
+      self->write_block_count = 0;
+    }
+  return success;
+}
+
+/* Appends the message to the pending block, which is written out once it
+ * is large enough, or when the reader catches up with the write head. The
+ * space check accounts for the worst case size of the block. */
+static gboolean
+_push_tail_compressed(QDisk *self, QDiskSerializeFunc serialize_func, gpointer user_data)
+{
+  GString *block = self->write_block;
+  gsize frame_start = qdisk_frame_begin(block);
+  SerializeArchive *sa;
+  gboolean success;
+
+  sa = serialize_string_archive_new(block);
+  success = serialize_func(sa, user_data);
+  serialize_archive_free(sa);
+  qdisk_frame_end(block, frame_start);
+
+  if (!success || block->len - frame_start <= sizeof(guint32) ||
+      !_is_space_avail(self, sizeof(guint32) + QDISK_BLOCK_HEADER_SIZE + LZ4_compressBound(block->len)))
+    {
+      g_string_truncate(block, frame_start);
+      return FALSE;
+    }
+
+  self->write_block_count++;
+  if (block->len >= QDISK_COMPRESS_BLOCK_SIZE && !_flush_write_block(self))
+    {
+      self->write_block_count--;
+      g_string_truncate(block, frame_start);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+#else
+
+static gboolean
+_flush_write_block(QDisk *self)
+{
+  return TRUE;
+}
+
+static gboolean
+_push_tail_compressed(QDisk *self, QDiskSerializeFunc serialize_func, gpointer user_data)
+{
+  g_assert_not_reached();
+  return FALSE;
+}
+
+#endif
+
+gboolean
+qdisk_push_tail_with(QDisk *self, QDiskSerializeFunc serialize_func, gpointer user_data)
+{
+  GString *frames;
+  SerializeArchive *sa;
+  gsize frame_start;
+  gboolean success;
+
+  if (self->options->compress)
+    return _push_tail_compressed(self, serialize_func, user_data);
+
+  if (self->options->use_mmap && _push_tail_mapped(self, serialize_func, user_data))
+    return TRUE;
+
+  frames = g_string_sized_new(256);
+  frame_start = qdisk_frame_begin(frames);
+  sa = serialize_string_archive_new(frames);
+  success = serialize_func(sa, user_data);
+  serialize_archive_free(sa);
+  qdisk_frame_end(frames, frame_start);
+
+  success = success && qdisk_push_tail_frames(self, frames, 1);
+  g_string_free(frames, TRUE);
+  return success;
+}
+
+gboolean
+qdisk_sync(QDisk *self)
+{
+  gint rc;
+
+  if (self->write_window.base)
+    msync(self->write_window.base, self->write_window.len, MS_SYNC);
+
+#if SYSLOG_NG_HAVE_FDATASYNC
+  rc = fdatasync(self->fd);
+#else
+  rc = fsync(self->fd);
+#endif
+
+  if (rc < 0)
+    {
+      msg_error("Error syncing disk-queue file",
+                evt_tag_errno("error", errno),
+                evt_tag_str("filename", self->filename));
+      return FALSE;
+    }
   return TRUE;
 }
 
@@ -299,137 +811,472 @@ _is_record_length_reached_hard_limit(guint32 record_length)
   return record_length > MAX_RECORD_LENGTH;
 }
 
-gboolean
-qdisk_pop_head(QDisk *self, GString *record)
+static gboolean
+_is_record_length_valid(QDisk *self, guint32 n)
 {
-  if (self->hdr->read_head != self->hdr->write_head)
+  if (_is_record_length_reached_hard_limit(n))
+    {
+      msg_warning("Disk-queue file contains possibly invalid record-length",
+                  evt_tag_int("rec_length", n),
+                  evt_tag_str("filename", self->filename));
+      return FALSE;
+    }
+  else if (n == 0)
+    {
+      msg_error("Disk-queue file contains empty record",
+                evt_tag_int("rec_length", n),
+                evt_tag_str("filename", self->filename));
+      return FALSE;
+    }
+  return TRUE;
+}
+
+static const gchar *
+_read_head_record(QDisk *self, GString *record, guint32 *record_len, gboolean *compressed)
+{
+  guint32 n;
+  gssize res;
+  res = pread(self->fd, (gchar *) &n, sizeof(n), self->hdr->read_head);
+
+  if (res == 0)
     {
-      guint32 n;
-      gssize res;
+      /* hmm, we are either at EOF or at hdr->qout_ofs, we need to wrap */
+      self->hdr->read_head = QDISK_RESERVED_SPACE;
       res = pread(self->fd, (gchar *) &n, sizeof(n), self->hdr->read_head);
+    }
+  if (res != sizeof(n))
+    {
+      msg_error("Error reading disk-queue file",
+                evt_tag_str("error", res < 0 ? g_strerror(errno) : "short read"),
+                evt_tag_str("filename", self->filename));
+      return NULL;
+    }
 
-      if (res == 0)
-        {
-          /* hmm, we are either at EOF or at hdr->qout_ofs, we need to wrap */
-          self->hdr->read_head = QDISK_RESERVED_SPACE;
-          res = pread(self->fd, (gchar *) &n, sizeof(n), self->hdr->read_head);
-        }
-      if (res != sizeof(n))
-        {
-          msg_error("Error reading disk-queue file",
-                    evt_tag_str("error", res < 0 ? g_strerror(errno) : "short read"),
-                    evt_tag_str("filename", self->filename));
-          return FALSE;
-        }
+  n = GUINT32_FROM_BE(n);
+  *compressed = !!(n & QDISK_RECORD_COMPRESSED);
+  n &= ~QDISK_RECORD_COMPRESSED;
+  if (!_is_record_length_valid(self, n))
+    return NULL;
 
-      n = GUINT32_FROM_BE(n);
-      if (_is_record_length_reached_hard_limit(n))
-        {
-          msg_warning("Disk-queue file contains possibly invalid record-length",
-                      evt_tag_int("rec_length", n),
-                      evt_tag_str("filename", self->filename));
-          return FALSE;
-        }
-      else if (n == 0)
-        {
-          msg_error("Disk-queue file contains empty record",
-                    evt_tag_int("rec_length", n),
-                    evt_tag_str("filename", self->filename));
-          return FALSE;
-        }
+  g_string_set_size(record, n);
+  res = pread(self->fd, record->str, n, self->hdr->read_head + sizeof(n));
+  if (res != n)
+    {
+      msg_error("Error reading disk-queue file",
+                evt_tag_str("filename", self->filename),
+                evt_tag_str("error", res < 0 ? g_strerror(errno) : "short read"),
+                evt_tag_int("read_length", n));
+      return NULL;
+    }
 
-      g_string_set_size(record, n);
-      res = pread(self->fd, record->str, n, self->hdr->read_head + sizeof(n));
-      if (res != n)
-        {
-          msg_error("Error reading disk-queue file",
-                    evt_tag_str("filename", self->filename),
-                    evt_tag_str("error", res < 0 ? g_strerror(errno) : "short read"),
-                    evt_tag_int("read_length", n));
-          return FALSE;
-        }
+  *record_len = n;
+  return record->str;
+}
 
-      self->hdr->read_head = self->hdr->read_head + record->len + sizeof(n);
+/* same as _read_head_record(), but returns a pointer into the mapped queue
+ * file, valid until the next qdisk call */
+static const gchar *
+_map_head_record(QDisk *self, guint32 *record_len, gboolean *compressed)
+{
+  const gchar *p;
+  guint32 n;
+
+  if (!_is_range_in_mapped_file(self, self->hdr->read_head, 1))
+    {
+      /* at EOF, wrap, just like the pread() based reader does */
+      self->hdr->read_head = QDISK_RESERVED_SPACE;
+    }
+
+  if (!_is_range_in_mapped_file(self, self->hdr->read_head, sizeof(n)) ||
+      !(p = _map_range(self, &self->read_window, self->hdr->read_head, sizeof(n), FALSE)))
+    {
+      msg_error("Error reading disk-queue file",
+                evt_tag_str("error", "short read"),
+                evt_tag_str("filename", self->filename));
+      return NULL;
+    }
+
+  memcpy(&n, p, sizeof(n));
+  n = GUINT32_FROM_BE(n);
+  *compressed = !!(n & QDISK_RECORD_COMPRESSED);
+  n &= ~QDISK_RECORD_COMPRESSED;
+  if (!_is_record_length_valid(self, n))
+    return NULL;
+
+  if (!_is_range_in_mapped_file(self, self->hdr->read_head, n + sizeof(n)) ||
+      !(p = _map_range(self, &self->read_window, self->hdr->read_head, n + sizeof(n), FALSE)))
+    {
+      msg_error("Error reading disk-queue file",
+                evt_tag_str("filename", self->filename),
+                evt_tag_str("error", "short read"),
+                evt_tag_int("read_length", n));
+      return NULL;
+    }
+
+  *record_len = n;
+  return p + sizeof(n);
+}
+
+#if SYSLOG_NG_ENABLE_LZ4
+
+static gboolean
+_decompress_block(QDisk *self, const gchar *compressed, gsize compressed_len, guint32 uncompressed_len)
+{
+  QDiskReadBlock *block = &self->read_block;
+  gint res;
+
+  if (!block->data)
+    block->data = g_string_sized_new(uncompressed_len);
+  g_string_set_size(block->data, uncompressed_len);
+
+  res = LZ4_decompress_safe(compressed, block->data->str, compressed_len, uncompressed_len);
+  return res >= 0 && res == uncompressed_len;
+}
+
+#else
+
+static gboolean
+_decompress_block(QDisk *self, const gchar *compressed, gsize compressed_len, guint32 uncompressed_len)
+{
+  msg_error("Disk-queue file contains compressed records, but syslog-ng was compiled without LZ4 support",
+            evt_tag_str("filename", self->filename));
+  return FALSE;
+}
+
+#endif
+
+/* returns the next length-prefixed message of the loaded block */
+static const gchar *
+_read_block_frame(QDisk *self, guint32 *frame_len)
+{
+  QDiskReadBlock *block = &self->read_block;
+  const gchar *frame;
+  guint32 n;
+
+  if (block->pos + sizeof(n) > block->data->len)
+    return NULL;
+
+  memcpy(&n, block->data->str + block->pos, sizeof(n));
+  n = GUINT32_FROM_BE(n);
+  if (n == 0 || n > block->data->len - block->pos - sizeof(n))
+    return NULL;
+
+  frame = block->data->str + block->pos + sizeof(n);
+  block->pos += n + sizeof(n);
+  *frame_len = n;
+  return frame;
+}
+
+static gboolean
+_load_read_block(QDisk *self, const gchar *record, guint32 record_len)
+{
+  QDiskReadBlock *block = &self->read_block;
+  guint32 uncompressed_len, count, frame_len;
+  guint32 i;
+
+  block->record_len = 0;
+  if (record_len <= QDISK_BLOCK_HEADER_SIZE)
+    goto error;
+
+  memcpy(&uncompressed_len, record, sizeof(uncompressed_len));
+  uncompressed_len = GUINT32_FROM_BE(uncompressed_len);
+  memcpy(&count, record + sizeof(uncompressed_len), sizeof(count));
+  count = GUINT32_FROM_BE(count);
+
+  if (count == 0 || count <= self->hdr->read_block_skip || _is_record_length_reached_hard_limit(uncompressed_len))
+    goto error;
+
+  if (!_decompress_block(self, record + QDISK_BLOCK_HEADER_SIZE, record_len - QDISK_BLOCK_HEADER_SIZE, uncompressed_len))
+    goto error;
+
+  block->pos = 0;
+  block->count = count;
+
+  /* skip the messages that were consumed before the queue file was saved */
+  for (i = 0; i < self->hdr->read_block_skip; i++)
+    {
+      if (!_read_block_frame(self, &frame_len))
+        goto error;
+    }
+
+  block->ofs = self->hdr->read_head;
+  block->record_len = record_len;
+  return TRUE;
+
+error:
+  msg_error("Error decompressing disk-queue record",
+            evt_tag_str("filename", self->filename),
+            evt_tag_long("position", self->hdr->read_head),
+            evt_tag_int("rec_length", record_len));
+  return FALSE;
+}
+
+/* returns the next message of the block at the read head, @consumed is
+ * set to the length of the block record with its last message, 0
+ * otherwise, as the read head stays on the block until then */
+static const gchar *
+_pop_block_message(QDisk *self, guint32 *message_len, guint32 *consumed)
+{
+  QDiskReadBlock *block = &self->read_block;
+  const gchar *message = _read_block_frame(self, message_len);
+
+  if (!message)
+    {
+      msg_error("Disk-queue file contains a corrupted compressed record",
+                evt_tag_str("filename", self->filename),
+                evt_tag_long("position", block->ofs));
+      block->record_len = 0;
+      return NULL;
+    }
+
+  *consumed = 0;
+  self->hdr->read_block_skip++;
+  if (self->hdr->read_block_skip >= block->count)
+    {
+      *consumed = block->record_len;
+      self->hdr->read_block_skip = 0;
+      block->record_len = 0;
+    }
+  return message;
+}
+
+/* Returns the message at the read head, either a plain record or the
+ * next message of a compressed block. @scratch is used as a read buffer
+ * unless the mmap backend is used. */
+static const gchar *
+_get_head_message(QDisk *self, GString *scratch, guint32 *message_len, guint32 *consumed)
+{
+  const gchar *record;
+  guint32 record_len;
+  gboolean compressed;
+
+  if (self->read_block.record_len && self->read_block.ofs == self->hdr->read_head)
+    return _pop_block_message(self, message_len, consumed);
+
+  if (self->options->use_mmap)
+    record = _map_head_record(self, &record_len, &compressed);
+  else
+    record = _read_head_record(self, scratch, &record_len, &compressed);
+
+  if (!record)
+    return NULL;
+
+  if (!compressed)
+    {
+      *message_len = record_len;
+      *consumed = record_len;
+      return record;
+    }
+
+  if (!_load_read_block(self, record, record_len))
+    return NULL;
+  return _pop_block_message(self, message_len, consumed);
+}
+
+static gboolean
+_has_head_record(QDisk *self)
+{
+  if (self->hdr->read_head != self->hdr->write_head)
+    return TRUE;
+
+  /* the reader caught up with the writer, write out the pending block */
+  if (self->write_block_count == 0 || self->options->read_only || !_flush_write_block(self))
+    return FALSE;
+  return self->hdr->read_head != self->hdr->write_head;
+}
+
+/* @record_len is 0 if the message came from a compressed block that still
+ * has messages left */
+static void
+_advance_read_head(QDisk *self, guint32 record_len)
+{
+  if (record_len)
+    {
+      self->hdr->read_head = self->hdr->read_head + record_len + sizeof(guint32);
 
       if (self->hdr->read_head > self->hdr->write_head)
         {
           self->hdr->read_head = _correct_position_if_eof(self, &self->hdr->read_head);
         }
+    }
+
+  self->hdr->length--;
+  if (!self->options->reliable)
+    {
+      self->hdr->backlog_head = self->hdr->read_head;
+    }
 
-      self->hdr->length--;
+  if (self->hdr->length == 0 && !self->options->reliable)
+    {
+      msg_debug("Queue file became empty, truncating file",
+                evt_tag_str("filename", self->filename));
+      self->hdr->read_head = QDISK_RESERVED_SPACE;
+      self->hdr->write_head = QDISK_RESERVED_SPACE;
       if (!self->options->reliable)
         {
           self->hdr->backlog_head = self->hdr->read_head;
         }
+      self->hdr->length = 0;
+      self->hdr->read_block_skip = 0;
+      _truncate_file(self, self->hdr->write_head);
+    }
+  else
+    {
+      if (!self->options->reliable)
+        _release_consumed_segments(self);
+      if (self->options->use_mmap)
+        _drop_consumed_pages(self, &self->read_window, self->hdr->read_head);
+    }
+}
 
-      if (self->hdr->length == 0 && !self->options->reliable)
-        {
-          msg_debug("Queue file became empty, truncating file",
-                    evt_tag_str("filename", self->filename));
-          self->hdr->read_head = QDISK_RESERVED_SPACE;
-          self->hdr->write_head = QDISK_RESERVED_SPACE;
-          if (!self->options->reliable)
-            {
-              self->hdr->backlog_head = self->hdr->read_head;
-            }
-          self->hdr->length = 0;
-          _truncate_file(self, self->hdr->write_head);
-        }
-      return TRUE;
+/* Pops the record at the read head and passes it to @record_func. With
+ * the mmap backend the record is passed without copying, right out of the
+ * mapping, which is only valid during the callback. */
+gboolean
+qdisk_pop_head_with(QDisk *self, QDiskRecordFunc record_func, gpointer user_data)
+{
+  GString *scratch = NULL;
+  const gchar *message;
+  guint32 message_len, consumed;
+
+  if (!_has_head_record(self))
+    return FALSE;
+
+  if (!self->options->use_mmap)
+    scratch = g_string_sized_new(256);
 
+  message = _get_head_message(self, scratch, &message_len, &consumed);
+  if (message)
+    {
+      record_func(message, message_len, user_data);
+      _advance_read_head(self, consumed);
     }
-  return FALSE;
+
+  if (scratch)
+    g_string_free(scratch, TRUE);
+  return message != NULL;
 }
 
-static gboolean
-_load_queue(QDisk *self, GQueue *q, gint64 q_ofs, gint32 q_len, gint32 q_count)
+gboolean
+qdisk_pop_head(QDisk *self, GString *record)
+{
+  const gchar *message;
+  guint32 message_len, consumed;
+
+  if (!_has_head_record(self))
+    return FALSE;
+
+  message = _get_head_message(self, record, &message_len, &consumed);
+  if (!message)
+    return FALSE;
+
+  if (message != record->str)
+    {
+      g_string_truncate(record, 0);
+      g_string_append_len(record, message, message_len);
+    }
+
+  _advance_read_head(self, consumed);
+  return TRUE;
+}
+
+static GString *
+_read_queue_section(QDisk *self, gint64 q_ofs, gint32 q_len)
 {
   GString *serialized;
+  gssize read_len;
+
+  serialized = g_string_sized_new(q_len);
+  g_string_set_size(serialized, q_len);
+  read_len = pread(self->fd, serialized->str, q_len, q_ofs);
+  if (read_len < 0 || read_len != q_len)
+    {
+      msg_error("Error reading in-memory buffer from disk-queue file",
+                evt_tag_str("filename", self->filename),
+                read_len < 0 ? evt_tag_errno("error", errno) : evt_tag_str("error", "short read"));
+      g_string_free(serialized, TRUE);
+      return NULL;
+    }
+  return serialized;
+}
+
+/* Restores the messages of an in-memory queue saved by qdisk_save_state()
+ * into @q. It does not touch the QDisk instance, so it can run in a
+ * thread of its own, see qdisk_take_overflow_section() */
+void
+qdisk_deserialize_queue(const gchar *filename, GString *serialized, gint32 q_count, GQueue *q)
+{
   SerializeArchive *sa;
   gint i;
 
-  if (q_ofs)
+  sa = serialize_string_archive_new(serialized);
+  for (i = 0; i < q_count; i++)
     {
-      gssize read_len;
+      LogMessage *msg;
 
-      serialized = g_string_sized_new(q_len);
-      g_string_set_size(serialized, q_len);
-      read_len = pread(self->fd, serialized->str, q_len, q_ofs);
-      if (read_len < 0 || read_len != q_len)
+      msg = log_msg_new_empty();
+      if (log_msg_deserialize(msg, sa))
         {
-          msg_error("Error reading in-memory buffer from disk-queue file",
-                    evt_tag_str("filename", self->filename),
-                    read_len < 0 ? evt_tag_errno("error", errno) : evt_tag_str("error", "short read"));
-          g_string_free(serialized, TRUE);
-          return FALSE;
+          g_queue_push_tail(q, msg);
+          /* we restore the queue without ACKs */
+          g_queue_push_tail(q, LOG_PATH_OPTIONS_FOR_BACKLOG);
         }
-      sa = serialize_string_archive_new(serialized);
-      for (i = 0; i < q_count; i++)
+      else
         {
-          LogMessage *msg;
-
-          msg = log_msg_new_empty();
-          if (log_msg_deserialize(msg, sa))
-            {
-              g_queue_push_tail(q, msg);
-              /* we restore the queue without ACKs */
-              g_queue_push_tail(q, LOG_PATH_OPTIONS_FOR_BACKLOG);
-            }
-          else
-            {
-              msg_error("Error reading message from disk-queue file (maybe corrupted file) some messages will be lost",
-                        evt_tag_str("filename", self->filename),
-                        evt_tag_int("lost messages", q_count - i));
-              log_msg_unref(msg);
-              break;
-            }
+          msg_error("Error reading message from disk-queue file (maybe corrupted file) some messages will be lost",
+                    evt_tag_str("filename", filename),
+                    evt_tag_int("lost messages", q_count - i));
+          log_msg_unref(msg);
+          break;
         }
+    }
+  serialize_archive_free(sa);
+}
+
+static gboolean
+_load_queue(QDisk *self, GQueue *q, gint64 q_ofs, gint32 q_len, gint32 q_count)
+{
+  GString *serialized;
+
+  if (q_ofs)
+    {
+      serialized = _read_queue_section(self, q_ofs, q_len);
+      if (!serialized)
+        return FALSE;
+
+      qdisk_deserialize_queue(self->filename, serialized, q_count, q);
       g_string_free(serialized, TRUE);
-      serialize_archive_free(sa);
     }
   return TRUE;
 }
 
+/* The qoverflow section of a non-reliable queue can be large, it is only
+ * read into memory by qdisk_start(), its messages are restored by the
+ * caller with qdisk_deserialize_queue(), possibly in the background. */
+static gboolean
+_load_overflow_section(QDisk *self, gint64 q_ofs, gint32 q_len, gint32 q_count)
+{
+  if (q_ofs)
+    {
+      self->overflow_section = _read_queue_section(self, q_ofs, q_len);
+      if (!self->overflow_section)
+        return FALSE;
+      self->overflow_section_count = q_count;
+    }
+  return TRUE;
+}
+
+GString *
+qdisk_take_overflow_section(QDisk *self, gint32 *count)
+{
+  GString *section = self->overflow_section;
+
+  *count = self->overflow_section_count;
+  self->overflow_section = NULL;
+  self->overflow_section_count = 0;
+  return section;
+}
+
 static gboolean
 _load_state(QDisk *self, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow)
 {
@@ -500,7 +1347,10 @@ _load_state(QDisk *self, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow)
 
       if (!(qoverflow_ofs > 0 && qoverflow_ofs < self->hdr->write_head))
         {
-          if(!_load_queue(self, qoverflow, qoverflow_ofs, qoverflow_len, qoverflow_count))
+          gboolean loaded = self->options->read_only
+                            ? _load_queue(self, qoverflow, qoverflow_ofs, qoverflow_len, qoverflow_count)
+                            : _load_overflow_section(self, qoverflow_ofs, qoverflow_len, qoverflow_count);
+          if (!loaded)
             return !self->options->read_only;
         }
       else
@@ -644,6 +1494,15 @@ qdisk_save_state(QDisk *self, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow)
   gint32 qoverflow_len = 0;
   gint32 qoverflow_count = 0;
 
+  if (!self->options->read_only && !_flush_write_block(self))
+    {
+      msg_error("Error writing compressed block of disk-queue file, messages are lost",
+                evt_tag_str("filename", self->filename),
+                evt_tag_int("lost_messages", self->write_block_count));
+      g_string_truncate(self->write_block, 0);
+      self->write_block_count = 0;
+    }
+
   if (!self->options->reliable)
     {
       qout_count = qout->length / 2;
@@ -833,6 +1692,7 @@ qdisk_start(QDisk *self, const gchar *filename, GQueue *qout, GQueue *qbacklog,
           self->hdr->qoverflow_count = GUINT32_SWAP_LE_BE(self->hdr->qoverflow_count);
           self->hdr->backlog_head = GUINT64_SWAP_LE_BE(self->hdr->backlog_head);
           self->hdr->backlog_len = GUINT64_SWAP_LE_BE(self->hdr->backlog_len);
+          self->hdr->read_block_skip = GUINT32_SWAP_LE_BE(self->hdr->read_block_skip);
           self->hdr->big_endian = (G_BYTE_ORDER == G_BIG_ENDIAN);
         }
       if (!_load_state(self, qout, qbacklog, qoverflow))
@@ -845,6 +1705,17 @@ qdisk_start(QDisk *self, const gchar *filename, GQueue *qout, GQueue *qbacklog,
         }
 
     }
+
+  if (self->options->use_mmap)
+    {
+      struct stat st;
+
+      self->mapped_file_size = fstat(self->fd, &st) == 0 ? st.st_size : 0;
+    }
+
+  /* whatever was consumed before the restart is released with the next segment */
+  self->release_head = QDISK_RESERVED_SPACE;
+  _preallocate_segment(self);
   return TRUE;
 }
 
@@ -853,7 +1724,18 @@ qdisk_init(QDisk *self, DiskQueueOptions *options)
 {
   self->fd = -1;
   self->file_size = 0;
+  self->mapped_file_size = 0;
   self->options = options;
+  self->segment_size = MAX(MIN(QDISK_SEGMENT_SIZE, self->options->disk_buf_size / 8), getpagesize());
+  self->release_head = QDISK_RESERVED_SPACE;
+  self->prealloc_start = self->prealloc_end = 0;
+  self->punch_hole_failed = FALSE;
+  self->prealloc_failed = FALSE;
+  if (self->options->compress)
+    {
+      self->write_block = g_string_sized_new(QDISK_COMPRESS_BLOCK_SIZE + 4096);
+      self->compress_buffer = g_string_sized_new(QDISK_COMPRESS_BLOCK_SIZE + 4096);
+    }
   if (!self->options->reliable)
     self->file_id = "SLQF";
   else
@@ -869,6 +1751,27 @@ qdisk_init(QDisk *self, DiskQueueOptions *options)
 void
 qdisk_deinit(QDisk *self)
 {
+  _unmap_windows(self);
+
+  if (self->write_block)
+    {
+      g_string_free(self->write_block, TRUE);
+      g_string_free(self->compress_buffer, TRUE);
+      self->write_block = NULL;
+      self->compress_buffer = NULL;
+      self->write_block_count = 0;
+    }
+  if (self->read_block.data)
+    g_string_free(self->read_block.data, TRUE);
+  memset(&self->read_block, 0, sizeof(self->read_block));
+
+  if (self->overflow_section)
+    {
+      g_string_free(self->overflow_section, TRUE);
+      self->overflow_section = NULL;
+      self->overflow_section_count = 0;
+    }
+
   if (self->filename)
     {
       g_free(self->filename);
@@ -972,7 +1875,7 @@ qdisk_get_options(QDisk *self)
 gint64
 qdisk_get_length(QDisk *self)
 {
-  return self->hdr->length;
+  return self->hdr->length + self->write_block_count;
 }
 
 void
@@ -1021,6 +1924,7 @@ void
 qdisk_set_backlog_head(QDisk *self, gint64 new_value)
 {
   self->hdr->backlog_head = new_value;
+  _release_consumed_segments(self);
 }
 
 void
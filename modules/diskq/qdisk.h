@@ -39,11 +39,21 @@
 
 typedef struct _QDisk QDisk;
 
+typedef void (*QDiskRecordFunc)(const gchar *record, gsize record_len, gpointer user_data);
+typedef gboolean (*QDiskSerializeFunc)(SerializeArchive *sa, gpointer user_data);
+
 QDisk *qdisk_new(void);
 
 gboolean qdisk_is_space_avail(QDisk *self, gint at_least);
 gboolean qdisk_push_tail(QDisk *self, GString *record);
+gsize qdisk_frame_begin(GString *frames);
+void qdisk_frame_end(GString *frames, gsize frame_start);
+gboolean qdisk_push_tail_frames(QDisk *self, GString *frames, gint count);
+gboolean qdisk_push_tail_frame(QDisk *self, GString *frames, gsize frame_start, gsize *frame_len);
+gboolean qdisk_sync(QDisk *self);
 gboolean qdisk_pop_head(QDisk *self, GString *record);
+gboolean qdisk_pop_head_with(QDisk *self, QDiskRecordFunc record_func, gpointer user_data);
+gboolean qdisk_push_tail_with(QDisk *self, QDiskSerializeFunc serialize_func, gpointer user_data);
 gboolean qdisk_start(QDisk *self, const gchar *filename, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow);
 void qdisk_init(QDisk *self, DiskQueueOptions *options);
 void qdisk_deinit(QDisk *self);
@@ -52,6 +62,8 @@ gboolean qdisk_initialized(QDisk *self);
 void qdisk_free(QDisk *self);
 
 gboolean qdisk_save_state(QDisk *self, GQueue *qout, GQueue *qbacklog, GQueue *qoverflow);
+GString *qdisk_take_overflow_section(QDisk *self, gint32 *count);
+void qdisk_deserialize_queue(const gchar *filename, GString *serialized, gint32 q_count, GQueue *q);
 
 DiskQueueOptions *qdisk_get_options(QDisk *self);
 gint64 qdisk_get_length(QDisk *self);
@@ -317,6 +317,380 @@ testcase_with_threads(void)
   fprintf(stderr, "Feed speed: %.2lf\n", (double) TEST_RUNS * MESSAGES_SUM * 1000000 / sum_time);
 }
 
+#define GROUP_COMMIT_BATCH 16
+
+/* FALSE if messages get into the overflow area, and are acked only after being sent */
+static gboolean group_commit_acks_on_commit;
+
+static gpointer
+threaded_feed_group_commit(gpointer args)
+{
+  LogQueue *q = (LogQueue *) args;
+
+  iv_init();
+  main_loop_worker_thread_start(NULL);
+
+  /* below sync-batch(): nothing is written or acked until the input batch ends */
+  feed_some_messages(q, GROUP_COMMIT_BATCH - 1, &parse_options);
+  assert_gint(log_queue_get_length(q), 0, "messages became visible before the batch was committed");
+  assert_gint(acked_messages, 0, "messages were acked before the batch was committed");
+
+  /* reaching sync-batch() commits the batch */
+  feed_some_messages(q, 5, &parse_options);
+  assert_gint(log_queue_get_length(q), GROUP_COMMIT_BATCH, "full batch was not committed");
+  if (group_commit_acks_on_commit)
+    assert_gint(acked_messages, GROUP_COMMIT_BATCH, "committed messages were not acked");
+
+  /* the rest is committed when the input thread finishes its job */
+  main_loop_worker_invoke_batch_callbacks();
+  assert_gint(log_queue_get_length(q), GROUP_COMMIT_BATCH + 5, "partial batch was not committed");
+  if (group_commit_acks_on_commit)
+    assert_gint(acked_messages, GROUP_COMMIT_BATCH + 5, "committed messages were not acked");
+
+  main_loop_worker_thread_stop();
+  return NULL;
+}
+
+static void
+_test_group_commit(gint mem_buf_size, gboolean acks_on_commit)
+{
+  LogQueue *q;
+  GThread *thread_feed;
+  DiskQueueOptions options;
+  const gchar *filename = "test-group-commit.rqf";
+
+  log_queue_set_max_threads(1);
+  _construct_options(&options, 10000000, mem_buf_size, TRUE);
+  options.sync_batch = GROUP_COMMIT_BATCH;
+  options.fsync = TRUE;
+
+  q = log_queue_disk_reliable_new(&options, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+
+  StatsClusterKey sc_key;
+  stats_cluster_logpipe_key_set(&sc_key, SCS_DESTINATION, "group commit", NULL );
+  stats_lock();
+  stats_register_counter(0, &sc_key, SC_TYPE_QUEUED, &q->queued_messages);
+  stats_register_counter(1, &sc_key, SC_TYPE_MEMORY_USAGE, &q->memory_usage);
+  stats_unlock();
+
+  unlink(filename);
+  log_queue_disk_load_queue(q, filename);
+  fed_messages = 0;
+  acked_messages = 0;
+  group_commit_acks_on_commit = acks_on_commit;
+
+  thread_feed = g_thread_create(threaded_feed_group_commit, q, TRUE, NULL);
+  g_thread_join(thread_feed);
+
+  assert_gint(stats_counter_get(q->queued_messages), fed_messages, "queued messages: line: %d", __LINE__);
+
+  send_some_messages(q, fed_messages);
+  app_ack_some_messages(q, fed_messages);
+  assert_gint(fed_messages, acked_messages,
+              "%s: did not receive enough acknowledgements: fed_messages=%d, acked_messages=%d\n", __FUNCTION__, fed_messages,
+              acked_messages);
+  /* every message kept in memory was matched with its position in the batch */
+  assert_gint(stats_counter_get(q->memory_usage), 0, "memory usage: line: %d", __LINE__);
+
+  stats_lock();
+  stats_unregister_counter(&sc_key, SC_TYPE_QUEUED, &q->queued_messages);
+  stats_unregister_counter(&sc_key, SC_TYPE_MEMORY_USAGE, &q->memory_usage);
+  stats_unlock();
+
+  log_queue_unref(q);
+  unlink(filename);
+  disk_queue_options_destroy(&options);
+}
+
+static void
+testcase_group_commit(void)
+{
+  _test_group_commit(100000, TRUE);
+}
+
+static void
+testcase_group_commit_with_overflow(void)
+{
+  /* mem_buf_size() larger than the queue file: every message is kept in memory */
+  _test_group_commit(100000000, FALSE);
+}
+
+/* several times the size of a minimal queue file */
+#define GROUP_COMMIT_OVERSIZED_BATCH 20000
+
+static gpointer
+threaded_feed_oversized_batch(gpointer args)
+{
+  LogQueue *q = (LogQueue *) args;
+
+  iv_init();
+  main_loop_worker_thread_start(NULL);
+  feed_some_messages(q, GROUP_COMMIT_OVERSIZED_BATCH, &parse_options);
+  main_loop_worker_invoke_batch_callbacks();
+  main_loop_worker_thread_stop();
+  return NULL;
+}
+
+static void
+testcase_group_commit_drops_only_what_does_not_fit(void)
+{
+  LogQueue *q;
+  GThread *thread_feed;
+  DiskQueueOptions options;
+  const gchar *filename = "test-group-commit-full.rqf";
+  gint queued, dropped;
+
+  log_queue_set_max_threads(1);
+  _construct_options(&options, MIN_DISK_BUF_SIZE, 100000, TRUE);
+  options.sync_batch = GROUP_COMMIT_OVERSIZED_BATCH;
+
+  q = log_queue_disk_reliable_new(&options, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+
+  StatsClusterKey sc_key;
+  stats_cluster_logpipe_key_set(&sc_key, SCS_DESTINATION, "group commit full", NULL );
+  stats_lock();
+  stats_register_counter(0, &sc_key, SC_TYPE_QUEUED, &q->queued_messages);
+  stats_register_counter(0, &sc_key, SC_TYPE_DROPPED, &q->dropped_messages);
+  stats_register_counter(1, &sc_key, SC_TYPE_MEMORY_USAGE, &q->memory_usage);
+  stats_unlock();
+
+  unlink(filename);
+  log_queue_disk_load_queue(q, filename);
+  fed_messages = 0;
+  acked_messages = 0;
+
+  thread_feed = g_thread_create(threaded_feed_oversized_batch, q, TRUE, NULL);
+  g_thread_join(thread_feed);
+
+  queued = stats_counter_get(q->queued_messages);
+  dropped = stats_counter_get(q->dropped_messages);
+  assert_true(queued > 0, "nothing was stored from a batch that did not fit into the queue file");
+  assert_true(dropped > 0, "the batch was expected to overflow the queue file");
+  assert_gint(queued + dropped, fed_messages, "messages were lost: line: %d", __LINE__);
+  assert_gint(log_queue_get_length(q), queued, "queue length: line: %d", __LINE__);
+
+  send_some_messages(q, queued);
+  app_ack_some_messages(q, queued);
+  assert_gint(acked_messages, fed_messages, "not every message was acked: line: %d", __LINE__);
+
+  stats_lock();
+  stats_unregister_counter(&sc_key, SC_TYPE_QUEUED, &q->queued_messages);
+  stats_unregister_counter(&sc_key, SC_TYPE_DROPPED, &q->dropped_messages);
+  stats_unregister_counter(&sc_key, SC_TYPE_MEMORY_USAGE, &q->memory_usage);
+  stats_unlock();
+
+  log_queue_unref(q);
+  unlink(filename);
+  disk_queue_options_destroy(&options);
+}
+
+static void
+_feed_and_remember_ids(LogQueue *q, gint n, GQueue *expected_ids)
+{
+  gint i;
+
+  feed_some_messages(q, n, &parse_options);
+  for (i = 0; i < n; i++)
+    g_queue_push_tail(expected_ids, GINT_TO_POINTER(i));
+}
+
+static void
+_assert_next_message_id(LogQueue *q, GQueue *expected_ids)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg;
+  gchar expected[32];
+
+  msg = log_queue_pop_head(q, &path_options);
+  assert_not_null(msg, "queue ran out of messages");
+
+  g_snprintf(expected, sizeof(expected), "ID :%08d", GPOINTER_TO_INT(g_queue_pop_head(expected_ids)));
+  assert_not_null(strstr(log_msg_get_value(msg, LM_V_MESSAGE, NULL), expected),
+                  "message read back from the queue file is not the expected one: %s", expected);
+
+  log_msg_ack(msg, &path_options, AT_PROCESSED);
+  log_msg_unref(msg);
+}
+
+static void
+_test_ring_wraparound(const gchar *filename, gboolean use_mmap, gboolean prealloc)
+{
+  LogQueue *q;
+  DiskQueueOptions options;
+  GQueue *expected_ids = g_queue_new();
+  gint64 last_wpos = 0;
+  gint round, i, wraps = 0;
+
+  /* a small ring, so that it wraps around many times, consumed segments
+   * get released and with mmap the records get serialized straight into
+   * the mapping */
+  _construct_options(&options, 64 * 1024, 0, TRUE);
+  options.use_mmap = use_mmap;
+  options.prealloc = prealloc;
+
+  q = log_queue_disk_reliable_new(&options, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+  unlink(filename);
+  log_queue_disk_load_queue(q, filename);
+
+  fed_messages = 0;
+  acked_messages = 0;
+
+  /* keep some messages in the queue, so the file is never reset */
+  _feed_and_remember_ids(q, 30, expected_ids);
+  for (round = 0; round < 200; round++)
+    {
+      _feed_and_remember_ids(q, 20, expected_ids);
+      for (i = 0; i < 20; i++)
+        _assert_next_message_id(q, expected_ids);
+      log_queue_ack_backlog(q, 20);
+
+      if (qdisk_get_writer_head(((LogQueueDisk *) q)->qdisk) < last_wpos)
+        wraps++;
+      last_wpos = qdisk_get_writer_head(((LogQueueDisk *) q)->qdisk);
+    }
+  assert_true(wraps > 0, "the queue file did not wrap around");
+
+  while (expected_ids->length > 0)
+    _assert_next_message_id(q, expected_ids);
+  log_queue_ack_backlog(q, 30);
+  assert_gint(fed_messages, acked_messages,
+              "%s: did not receive enough acknowledgements: fed_messages=%d, acked_messages=%d\n", __FUNCTION__, fed_messages,
+              acked_messages);
+
+  log_queue_unref(q);
+  unlink(filename);
+  g_queue_free(expected_ids);
+  disk_queue_options_destroy(&options);
+}
+
+static void
+testcase_mmap_ring_wraparound(void)
+{
+  _test_ring_wraparound("test-mmap-ring.rqf", TRUE, FALSE);
+}
+
+static void
+testcase_segmented_ring_wraparound(void)
+{
+  _test_ring_wraparound("test-segmented-ring.rqf", FALSE, TRUE);
+}
+
+static void
+testcase_compressed_records(void)
+{
+  LogQueue *q;
+  DiskQueueOptions options;
+  GQueue *expected_ids = g_queue_new();
+  const gchar *filename = "test-compressed.qf";
+  gboolean persistent;
+  gint i;
+
+  _construct_options(&options, 10000000, 0, FALSE);
+  options.compress = TRUE;
+
+  q = log_queue_disk_non_reliable_new(&options, NULL);
+  unlink(filename);
+  log_queue_disk_load_queue(q, filename);
+
+  fed_messages = 0;
+  acked_messages = 0;
+
+  /* several full blocks and a pending one */
+  _feed_and_remember_ids(q, 500, expected_ids);
+  assert_gint(qdisk_get_length(((LogQueueDisk *) q)->qdisk), 500, "queue length does not include the pending block");
+
+  /* stop in the middle of a block, the rest must survive a restart */
+  for (i = 0; i < 250; i++)
+    _assert_next_message_id(q, expected_ids);
+
+  assert_true(log_queue_disk_save_queue(q, &persistent), "saving the disk-queue failed");
+  log_queue_unref(q);
+
+  q = log_queue_disk_non_reliable_new(&options, NULL);
+  log_queue_disk_load_queue(q, filename);
+  assert_gint(qdisk_get_length(((LogQueueDisk *) q)->qdisk), 250, "messages lost while restarting the queue");
+
+  while (expected_ids->length > 0)
+    _assert_next_message_id(q, expected_ids);
+  assert_gint(fed_messages, acked_messages,
+              "%s: did not receive enough acknowledgements: fed_messages=%d, acked_messages=%d\n", __FUNCTION__, fed_messages,
+              acked_messages);
+
+  log_queue_unref(q);
+  unlink(filename);
+  g_queue_free(expected_ids);
+  disk_queue_options_destroy(&options);
+}
+
+static void
+_assert_next_message_id_with_retry(LogQueue *q, GQueue *expected_ids)
+{
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  LogMessage *msg;
+  gchar expected[32];
+  gint retries;
+
+  /* qoverflow is restored in the background, the queue looks empty until then */
+  for (retries = 0; retries < 10000; retries++)
+    {
+      msg = log_queue_pop_head(q, &path_options);
+      if (msg)
+        break;
+      g_usleep(1000);
+    }
+  assert_not_null(msg, "queue ran out of messages");
+
+  g_snprintf(expected, sizeof(expected), "ID :%08d", GPOINTER_TO_INT(g_queue_pop_head(expected_ids)));
+  assert_not_null(strstr(log_msg_get_value(msg, LM_V_MESSAGE, NULL), expected),
+                  "message read back from the queue file is not the expected one: %s", expected);
+
+  log_msg_ack(msg, &path_options, AT_PROCESSED);
+  log_msg_unref(msg);
+}
+
+static void
+testcase_overflow_replay(void)
+{
+  LogQueue *q;
+  DiskQueueOptions options;
+  GQueue *expected_ids = g_queue_new();
+  const gchar *filename = "test-overflow-replay.qf";
+  gboolean persistent;
+  gint i;
+
+  /* a few messages in qout, some on the disk and most of them in qoverflow */
+  _construct_options(&options, 32 * 1024, 1000, FALSE);
+  options.qout_size = 10;
+
+  q = log_queue_disk_non_reliable_new(&options, NULL);
+  unlink(filename);
+  log_queue_disk_load_queue(q, filename);
+
+  fed_messages = 0;
+  acked_messages = 0;
+  _feed_and_remember_ids(q, 500, expected_ids);
+  assert_true(log_queue_disk_save_queue(q, &persistent), "saving the disk-queue failed");
+  log_queue_unref(q);
+
+  q = log_queue_disk_non_reliable_new(&options, NULL);
+  log_queue_disk_load_queue(q, filename);
+
+  /* messages pushed during the replay must not overtake the replayed ones */
+  _feed_and_remember_ids(q, 10, expected_ids);
+  assert_gint(log_queue_get_length(q), 510, "messages lost while restarting the queue");
+
+  for (i = 0; i < 510; i++)
+    _assert_next_message_id_with_retry(q, expected_ids);
+
+  log_queue_unref(q);
+  unlink(filename);
+  g_queue_free(expected_ids);
+  disk_queue_options_destroy(&options);
+}
+
 static void
 testcase_diskbuffer_restart_corrupted(void)
 {
@@ -558,6 +932,15 @@ main(void)
 
   testcase_ack_and_rewind_messages();
   testcase_with_threads();
+  testcase_group_commit();
+  testcase_group_commit_with_overflow();
+  testcase_group_commit_drops_only_what_does_not_fit();
+  testcase_mmap_ring_wraparound();
+  testcase_segmented_ring_wraparound();
+#if SYSLOG_NG_ENABLE_LZ4
+  testcase_compressed_records();
+#endif
+  testcase_overflow_replay();
 
   testcase_diskq_statistics((diskq_tester_parameters_t)
   {
@@ -47,6 +47,11 @@ static CfgLexerKeyword http_keywords[] =
   { "peer_verify",  KW_PEER_VERIFY },
   { "timeout",      KW_TIMEOUT },
   { "tls",          KW_TLS },
+  { "body_prefix",  KW_BODY_PREFIX },
+  { "body_suffix",  KW_BODY_SUFFIX },
+  { "delimiter",    KW_DELIMITER },
+  { "content_compression", KW_CONTENT_COMPRESSION },
+  { "max_in_flight", KW_MAX_IN_FLIGHT },
   { NULL }
 };
 
@@ -27,12 +27,17 @@
 #define METHOD_TYPE_POST 1
 #define METHOD_TYPE_PUT  2
 
+#define HTTP_COMPRESSION_NONE    0
+#define HTTP_COMPRESSION_GZIP    1
+#define HTTP_COMPRESSION_DEFLATE 2
+
 #include "logthrdestdrv.h"
 
+#include <curl/curl.h>
+
 typedef struct
 {
   LogThrDestDriver super;
-  gchar *curl;
   gchar *url;
   gchar *user;
   gchar *password;
@@ -48,9 +53,30 @@ typedef struct
   short int method_type;
   glong timeout;
   LogTemplate *body_template;
+  gchar *body_prefix;
+  gchar *body_suffix;
+  gchar *delimiter;
+  gint content_compression;
+  gint max_in_flight;
   LogTemplateOptions template_options;
 } HTTPDestinationDriver;
 
+typedef struct
+{
+  LogThrDestWorker super;
+  CURL *curl;
+  GString *request_body;
+  GString *compressed_body;
+  struct curl_slist *request_headers;
+
+  /* used with max-in-flight() > 1 */
+  CURLM *multi;
+  struct iv_timer multi_timer;
+  GQueue *requests_in_flight;
+  GQueue *idle_requests;
+  GList *sockets;
+} HTTPDestinationWorker;
+
 gboolean http_dd_init(LogPipe *s);
 gboolean http_dd_deinit(LogPipe *s);
 LogDriver *http_dd_new(GlobalConfig *cfg);
@@ -61,6 +87,11 @@ void http_dd_set_method(LogDriver *d, const gchar *method);
 void http_dd_set_user_agent(LogDriver *d, const gchar *user_agent);
 void http_dd_set_headers(LogDriver *d, GList *headers);
 void http_dd_set_body(LogDriver *d, LogTemplate *body);
+void http_dd_set_body_prefix(LogDriver *d, const gchar *body_prefix);
+void http_dd_set_body_suffix(LogDriver *d, const gchar *body_suffix);
+void http_dd_set_delimiter(LogDriver *d, const gchar *delimiter);
+gboolean http_dd_set_content_compression(LogDriver *d, const gchar *compression);
+void http_dd_set_max_in_flight(LogDriver *d, gint max_in_flight);
 void http_dd_set_ca_dir(LogDriver *d, const gchar *ca_dir);
 void http_dd_set_ca_file(LogDriver *d, const gchar *ca_file);
 void http_dd_set_cert_file(LogDriver *d, const gchar *cert_file);
@@ -21,10 +21,12 @@
  */
 
 #include <curl/curl.h>
+#include <zlib.h>
 
 #include "syslog-names.h"
 #include "http-plugin.h"
 #include "scratch-buffers.h"
+#include "timeutils.h"
 
 static const gchar *
 _format_persist_name(const LogPipe *s)
@@ -59,43 +61,9 @@ _http_write_cb(char *ptr, size_t size, size_t nmemb, void *userdata)
   return nmemb * size;
 }
 
-static void
-_thread_init(LogThrDestDriver *s)
-{
-  HTTPDestinationDriver *self = (HTTPDestinationDriver *) s;
-
-  curl_version_info_data *curl_info = curl_version_info(CURLVERSION_NOW);
-  if (!self->user_agent)
-    self->user_agent = g_strdup_printf("syslog-ng %s/libcurl %s",
-                                       SYSLOG_NG_VERSION, curl_info->version);
-}
-
-static void
-_thread_deinit(LogThrDestDriver *s)
-{
-}
-
-static gboolean
-_connect(LogThrDestDriver *s)
-{
-  return TRUE;
-}
-
-static void
-_disconnect(LogThrDestDriver *s)
-{
-}
-
-static void
-_add_custom_curl_header(gpointer data, gpointer curl_headers)
-{
-  curl_headers = curl_slist_append((struct curl_slist *)curl_headers, data);
-}
-
 static struct curl_slist *
-_get_curl_headers(HTTPDestinationDriver *self, LogMessage *msg)
+_add_message_headers(struct curl_slist *curl_headers, LogMessage *msg)
 {
-  struct curl_slist *curl_headers = NULL;
   gchar header_host[128] = {0};
   gchar header_program[32] = {0};
   gchar header_facility[32] = {0};
@@ -117,7 +85,23 @@ _get_curl_headers(HTTPDestinationDriver *self, LogMessage *msg)
              "X-Syslog-Level: %s", syslog_name_lookup_name_by_value(msg->pri & LOG_PRIMASK, sl_levels));
   curl_headers = curl_slist_append(curl_headers, header_level);
 
-  g_list_foreach(self->headers, _add_custom_curl_header, curl_headers);
+  return curl_headers;
+}
+
+/* the X-Syslog-* headers describe a single message, they are omitted when
+ * the messages are batched */
+static struct curl_slist *
+_get_curl_headers(HTTPDestinationDriver *self, LogMessage *msg)
+{
+  struct curl_slist *curl_headers = NULL;
+  GList *l;
+
+  if (self->super.batch_lines <= 1)
+    curl_headers = _add_message_headers(curl_headers, msg);
+
+  /* curl_slist_append() returns a new list if it was empty */
+  for (l = self->headers; l; l = l->next)
+    curl_headers = curl_slist_append(curl_headers, l->data);
 
   return curl_headers;
 }
@@ -180,57 +164,52 @@ gint _http_trace(CURL *handle, curl_infotype type,
 }
 
 static void
-_set_curl_opt(HTTPDestinationDriver *self)
+_set_curl_opt(HTTPDestinationWorker *worker, CURL *curl)
 {
-  curl_easy_reset(self->curl);
+  HTTPDestinationDriver *self = (HTTPDestinationDriver *) worker->super.owner;
+
+  curl_easy_reset(curl);
 
-  curl_easy_setopt(self->curl, CURLOPT_WRITEFUNCTION, _http_write_cb);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, _http_write_cb);
 
-  curl_easy_setopt(self->curl, CURLOPT_URL, self->url);
+  curl_easy_setopt(curl, CURLOPT_URL, self->url);
 
   if (self->user)
-    curl_easy_setopt(self->curl, CURLOPT_USERNAME, self->user);
+    curl_easy_setopt(curl, CURLOPT_USERNAME, self->user);
 
   if (self->password)
-    curl_easy_setopt(self->curl, CURLOPT_PASSWORD, self->password);
+    curl_easy_setopt(curl, CURLOPT_PASSWORD, self->password);
 
   if (self->user_agent)
-    curl_easy_setopt(self->curl, CURLOPT_USERAGENT, self->user_agent);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, self->user_agent);
 
   if (self->ca_dir)
-    curl_easy_setopt(self->curl, CURLOPT_CAPATH, self->ca_dir);
+    curl_easy_setopt(curl, CURLOPT_CAPATH, self->ca_dir);
 
   if (self->ca_file)
-    curl_easy_setopt(self->curl, CURLOPT_CAINFO, self->ca_file);
+    curl_easy_setopt(curl, CURLOPT_CAINFO, self->ca_file);
 
   if (self->cert_file)
-    curl_easy_setopt(self->curl, CURLOPT_SSLCERT, self->cert_file);
+    curl_easy_setopt(curl, CURLOPT_SSLCERT, self->cert_file);
 
   if (self->key_file)
-    curl_easy_setopt(self->curl, CURLOPT_SSLKEY, self->key_file);
+    curl_easy_setopt(curl, CURLOPT_SSLKEY, self->key_file);
 
   if (self->ciphers)
-    curl_easy_setopt(self->curl, CURLOPT_SSL_CIPHER_LIST, self->ciphers);
+    curl_easy_setopt(curl, CURLOPT_SSL_CIPHER_LIST, self->ciphers);
 
-  curl_easy_setopt(self->curl, CURLOPT_SSLVERSION, self->ssl_version);
+  curl_easy_setopt(curl, CURLOPT_SSLVERSION, self->ssl_version);
 
-  curl_easy_setopt(self->curl, CURLOPT_SSL_VERIFYHOST, self->peer_verify ? 2L : 0L);
-  curl_easy_setopt(self->curl, CURLOPT_SSL_VERIFYPEER, self->peer_verify ? 1L : 0L);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, self->peer_verify ? 2L : 0L);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, self->peer_verify ? 1L : 0L);
 
-  curl_easy_setopt(self->curl, CURLOPT_DEBUGFUNCTION, _http_trace);
-  curl_easy_setopt(self->curl, CURLOPT_VERBOSE, 1L);
+  curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, _http_trace);
+  curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
 
-  curl_easy_setopt(self->curl, CURLOPT_TIMEOUT, self->timeout);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT, self->timeout);
 
   if (self->method_type == METHOD_TYPE_PUT)
-    curl_easy_setopt(self->curl, CURLOPT_CUSTOMREQUEST, "PUT");
-}
-
-static void
-_set_payload(HTTPDestinationDriver *self, struct curl_slist *curl_headers, const gchar *body)
-{
-  curl_easy_setopt(self->curl, CURLOPT_HTTPHEADER, curl_headers);
-  curl_easy_setopt(self->curl, CURLOPT_POSTFIELDS, body);
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
 }
 
 static worker_insert_result_t
@@ -260,36 +239,537 @@ _map_http_status_to_worker_status(glong http_code)
   return retval;
 }
 
+static const gchar *
+_get_content_encoding_header(HTTPDestinationDriver *self)
+{
+  switch (self->content_compression)
+    {
+    case HTTP_COMPRESSION_GZIP:
+      return "Content-Encoding: gzip";
+    case HTTP_COMPRESSION_DEFLATE:
+      return "Content-Encoding: deflate";
+    default:
+      return NULL;
+    }
+}
+
 static worker_insert_result_t
-_insert(LogThrDestDriver *s, LogMessage *msg)
+_insert(LogThrDestWorker *s, LogMessage *msg)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) s;
+  HTTPDestinationDriver *owner = (HTTPDestinationDriver *) s->owner;
+
+  if (s->batch.lines == 0)
+    {
+      g_string_truncate(self->request_body, 0);
+      if (owner->body_prefix)
+        g_string_append(self->request_body, owner->body_prefix);
+
+      curl_slist_free_all(self->request_headers);
+      self->request_headers = _get_curl_headers(owner, msg);
+    }
+  else
+    {
+      g_string_append(self->request_body, owner->delimiter);
+    }
+
+  g_string_append(self->request_body, _get_body(owner, msg));
+  s->batch.bytes = self->request_body->len;
+
+  return WORKER_INSERT_RESULT_QUEUED;
+}
+
+static gboolean
+_compress_body(HTTPDestinationWorker *self, gint compression)
+{
+  z_stream stream;
+  gint window_bits = (compression == HTTP_COMPRESSION_GZIP) ? MAX_WBITS + 16 : MAX_WBITS;
+  gint rc;
+
+  memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return FALSE;
+
+  g_string_set_size(self->compressed_body, deflateBound(&stream, self->request_body->len));
+
+  stream.next_in = (Bytef *) self->request_body->str;
+  stream.avail_in = self->request_body->len;
+  stream.next_out = (Bytef *) self->compressed_body->str;
+  stream.avail_out = self->compressed_body->len;
+
+  rc = deflate(&stream, Z_FINISH);
+  deflateEnd(&stream);
+
+  if (rc != Z_STREAM_END)
+    return FALSE;
+
+  g_string_set_size(self->compressed_body, stream.total_out);
+  return TRUE;
+}
+
+/* returns the buffer to be sent, either request_body or compressed_body */
+static GString *
+_finalize_request_body(HTTPDestinationWorker *self)
+{
+  HTTPDestinationDriver *owner = (HTTPDestinationDriver *) self->super.owner;
+
+  if (owner->body_suffix)
+    g_string_append(self->request_body, owner->body_suffix);
+
+  if (owner->content_compression == HTTP_COMPRESSION_NONE)
+    return self->request_body;
+
+  if (!_compress_body(self, owner->content_compression))
+    {
+      msg_error("http: error compressing request body, sending it uncompressed",
+                log_pipe_location_tag(&owner->super.super.super.super));
+      return self->request_body;
+    }
+
+  self->request_headers = curl_slist_append(self->request_headers,
+                                            _get_content_encoding_header(owner));
+  return self->compressed_body;
+}
+
+static worker_insert_result_t
+_flush(LogThrDestWorker *s)
 {
   CURLcode ret;
   worker_insert_result_t retval;
 
-  HTTPDestinationDriver *self = (HTTPDestinationDriver *) s;
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) s;
+  HTTPDestinationDriver *owner = (HTTPDestinationDriver *) s->owner;
+  GString *body = _finalize_request_body(self);
 
-  struct curl_slist *curl_headers = _get_curl_headers(self, msg);
-  const gchar *body = _get_body(self, msg);
-  _set_payload(self, curl_headers, body);
+  curl_easy_setopt(self->curl, CURLOPT_POSTFIELDS, body->str);
+  curl_easy_setopt(self->curl, CURLOPT_POSTFIELDSIZE, (long) body->len);
+  curl_easy_setopt(self->curl, CURLOPT_HTTPHEADER, self->request_headers);
 
   if ((ret = curl_easy_perform(self->curl)) != CURLE_OK)
     {
       msg_error("curl: error sending HTTP request",
                 evt_tag_str("error", curl_easy_strerror(ret)),
-                log_pipe_location_tag(&s->super.super.super));
+                evt_tag_int("worker_index", s->worker_index),
+                evt_tag_int("batch_size", s->batch.lines),
+                log_pipe_location_tag(&owner->super.super.super.super));
+
+      retval = WORKER_INSERT_RESULT_NOT_CONNECTED;
+    }
+  else
+    {
+      glong http_code = 0;
+
+      curl_easy_getinfo(self->curl, CURLINFO_RESPONSE_CODE, &http_code);
+      retval = _map_http_status_to_worker_status(http_code);
+    }
+
+  curl_slist_free_all(self->request_headers);
+  self->request_headers = NULL;
+
+  return retval;
+}
+
+/*
+ * Asynchronous mode (max-in-flight() > 1)
+ *
+ * Each flushed batch becomes an HTTPRequest with its own easy handle, which
+ * is added to the curl multi handle of the worker.  The sockets and the
+ * timeout of the multi handle are driven by the ivykis loop of the worker
+ * thread.  Responses may arrive in any order, but batches are reported to
+ * LogThrDestWorker in the order they were sent, as the backlog of the
+ * queue can only be acked from its head.
+ */
+
+typedef struct
+{
+  HTTPDestinationWorker *worker;
+  CURL *curl;
+  GString *body;
+  struct curl_slist *headers;
+  gint lines;
+  gboolean done;
+  CURLcode curl_result;
+  glong http_code;
+} HTTPRequest;
+
+typedef struct
+{
+  HTTPDestinationWorker *worker;
+  struct iv_fd fd;
+} HTTPSocket;
 
-      curl_slist_free_all(curl_headers);
+static HTTPRequest *
+_request_new(HTTPDestinationWorker *worker)
+{
+  HTTPRequest *self;
+  CURL *curl = curl_easy_init();
+
+  if (!curl)
+    return NULL;
+
+  self = g_new0(HTTPRequest, 1);
+  self->worker = worker;
+  self->curl = curl;
+  self->body = g_string_sized_new(1024);
 
+  _set_curl_opt(worker, curl);
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, self);
+#ifdef CURLOPT_PIPEWAIT
+  curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+  return self;
+}
+
+static void
+_request_free(HTTPRequest *self)
+{
+  curl_easy_cleanup(self->curl);
+  curl_slist_free_all(self->headers);
+  g_string_free(self->body, TRUE);
+  g_free(self);
+}
+
+/* easy handles are kept around, so that their connections can be reused */
+static void
+_release_request(HTTPDestinationWorker *self, HTTPRequest *request)
+{
+  curl_slist_free_all(request->headers);
+  request->headers = NULL;
+  request->done = FALSE;
+  g_queue_push_tail(self->idle_requests, request);
+}
+
+static HTTPRequest *
+_acquire_request(HTTPDestinationWorker *self)
+{
+  HTTPRequest *request = g_queue_pop_head(self->idle_requests);
+
+  if (request)
+    return request;
+
+  return _request_new(self);
+}
+
+static void
+_abort_requests_in_flight(HTTPDestinationWorker *self)
+{
+  HTTPRequest *request;
+
+  while ((request = g_queue_pop_head(self->requests_in_flight)))
+    {
+      curl_multi_remove_handle(self->multi, request->curl);
+      _release_request(self, request);
+    }
+}
+
+static worker_insert_result_t
+_get_request_result(HTTPRequest *request)
+{
+  HTTPDestinationWorker *worker = request->worker;
+
+  if (request->curl_result != CURLE_OK)
+    {
+      msg_error("curl: error sending HTTP request",
+                evt_tag_str("error", curl_easy_strerror(request->curl_result)),
+                evt_tag_int("worker_index", worker->super.worker_index),
+                evt_tag_int("batch_size", request->lines),
+                log_pipe_location_tag(&worker->super.owner->super.super.super));
       return WORKER_INSERT_RESULT_NOT_CONNECTED;
     }
 
-  glong http_code = 0;
-  curl_easy_getinfo (self->curl, CURLINFO_RESPONSE_CODE, &http_code);
-  retval = _map_http_status_to_worker_status(http_code);
+  return _map_http_status_to_worker_status(request->http_code);
+}
 
-  curl_slist_free_all(curl_headers);
+static void
+_complete_requests_in_order(HTTPDestinationWorker *self)
+{
+  HTTPRequest *request;
 
-  return retval;
+  while ((request = g_queue_peek_head(self->requests_in_flight)) && request->done)
+    {
+      worker_insert_result_t result = _get_request_result(request);
+      gint lines = request->lines;
+
+      g_queue_pop_head(self->requests_in_flight);
+      _release_request(self, request);
+
+      /* may disconnect the worker, which aborts the rest of the requests */
+      log_threaded_dest_worker_complete_batch(&self->super, lines, result);
+    }
+}
+
+static void
+_check_multi_info(HTTPDestinationWorker *self)
+{
+  CURLMsg *msg;
+  gint msgs_left;
+
+  while ((msg = curl_multi_info_read(self->multi, &msgs_left)))
+    {
+      HTTPRequest *request = NULL;
+
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (gchar **) &request);
+      request->curl_result = msg->data.result;
+      request->http_code = 0;
+      curl_easy_getinfo(request->curl, CURLINFO_RESPONSE_CODE, &request->http_code);
+      request->done = TRUE;
+      curl_multi_remove_handle(self->multi, request->curl);
+    }
+
+  _complete_requests_in_order(self);
+}
+
+static void
+_socket_action(HTTPDestinationWorker *self, curl_socket_t fd, gint events)
+{
+  gint running;
+
+  curl_multi_socket_action(self->multi, fd, events, &running);
+  _check_multi_info(self);
+}
+
+static void
+_on_socket_readable(gpointer cookie)
+{
+  HTTPSocket *sock = (HTTPSocket *) cookie;
+
+  _socket_action(sock->worker, sock->fd.fd, CURL_CSELECT_IN);
+}
+
+static void
+_on_socket_writable(gpointer cookie)
+{
+  HTTPSocket *sock = (HTTPSocket *) cookie;
+
+  _socket_action(sock->worker, sock->fd.fd, CURL_CSELECT_OUT);
+}
+
+static void
+_on_multi_timer_expired(gpointer cookie)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) cookie;
+
+  _socket_action(self, CURL_SOCKET_TIMEOUT, 0);
+}
+
+static void
+_socket_free(HTTPDestinationWorker *self, HTTPSocket *sock)
+{
+  iv_fd_unregister(&sock->fd);
+  self->sockets = g_list_remove(self->sockets, sock);
+  g_free(sock);
+}
+
+static gint
+_multi_socket_cb(CURL *easy, curl_socket_t fd, gint what, gpointer user_data, gpointer socket_data)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) user_data;
+  HTTPSocket *sock = (HTTPSocket *) socket_data;
+
+  if (what == CURL_POLL_REMOVE)
+    {
+      if (sock)
+        _socket_free(self, sock);
+      return 0;
+    }
+
+  if (!sock)
+    {
+      sock = g_new0(HTTPSocket, 1);
+      sock->worker = self;
+      IV_FD_INIT(&sock->fd);
+      sock->fd.fd = fd;
+      sock->fd.cookie = sock;
+      iv_fd_register(&sock->fd);
+      self->sockets = g_list_prepend(self->sockets, sock);
+      curl_multi_assign(self->multi, fd, sock);
+    }
+
+  iv_fd_set_handler_in(&sock->fd, (what & CURL_POLL_IN) ? _on_socket_readable : NULL);
+  iv_fd_set_handler_out(&sock->fd, (what & CURL_POLL_OUT) ? _on_socket_writable : NULL);
+  return 0;
+}
+
+static gint
+_multi_timer_cb(CURLM *multi, glong timeout_ms, gpointer user_data)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) user_data;
+
+  if (iv_timer_registered(&self->multi_timer))
+    iv_timer_unregister(&self->multi_timer);
+
+  if (timeout_ms < 0)
+    return 0;
+
+  iv_validate_now();
+  self->multi_timer.expires = iv_now;
+  timespec_add_msec(&self->multi_timer.expires, timeout_ms);
+  iv_timer_register(&self->multi_timer);
+  return 0;
+}
+
+static worker_insert_result_t
+_flush_async(LogThrDestWorker *s)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) s;
+  HTTPDestinationDriver *owner = (HTTPDestinationDriver *) s->owner;
+  HTTPRequest *request = self->multi ? _acquire_request(self) : NULL;
+  GString *body;
+  CURLMcode ret;
+
+  if (!request)
+    {
+      msg_error("curl: cannot initialize libcurl",
+                evt_tag_int("worker_index", s->worker_index),
+                log_pipe_location_tag(&owner->super.super.super.super));
+      return WORKER_INSERT_RESULT_NOT_CONNECTED;
+    }
+
+  /* the request takes over the buffers of the batch, curl doesn't copy
+   * the body */
+  body = _finalize_request_body(self);
+  if (body == self->request_body)
+    self->request_body = request->body;
+  else
+    self->compressed_body = request->body;
+  request->body = body;
+
+  request->headers = self->request_headers;
+  self->request_headers = NULL;
+  request->lines = s->batch.lines;
+
+  curl_easy_setopt(request->curl, CURLOPT_POSTFIELDS, request->body->str);
+  curl_easy_setopt(request->curl, CURLOPT_POSTFIELDSIZE, (long) request->body->len);
+  curl_easy_setopt(request->curl, CURLOPT_HTTPHEADER, request->headers);
+
+  if ((ret = curl_multi_add_handle(self->multi, request->curl)) != CURLM_OK)
+    {
+      msg_error("curl: error sending HTTP request",
+                evt_tag_str("error", curl_multi_strerror(ret)),
+                evt_tag_int("worker_index", s->worker_index),
+                evt_tag_int("batch_size", s->batch.lines),
+                log_pipe_location_tag(&owner->super.super.super.super));
+      _release_request(self, request);
+      return WORKER_INSERT_RESULT_NOT_CONNECTED;
+    }
+
+  g_queue_push_tail(self->requests_in_flight, request);
+  return WORKER_INSERT_RESULT_PENDING;
+}
+
+static void
+_disconnect_async(LogThrDestWorker *s)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) s;
+
+  _abort_requests_in_flight(self);
+}
+
+/* the multi handle and its sockets belong to the ivykis loop of the
+ * worker thread */
+static void
+_thread_init_async(LogThrDestWorker *s)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) s;
+
+  IV_TIMER_INIT(&self->multi_timer);
+  self->multi_timer.cookie = self;
+  self->multi_timer.handler = _on_multi_timer_expired;
+
+  self->multi = curl_multi_init();
+  curl_multi_setopt(self->multi, CURLMOPT_SOCKETFUNCTION, _multi_socket_cb);
+  curl_multi_setopt(self->multi, CURLMOPT_SOCKETDATA, self);
+  curl_multi_setopt(self->multi, CURLMOPT_TIMERFUNCTION, _multi_timer_cb);
+  curl_multi_setopt(self->multi, CURLMOPT_TIMERDATA, self);
+#ifdef CURLPIPE_MULTIPLEX
+  curl_multi_setopt(self->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+}
+
+static void
+_thread_deinit_async(LogThrDestWorker *s)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) s;
+
+  _abort_requests_in_flight(self);
+  curl_multi_cleanup(self->multi);
+  self->multi = NULL;
+
+  while (self->sockets)
+    _socket_free(self, (HTTPSocket *) self->sockets->data);
+
+  if (iv_timer_registered(&self->multi_timer))
+    iv_timer_unregister(&self->multi_timer);
+
+  g_queue_foreach(self->idle_requests, (GFunc) _request_free, NULL);
+  g_queue_clear(self->idle_requests);
+}
+
+static gboolean
+_connect(LogThrDestWorker *s)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) s;
+
+  if (self->curl)
+    return TRUE;
+
+  if (!(self->curl = curl_easy_init()))
+    {
+      msg_error("curl: cannot initialize libcurl",
+                evt_tag_int("worker_index", s->worker_index),
+                log_pipe_location_tag(&s->owner->super.super.super));
+      return FALSE;
+    }
+
+  _set_curl_opt(self, self->curl);
+  return TRUE;
+}
+
+static void
+_worker_free(LogThrDestWorker *s)
+{
+  HTTPDestinationWorker *self = (HTTPDestinationWorker *) s;
+
+  if (self->curl)
+    curl_easy_cleanup(self->curl);
+  curl_slist_free_all(self->request_headers);
+  g_string_free(self->request_body, TRUE);
+  g_string_free(self->compressed_body, TRUE);
+  g_queue_free(self->requests_in_flight);
+  g_queue_free(self->idle_requests);
+}
+
+static LogThrDestWorker *
+_construct_worker(LogThrDestDriver *s, gint worker_index)
+{
+  HTTPDestinationWorker *self = g_new0(HTTPDestinationWorker, 1);
+  HTTPDestinationDriver *owner = (HTTPDestinationDriver *) s;
+
+  log_threaded_dest_worker_init_instance(&self->super, s, worker_index);
+  self->super.connect = _connect;
+  self->super.insert = _insert;
+  self->super.flush = _flush;
+  self->super.free_fn = _worker_free;
+
+  if (owner->max_in_flight > 1)
+    {
+      self->super.thread_init = _thread_init_async;
+      self->super.thread_deinit = _thread_deinit_async;
+      self->super.disconnect = _disconnect_async;
+      self->super.flush = _flush_async;
+      self->super.max_pending_batches = owner->max_in_flight;
+    }
+
+  self->requests_in_flight = g_queue_new();
+  self->idle_requests = g_queue_new();
+
+  self->request_body = g_string_sized_new(1024);
+  self->compressed_body = g_string_sized_new(1024);
+
+  return &self->super;
 }
 
 void
@@ -363,6 +843,58 @@ http_dd_set_body(LogDriver *d, LogTemplate *body)
   self->body_template = log_template_ref(body);
 }
 
+void
+http_dd_set_body_prefix(LogDriver *d, const gchar *body_prefix)
+{
+  HTTPDestinationDriver *self = (HTTPDestinationDriver *) d;
+
+  g_free(self->body_prefix);
+  self->body_prefix = g_strdup(body_prefix);
+}
+
+void
+http_dd_set_body_suffix(LogDriver *d, const gchar *body_suffix)
+{
+  HTTPDestinationDriver *self = (HTTPDestinationDriver *) d;
+
+  g_free(self->body_suffix);
+  self->body_suffix = g_strdup(body_suffix);
+}
+
+void
+http_dd_set_delimiter(LogDriver *d, const gchar *delimiter)
+{
+  HTTPDestinationDriver *self = (HTTPDestinationDriver *) d;
+
+  g_free(self->delimiter);
+  self->delimiter = g_strdup(delimiter);
+}
+
+gboolean
+http_dd_set_content_compression(LogDriver *d, const gchar *compression)
+{
+  HTTPDestinationDriver *self = (HTTPDestinationDriver *) d;
+
+  if (g_ascii_strcasecmp(compression, "gzip") == 0)
+    self->content_compression = HTTP_COMPRESSION_GZIP;
+  else if (g_ascii_strcasecmp(compression, "deflate") == 0)
+    self->content_compression = HTTP_COMPRESSION_DEFLATE;
+  else if (g_ascii_strcasecmp(compression, "none") == 0)
+    self->content_compression = HTTP_COMPRESSION_NONE;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+void
+http_dd_set_max_in_flight(LogDriver *d, gint max_in_flight)
+{
+  HTTPDestinationDriver *self = (HTTPDestinationDriver *) d;
+
+  self->max_in_flight = max_in_flight;
+}
+
 LogTemplateOptions *
 http_dd_get_template_options(LogDriver *d)
 {
@@ -502,19 +1034,18 @@ http_dd_init(LogPipe *s)
 
   log_template_options_init(&self->template_options, cfg);
 
-  if (!(self->curl = curl_easy_init()))
-    {
-      msg_error("curl: cannot initialize libcurl",
-                log_pipe_location_tag(s));
-      return FALSE;
-    }
-
   if (!self->url)
     {
       self->url = g_strdup(HTTP_DEFAULT_URL);
     }
 
-  _set_curl_opt(self);
+  if (!self->user_agent)
+    {
+      curl_version_info_data *curl_info = curl_version_info(CURLVERSION_NOW);
+
+      self->user_agent = g_strdup_printf("syslog-ng %s/libcurl %s",
+                                         SYSLOG_NG_VERSION, curl_info->version);
+    }
 
   return log_threaded_dest_driver_start(s);
 }
@@ -532,7 +1063,6 @@ http_dd_free(LogPipe *s)
 
   log_template_options_destroy(&self->template_options);
 
-  curl_easy_cleanup(self->curl);
   curl_global_cleanup();
 
   g_free(self->url);
@@ -544,6 +1074,9 @@ http_dd_free(LogPipe *s)
   g_free(self->cert_file);
   g_free(self->key_file);
   g_free(self->ciphers);
+  g_free(self->body_prefix);
+  g_free(self->body_suffix);
+  g_free(self->delimiter);
   g_list_free_full(self->headers, g_free);
 
   log_threaded_dest_driver_free(s);
@@ -559,11 +1092,7 @@ http_dd_new(GlobalConfig *cfg)
 
   self->super.super.super.super.init = http_dd_init;
   self->super.super.super.super.deinit = http_dd_deinit;
-  self->super.worker.thread_init = _thread_init;
-  self->super.worker.thread_deinit = _thread_deinit;
-  self->super.worker.connect = _connect;
-  self->super.worker.disconnect = _disconnect;
-  self->super.worker.insert = _insert;
+  self->super.construct_worker = _construct_worker;
   self->super.super.super.super.generate_persist_name = _format_persist_name;
   self->super.format.stats_instance = _format_stats_instance;
   self->super.stats_source = SCS_HTTP;
@@ -573,6 +1102,9 @@ http_dd_new(GlobalConfig *cfg)
 
   self->ssl_version = CURL_SSLVERSION_DEFAULT;
   self->peer_verify = TRUE;
+  self->delimiter = g_strdup("\n");
+  self->content_compression = HTTP_COMPRESSION_NONE;
+  self->max_in_flight = 1;
 
   return &self->super.super.super;
 }
@@ -186,6 +186,80 @@ test_json_parser_works_with_templates(void)
   log_msg_unref(msg);
 }
 
+#define MANY_KEYS 200
+
+static GString *
+_format_json_with_many_keys(const gchar *prefix, gint num_keys)
+{
+  GString *json = g_string_new("{");
+  gint i;
+
+  for (i = 0; i < num_keys; i++)
+    g_string_append_printf(json, "%s'%s%03d': 'value%d'", i ? ", " : "", prefix, i, i);
+  g_string_append_c(json, '}');
+  return json;
+}
+
+static void
+assert_log_message_has_keys(LogMessage *msg, const gchar *prefix, gint first, gint last)
+{
+  gchar name[32], value[32];
+  gint i;
+
+  for (i = first; i < last; i++)
+    {
+      g_snprintf(name, sizeof(name), "%s%03d", prefix, i);
+      g_snprintf(value, sizeof(value), "value%d", i);
+      assert_log_message_value(msg, log_msg_get_value_handle(name), value);
+    }
+}
+
+static void
+test_json_parser_lookups_with_many_keys(void)
+{
+  GString *json = _format_json_with_many_keys("key", MANY_KEYS);
+  LogMessage *msg;
+  gchar name[32];
+  gint i;
+
+  msg = parse_json_into_log_message(json->str);
+  assert_log_message_has_keys(msg, "key", 0, MANY_KEYS);
+  assert_log_message_value(msg, log_msg_get_value_handle("key-not-set"), "");
+
+  /* unset every other key, the rest must still be found */
+  for (i = 0; i < MANY_KEYS; i += 2)
+    {
+      g_snprintf(name, sizeof(name), "key%03d", i);
+      log_msg_unset_value_by_name(msg, name);
+    }
+  for (i = 0; i < MANY_KEYS; i++)
+    {
+      g_snprintf(name, sizeof(name), "key%03d", i);
+      if (i % 2 == 0)
+        assert_log_message_value(msg, log_msg_get_value_handle(name), "");
+      else
+        assert_log_message_has_keys(msg, "key", i, i + 1);
+    }
+
+  /* doubling the number of keys grows the table and rebuilds the index */
+  for (i = 0; i < MANY_KEYS; i++)
+    {
+      gchar value[32];
+
+      g_snprintf(name, sizeof(name), "more%03d", i);
+      g_snprintf(value, sizeof(value), "value%d", i);
+      log_msg_set_value_by_name(msg, name, value, -1);
+    }
+  log_msg_set_value_by_name(msg, "key000", "value0", -1);
+  assert_log_message_has_keys(msg, "more", 0, MANY_KEYS);
+  assert_log_message_has_keys(msg, "key", 0, 2);
+  assert_log_message_value(msg, log_msg_get_value_handle("key002"), "");
+  assert_log_message_has_keys(msg, "key", MANY_KEYS - 1, MANY_KEYS);
+
+  log_msg_unref(msg);
+  g_string_free(json, TRUE);
+}
+
 static void
 test_json_parser(void)
 {
@@ -198,6 +272,7 @@ test_json_parser(void)
   JSON_PARSER_TESTCASE(test_json_parser_fails_for_non_object_top_element);
   JSON_PARSER_TESTCASE(test_json_parser_extracts_subobjects_if_extract_prefix_is_specified);
   JSON_PARSER_TESTCASE(test_json_parser_works_with_templates);
+  JSON_PARSER_TESTCASE(test_json_parser_lookups_with_many_keys);
 }
 
 int
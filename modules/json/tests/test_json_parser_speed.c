@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2014 Balabit
+ * Copyright (c) 2014 Balazs Scheidler <bazsi@balabit.hu>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As an additional exemption you are allowed to compile & link against the
+ * OpenSSL libraries as published by the OpenSSL project. See the file
+ * COPYING for details.
+ */
+#include "testutils.h"
+#include "json-parser.h"
+#include "apphook.h"
+#include "stopwatch.h"
+#include "cfg.h"
+
+#include <string.h>
+
+static LogMessage *
+parse_json_into_log_message(LogParser *json_parser, const gchar *json)
+{
+  LogMessage *msg;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+
+  msg = log_msg_new_empty();
+  log_msg_set_value(msg, LM_V_MESSAGE, json, -1);
+  assert_true(log_parser_process_message(json_parser, &msg, &path_options),
+              "json-parser failed to parse its input, json=%s", json);
+  return msg;
+}
+
+#define PERFTEST_KEYS 200
+#define PERFTEST_ITERATIONS 10000
+
+static void
+test_json_parser_and_format_json_performance(void)
+{
+  GString *json = g_string_new("{");
+  GString *result = g_string_sized_new(16384);
+  LogParser *json_parser = json_parser_new(NULL);
+  LogTemplate *template;
+  LogMessage *msg;
+  gint i;
+
+  for (i = 0; i < PERFTEST_KEYS; i++)
+    g_string_append_printf(json, "%s'key%03d': 'value%d'", i ? ", " : "", i, i);
+  g_string_append_c(json, '}');
+
+  configuration = cfg_new_snippet();
+  cfg_load_module(configuration, "json-plugin");
+  template = log_template_new(configuration, NULL);
+  assert_true(log_template_compile(template, "$(format-json --key key*)", NULL),
+              "format-json template failed to compile");
+
+  start_stopwatch();
+  for (i = 0; i < PERFTEST_ITERATIONS; i++)
+    {
+      msg = parse_json_into_log_message(json_parser, json->str);
+      g_string_truncate(result, 0);
+      log_template_format(template, msg, NULL, LTZ_LOCAL, 0, NULL, result);
+      log_msg_unref(msg);
+    }
+  stop_stopwatch_and_display_result(PERFTEST_ITERATIONS, "json-parser and format-json, %d keys", PERFTEST_KEYS);
+
+  assert_true(strstr(result->str, "\"key199\":\"value199\"") != NULL,
+              "format-json output is missing the last key: %s", result->str);
+
+  log_template_unref(template);
+  log_pipe_unref(&json_parser->super);
+  cfg_free(configuration);
+  configuration = NULL;
+  g_string_free(result, TRUE);
+  g_string_free(json, TRUE);
+}
+
+int
+main(int argc G_GNUC_UNUSED, char *argv[] G_GNUC_UNUSED)
+{
+  app_startup();
+
+  test_json_parser_and_format_json_performance();
+  app_shutdown();
+  return 0;
+}
@@ -1103,7 +1103,7 @@ log_msg_parse_legacy(const MsgFormatOptions *parse_options,
       self->timestamps[LM_TS_STAMP] = self->timestamps[LM_TS_RECVD];
     }
 
-  if (parse_options->flags & LP_SANITIZE_UTF8 && !g_utf8_validate((gchar *) src, left, NULL))
+  if (parse_options->flags & LP_SANITIZE_UTF8 && !utf8_validate((gchar *) src, left))
     {
       GString sanitized_message;
       gchar buf[left * 6 + 1];
@@ -1127,7 +1127,7 @@ log_msg_parse_legacy(const MsgFormatOptions *parse_options,
       /* we don't need revalidation if sanitize already said it was valid utf8 */
       if ((parse_options->flags & LP_VALIDATE_UTF8) &&
           ((parse_options->flags & LP_SANITIZE_UTF8) == 0) &&
-          g_utf8_validate((gchar *) src, left, NULL))
+          utf8_validate((gchar *) src, left))
         self->flags |= LF_UTF8;
     }
 
@@ -1238,7 +1238,7 @@ log_msg_parse_syslog_proto(const MsgFormatOptions *parse_options, const guchar *
       src += 3;
       left -= 3;
     }
-  else if ((parse_options->flags & LP_VALIDATE_UTF8) && g_utf8_validate((gchar *) src, left, NULL))
+  else if ((parse_options->flags & LP_VALIDATE_UTF8) && utf8_validate((gchar *) src, left))
     {
       self->flags |= LF_UTF8;
     }
@@ -26,6 +26,7 @@
 #include "find-crlf.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 struct findcrlf_params
 {
@@ -138,3 +139,25 @@ ParameterizedTest(struct findcrlf_params *params, findcrlf, test)
                 "EOM is at wrong location. msg=%s, eom_ofs=%d, eom=%s\n",
                 params->msg, (gint) params->eom_ofs, eom);
 }
+
+/* cover terminators at every offset of the vectorized code paths */
+Test(findcrlf, test_long_buffers)
+{
+  gchar msg[160];
+  gint eom_ofs;
+
+  for (eom_ofs = 0; eom_ofs < sizeof(msg); eom_ofs++)
+    {
+      memset(msg, 'a', sizeof(msg));
+
+      msg[eom_ofs] = '\r';
+      cr_assert_eq(find_cr_or_lf(msg, sizeof(msg)), msg + eom_ofs, "CR not found at offset %d", eom_ofs);
+      cr_assert_null(find_cr_or_lf(msg, eom_ofs), "CR found beyond length %d", eom_ofs);
+
+      msg[eom_ofs] = '\n';
+      cr_assert_eq(find_cr_or_lf(msg, sizeof(msg)), msg + eom_ofs, "LF not found at offset %d", eom_ofs);
+
+      msg[eom_ofs] = '\0';
+      cr_assert_null(find_cr_or_lf(msg, sizeof(msg)), "NUL did not terminate the search at offset %d", eom_ofs);
+    }
+}
@@ -46,6 +46,9 @@ MsgFormatOptions parse_options;
 #define MESSAGES_SUM (FEEDERS * MESSAGES_PER_FEEDER)
 #define TEST_RUNS 10
 
+#define STRESS_FEEDERS 8
+#define STRESS_MESSAGES_PER_FEEDER 20000
+
 GStaticMutex tlock;
 glong sum_time;
 
@@ -286,3 +289,141 @@ Test(logqueue, test_with_threads)
     }
   fprintf(stderr, "Feed speed: %.2lf\n", (double) TEST_RUNS * MESSAGES_SUM * 1000000 / sum_time);
 }
+
+typedef struct _StressFeederArgs
+{
+  LogQueue *q;
+  gint feeder_id;
+} StressFeederArgs;
+
+static gpointer
+_stress_feed(gpointer user_data)
+{
+  StressFeederArgs *args = (StressFeederArgs *) user_data;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  gchar value[32];
+  gint i;
+
+  path_options.ack_needed = TRUE;
+  iv_init();
+  main_loop_worker_thread_start(NULL);
+
+  for (i = 0; i < STRESS_MESSAGES_PER_FEEDER; i++)
+    {
+      LogMessage *msg = log_msg_new_empty();
+
+      g_snprintf(value, sizeof(value), "%d", args->feeder_id);
+      log_msg_set_value_by_name(msg, "FEEDER", value, -1);
+      g_snprintf(value, sizeof(value), "%d", i);
+      log_msg_set_value_by_name(msg, "SEQ", value, -1);
+      log_msg_add_ack(msg, &path_options);
+      msg->ack_func = test_ack;
+
+      log_queue_push_tail(args->q, msg, &path_options);
+
+      /* vary the size of the batches pushed to the wait queue */
+      if ((i % (args->feeder_id + 7)) == 0)
+        main_loop_worker_invoke_batch_callbacks();
+    }
+  main_loop_worker_invoke_batch_callbacks();
+
+  main_loop_worker_thread_stop();
+  iv_deinit();
+  return NULL;
+}
+
+static gpointer
+_stress_consume(gpointer user_data)
+{
+  LogQueue *q = (LogQueue *) user_data;
+  LogPathOptions path_options = LOG_PATH_OPTIONS_INIT;
+  gint next_seq[STRESS_FEEDERS] = { 0 };
+  gint msg_count = 0;
+  gint slept = 0;
+
+  while (msg_count < STRESS_FEEDERS * STRESS_MESSAGES_PER_FEEDER)
+    {
+      LogMessage *msg = log_queue_pop_head(q, &path_options);
+      gint feeder, seq;
+
+      if (!msg)
+        {
+          struct timespec ns = { 0, 100000 };
+
+          nanosleep(&ns, NULL);
+          if (++slept > 100000)
+            return GUINT_TO_POINTER(1);
+          continue;
+        }
+
+      feeder = atoi(log_msg_get_value_by_name(msg, "FEEDER", NULL));
+      seq = atoi(log_msg_get_value_by_name(msg, "SEQ", NULL));
+
+      /* messages of a single feeder must come out in the order they were pushed */
+      if (seq != next_seq[feeder])
+        return GUINT_TO_POINTER(1);
+      next_seq[feeder]++;
+
+      if ((msg_count % 100) == 0)
+        {
+          /* exercise the backlog on the output side while feeders are pushing */
+          log_msg_unref(msg);
+          log_queue_rewind_backlog(q, 1);
+          msg = log_queue_pop_head(q, &path_options);
+          g_assert(msg);
+        }
+      log_msg_unref(msg);
+
+      log_queue_ack_backlog(q, 1);
+      msg_count++;
+    }
+  return NULL;
+}
+
+Test(logqueue, test_lockfree_wait_queue_with_many_feeders)
+{
+  LogQueue *q;
+  GThread *feeders[STRESS_FEEDERS], *consumer;
+  StressFeederArgs args[STRESS_FEEDERS];
+  gpointer consumer_result;
+  gint i;
+
+  log_queue_set_max_threads(STRESS_FEEDERS);
+  q = log_queue_fifo_new(STRESS_FEEDERS * STRESS_MESSAGES_PER_FEEDER, NULL);
+  log_queue_set_use_backlog(q, TRUE);
+
+  StatsClusterKey sc_key;
+  stats_lock();
+  stats_cluster_logpipe_key_set(&sc_key, SCS_DESTINATION, "lockfree_stress", NULL);
+  stats_register_counter(0, &sc_key, SC_TYPE_QUEUED, &q->queued_messages);
+  stats_register_counter(1, &sc_key, SC_TYPE_MEMORY_USAGE, &q->memory_usage);
+  stats_unlock();
+
+  fed_messages = 0;
+  acked_messages = 0;
+
+  consumer = g_thread_create(_stress_consume, q, TRUE, NULL);
+  for (i = 0; i < STRESS_FEEDERS; i++)
+    {
+      args[i].q = q;
+      args[i].feeder_id = i;
+      feeders[i] = g_thread_create(_stress_feed, &args[i], TRUE, NULL);
+    }
+
+  for (i = 0; i < STRESS_FEEDERS; i++)
+    g_thread_join(feeders[i]);
+  consumer_result = g_thread_join(consumer);
+
+  cr_assert_null(consumer_result, "consumer failed: messages lost or reordered");
+  cr_assert_eq(acked_messages, STRESS_FEEDERS * STRESS_MESSAGES_PER_FEEDER,
+               "not all messages were acknowledged: acked_messages=%d", acked_messages);
+  cr_assert_eq(log_queue_get_length(q), 0);
+  cr_assert_eq(stats_counter_get(q->queued_messages), 0);
+  cr_assert_eq(stats_counter_get(q->memory_usage), 0);
+
+  stats_lock();
+  stats_unregister_counter(&sc_key, SC_TYPE_QUEUED, &q->queued_messages);
+  stats_unregister_counter(&sc_key, SC_TYPE_MEMORY_USAGE, &q->memory_usage);
+  stats_unlock();
+  log_queue_unref(q);
+}